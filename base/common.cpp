@@ -1,5 +1,12 @@
 #include "common.hpp"
 
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 
 
 const vec3 Vectors::UNIT_X{ 1.0f, 0.0f, 0.0f };
@@ -23,4 +30,71 @@ const vec3& Vectors::UP = Vectors::UNIT_Y;
 const vec3& Vectors::FRONT = Vectors::UNIT_Z;
 
 const quat Rotations::IDENTITY{ 1.0f, 0.0f, 0.0f, 0.0f };
-const quat Rotations::Y_180{ 0.0f, 0.0f, 1.0f, 0.0f };
\ No newline at end of file
+const quat Rotations::Y_180{ 0.0f, 0.0f, 1.0f, 0.0f };
+
+namespace vkx {
+    static std::vector<std::string>& commandLine() {
+        static std::vector<std::string> arguments;
+        return arguments;
+    }
+
+    void setCommandLine(int argc, const char* argv[]) {
+        commandLine().assign(argv, argv + argc);
+    }
+
+    bool hasCommandLineFlag(const std::string& flag) {
+        const auto& arguments = commandLine();
+        return std::find(arguments.begin(), arguments.end(), flag) != arguments.end();
+    }
+
+    bool statsEnabled() {
+        return hasCommandLineFlag("-stats");
+    }
+
+    std::string getCommandLineOption(const std::string& option, const std::string& defaultValue) {
+        const auto& arguments = commandLine();
+        auto itr = std::find(arguments.begin(), arguments.end(), option);
+        if (itr == arguments.end() || ++itr == arguments.end()) {
+            return defaultValue;
+        }
+        return *itr;
+    }
+
+    std::string getExecutableName() {
+        const auto& arguments = commandLine();
+        if (arguments.empty()) {
+            return "vulkanExample";
+        }
+        std::string result = arguments[0];
+        std::replace(result.begin(), result.end(), '\\', '/');
+        std::string::size_type lastSlash = result.rfind('/');
+        if (lastSlash != std::string::npos) {
+            result = result.substr(lastSlash + 1);
+        }
+        std::string::size_type extension = result.rfind('.');
+        if (extension != std::string::npos && extension > 0) {
+            result = result.substr(0, extension);
+        }
+        return result;
+    }
+
+    double getPeakMemoryMB() {
+#if defined(_WIN32)
+        PROCESS_MEMORY_COUNTERS counters;
+        if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+            return 0.0;
+        }
+        return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+#else
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage)) {
+            return 0.0;
+        }
+#if defined(__APPLE__)
+        return usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        return usage.ru_maxrss / 1024.0;
+#endif
+#endif
+    }
+}
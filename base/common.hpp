@@ -10,6 +10,7 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <fstream>
 #include <functional>
@@ -108,6 +109,21 @@ public:
 #include "glfw.hpp"
 #endif
 
+namespace vkx {
+    // Command line of the example, recorded by the entry point
+    void setCommandLine(int argc, const char* argv[]);
+    // True if the flag (e.g. "-validation") was passed on the command line
+    bool hasCommandLineFlag(const std::string& flag);
+    // True if run with -stats, which prints what the caches, queues and allocators did at exit and per mesh load
+    bool statsEnabled();
+    // Argument following option (e.g. "-frames 300"), defaultValue if the option wasn't passed
+    std::string getCommandLineOption(const std::string& option, const std::string& defaultValue = "");
+    // File name of the executable without directory or extension
+    std::string getExecutableName();
+    // Peak resident memory of the process in MB, 0 if the platform can't tell
+    double getPeakMemoryMB();
+}
+
 // Boilerplate for running an example
 #if defined(__ANDROID__)
 #define ENTRY_POINT_START \
@@ -118,7 +134,8 @@ public:
         }
 #else
 #define ENTRY_POINT_START \
-        int main(const int argc, const char *argv[]) {
+        int main(const int argc, const char *argv[]) { \
+            vkx::setCommandLine(argc, argv);
 
 #define ENTRY_POINT_END \
             return 0; \
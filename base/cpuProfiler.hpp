@@ -0,0 +1,256 @@
+/*
+* CPU profiler for frame phases
+*
+* Scoped zones record their begin and end time in nanoseconds into a ring buffer owned by the
+* recording thread.  Recording is a couple of clock reads and a store, without locks, so zones can
+* stay in release builds.  Defining VKX_CPU_PROFILER to 0 compiles the zone macros out entirely.
+* The rings can be dumped at any time in the Chrome trace event format.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+
+#include "json.hpp"
+
+#ifndef VKX_CPU_PROFILER
+#define VKX_CPU_PROFILER 1
+#endif
+
+#define VKX_CPU_ZONE_CONCAT_INNER(a, b) a##b
+#define VKX_CPU_ZONE_CONCAT(a, b) VKX_CPU_ZONE_CONCAT_INNER(a, b)
+
+#if VKX_CPU_PROFILER
+// Records the rest of the enclosing scope, name must be a string literal
+#define VKX_CPU_ZONE(name) vkx::CpuProfiler::Zone VKX_CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
+#define VKX_CPU_THREAD_NAME(name) vkx::CpuProfiler::setThreadName(name)
+#else
+#define VKX_CPU_ZONE(name)
+#define VKX_CPU_THREAD_NAME(name)
+#endif
+
+namespace vkx {
+
+    class CpuProfiler {
+    public:
+        // Zones kept per thread, older zones are overwritten
+        static const size_t RingCapacity = 1 << 15;
+
+        class Zone {
+        public:
+            explicit Zone(const char* name) : name(name), begin(now()) {}
+
+            ~Zone() {
+                record(name, begin, now());
+            }
+
+        private:
+            const char* name;
+            uint64_t begin;
+        };
+
+        // Nanoseconds since the profiler was first used
+        static uint64_t now() {
+            auto elapsed = std::chrono::steady_clock::now() - registry().epoch;
+            return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+
+        static void record(const char* name, uint64_t begin, uint64_t end) {
+            ThreadRing& ring = getThreadRing();
+            uint64_t head = ring.head.load(std::memory_order_relaxed);
+            Slot& slot = ring.slots[head & (RingCapacity - 1)];
+            // Odd while the slot is being written, readers skip it or discard what they copied
+            slot.sequence.store(head * 2 + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            slot.name.store(name, std::memory_order_relaxed);
+            slot.begin.store(begin, std::memory_order_relaxed);
+            slot.end.store(end, std::memory_order_relaxed);
+            slot.sequence.store(head * 2 + 2, std::memory_order_release);
+            ring.head.store(head + 1, std::memory_order_release);
+        }
+
+        static void setThreadName(const std::string& name) {
+            ThreadRing& ring = getThreadRing();
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            ring.name = name;
+        }
+
+        // Writes the zones still held by the rings of all threads, returns the number of zones written
+        // or -1 if the file couldn't be written
+        static int64_t writeChromeTrace(const std::string& filename) {
+            nlohmann::json events = nlohmann::json::array();
+            Registry& reg = registry();
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            for (const auto& ring : reg.rings) {
+                nlohmann::json metadata;
+                metadata["name"] = "thread_name";
+                metadata["ph"] = "M";
+                metadata["pid"] = 0;
+                metadata["tid"] = ring->id;
+                metadata["args"]["name"] = ring->name.empty() ? "Thread " + std::to_string(ring->id) : ring->name;
+                events.push_back(metadata);
+
+                std::vector<Event> snapshot;
+                readRing(*ring, snapshot);
+                for (const auto& zone : snapshot) {
+                    nlohmann::json event;
+                    event["name"] = zone.name;
+                    event["cat"] = "cpu";
+                    event["ph"] = "X";
+                    event["ts"] = (double)zone.begin / 1000.0;
+                    event["dur"] = (double)(zone.end - zone.begin) / 1000.0;
+                    event["pid"] = 0;
+                    event["tid"] = ring->id;
+                    events.push_back(event);
+                }
+            }
+            nlohmann::json trace;
+            trace["traceEvents"] = events;
+            trace["displayTimeUnit"] = "ms";
+            std::ofstream file(filename);
+            if (!file) {
+                return -1;
+            }
+            file << trace.dump();
+            if (!file) {
+                return -1;
+            }
+            return (int64_t)events.size() - (int64_t)reg.rings.size();
+        }
+
+    private:
+        struct Event {
+            const char* name{ nullptr };
+            uint64_t begin{ 0 };
+            uint64_t end{ 0 };
+        };
+
+        // Each slot is a seqlock, the sequence is 2 * (index + 1) once the zone with that index is complete
+        struct Slot {
+            std::atomic<uint64_t> sequence{ 0 };
+            std::atomic<const char*> name{ nullptr };
+            std::atomic<uint64_t> begin{ 0 };
+            std::atomic<uint64_t> end{ 0 };
+        };
+
+        // Written only by the owning thread, read by whichever thread writes a trace
+        struct ThreadRing {
+            std::atomic<uint64_t> head{ 0 };
+            std::unique_ptr<Slot[]> slots{ new Slot[RingCapacity] };
+            uint32_t id{ 0 };
+            std::string name;
+        };
+
+        struct Registry {
+            std::chrono::steady_clock::time_point epoch{ std::chrono::steady_clock::now() };
+            std::mutex mutex;
+            // Rings outlive their threads so zones of finished workers still show up in the trace
+            std::vector<std::shared_ptr<ThreadRing>> rings;
+        };
+
+        static Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        static ThreadRing& getThreadRing() {
+            static thread_local std::shared_ptr<ThreadRing> ring;
+            if (!ring) {
+                auto newRing = std::make_shared<ThreadRing>();
+                Registry& reg = registry();
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                newRing->id = (uint32_t)reg.rings.size();
+                reg.rings.push_back(newRing);
+                ring = newRing;
+            }
+            return *ring;
+        }
+
+        // Copies the ring while its thread may keep recording, zones overwritten during the copy are dropped
+        static void readRing(const ThreadRing& ring, std::vector<Event>& result) {
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            uint64_t first = head > RingCapacity ? head - RingCapacity : 0;
+            result.clear();
+            result.reserve((size_t)(head - first));
+            for (uint64_t i = first; i < head; ++i) {
+                const Slot& slot = ring.slots[i & (RingCapacity - 1)];
+                uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence != i * 2 + 2) {
+                    continue;
+                }
+                Event event;
+                event.name = slot.name.load(std::memory_order_relaxed);
+                event.begin = slot.begin.load(std::memory_order_relaxed);
+                event.end = slot.end.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                    result.push_back(event);
+                }
+            }
+        }
+    };
+
+    // Frame times in 0.1 ms buckets up to 100 ms, so percentiles cost no allocation or sorting
+    class FrameTimeHistogram {
+    public:
+        static const uint32_t BucketCount = 1000;
+        static constexpr float BucketWidth = 0.1f;
+
+        void add(float milliseconds) {
+            uint32_t bucket = std::min((uint32_t)std::max(milliseconds / BucketWidth, 0.0f), BucketCount - 1);
+            ++buckets[bucket];
+            ++count;
+            total += milliseconds;
+            maxTime = std::max(maxTime, milliseconds);
+        }
+
+        // Upper edge of the bucket containing the percentile, p in [0, 1]
+        float percentile(float p) const {
+            if (!count) {
+                return 0.0f;
+            }
+            uint64_t target = std::max<uint64_t>((uint64_t)ceil(p * count), 1);
+            uint64_t accumulated = 0;
+            for (uint32_t i = 0; i < BucketCount; ++i) {
+                accumulated += buckets[i];
+                if (accumulated >= target) {
+                    return std::min((i + 1) * BucketWidth, maxTime);
+                }
+            }
+            return maxTime;
+        }
+
+        uint64_t getCount() const {
+            return count;
+        }
+
+        float getMean() const {
+            return count ? (float)(total / count) : 0.0f;
+        }
+
+        float getMax() const {
+            return maxTime;
+        }
+
+        void reset() {
+            *this = FrameTimeHistogram();
+        }
+
+    private:
+        std::vector<uint32_t> buckets = std::vector<uint32_t>(BucketCount, 0);
+        uint64_t count{ 0 };
+        double total{ 0.0 };
+        float maxTime{ 0.0f };
+    };
+}
@@ -0,0 +1,436 @@
+/*
+* Work stealing job system
+*
+* Every worker owns a lock-free Chase-Lev deque.  Jobs pushed by a worker go to the bottom of its
+* own deque, idle workers steal from the top of the others.  Job closures are stored in place in
+* pooled job slots, so scheduling does not allocate.  Completion is tracked with counters that can
+* be waited on (the waiting thread executes jobs in the meantime) or used as job dependencies.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <assert.h>
+#include <stdint.h>
+
+#include "cpuProfiler.hpp"
+
+namespace vkx {
+
+    // Number of jobs scheduled against the counter that have not finished yet
+    class JobCounter {
+    public:
+        bool isDone() const {
+            return 0 == pending.load();
+        }
+
+    private:
+        friend class JobSystem;
+        std::atomic<uint32_t> pending{ 0 };
+    };
+
+    // Chase-Lev work stealing deque of fixed capacity (Le et al., "Correct and Efficient
+    // Work-Stealing for Weak Memory Models").  push and pop may only be called by the owning thread,
+    // steal by any thread.
+    template <typename T, size_t Capacity>
+    class WorkStealingDeque {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    public:
+        WorkStealingDeque() {
+            for (auto& item : items) {
+                item.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        bool push(T* item) {
+            int64_t b = bottom.load(std::memory_order_relaxed);
+            int64_t t = top.load(std::memory_order_acquire);
+            if (b - t >= (int64_t)Capacity) {
+                return false;
+            }
+            items[b & (Capacity - 1)].store(item, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        T* pop() {
+            int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(b, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t t = top.load(std::memory_order_relaxed);
+            if (t > b) {
+                // Empty
+                bottom.store(b + 1, std::memory_order_relaxed);
+                return nullptr;
+            }
+            T* item = items[b & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (t == b) {
+                // Last item, race against thieves for it
+                if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom.store(b + 1, std::memory_order_relaxed);
+            }
+            return item;
+        }
+
+        T* steal() {
+            int64_t t = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            int64_t b = bottom.load(std::memory_order_acquire);
+            if (t >= b) {
+                return nullptr;
+            }
+            T* item = items[t & (Capacity - 1)].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return item;
+        }
+
+    private:
+        alignas(64) std::atomic<int64_t> top{ 0 };
+        alignas(64) std::atomic<int64_t> bottom{ 0 };
+        std::array<std::atomic<T*>, Capacity> items;
+    };
+
+    class JobSystem {
+    public:
+        // Maximum size of a job closure, larger state should be captured by reference
+        static const size_t JobStorageSize = 128;
+
+        struct Stats {
+            uint64_t jobsExecuted{ 0 };
+            uint64_t jobsStolen{ 0 };
+        };
+
+        // workerCount includes the thread constructing the job system, which executes jobs while it waits
+        explicit JobSystem(uint32_t workerCount = std::thread::hardware_concurrency()) {
+            workerCount = std::max(workerCount, 1u);
+            for (uint32_t i = 0; i < workerCount; ++i) {
+                workers.push_back(std::make_unique<Worker>());
+            }
+            previousState = threadState();
+            threadState() = { this, 0 };
+            for (uint32_t i = 1; i < workerCount; ++i) {
+                workers[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+            }
+        }
+
+        ~JobSystem() {
+            {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                stopping = true;
+            }
+            wakeCondition.notify_all();
+            for (auto& worker : workers) {
+                if (worker->thread.joinable()) {
+                    worker->thread.join();
+                }
+            }
+            if (threadState().system == this) {
+                threadState() = previousState;
+            }
+        }
+
+        JobSystem(const JobSystem&) = delete;
+        JobSystem& operator=(const JobSystem&) = delete;
+
+        uint32_t getWorkerCount() const {
+            return (uint32_t)workers.size();
+        }
+
+        // Index of the worker executing the calling job, in the range [0, getWorkerCount()).
+        // Useful for indexing per-worker resources such as command pools.
+        uint32_t getWorkerIndex() const {
+            const auto& state = threadState();
+            assert(state.system == this);
+            return state.index;
+        }
+
+        // Schedule f to run on any worker.  If dependency is given the job is held back until the
+        // dependency counter reaches zero.
+        template <typename F>
+        void run(F&& f, JobCounter& counter, const JobCounter* dependency = nullptr) {
+            using Closure = typename std::decay<F>::type;
+            static_assert(sizeof(Closure) <= JobStorageSize, "Job closure too large, capture by reference");
+            static_assert(alignof(Closure) <= alignof(std::max_align_t), "Job closure over-aligned");
+
+            counter.pending.fetch_add(1);
+            Job* job = allocateJob();
+            new (&job->storage) Closure(std::forward<F>(f));
+            job->invoke = [](void* storage) {
+                Closure* closure = reinterpret_cast<Closure*>(storage);
+                (*closure)();
+                closure->~Closure();
+            };
+            job->counter = &counter;
+
+            if (dependency && !dependency->isDone()) {
+                {
+                    std::lock_guard<std::mutex> lock(deferredMutex);
+                    job->dependency = dependency;
+                    deferred.push_back(job);
+                    deferredCount.fetch_add(1);
+                }
+                // The dependency may have completed before the job became visible in the deferred list
+                if (dependency->isDone()) {
+                    releaseDeferred();
+                }
+                return;
+            }
+            enqueue(job);
+        }
+
+        // Block until all jobs scheduled against the counter have finished, executing jobs meanwhile
+        void wait(const JobCounter& counter) {
+            const auto& state = threadState();
+            while (!counter.isDone()) {
+                if (state.system != this || !executeOne(state.index)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // Call f(rangeBegin, rangeEnd) over [begin, end) split into chunks of grainSize and wait for all of them
+        template <typename F>
+        void parallelFor(uint32_t begin, uint32_t end, uint32_t grainSize, const F& f) {
+            grainSize = std::max(grainSize, 1u);
+            JobCounter counter;
+            for (uint32_t start = begin; start < end; start += grainSize) {
+                uint32_t stop = start + std::min(grainSize, end - start);
+                const F* fn = &f;
+                run([fn, start, stop] { (*fn)(start, stop); }, counter);
+            }
+            wait(counter);
+        }
+
+        Stats getStats() const {
+            Stats result;
+            for (const auto& worker : workers) {
+                result.jobsExecuted += worker->jobsExecuted.load(std::memory_order_relaxed);
+                result.jobsStolen += worker->jobsStolen.load(std::memory_order_relaxed);
+            }
+            return result;
+        }
+
+    private:
+        static const size_t DequeCapacity = 4096;
+        static const size_t JobPoolSize = 4096;
+
+        struct Job {
+            typename std::aligned_storage<JobStorageSize, alignof(std::max_align_t)>::type storage;
+            void(*invoke)(void*) { nullptr };
+            JobCounter* counter{ nullptr };
+            const JobCounter* dependency{ nullptr };
+            std::atomic<bool> inUse{ false };
+        };
+
+        struct Worker {
+            WorkStealingDeque<Job, DequeCapacity> deque;
+            // Job slots are allocated round robin by the owning thread and released by whichever
+            // worker executed the job
+            std::unique_ptr<Job[]> jobs{ new Job[JobPoolSize] };
+            uint32_t nextJob{ 0 };
+            std::thread thread;
+            std::atomic<uint64_t> jobsExecuted{ 0 };
+            std::atomic<uint64_t> jobsStolen{ 0 };
+        };
+
+        struct ThreadState {
+            JobSystem* system{ nullptr };
+            uint32_t index{ 0 };
+        };
+
+        static ThreadState& threadState() {
+            static thread_local ThreadState state;
+            return state;
+        }
+
+        Job* allocateJob() {
+            const auto& state = threadState();
+            if (state.system != this) {
+                // Threads outside the job system share a pool guarded by the injection mutex
+                std::unique_lock<std::mutex> lock(injectionMutex);
+                while (true) {
+                    Job& job = externalJobs[externalNextJob++ % JobPoolSize];
+                    if (!job.inUse.load(std::memory_order_acquire)) {
+                        job.inUse.store(true, std::memory_order_relaxed);
+                        job.dependency = nullptr;
+                        return &job;
+                    }
+                    lock.unlock();
+                    std::this_thread::yield();
+                    lock.lock();
+                }
+            }
+
+            Worker& worker = *workers[state.index];
+            while (true) {
+                Job& job = worker.jobs[worker.nextJob++ % JobPoolSize];
+                if (!job.inUse.load(std::memory_order_acquire)) {
+                    job.inUse.store(true, std::memory_order_relaxed);
+                    job.dependency = nullptr;
+                    return &job;
+                }
+                // The slot still holds a pending job, make progress instead of overwriting it
+                if (!executeOne(state.index)) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void enqueue(Job* job) {
+            const auto& state = threadState();
+            // Count the job before publishing it, so a thief never decrements below zero
+            queuedJobs.fetch_add(1);
+            if (state.system == this) {
+                if (!workers[state.index]->deque.push(job)) {
+                    // Deque is full, run the job right away
+                    queuedJobs.fetch_sub(1);
+                    execute(job, state.index);
+                    return;
+                }
+            } else {
+                std::lock_guard<std::mutex> lock(injectionMutex);
+                injected.push_back(job);
+            }
+            if (sleepingWorkers.load()) {
+                std::lock_guard<std::mutex> lock(sleepMutex);
+                wakeCondition.notify_one();
+            }
+        }
+
+        // Move jobs whose dependency has completed from the deferred list to the injection queue
+        void releaseDeferred() {
+            std::vector<Job*> ready;
+            {
+                std::lock_guard<std::mutex> lock(deferredMutex);
+                auto itr = std::stable_partition(deferred.begin(), deferred.end(), [](Job* job) {
+                    return !job->dependency->isDone();
+                });
+                ready.assign(itr, deferred.end());
+                deferred.erase(itr, deferred.end());
+                deferredCount.fetch_sub((uint32_t)ready.size());
+            }
+            if (ready.empty()) {
+                return;
+            }
+            queuedJobs.fetch_add((uint32_t)ready.size());
+            {
+                std::lock_guard<std::mutex> lock(injectionMutex);
+                for (Job* job : ready) {
+                    job->dependency = nullptr;
+                    injected.push_back(job);
+                }
+            }
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wakeCondition.notify_all();
+        }
+
+        Job* takeJob(uint32_t index) {
+            Worker& worker = *workers[index];
+            Job* job = worker.deque.pop();
+            if (!job && queuedJobs.load(std::memory_order_relaxed)) {
+                {
+                    std::lock_guard<std::mutex> lock(injectionMutex);
+                    if (!injected.empty()) {
+                        job = injected.front();
+                        injected.pop_front();
+                    }
+                }
+                const uint32_t workerCount = (uint32_t)workers.size();
+                for (uint32_t i = 1; !job && i < workerCount; ++i) {
+                    job = workers[(index + i) % workerCount]->deque.steal();
+                    if (job) {
+                        worker.jobsStolen.fetch_add(1, std::memory_order_relaxed);
+                    }
+                }
+            }
+            if (job) {
+                queuedJobs.fetch_sub(1);
+            }
+            return job;
+        }
+
+        void execute(Job* job, uint32_t index) {
+            JobCounter* counter = job->counter;
+            {
+                VKX_CPU_ZONE("Job");
+                job->invoke(&job->storage);
+            }
+            job->inUse.store(false, std::memory_order_release);
+            workers[index]->jobsExecuted.fetch_add(1, std::memory_order_relaxed);
+            if (1 == counter->pending.fetch_sub(1) && deferredCount.load()) {
+                releaseDeferred();
+            }
+        }
+
+        bool executeOne(uint32_t index) {
+            Job* job = takeJob(index);
+            if (!job) {
+                return false;
+            }
+            execute(job, index);
+            return true;
+        }
+
+        void workerLoop(uint32_t index) {
+            threadState() = { this, index };
+            VKX_CPU_THREAD_NAME("Worker " + std::to_string(index));
+            uint32_t idleSpins = 0;
+            while (!stopping.load()) {
+                if (executeOne(index)) {
+                    idleSpins = 0;
+                    continue;
+                }
+                if (++idleSpins < 64) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                sleepingWorkers.fetch_add(1);
+                {
+                    std::unique_lock<std::mutex> lock(sleepMutex);
+                    wakeCondition.wait(lock, [this] { return queuedJobs.load() > 0 || stopping.load(); });
+                }
+                sleepingWorkers.fetch_sub(1);
+                idleSpins = 0;
+            }
+        }
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        ThreadState previousState;
+
+        // Jobs scheduled from threads outside the job system, or released by a dependency
+        std::mutex injectionMutex;
+        std::deque<Job*> injected;
+        std::unique_ptr<Job[]> externalJobs{ new Job[JobPoolSize] };
+        uint32_t externalNextJob{ 0 };
+
+        std::mutex deferredMutex;
+        std::vector<Job*> deferred;
+        std::atomic<uint32_t> deferredCount{ 0 };
+
+        // Approximate number of jobs waiting in deques or the injection queue, used to put idle workers to sleep
+        std::atomic<uint32_t> queuedJobs{ 0 };
+        std::atomic<uint32_t> sleepingWorkers{ 0 };
+        std::atomic<bool> stopping{ false };
+        std::mutex sleepMutex;
+        std::condition_variable wakeCondition;
+    };
+}
@@ -0,0 +1,128 @@
+/*
+* Helpers shared by the on-disk caches (meshes, shaders)
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace vkx {
+
+    // Read only memory mapping of a whole file
+    class MappedFile {
+    public:
+        MappedFile() {}
+
+        explicit MappedFile(const std::string& filename) {
+            open(filename);
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        ~MappedFile() {
+            close();
+        }
+
+        bool open(const std::string& filename) {
+            close();
+#if defined(_WIN32)
+            file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+            if (file == INVALID_HANDLE_VALUE) {
+                return false;
+            }
+            LARGE_INTEGER fileSize;
+            if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+                close();
+                return false;
+            }
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping) {
+                close();
+                return false;
+            }
+            data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            size = (size_t)fileSize.QuadPart;
+#elif !defined(__ANDROID__)
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat fileStat;
+            if (fstat(fd, &fileStat) == 0 && fileStat.st_size > 0) {
+                void* mapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped != MAP_FAILED) {
+                    data = (const uint8_t*)mapped;
+                    size = (size_t)fileStat.st_size;
+                }
+            }
+            // The mapping stays valid after the descriptor is closed
+            ::close(fd);
+#endif
+            if (!data) {
+                close();
+                return false;
+            }
+            return true;
+        }
+
+        void close() {
+#if defined(_WIN32)
+            if (data) {
+                UnmapViewOfFile(data);
+            }
+            if (mapping) {
+                CloseHandle(mapping);
+                mapping = nullptr;
+            }
+            if (file != INVALID_HANDLE_VALUE) {
+                CloseHandle(file);
+                file = INVALID_HANDLE_VALUE;
+            }
+#elif !defined(__ANDROID__)
+            if (data) {
+                munmap((void*)data, size);
+            }
+#endif
+            data = nullptr;
+            size = 0;
+        }
+
+        const uint8_t* data{ nullptr };
+        size_t size{ 0 };
+
+    private:
+#if defined(_WIN32)
+        HANDLE file{ INVALID_HANDLE_VALUE };
+        HANDLE mapping{ nullptr };
+#endif
+    };
+
+    // 64 bit FNV-1a, used to key cache entries by content
+    inline uint64_t hashBytes(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    // Hash of the contents of a file.  Missing and empty files hash like empty contents.
+    inline uint64_t hashFile(const std::string& filename) {
+        MappedFile file(filename);
+        return hashBytes(file.data, file.size);
+    }
+}
@@ -0,0 +1,78 @@
+/*
+* Bounded lock-free multiple producer, single consumer queue
+*
+* Based on Dmitry Vyukov's bounded MPMC queue: every cell carries a sequence number telling
+* producers and the consumer whether it is free or filled for their position, so pushing is a
+* single compare and swap on the enqueue position.  The consumer side is reduced to a plain
+* counter since only one thread pops.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace vkx {
+
+    template <typename T, size_t Capacity>
+    class MpscQueue {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    public:
+        MpscQueue() {
+            for (size_t i = 0; i < Capacity; ++i) {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        MpscQueue(const MpscQueue&) = delete;
+        MpscQueue& operator=(const MpscQueue&) = delete;
+
+        // Any thread, returns false if the queue is full
+        bool push(const T& value) {
+            size_t position = enqueuePosition.load(std::memory_order_relaxed);
+            while (true) {
+                Cell& cell = cells[position & (Capacity - 1)];
+                size_t sequence = cell.sequence.load(std::memory_order_acquire);
+                intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+                if (difference == 0) {
+                    if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        cell.value = value;
+                        cell.sequence.store(position + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (difference < 0) {
+                    return false;
+                } else {
+                    position = enqueuePosition.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        // Consumer thread only, returns false if the queue is empty or the next value is still being written
+        bool pop(T& value) {
+            Cell& cell = cells[dequeuePosition & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            if (sequence != dequeuePosition + 1) {
+                return false;
+            }
+            value = cell.value;
+            cell.sequence.store(dequeuePosition + Capacity, std::memory_order_release);
+            ++dequeuePosition;
+            return true;
+        }
+
+    private:
+        struct Cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        std::unique_ptr<Cell[]> cells{ new Cell[Capacity] };
+        alignas(64) std::atomic<size_t> enqueuePosition{ 0 };
+        alignas(64) size_t dequeuePosition{ 0 };
+    };
+}
@@ -0,0 +1,439 @@
+/*
+* Sub-allocating device memory allocator
+*
+* Resources created through the Context are placed into large blocks of device memory
+* (one set of blocks per memory type) instead of receiving a VkDeviceMemory of their own.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <iterator>
+#include <map>
+#include <memory>
+#include <ostream>
+
+#include "common.hpp"
+
+namespace vkx {
+
+    // Rounds value up to the next multiple of alignment
+    inline vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+        if (alignment <= 1) {
+            return value;
+        }
+        return ((value + alignment - 1) / alignment) * alignment;
+    }
+
+    // CPU side bookkeeping of the free ranges inside a single block of memory.
+    //
+    // Free ranges are indexed by offset (to coalesce neighbours on release) and by size
+    // (for best fit searches on allocation).  No Vulkan calls are made here, so the
+    // free list logic can be exercised without a device.
+    class RangeAllocator {
+    public:
+        RangeAllocator(vk::DeviceSize size = 0) : size(size) {
+            if (size) {
+                insertFree(0, size);
+            }
+        }
+
+        // Reserve a range of the requested size and alignment.  Returns false if no free range is large enough
+        bool allocate(vk::DeviceSize requestSize, vk::DeviceSize alignment, vk::DeviceSize& outOffset) {
+            if (requestSize == 0) {
+                return false;
+            }
+            for (auto itr = freeBySize.lower_bound(requestSize); itr != freeBySize.end(); ++itr) {
+                const vk::DeviceSize freeSize = itr->first;
+                const vk::DeviceSize freeOffset = itr->second;
+                const vk::DeviceSize alignedOffset = alignUp(freeOffset, alignment);
+                const vk::DeviceSize padding = alignedOffset - freeOffset;
+                if (padding + requestSize > freeSize) {
+                    continue;
+                }
+
+                freeBySize.erase(itr);
+                freeByOffset.erase(freeOffset);
+                // Alignment padding in front of the allocation stays available for smaller requests
+                if (padding) {
+                    insertFree(freeOffset, padding);
+                }
+                const vk::DeviceSize tail = freeSize - padding - requestSize;
+                if (tail) {
+                    insertFree(alignedOffset + requestSize, tail);
+                }
+                used += requestSize;
+                outOffset = alignedOffset;
+                return true;
+            }
+            return false;
+        }
+
+        // Return a previously allocated range, merging it with any adjacent free ranges
+        void free(vk::DeviceSize offset, vk::DeviceSize rangeSize) {
+            assert(rangeSize <= used);
+            assert(offset + rangeSize <= size);
+            used -= rangeSize;
+
+            auto next = freeByOffset.lower_bound(offset);
+            assert(next == freeByOffset.end() || next->first >= offset + rangeSize);
+            if (next != freeByOffset.end() && next->first == offset + rangeSize) {
+                rangeSize += next->second;
+                eraseFree(next->first, next->second);
+                next = freeByOffset.lower_bound(offset);
+            }
+
+            if (next != freeByOffset.begin()) {
+                auto prev = std::prev(next);
+                assert(prev->first + prev->second <= offset);
+                if (prev->first + prev->second == offset) {
+                    offset = prev->first;
+                    rangeSize += prev->second;
+                    eraseFree(prev->first, prev->second);
+                }
+            }
+            insertFree(offset, rangeSize);
+        }
+
+        vk::DeviceSize getSize() const { return size; }
+        vk::DeviceSize getUsed() const { return used; }
+        vk::DeviceSize getFree() const { return size - used; }
+        size_t getFreeRangeCount() const { return freeByOffset.size(); }
+        bool empty() const { return used == 0; }
+
+        vk::DeviceSize getLargestFreeRange() const {
+            return freeBySize.empty() ? 0 : freeBySize.rbegin()->first;
+        }
+
+    private:
+        void insertFree(vk::DeviceSize offset, vk::DeviceSize rangeSize) {
+            freeByOffset[offset] = rangeSize;
+            freeBySize.insert({ rangeSize, offset });
+        }
+
+        void eraseFree(vk::DeviceSize offset, vk::DeviceSize rangeSize) {
+            freeByOffset.erase(offset);
+            auto range = freeBySize.equal_range(rangeSize);
+            for (auto itr = range.first; itr != range.second; ++itr) {
+                if (itr->second == offset) {
+                    freeBySize.erase(itr);
+                    break;
+                }
+            }
+        }
+
+        vk::DeviceSize size{ 0 };
+        vk::DeviceSize used{ 0 };
+        // offset -> size
+        std::map<vk::DeviceSize, vk::DeviceSize> freeByOffset;
+        // size -> offset
+        std::multimap<vk::DeviceSize, vk::DeviceSize> freeBySize;
+    };
+
+    // A single VkDeviceMemory object owned by the allocator
+    struct MemoryBlock {
+        vk::DeviceMemory memory;
+        uint32_t memoryTypeIndex{ 0 };
+        uint32_t poolIndex{ 0 };
+        // Dedicated blocks hold exactly one (large) resource and are released with it
+        bool dedicated{ false };
+        // Host visible blocks are mapped once on first use and stay mapped until the block is released
+        void* mapped{ nullptr };
+        // Host writes to blocks without HOST_COHERENT have to be flushed, device writes invalidated
+        bool coherent{ true };
+        uint32_t allocationCount{ 0 };
+        RangeAllocator ranges;
+    };
+
+    class MemoryAllocator;
+
+    // Handle to a range of a memory block.  Owned by the CreateBufferResult / CreateImageResult
+    // that the memory is bound to, and returned to the allocator by their destroy() calls or through the
+    // deletion queue when the result is trashed.
+    struct MemoryAllocation {
+        MemoryAllocator* allocator{ nullptr };
+        MemoryBlock* block{ nullptr };
+        vk::DeviceMemory memory;
+        vk::DeviceSize offset{ 0 };
+        vk::DeviceSize size{ 0 };
+
+        operator bool() const { return allocator != nullptr; }
+
+        // Host pointer to the start of the allocation (plus the given offset)
+        inline void* map(vk::DeviceSize mapOffset = 0) const;
+        // Make host writes to [offset, offset + size) of the allocation visible to the device.  No-op for coherent memory.
+        inline void flush(vk::DeviceSize rangeOffset = 0, vk::DeviceSize rangeSize = VK_WHOLE_SIZE) const;
+        // Make device writes to [offset, offset + size) of the allocation visible to the host.  No-op for coherent memory.
+        inline void invalidate(vk::DeviceSize rangeOffset = 0, vk::DeviceSize rangeSize = VK_WHOLE_SIZE) const;
+        inline void free();
+    };
+
+    struct MemoryStats {
+        // Number of live VkDeviceMemory objects, compare against maxMemoryAllocationCount
+        uint32_t blockCount{ 0 };
+        uint32_t dedicatedBlockCount{ 0 };
+        uint32_t allocationCount{ 0 };
+        uint32_t freeRangeCount{ 0 };
+        vk::DeviceSize bytesReserved{ 0 };
+        vk::DeviceSize bytesUsed{ 0 };
+        // Sum over all blocks of the largest free range in the block
+        vk::DeviceSize bytesLargestFree{ 0 };
+
+        vk::DeviceSize bytesFree() const { return bytesReserved - bytesUsed; }
+
+        // Fraction of the free memory that can't be handed out as part of a single range
+        // 0 means every block has one contiguous free range, values close to 1 mean the free
+        // memory is scattered in small holes
+        float fragmentation() const {
+            auto free = bytesFree();
+            return free ? 1.0f - (float)((double)bytesLargestFree / (double)free) : 0.0f;
+        }
+
+        MemoryStats& operator+=(const MemoryStats& other) {
+            blockCount += other.blockCount;
+            dedicatedBlockCount += other.dedicatedBlockCount;
+            allocationCount += other.allocationCount;
+            freeRangeCount += other.freeRangeCount;
+            bytesReserved += other.bytesReserved;
+            bytesUsed += other.bytesUsed;
+            bytesLargestFree += other.bytesLargestFree;
+            return *this;
+        }
+    };
+
+    // Block based allocator with one pool of blocks per memory type.
+    //
+    // Linear (buffers, linear images) and optimal (optimally tiled images) resources are kept in separate
+    // pools when the device reports a bufferImageGranularity larger than 1, so neighbouring allocations in
+    // a block never violate the granularity requirement.
+    class MemoryAllocator {
+    public:
+        enum class ResourceType { Linear, Optimal };
+
+        // Size of newly created blocks.  Requests larger than half a block get a dedicated allocation.
+        vk::DeviceSize blockSize{ 64 * 1024 * 1024 };
+
+        MemoryAllocator(const vk::Device& device, const vk::PhysicalDeviceMemoryProperties& memoryProperties, vk::DeviceSize bufferImageGranularity, vk::DeviceSize nonCoherentAtomSize = 1)
+            : device(device), memoryProperties(memoryProperties), separateOptimal(bufferImageGranularity > 1), nonCoherentAtomSize(std::max<vk::DeviceSize>(nonCoherentAtomSize, 1)) {
+            pools.resize(memoryProperties.memoryTypeCount * 2);
+        }
+
+        ~MemoryAllocator() {
+            destroy();
+        }
+
+        MemoryAllocation allocate(const vk::MemoryRequirements& requirements, uint32_t memoryTypeIndex, ResourceType type = ResourceType::Linear) {
+            std::lock_guard<std::mutex> lock(mutex);
+            const uint32_t poolIndex = memoryTypeIndex * 2 + ((separateOptimal && type == ResourceType::Optimal) ? 1 : 0);
+            auto& pool = pools[poolIndex];
+
+            MemoryAllocation result;
+            result.allocator = this;
+            result.size = requirements.size;
+
+            if (requirements.size > blockSize / 2) {
+                result.block = createBlock(pool, memoryTypeIndex, poolIndex, requirements.size, true);
+                result.block->ranges.allocate(requirements.size, 1, result.offset);
+            } else {
+                for (const auto& block : pool) {
+                    if (!block->dedicated && block->ranges.allocate(requirements.size, requirements.alignment, result.offset)) {
+                        result.block = block.get();
+                        break;
+                    }
+                }
+                if (!result.block) {
+                    result.block = createBlock(pool, memoryTypeIndex, poolIndex, blockSize, false);
+                    result.block->ranges.allocate(requirements.size, requirements.alignment, result.offset);
+                }
+            }
+            ++result.block->allocationCount;
+            result.memory = result.block->memory;
+            return result;
+        }
+
+        void free(const MemoryAllocation& allocation) {
+            if (!allocation.block) {
+                return;
+            }
+            assert(allocation.allocator == this);
+            std::lock_guard<std::mutex> lock(mutex);
+            MemoryBlock* block = allocation.block;
+            block->ranges.free(allocation.offset, allocation.size);
+            --block->allocationCount;
+            if (block->allocationCount) {
+                return;
+            }
+
+            // Keep one empty shared block per pool around to avoid thrashing vkAllocateMemory
+            auto& pool = pools[block->poolIndex];
+            if (!block->dedicated) {
+                size_t sharedBlocks = std::count_if(pool.begin(), pool.end(), [](const std::unique_ptr<MemoryBlock>& b) { return !b->dedicated; });
+                if (sharedBlocks <= 1) {
+                    return;
+                }
+            }
+            auto itr = std::find_if(pool.begin(), pool.end(), [block](const std::unique_ptr<MemoryBlock>& b) { return b.get() == block; });
+            assert(itr != pool.end());
+            releaseBlock(*block);
+            pool.erase(itr);
+        }
+
+        void* map(const MemoryAllocation& allocation) {
+            std::lock_guard<std::mutex> lock(mutex);
+            MemoryBlock* block = allocation.block;
+            if (!block->mapped) {
+                block->mapped = device.mapMemory(block->memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags());
+            }
+            return (uint8_t*)block->mapped + allocation.offset;
+        }
+
+        void flush(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const {
+            if (!allocation.block->coherent) {
+                device.flushMappedMemoryRanges(getMappedRange(allocation, offset, size));
+            }
+        }
+
+        void invalidate(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const {
+            if (!allocation.block->coherent) {
+                device.invalidateMappedMemoryRanges(getMappedRange(allocation, offset, size));
+            }
+        }
+
+        MemoryStats getStats(uint32_t memoryTypeIndex) const {
+            std::lock_guard<std::mutex> lock(mutex);
+            MemoryStats result;
+            for (uint32_t i = 0; i < 2; ++i) {
+                for (const auto& block : pools[memoryTypeIndex * 2 + i]) {
+                    ++result.blockCount;
+                    if (block->dedicated) {
+                        ++result.dedicatedBlockCount;
+                    }
+                    result.allocationCount += block->allocationCount;
+                    result.freeRangeCount += (uint32_t)block->ranges.getFreeRangeCount();
+                    result.bytesReserved += block->ranges.getSize();
+                    result.bytesUsed += block->ranges.getUsed();
+                    result.bytesLargestFree += block->ranges.getLargestFreeRange();
+                }
+            }
+            return result;
+        }
+
+        MemoryStats getStats() const {
+            MemoryStats result;
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+                result += getStats(i);
+            }
+            return result;
+        }
+
+        // Total number of vkAllocateMemory calls made over the lifetime of the allocator
+        uint32_t getDeviceAllocationCount() const {
+            return deviceAllocationCount;
+        }
+
+        void dumpStats(std::ostream& out) const {
+            static const double MB = 1024.0 * 1024.0;
+            out << "Device memory allocator: " << deviceAllocationCount << " device allocations made" << std::endl;
+            for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; ++i) {
+                auto stats = getStats(i);
+                if (!stats.blockCount) {
+                    continue;
+                }
+                out << "  type " << i << " (" << vk::to_string(memoryProperties.memoryTypes[i].propertyFlags) << ")"
+                    << std::fixed << std::setprecision(2)
+                    << ": " << stats.blockCount << " blocks (" << stats.dedicatedBlockCount << " dedicated)"
+                    << ", " << stats.allocationCount << " allocations"
+                    << ", " << (stats.bytesUsed / MB) << " / " << (stats.bytesReserved / MB) << " MB used"
+                    << ", fragmentation " << (stats.fragmentation() * 100.0f) << "%" << std::endl;
+            }
+        }
+
+        // Release all blocks, regardless of whether they still contain live allocations
+        void destroy() {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (auto& pool : pools) {
+                for (auto& block : pool) {
+                    releaseBlock(*block);
+                }
+                pool.clear();
+            }
+        }
+
+    private:
+        using Pool = std::vector<std::unique_ptr<MemoryBlock>>;
+
+        MemoryBlock* createBlock(Pool& pool, uint32_t memoryTypeIndex, uint32_t poolIndex, vk::DeviceSize size, bool dedicated) {
+            vk::MemoryAllocateInfo memAllocInfo;
+            memAllocInfo.allocationSize = size;
+            memAllocInfo.memoryTypeIndex = memoryTypeIndex;
+
+            std::unique_ptr<MemoryBlock> block(new MemoryBlock());
+            block->memory = device.allocateMemory(memAllocInfo);
+            block->memoryTypeIndex = memoryTypeIndex;
+            block->poolIndex = poolIndex;
+            block->dedicated = dedicated;
+            block->coherent = !!(memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & vk::MemoryPropertyFlagBits::eHostCoherent);
+            block->ranges = RangeAllocator(size);
+            ++deviceAllocationCount;
+            pool.push_back(std::move(block));
+            return pool.back().get();
+        }
+
+        // Range of the block covering [offset, offset + size) of the allocation, widened to multiples of
+        // nonCoherentAtomSize as required for flushes and invalidates
+        vk::MappedMemoryRange getMappedRange(const MemoryAllocation& allocation, vk::DeviceSize offset, vk::DeviceSize size) const {
+            const vk::DeviceSize blockSize = allocation.block->ranges.getSize();
+            vk::DeviceSize begin = allocation.offset + offset;
+            vk::DeviceSize end = allocation.offset + (size == VK_WHOLE_SIZE ? allocation.size : offset + size);
+            assert(end <= allocation.offset + allocation.size);
+            begin -= begin % nonCoherentAtomSize;
+            end = alignUp(end, nonCoherentAtomSize);
+            vk::MappedMemoryRange result;
+            result.memory = allocation.memory;
+            result.offset = begin;
+            // The last atom of a block that isn't a multiple of the atom size can only be reached by VK_WHOLE_SIZE
+            result.size = end >= blockSize ? VK_WHOLE_SIZE : end - begin;
+            return result;
+        }
+
+        void releaseBlock(MemoryBlock& block) {
+            if (block.mapped) {
+                device.unmapMemory(block.memory);
+                block.mapped = nullptr;
+            }
+            if (block.memory) {
+                device.freeMemory(block.memory);
+                block.memory = vk::DeviceMemory();
+            }
+        }
+
+        vk::Device device;
+        vk::PhysicalDeviceMemoryProperties memoryProperties;
+        bool separateOptimal{ true };
+        vk::DeviceSize nonCoherentAtomSize{ 1 };
+        uint32_t deviceAllocationCount{ 0 };
+        // Indexed by memoryTypeIndex * 2 + (optimal resource ? 1 : 0)
+        std::vector<Pool> pools;
+        mutable std::mutex mutex;
+    };
+
+    inline void* MemoryAllocation::map(vk::DeviceSize mapOffset) const {
+        return (uint8_t*)allocator->map(*this) + mapOffset;
+    }
+
+    inline void MemoryAllocation::flush(vk::DeviceSize rangeOffset, vk::DeviceSize rangeSize) const {
+        allocator->flush(*this, rangeOffset, rangeSize);
+    }
+
+    inline void MemoryAllocation::invalidate(vk::DeviceSize rangeOffset, vk::DeviceSize rangeSize) const {
+        allocator->invalidate(*this, rangeOffset, rangeSize);
+    }
+
+    inline void MemoryAllocation::free() {
+        if (allocator) {
+            allocator->free(*this);
+        }
+        *this = MemoryAllocation();
+    }
+}
@@ -4,6 +4,11 @@
 #include "vulkanDebug.h"
 #include "vulkanTools.h"
 #include "vulkanShaders.h"
+#include "vulkanStaging.hpp"
+#include "vulkanDeletionQueue.hpp"
+#include "vulkanDescriptorAllocator.hpp"
+#include "vulkanStateCache.hpp"
+#include "vulkanStateTracker.hpp"
 
 namespace vkx {
     class Context {
@@ -13,6 +18,8 @@ namespace vkx {
         bool enableValidation = false;
         // Set to true when the debug marker extension is detected
         bool enableDebugMarkers = false;
+        // Set to true to create the context without surface and swap chain support, for rendering offscreen only
+        bool headless = false;
         // fps timer (one second interval)
         float fpsTimer = 0.0f;
         // Create application wide Vulkan instance
@@ -41,14 +48,16 @@ namespace vkx {
 #if defined(__ANDROID__)
                 enabledExtensions.push_back(VK_KHR_ANDROID_SURFACE_EXTENSION_NAME);
 #else
-                enabledExtensions = glfw::getRequiredInstanceExtensions();
+                if (!headless) {
+                    enabledExtensions = glfw::getRequiredInstanceExtensions();
+                }
 #endif
+                if (enableValidation) {
+                    enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
+                }
                 vk::InstanceCreateInfo instanceCreateInfo;
                 instanceCreateInfo.pApplicationInfo = &appInfo;
                 if (enabledExtensions.size() > 0) {
-                    if (enableValidation) {
-                        enabledExtensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME);
-                    }
                     instanceCreateInfo.enabledExtensionCount = (uint32_t)enabledExtensions.size();
                     instanceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data();
                 }
@@ -83,15 +92,32 @@ namespace vkx {
             {
                 // Find a queue that supports graphics operations
                 uint32_t graphicsQueueIndex = findQueue(vk::QueueFlagBits::eGraphics);
+                // Also create queues from a compute only family (async compute) and a transfer only family
+                // (typically a DMA engine) if there are any
+                uint32_t computeQueueIndex = findDedicatedQueue(vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+                uint32_t transferQueueIndex = findDedicatedQueue(vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
                 std::array<float, 1> queuePriorities = { 0.0f };
+                std::vector<vk::DeviceQueueCreateInfo> queueCreateInfos;
                 vk::DeviceQueueCreateInfo queueCreateInfo;
                 queueCreateInfo.queueFamilyIndex = graphicsQueueIndex;
                 queueCreateInfo.queueCount = 1;
                 queueCreateInfo.pQueuePriorities = queuePriorities.data();
-                std::vector<const char*> enabledExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
+                queueCreateInfos.push_back(queueCreateInfo);
+                if (computeQueueIndex != VK_QUEUE_FAMILY_IGNORED) {
+                    queueCreateInfo.queueFamilyIndex = computeQueueIndex;
+                    queueCreateInfos.push_back(queueCreateInfo);
+                }
+                if (transferQueueIndex != VK_QUEUE_FAMILY_IGNORED) {
+                    queueCreateInfo.queueFamilyIndex = transferQueueIndex;
+                    queueCreateInfos.push_back(queueCreateInfo);
+                }
+                std::vector<const char*> enabledExtensions;
+                if (!headless) {
+                    enabledExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+                }
                 vk::DeviceCreateInfo deviceCreateInfo;
-                deviceCreateInfo.queueCreateInfoCount = 1;
-                deviceCreateInfo.pQueueCreateInfos = &queueCreateInfo;
+                deviceCreateInfo.queueCreateInfoCount = (uint32_t)queueCreateInfos.size();
+                deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data();
                 deviceCreateInfo.pEnabledFeatures = &deviceFeatures;
                 // enable the debug marker extension if it is present (likely meaning a debugging tool is present)
                 if (vkx::checkDeviceExtensionPresent(physicalDevice, VK_EXT_DEBUG_MARKER_EXTENSION_NAME)) {
@@ -116,26 +142,94 @@ namespace vkx {
             if (enableDebugMarkers) {
                 debug::marker::setup(device);
             }
-            pipelineCache = device.createPipelineCache(vk::PipelineCacheCreateInfo());
+            allocator = std::make_shared<MemoryAllocator>(device, deviceMemoryProperties, deviceProperties.limits.bufferImageGranularity, deviceProperties.limits.nonCoherentAtomSize);
+            deletionQueue = std::make_shared<DeletionQueue>(device);
+            descriptorAllocator = std::make_shared<DescriptorAllocator>(device);
+            createPipelineCache();
+            stateCache = std::make_shared<StateCache>(device, pipelineCache, deletionQueue, [stats = pipelineStats, objectCount = createdObjectCount](std::chrono::high_resolution_clock::duration duration) {
+                stats->record(duration);
+                *objectCount += 1;
+            });
             // Find a queue that supports graphics operations
             graphicsQueueIndex = findQueue(vk::QueueFlagBits::eGraphics);
             // Get the graphics queue
             queue = device.getQueue(graphicsQueueIndex, 0);
-
+            // Without dedicated families compute and transfers go through the graphics queue
+            computeQueueIndex = findDedicatedQueue(vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+            if (computeQueueIndex == VK_QUEUE_FAMILY_IGNORED) {
+                computeQueueIndex = graphicsQueueIndex;
+                computeQueue = queue;
+            } else {
+                computeQueue = device.getQueue(computeQueueIndex, 0);
+            }
+            transferQueueIndex = findDedicatedQueue(vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute);
+            if (transferQueueIndex == VK_QUEUE_FAMILY_IGNORED) {
+                transferQueueIndex = graphicsQueueIndex;
+                transferQueue = queue;
+            } else {
+                transferQueue = device.getQueue(transferQueueIndex, 0);
+            }
+            staging = std::make_shared<StagingRing>(device, queue, queueMutex, graphicsQueueIndex,
+                createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, stagingRingSize));
         }
 
         void destroyContext() {
             queue.waitIdle();
             device.waitIdle();
-            for (const auto& trash : dumpster) {
-                trash();
+            const bool printStats = statsEnabled();
+            if (stateCache) {
+                auto stats = stateCache->getStats();
+                if (printStats) {
+                    std::cout << "State cache: " << stats.hits << " hits / " << stats.misses << " misses, " << stats.asyncCompiles
+                        << " compiled in the background, " << stats.getCompileMilliseconds() << " ms compiling, "
+                        << stats.liveObjects << " objects still referenced" << std::endl;
+                }
+                stateCache->destroy();
+                stateCache.reset();
             }
-
-            while (!recycler.empty()) {
-                recycle();
+            if (deletionQueue) {
+                deletionQueue->releaseAll();
+                auto stats = deletionQueue->getStats();
+                if (printStats) {
+                    std::cout << "Deletion queue: " << stats.retired << " objects retired, " << stats.destroyed << " destroyed, at most "
+                        << stats.peakFrameCount << " in one frame, " << stats.overflowed << " overflowed" << std::endl;
+                }
+                deletionQueue.reset();
+            }
+            if (descriptorAllocator) {
+                auto stats = descriptorAllocator->getStats();
+                if (printStats) {
+                    std::cout << "Descriptors: " << stats.persistentSets << " persistent and " << stats.transientSets << " transient sets from "
+                        << stats.poolsCreated << " pools, " << stats.poolResets << " pool resets, cache " << stats.cacheHits << " hits / "
+                        << stats.cacheMisses << " misses, " << stats.allocatingFrames << " of " << stats.frames << " frames allocated" << std::endl;
+                }
+                descriptorAllocator->destroy();
+                descriptorAllocator.reset();
             }
 
             destroyCommandPool();
+            if (staging) {
+                auto stats = staging->getStats();
+                if (printStats) {
+                    std::cout << "Staging: " << stats.uploadCount << " uploads, " << stats.bytesStaged << " bytes in "
+                        << stats.submitCount << " submits, " << stats.stallCount << " stalls" << std::endl;
+                }
+                staging->destroy();
+                staging.reset();
+            }
+            if (allocator) {
+                if (printStats) {
+                    allocator->dumpStats(std::cout);
+                }
+                allocator->destroy();
+                allocator.reset();
+            }
+            savePipelineCache();
+            auto shaderStats = shader::getCompileStats();
+            if (printStats && shaderStats.compiled + shaderStats.memoryHits + shaderStats.diskHits) {
+                std::cout << "Shaders: " << shaderStats.compiled << " compiled in " << shaderStats.compileMilliseconds << " ms, "
+                    << shaderStats.diskHits << " loaded from the SPIR-V cache, " << shaderStats.memoryHits << " reused" << std::endl;
+            }
             device.destroyPipelineCache(pipelineCache);
             device.destroy();
             if (enableValidation) {
@@ -144,6 +238,119 @@ namespace vkx {
             instance.destroy();
         }
 
+        // Find a queue family supporting flags but none of the excluded flags, VK_QUEUE_FAMILY_IGNORED if there is none
+        uint32_t findDedicatedQueue(const vk::QueueFlags& flags, const vk::QueueFlags& excluded) const {
+            std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
+            for (uint32_t i = 0; i < (uint32_t)queueProps.size(); i++) {
+                if ((queueProps[i].queueFlags & flags) == flags && !(queueProps[i].queueFlags & excluded)) {
+                    return i;
+                }
+            }
+            return VK_QUEUE_FAMILY_IGNORED;
+        }
+
+        // Pipeline cache data is persisted in the cache directory, one file per device
+        std::string getPipelineCachePath() const {
+            const std::string& cachePath = getCachePath();
+            if (cachePath.empty()) {
+                return cachePath;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "pipelines_%04x_%04x.bin", deviceProperties.vendorID, deviceProperties.deviceID);
+            return cachePath + name;
+        }
+
+        // Check the data against the VkPipelineCacheHeaderVersionOne of the current device.  Data written by a
+        // different device or driver would be ignored by the driver anyway, so don't even pass it on
+        bool isPipelineCacheDataValid(const std::vector<uint8_t>& data) const {
+            // length, version, vendorID, deviceID followed by the cache UUID
+            uint32_t header[4];
+            if (data.size() < sizeof(header) + VK_UUID_SIZE) {
+                return false;
+            }
+            memcpy(header, data.data(), sizeof(header));
+            return header[0] >= sizeof(header) + VK_UUID_SIZE && header[0] <= data.size() &&
+                header[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                header[2] == deviceProperties.vendorID &&
+                header[3] == deviceProperties.deviceID &&
+                0 == memcmp(data.data() + sizeof(header), deviceProperties.pipelineCacheUUID, VK_UUID_SIZE);
+        }
+
+        void createPipelineCache() {
+            std::vector<uint8_t> data;
+            std::string path = getPipelineCachePath();
+            if (!path.empty()) {
+                std::ifstream file(path, std::ios::binary | std::ios::ate);
+                if (file) {
+                    data.resize((size_t)file.tellg());
+                    file.seekg(0, std::ios::beg);
+                    if (!file.read((char*)data.data(), data.size()) || !isPipelineCacheDataValid(data)) {
+                        std::cout << "Ignoring stale pipeline cache " << path << std::endl;
+                        data.clear();
+                    }
+                }
+            }
+            vk::PipelineCacheCreateInfo pipelineCacheCreateInfo;
+            pipelineCacheCreateInfo.initialDataSize = data.size();
+            pipelineCacheCreateInfo.pInitialData = data.data();
+            pipelineCache = device.createPipelineCache(pipelineCacheCreateInfo);
+            pipelineStats->initialCacheSize = data.size();
+        }
+
+        void savePipelineCache() const {
+            std::string path = getPipelineCachePath();
+            if (path.empty() || !pipelineCache) {
+                return;
+            }
+            std::vector<uint8_t> data = device.getPipelineCacheData(pipelineCache);
+            // Write to a temporary file first so an interrupted write can't leave a truncated cache behind
+            std::string tempPath = path + ".tmp";
+            {
+                std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+                if (!file.write((const char*)data.data(), data.size())) {
+                    std::cerr << "Unable to write pipeline cache " << tempPath << std::endl;
+                    return;
+                }
+            }
+            remove(path.c_str());
+            if (rename(tempPath.c_str(), path.c_str())) {
+                remove(tempPath.c_str());
+            }
+        }
+
+        // Create pipelines through the context pipeline cache, timing the creation
+        vk::Pipeline createGraphicsPipeline(const vk::GraphicsPipelineCreateInfo& createInfo) const {
+            auto start = std::chrono::high_resolution_clock::now();
+            vk::Pipeline result = device.createGraphicsPipelines(pipelineCache, createInfo, nullptr)[0];
+            pipelineStats->record(std::chrono::high_resolution_clock::now() - start);
+            countCreatedObjects();
+            return result;
+        }
+
+        vk::Pipeline createComputePipeline(const vk::ComputePipelineCreateInfo& createInfo) const {
+            auto start = std::chrono::high_resolution_clock::now();
+            vk::Pipeline result = device.createComputePipelines(pipelineCache, createInfo, nullptr)[0];
+            pipelineStats->record(std::chrono::high_resolution_clock::now() - start);
+            countCreatedObjects();
+            return result;
+        }
+
+        struct PipelineStats {
+            std::atomic<uint32_t> count{ 0 };
+            std::atomic<uint64_t> nanoseconds{ 0 };
+            // Size of the pipeline cache data loaded at startup, 0 on a cold start
+            size_t initialCacheSize{ 0 };
+
+            void record(std::chrono::high_resolution_clock::duration duration) {
+                ++count;
+                nanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            }
+
+            double getMilliseconds() const {
+                return (double)nanoseconds / 1.0e6;
+            }
+        };
+
         uint32_t findQueue(const vk::QueueFlags& flags, const vk::SurfaceKHR& presentSurface = vk::SurfaceKHR()) const {
             std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
             size_t queueCount = queueProps.size();
@@ -171,130 +378,147 @@ namespace vkx {
         vk::PhysicalDeviceMemoryProperties deviceMemoryProperties;
         // Logical device, application's view of the physical device (GPU)
         vk::Device device;
+        // Sub-allocates the memory for all buffers and images created through the context.
+        // Shared so that copies of the context (texture loader, text overlay) use the same blocks
+        std::shared_ptr<MemoryAllocator> allocator;
+        // Persistently mapped ring used by the stageToDevice* functions
+        std::shared_ptr<StagingRing> staging;
+        vk::DeviceSize stagingRingSize{ 16 * 1024 * 1024 };
+        // Serializes access to queue, which the staging ring submits to from whichever thread uploads.
+        // Shared between copies of the context, hold it through lockQueue around every submit or present on queue.
+        std::shared_ptr<std::mutex> queueMutex{ std::make_shared<std::mutex>() };
+
+        std::unique_lock<std::mutex> lockQueue() const {
+            return std::unique_lock<std::mutex>(*queueMutex);
+        }
+
+        // Running count of the Vulkan objects created through the context helpers.  Shared between
+        // copies of the context so objects created by the texture loader or text overlay are included.
+        std::shared_ptr<std::atomic<uint64_t>> createdObjectCount{ std::make_shared<std::atomic<uint64_t>>(0) };
+
+        // Every shader stage the device can run, for uploads whose consumers aren't known yet
+        vk::PipelineStageFlags getShaderStages() const {
+            vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+            if (deviceFeatures.tessellationShader) {
+                stages |= vk::PipelineStageFlagBits::eTessellationControlShader | vk::PipelineStageFlagBits::eTessellationEvaluationShader;
+            }
+            if (deviceFeatures.geometryShader) {
+                stages |= vk::PipelineStageFlagBits::eGeometryShader;
+            }
+            return stages;
+        }
+
+        void countCreatedObjects(uint64_t count = 1) const {
+            *createdObjectCount += count;
+        }
+
+        uint64_t getCreatedObjectCount() const {
+            return *createdObjectCount;
+        }
         // vk::Pipeline cache object
         vk::PipelineCache pipelineCache;
+        // Time spent in createGraphicsPipeline / createComputePipeline, shared between copies of the context
+        std::shared_ptr<PipelineStats> pipelineStats{ std::make_shared<PipelineStats>() };
         // List of shader modules created (stored for cleanup)
         mutable std::vector<vk::ShaderModule> shaderModules;
 
         vk::Queue queue;
         // Find a queue that supports graphics operations
         uint32_t graphicsQueueIndex;
+        // Queue of a compute only family if the device has one, otherwise the graphics queue.  Work submitted
+        // here can overlap with rendering, but exclusive resources need ownership transfers (see releaseBuffers).
+        vk::Queue computeQueue;
+        uint32_t computeQueueIndex{ VK_QUEUE_FAMILY_IGNORED };
+        // Queue of a transfer only family if the device has one, otherwise the graphics queue
+        vk::Queue transferQueue;
+        uint32_t transferQueueIndex{ VK_QUEUE_FAMILY_IGNORED };
+
+        bool hasDedicatedComputeQueue() const {
+            return computeQueueIndex != graphicsQueueIndex;
+        }
 
         ///////////////////////////////////////////////////////////////////////
         //
         // Object destruction support
         //
-        // It's often critical to avoid destroying an object that may be in use by the GPU.  In order to service this need
-        // the context class contains structures for objects that are pending deletion.  
-        // 
-        // The first container is the dumpster, and it just contains a set of lambda objects that when executed, destroy 
-        // resources (presumably... in theory the lambda can do anything you want, but the purpose is to contain GPU object 
-        // destruction calls).
-        //
-        // When the application makes use of a function that uses a fence, it can provide that fence to the context as a marker 
-        // for destroying all the pending objects.  Anything in the dumpster is migrated to the recycler.
-        // 
-        // Finally, an application can call the recycle function at regular intervals (perhaps once per frame, perhaps less often)
-        // in order to check the fences and execute the associated destructors for any that are signalled.
-        using VoidLambda = std::function<void()>;
-        using VoidLambdaList = std::list<VoidLambda>;
-        using FencedLambda = std::pair<vk::Fence, VoidLambda>;
-        using FencedLambdaQueue = std::queue<FencedLambda>;
-
-        // A collection of items queued for destruction.  Once a fence has been created
-        // for a queued submit, these items can be moved to the recycler for actual destruction
-        // by calling the rec
-        VoidLambdaList dumpster;
-        FencedLambdaQueue recycler;
+        // It's often critical to avoid destroying an object that may be in use by the GPU.  Objects are
+        // therefore trashed instead: they are retired to the deletion queue shared by all copies of the
+        // context, from any thread, and destroyed in bulk once the frame that last used them has completed.
+        // The example base collects and releases the queue per frame slot.  The trash functions reset the
+        // passed handles.
+        std::shared_ptr<DeletionQueue> deletionQueue;
 
-        template<typename T>
-        void trash(T value, std::function<void(const T& t)> destructor) {
-            if (!value) {
-                return;
-            }
-            T trashedValue;
-            std::swap(trashedValue, value);
-            dumpster.push_back([trashedValue, destructor] {
-                destructor(trashedValue);
-            });
-        }
+        // Descriptor sets for anything that doesn't need a hand sized pool.  Transient sets are recycled per frame slot.
+        std::shared_ptr<DescriptorAllocator> descriptorAllocator;
+
+        // Shared descriptor set layouts, pipeline layouts and pipelines, looked up by their create info.
+        // Objects acquired here are given back with stateCache->release instead of being destroyed or trashed.
+        std::shared_ptr<StateCache> stateCache;
 
         template<typename T>
-        void trash(std::vector<T>& values, std::function<void(const T& t)> destructor) {
-            if (values.empty()) {
-                return;
-            }
-            std::vector<T> trashedValues;
-            trashedValues.swap(values);
-            for (const T& value : trashedValues) {
-                trash(value, destructor);
+        void trash(T& value) const {
+            if (value) {
+                deletionQueue->retire(value);
+                value = T();
             }
         }
 
         template<typename T>
-        void trash(std::vector<T>& values, std::function<void(const std::vector<T>& t)> destructor) {
-            if (values.empty()) {
-                return;
+        void trash(std::vector<T>& values) const {
+            for (auto& value : values) {
+                trash(value);
             }
-            std::vector<T> trashedValues;
-            trashedValues.swap(values);
-            dumpster.push_back([trashedValues, destructor] {
-                destructor(trashedValues);
-            });
+            values.clear();
         }
 
-        //
-        // Convenience functions for trashing specific types.  These functions know what kind of function 
-        // call to make for destroying a given Vulkan object.
-        //
-
-        void trashPipeline(vk::Pipeline& pipeline) {
-            std::function<void(const vk::Pipeline& t)> destructor =
-                [this](const vk::Pipeline& pipeline) { device.destroyPipeline(pipeline); };
-            trash(pipeline, destructor);
+        // Buffers and images are retired together with their memory, the result is left empty
+        void trash(CreateBufferResult& result) const {
+            trash(result.buffer);
+            trashMemory(result);
+            result.descriptor = vk::DescriptorBufferInfo();
         }
 
-        void trashCommandBuffer(vk::CommandBuffer& cmdBuffer) {
-            std::function<void(const vk::CommandBuffer& t)> destructor =
-                [this](const vk::CommandBuffer& cmdBuffer) {
-                device.freeCommandBuffers(getCommandPool(), cmdBuffer);
-            };
-            trash(cmdBuffer, destructor);
+        void trash(CreateImageResult& result) const {
+            trash(result.sampler);
+            trash(result.view);
+            trash(result.image);
+            trashMemory(result);
         }
 
-        void trashCommandBuffers(std::vector<vk::CommandBuffer>& cmdBuffers) {
-            std::function<void(const std::vector<vk::CommandBuffer>& t)> destructor =
-                [this](const std::vector<vk::CommandBuffer>& cmdBuffers) {
-                device.freeCommandBuffers(getCommandPool(), cmdBuffers);
-            };
-            trash(cmdBuffers, destructor);
+        void trashMemory(AllocatedResult& result) const {
+            if (result.mapped) {
+                result.unmap();
+            }
+            if (result.allocation) {
+                trash(result.allocation);
+                result.memory = vk::DeviceMemory();
+            } else {
+                trash(result.memory);
+            }
         }
 
-        // Should be called from time to time by the application to migrate zombie resources
-        // to the recycler along with a fence that will be signalled when the objects are 
-        // safe to delete.
-        void emptyDumpster(vk::Fence fence) {
-            VoidLambdaList newDumpster;
-            newDumpster.swap(dumpster);
-            recycler.push(FencedLambda{ fence, [fence, newDumpster, this] {
-                for (const auto & f : newDumpster) { f(); }
-            } });
+        void trashPipeline(vk::Pipeline& pipeline) const {
+            trash(pipeline);
         }
 
-        // Check the recycler fences for signalled status.  Any that are signalled will have their corresponding
-        // lambdas executed, freeing up the associated resources
-        void recycle() {
-            while (!recycler.empty() && vk::Result::eSuccess == device.getFenceStatus(recycler.front().first)) {
-                vk::Fence fence = recycler.front().first;
-                VoidLambda lambda = recycler.front().second;
-                recycler.pop();
+        // Command buffers allocated from the calling thread's context pool
+        void trashCommandBuffer(vk::CommandBuffer& cmdBuffer) const {
+            trashCommandBuffer(cmdBuffer, getCommandPool());
+        }
 
-                lambda();
+        void trashCommandBuffer(vk::CommandBuffer& cmdBuffer, const vk::CommandPool& pool) const {
+            if (cmdBuffer) {
+                deletionQueue->retire(cmdBuffer, pool);
+                cmdBuffer = vk::CommandBuffer();
+            }
+        }
 
-                if (recycler.empty() || fence != recycler.front().first) {
-                    device.destroyFence(fence);
-                }
+        void trashCommandBuffers(std::vector<vk::CommandBuffer>& cmdBuffers) const {
+            vk::CommandPool pool = getCommandPool();
+            for (auto& cmdBuffer : cmdBuffers) {
+                trashCommandBuffer(cmdBuffer, pool);
             }
+            cmdBuffers.clear();
         }
 
 #ifdef WIN32
@@ -328,6 +552,7 @@ namespace vkx {
             cmdBufAllocateInfo.commandBufferCount = 1;
 
             cmdBuffer = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+            countCreatedObjects();
 
             // If requested, also start the new command buffer
             if (begin) {
@@ -347,8 +572,11 @@ namespace vkx {
             vk::SubmitInfo submitInfo;
             submitInfo.commandBufferCount = 1;
             submitInfo.pCommandBuffers = &commandBuffer;
-            queue.submit(submitInfo, vk::Fence());
-            queue.waitIdle();
+            {
+                auto queueLock = lockQueue();
+                queue.submit(submitInfo, vk::Fence());
+                queue.waitIdle();
+            }
             device.waitIdle();
             if (free) {
                 device.freeCommandBuffers(getCommandPool(), commandBuffer);
@@ -368,32 +596,60 @@ namespace vkx {
             CreateImageResult result;
             result.device = device;
             result.image = device.createImage(imageCreateInfo);
+            countCreatedObjects();
             result.format = imageCreateInfo.format;
             vk::MemoryRequirements memReqs = device.getImageMemoryRequirements(result.image);
-            vk::MemoryAllocateInfo memAllocInfo;
-            memAllocInfo.allocationSize = result.allocSize = memReqs.size;
-            memAllocInfo.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
-            result.memory = device.allocateMemory(memAllocInfo);
-            device.bindImageMemory(result.image, result.memory, 0);
+            result.allocSize = memReqs.size;
+            auto resourceType = imageCreateInfo.tiling == vk::ImageTiling::eOptimal ? MemoryAllocator::ResourceType::Optimal : MemoryAllocator::ResourceType::Linear;
+            result.allocation = allocator->allocate(memReqs, getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags), resourceType);
+            result.memory = result.allocation.memory;
+            device.bindImageMemory(result.image, result.memory, result.allocation.offset);
             return result;
         }
 
         using MipData = ::std::pair<vk::Extent3D, vk::DeviceSize>;
 
+        // Uploads made through the stageToDevice* functions are recorded into a single submit until the
+        // matching endUploadBatch.  The returned token can be passed to waitForUpload or isUploadComplete.
+        // Consumers on the context queue don't need to wait, the upload submit ends with a barrier making
+        // the data visible to all later work on the queue.
+        void beginUploadBatch() const {
+            staging->beginBatch();
+        }
+
+        UploadToken endUploadBatch() const {
+            return staging->endBatch();
+        }
+
+        // Submit uploads recorded in an open batch, so that work submitted to the queue afterwards sees them
+        UploadToken flushUploads() const {
+            return staging->flush();
+        }
+
+        bool isUploadComplete(UploadToken token) const {
+            return staging->isComplete(token);
+        }
+
+        void waitForUpload(UploadToken token) const {
+            staging->wait(token);
+        }
+
         CreateImageResult stageToDeviceImage(vk::ImageCreateInfo imageCreateInfo, const vk::MemoryPropertyFlags& memoryPropertyFlags, vk::DeviceSize size, const void* data, const std::vector<MipData>& mipData = {}) const {
-            CreateBufferResult staging = createBuffer(vk::BufferUsageFlagBits::eTransferSrc, size, data);
             imageCreateInfo.usage = imageCreateInfo.usage | vk::ImageUsageFlagBits::eTransferDst;
             CreateImageResult result = createImage(imageCreateInfo, memoryPropertyFlags);
 
-            withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
+            auto recordCopy = [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& srcBuffer, vk::DeviceSize srcOffset) {
                 vk::ImageSubresourceRange range(vk::ImageAspectFlagBits::eColor, 0, imageCreateInfo.mipLevels, 0, 1);
                 // Prepare for transfer
-                setImageLayout(copyCmd, result.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal, range);
+                ResourceStateTracker tracker;
+                tracker.requireImage(result.image, range, ResourceStateTracker::Usage::transferDst());
+                tracker.flush(copyCmd);
 
                 // Prepare for transfer
                 std::vector<vk::BufferImageCopy> bufferCopyRegions;
                 {
                     vk::BufferImageCopy bufferCopyRegion;
+                    bufferCopyRegion.bufferOffset = srcOffset;
                     bufferCopyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
                     bufferCopyRegion.imageSubresource.layerCount = 1;
                     if (!mipData.empty()) {
@@ -408,11 +664,23 @@ namespace vkx {
                         bufferCopyRegions.push_back(bufferCopyRegion);
                     }
                 }
-                copyCmd.copyBufferToImage(staging.buffer, result.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
+                copyCmd.copyBufferToImage(srcBuffer, result.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
                 // Prepare for shader read
-                setImageLayout(copyCmd, result.image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, range);
-            });
-            staging.destroy();
+                tracker.requireImage(result.image, range, ResourceStateTracker::Usage::sampled(getShaderStages()));
+                tracker.flush(copyCmd);
+            };
+
+            if (size <= staging->getCapacity()) {
+                // Copy offsets must be a multiple of the texel block size, 16 covers every format used here
+                staging->upload(data, size, 16, recordCopy);
+            } else {
+                // Too large for the ring, use a dedicated staging buffer released once the copy has executed
+                CreateBufferResult oversized = createBuffer(vk::BufferUsageFlagBits::eTransferSrc, size, data);
+                staging->retain(oversized);
+                staging->record([&](const vk::CommandBuffer& copyCmd) {
+                    recordCopy(copyCmd, oversized.buffer, 0);
+                });
+            }
             return result;
         }
 
@@ -438,16 +706,18 @@ namespace vkx {
             bufferCreateInfo.size = size;
 
             result.descriptor.buffer = result.buffer = device.createBuffer(bufferCreateInfo);
+            countCreatedObjects();
 
             vk::MemoryRequirements memReqs = device.getBufferMemoryRequirements(result.buffer);
-            vk::MemoryAllocateInfo memAlloc;
-            result.allocSize = memAlloc.allocationSize = memReqs.size;
-            memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-            result.memory = device.allocateMemory(memAlloc);
+            result.allocSize = memReqs.size;
+            result.allocation = allocator->allocate(memReqs, getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags));
+            result.memory = result.allocation.memory;
+            device.bindBufferMemory(result.buffer, result.memory, result.allocation.offset);
             if (data != nullptr) {
-                copyToMemory(result.memory, data, size);
+                result.map();
+                result.copy(size, data);
+                result.unmap();
             }
-            device.bindBufferMemory(result.buffer, result.memory, 0);
             return result;
         }
 
@@ -477,9 +747,7 @@ namespace vkx {
 
         template <typename T>
         CreateBufferResult createUniformBuffer(const T& data, size_t count = 3) const {
-            auto alignment = deviceProperties.limits.minUniformBufferOffsetAlignment;
-            auto extra = sizeof(T) % alignment;
-            auto alignedSize = sizeof(T) + (alignment - extra);
+            auto alignedSize = alignUp(sizeof(T), deviceProperties.limits.minUniformBufferOffsetAlignment);
             auto allocatedSize = count * alignedSize;
             CreateBufferResult result = createBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, allocatedSize);
             result.alignment = alignedSize;
@@ -506,13 +774,17 @@ namespace vkx {
         }
 
         CreateBufferResult stageToDeviceBuffer(const vk::BufferUsageFlags& usage, size_t size, const void* data) const {
-            CreateBufferResult staging = createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible, size, data);
             CreateBufferResult result = createBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, size);
-            withPrimaryCommandBuffer([&](vk::CommandBuffer copyCmd) {
-                copyCmd.copyBuffer(staging.buffer, result.buffer, vk::BufferCopy(0, 0, size));
-            });
-            device.freeMemory(staging.memory);
-            device.destroyBuffer(staging.buffer);
+            // Buffers larger than the ring are uploaded in ring sized chunks inside a single batch
+            staging->beginBatch();
+            const vk::DeviceSize chunkSize = staging->getCapacity();
+            for (vk::DeviceSize offset = 0; offset < size; offset += chunkSize) {
+                vk::DeviceSize copySize = std::min<vk::DeviceSize>(chunkSize, size - offset);
+                staging->upload((const uint8_t*)data + offset, copySize, 4, [&](const vk::CommandBuffer& copyCmd, const vk::Buffer& srcBuffer, vk::DeviceSize srcOffset) {
+                    copyCmd.copyBuffer(srcBuffer, result.buffer, vk::BufferCopy(srcOffset, offset, copySize));
+                });
+            }
+            staging->endBatch();
             return result;
         }
 
@@ -559,6 +831,7 @@ namespace vkx {
 #endif
             shaderStage.pName = "main"; // todo : make param
             assert(shaderStage.module);
+            countCreatedObjects();
             shaderModules.push_back(shaderStage.module);
             return shaderStage;
         }
@@ -569,10 +842,32 @@ namespace vkx {
             shaderStage.stage = stage;
             shaderStage.module = shader::glslToShaderModule(device, stage, source);
             shaderStage.pName = "main";
+            countCreatedObjects();
             shaderModules.push_back(shaderStage.module);
             return shaderStage;
         }
 
+        // Load and compile several GLSL shaders at once, concurrently if a job system is given
+        std::vector<vk::PipelineShaderStageCreateInfo> loadGlslShaders(const std::vector<std::pair<std::string, vk::ShaderStageFlagBits>>& files, JobSystem* jobSystem = nullptr) const {
+            std::vector<shader::GlslSource> sources;
+            for (const auto& file : files) {
+                sources.push_back({ file.second, readTextFile(file.first.c_str()) });
+            }
+            std::vector<shader::SpvBuffer> spvs = shader::glslToSpv(sources, jobSystem);
+            std::vector<vk::PipelineShaderStageCreateInfo> result(files.size());
+            for (size_t i = 0; i < files.size(); ++i) {
+                vk::ShaderModuleCreateInfo moduleCreateInfo;
+                moduleCreateInfo.codeSize = spvs[i].size() * sizeof(uint32_t);
+                moduleCreateInfo.pCode = spvs[i].data();
+                result[i].stage = files[i].second;
+                result[i].module = device.createShaderModule(moduleCreateInfo);
+                result[i].pName = "main";
+                countCreatedObjects();
+                shaderModules.push_back(result[i].module);
+            }
+            return result;
+        }
+
         void submit(
             const vk::ArrayProxy<const vk::CommandBuffer>& commandBuffers,
             const vk::ArrayProxy<const vk::Semaphore>& wait = {},
@@ -580,6 +875,19 @@ namespace vkx {
             const vk::ArrayProxy<const vk::Semaphore>& signals = {},
             const vk::Fence& fence = vk::Fence()
             ) {
+            submit(queue, commandBuffers, wait, waitStages, signals, fence);
+        }
+
+        // Submit to any of the context queues.  Dependencies between queues are expressed with the wait and
+        // signal semaphores, exclusive resources additionally need releaseBuffers / acquireBuffers.
+        void submit(
+            const vk::Queue& targetQueue,
+            const vk::ArrayProxy<const vk::CommandBuffer>& commandBuffers,
+            const vk::ArrayProxy<const vk::Semaphore>& wait,
+            const vk::ArrayProxy<const vk::PipelineStageFlags>& waitStages,
+            const vk::ArrayProxy<const vk::Semaphore>& signals = {},
+            const vk::Fence& fence = vk::Fence()
+            ) {
             vk::SubmitInfo info;
             info.commandBufferCount = commandBuffers.size();
             info.pCommandBuffers = commandBuffers.data();
@@ -599,7 +907,9 @@ namespace vkx {
             info.pWaitDstStageMask = waitStages.data();
 
             info.signalSemaphoreCount = signals.size();
-            queue.submit(info, fence);
+            // The compute and transfer queues fall back to queue when the device has no dedicated family
+            auto queueLock = lockQueue();
+            targetQueue.submit(info, fence);
         }
 
         using SemaphoreStagePair = std::pair<const vk::Semaphore, const vk::PipelineStageFlags>;
@@ -609,6 +919,15 @@ namespace vkx {
             const vk::ArrayProxy<const SemaphoreStagePair>& wait = {},
             const vk::ArrayProxy<const vk::Semaphore>& signals = {},
             const vk::Fence& fence = vk::Fence()) {
+            submit(queue, commandBuffers, wait, signals, fence);
+        }
+
+        void submit(
+            const vk::Queue& targetQueue,
+            const vk::ArrayProxy<const vk::CommandBuffer>& commandBuffers,
+            const vk::ArrayProxy<const SemaphoreStagePair>& wait,
+            const vk::ArrayProxy<const vk::Semaphore>& signals = {},
+            const vk::Fence& fence = vk::Fence()) {
             std::vector<vk::Semaphore> waitSemaphores;
             std::vector<vk::PipelineStageFlags> waitStages;
             for (size_t i = 0; i < wait.size(); ++i) {
@@ -616,7 +935,74 @@ namespace vkx {
                 waitSemaphores.push_back(pair.first);
                 waitStages.push_back(pair.second);
             }
-            submit(commandBuffers, waitSemaphores, waitStages, signals, fence);
+            submit(targetQueue, commandBuffers, waitSemaphores, waitStages, signals, fence);
+        }
+
+        // Hands a buffer range written on one queue to another.  srcAccess / srcStage describe the last use on the
+        // source queue, dstAccess / dstStage the first use on the destination queue.
+        struct BufferTransfer {
+            vk::Buffer buffer;
+            vk::DeviceSize offset{ 0 };
+            vk::DeviceSize size{ VK_WHOLE_SIZE };
+            uint32_t srcQueueFamily{ VK_QUEUE_FAMILY_IGNORED };
+            uint32_t dstQueueFamily{ VK_QUEUE_FAMILY_IGNORED };
+            vk::AccessFlags srcAccess;
+            vk::PipelineStageFlags srcStage{ vk::PipelineStageFlagBits::eAllCommands };
+            vk::AccessFlags dstAccess;
+            vk::PipelineStageFlags dstStage{ vk::PipelineStageFlagBits::eAllCommands };
+        };
+
+        // Record the release half of the transfers at the end of the source queue's command buffer.  When both
+        // queues are from the same family this is an ordinary barrier and acquireBuffers records nothing.
+        void releaseBuffers(const vk::CommandBuffer& cmdBuffer, const vk::ArrayProxy<const BufferTransfer>& transfers) const {
+            recordBufferTransfers(cmdBuffer, transfers, true);
+        }
+
+        // Record the acquire half of the transfers at the start of the destination queue's command buffer,
+        // which has to be submitted after (i.e. wait on a semaphore signalled by) the release
+        void acquireBuffers(const vk::CommandBuffer& cmdBuffer, const vk::ArrayProxy<const BufferTransfer>& transfers) const {
+            recordBufferTransfers(cmdBuffer, transfers, false);
+        }
+
+    private:
+        void recordBufferTransfers(const vk::CommandBuffer& cmdBuffer, const vk::ArrayProxy<const BufferTransfer>& transfers, bool release) const {
+            std::vector<vk::BufferMemoryBarrier> barriers;
+            vk::PipelineStageFlags srcStages, dstStages;
+            for (size_t i = 0; i < transfers.size(); ++i) {
+                const auto& transfer = transfers.data()[i];
+                vk::BufferMemoryBarrier barrier;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.buffer = transfer.buffer;
+                barrier.offset = transfer.offset;
+                barrier.size = transfer.size;
+                if (transfer.srcQueueFamily == transfer.dstQueueFamily) {
+                    if (!release) {
+                        continue;
+                    }
+                    barrier.srcAccessMask = transfer.srcAccess;
+                    barrier.dstAccessMask = transfer.dstAccess;
+                    srcStages |= transfer.srcStage;
+                    dstStages |= transfer.dstStage;
+                } else if (release) {
+                    // Access masks of the other queue are ignored, the semaphore provides the execution dependency
+                    barrier.srcAccessMask = transfer.srcAccess;
+                    barrier.srcQueueFamilyIndex = transfer.srcQueueFamily;
+                    barrier.dstQueueFamilyIndex = transfer.dstQueueFamily;
+                    srcStages |= transfer.srcStage;
+                    dstStages |= vk::PipelineStageFlagBits::eBottomOfPipe;
+                } else {
+                    barrier.dstAccessMask = transfer.dstAccess;
+                    barrier.srcQueueFamilyIndex = transfer.srcQueueFamily;
+                    barrier.dstQueueFamilyIndex = transfer.dstQueueFamily;
+                    srcStages |= vk::PipelineStageFlagBits::eTopOfPipe;
+                    dstStages |= transfer.dstStage;
+                }
+                barriers.push_back(barrier);
+            }
+            if (!barriers.empty()) {
+                cmdBuffer.pipelineBarrier(srcStages, dstStages, vk::DependencyFlags(), nullptr, barriers, nullptr);
+            }
         }
     };
 
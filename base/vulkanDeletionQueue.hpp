@@ -0,0 +1,245 @@
+/*
+* Deferred destruction of Vulkan objects
+*
+* Objects that may still be referenced by submitted work are retired instead of destroyed.  A
+* retired object is a POD entry holding the handle, its parent (the pool of a command buffer or the
+* allocator of a suballocation) and a type tag, pushed into a lock-free queue so any thread can retire objects without allocating.
+* The thread owning the frames collects the queue into the bucket of the frame being submitted and
+* destroys the bucket in bulk once that frame's fence has signalled.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "common.hpp"
+#include "cpuProfiler.hpp"
+#include "vulkanAllocator.hpp"
+#include "mpscQueue.hpp"
+
+namespace vkx {
+
+    class DeletionQueue {
+    public:
+        // Children come before their parents, so sorting a bucket by type frees command buffers
+        // before a pool retired in the same frame is destroyed, and resources before their memory
+        enum class Type : uint32_t {
+            CommandBuffer,
+            CommandPool,
+            Framebuffer,
+            RenderPass,
+            Pipeline,
+            PipelineLayout,
+            DescriptorPool,
+            DescriptorSetLayout,
+            ShaderModule,
+            ImageView,
+            Sampler,
+            QueryPool,
+            Semaphore,
+            Fence,
+            Event,
+            Buffer,
+            Image,
+            DeviceMemory,
+            // Range of a MemoryAllocator block, handed back to the allocator
+            Allocation,
+        };
+
+        struct Entry {
+            uint64_t handle;
+            uint64_t parent;
+            Type type;
+            // Allocations only
+            uint64_t offset;
+            uint64_t size;
+        };
+
+        struct Stats {
+            uint64_t retired{ 0 };
+            uint64_t destroyed{ 0 };
+            // Entries that didn't fit the lock-free queue and went through the mutex protected overflow list
+            uint64_t overflowed{ 0 };
+            // Largest number of objects destroyed for a single frame
+            uint64_t peakFrameCount{ 0 };
+        };
+
+        explicit DeletionQueue(const vk::Device& device) : device(device) {}
+
+        DeletionQueue(const DeletionQueue&) = delete;
+        DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+        // Any thread
+        template <typename T>
+        void retire(const T& object) {
+            push({ toHandle(object), 0, getType(object) });
+        }
+
+        // Any thread, command buffers go back to the pool they were allocated from
+        void retire(const vk::CommandBuffer& cmdBuffer, const vk::CommandPool& pool) {
+            push({ toHandle(cmdBuffer), toHandle(pool), Type::CommandBuffer });
+        }
+
+        // Any thread, the range goes back to its allocator
+        void retire(const MemoryAllocation& allocation) {
+            push({ (uint64_t)(uintptr_t)allocation.block, (uint64_t)(uintptr_t)allocation.allocator, Type::Allocation, allocation.offset, allocation.size });
+        }
+
+        // Owner thread only.  Moves everything retired so far into the bucket of frame, call it before
+        // submitting the frame whose fence gates the bucket.
+        void collect(uint32_t frame) {
+            if (frame >= frames.size()) {
+                frames.resize(frame + 1);
+            }
+            auto& bucket = frames[frame];
+            Entry entry;
+            while (queue.pop(entry)) {
+                bucket.push_back(entry);
+            }
+            if (overflowPending.load(std::memory_order_acquire)) {
+                std::lock_guard<std::mutex> lock(overflowMutex);
+                bucket.insert(bucket.end(), overflow.begin(), overflow.end());
+                overflow.clear();
+                overflowPending.store(false, std::memory_order_relaxed);
+            }
+        }
+
+        // Owner thread only.  Destroys the objects collected for frame, once its fence has signalled.
+        void release(uint32_t frame) {
+            if (frame >= frames.size() || frames[frame].empty()) {
+                return;
+            }
+            VKX_CPU_ZONE("Release retired objects");
+            auto& bucket = frames[frame];
+            std::sort(bucket.begin(), bucket.end(), [](const Entry& a, const Entry& b) {
+                return a.type != b.type ? a.type < b.type : a.parent < b.parent;
+            });
+            size_t i = 0;
+            while (i < bucket.size()) {
+                if (bucket[i].type == Type::CommandBuffer) {
+                    // One free call per pool
+                    uint64_t pool = bucket[i].parent;
+                    cmdBufferScratch.clear();
+                    for (; i < bucket.size() && bucket[i].type == Type::CommandBuffer && bucket[i].parent == pool; ++i) {
+                        cmdBufferScratch.push_back(fromHandle<vk::CommandBuffer>(bucket[i].handle));
+                    }
+                    device.freeCommandBuffers(fromHandle<vk::CommandPool>(pool), cmdBufferScratch);
+                } else {
+                    destroy(bucket[i]);
+                    ++i;
+                }
+            }
+            stats.destroyed += bucket.size();
+            stats.peakFrameCount = std::max<uint64_t>(stats.peakFrameCount, bucket.size());
+            bucket.clear();
+        }
+
+        // Owner thread only.  Destroys everything retired so far, the device must be idle.
+        void releaseAll() {
+            collect(0);
+            for (uint32_t frame = 0; frame < frames.size(); ++frame) {
+                release(frame);
+            }
+        }
+
+        Stats getStats() const {
+            Stats result = stats;
+            result.retired = retiredCount.load(std::memory_order_relaxed);
+            result.overflowed = overflowCount.load(std::memory_order_relaxed);
+            return result;
+        }
+
+    private:
+        template <typename T>
+        static uint64_t toHandle(const T& object) {
+            static_assert(sizeof(T) <= sizeof(uint64_t), "Not a Vulkan handle");
+            uint64_t handle = 0;
+            memcpy(&handle, &object, sizeof(T));
+            return handle;
+        }
+
+        template <typename T>
+        static T fromHandle(uint64_t handle) {
+            T object;
+            memcpy(&object, &handle, sizeof(T));
+            return object;
+        }
+
+        static Type getType(const vk::CommandPool&) { return Type::CommandPool; }
+        static Type getType(const vk::Framebuffer&) { return Type::Framebuffer; }
+        static Type getType(const vk::RenderPass&) { return Type::RenderPass; }
+        static Type getType(const vk::Pipeline&) { return Type::Pipeline; }
+        static Type getType(const vk::PipelineLayout&) { return Type::PipelineLayout; }
+        static Type getType(const vk::DescriptorPool&) { return Type::DescriptorPool; }
+        static Type getType(const vk::DescriptorSetLayout&) { return Type::DescriptorSetLayout; }
+        static Type getType(const vk::ShaderModule&) { return Type::ShaderModule; }
+        static Type getType(const vk::ImageView&) { return Type::ImageView; }
+        static Type getType(const vk::Sampler&) { return Type::Sampler; }
+        static Type getType(const vk::QueryPool&) { return Type::QueryPool; }
+        static Type getType(const vk::Semaphore&) { return Type::Semaphore; }
+        static Type getType(const vk::Fence&) { return Type::Fence; }
+        static Type getType(const vk::Event&) { return Type::Event; }
+        static Type getType(const vk::Buffer&) { return Type::Buffer; }
+        static Type getType(const vk::Image&) { return Type::Image; }
+        static Type getType(const vk::DeviceMemory&) { return Type::DeviceMemory; }
+
+        void push(const Entry& entry) {
+            retiredCount.fetch_add(1, std::memory_order_relaxed);
+            if (queue.push(entry)) {
+                return;
+            }
+            // Only happens if more than QueueCapacity objects are retired between two collects
+            overflowCount.fetch_add(1, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(overflowMutex);
+            overflow.push_back(entry);
+            overflowPending.store(true, std::memory_order_release);
+        }
+
+        void destroy(const Entry& entry) {
+            switch (entry.type) {
+            case Type::CommandPool: device.destroyCommandPool(fromHandle<vk::CommandPool>(entry.handle)); break;
+            case Type::Framebuffer: device.destroyFramebuffer(fromHandle<vk::Framebuffer>(entry.handle)); break;
+            case Type::RenderPass: device.destroyRenderPass(fromHandle<vk::RenderPass>(entry.handle)); break;
+            case Type::Pipeline: device.destroyPipeline(fromHandle<vk::Pipeline>(entry.handle)); break;
+            case Type::PipelineLayout: device.destroyPipelineLayout(fromHandle<vk::PipelineLayout>(entry.handle)); break;
+            case Type::DescriptorPool: device.destroyDescriptorPool(fromHandle<vk::DescriptorPool>(entry.handle)); break;
+            case Type::DescriptorSetLayout: device.destroyDescriptorSetLayout(fromHandle<vk::DescriptorSetLayout>(entry.handle)); break;
+            case Type::ShaderModule: device.destroyShaderModule(fromHandle<vk::ShaderModule>(entry.handle)); break;
+            case Type::ImageView: device.destroyImageView(fromHandle<vk::ImageView>(entry.handle)); break;
+            case Type::Sampler: device.destroySampler(fromHandle<vk::Sampler>(entry.handle)); break;
+            case Type::QueryPool: device.destroyQueryPool(fromHandle<vk::QueryPool>(entry.handle)); break;
+            case Type::Semaphore: device.destroySemaphore(fromHandle<vk::Semaphore>(entry.handle)); break;
+            case Type::Fence: device.destroyFence(fromHandle<vk::Fence>(entry.handle)); break;
+            case Type::Event: device.destroyEvent(fromHandle<vk::Event>(entry.handle)); break;
+            case Type::Buffer: device.destroyBuffer(fromHandle<vk::Buffer>(entry.handle)); break;
+            case Type::Image: device.destroyImage(fromHandle<vk::Image>(entry.handle)); break;
+            case Type::DeviceMemory: device.freeMemory(fromHandle<vk::DeviceMemory>(entry.handle)); break;
+            case Type::Allocation: {
+                MemoryAllocation allocation;
+                allocation.allocator = (MemoryAllocator*)(uintptr_t)entry.parent;
+                allocation.block = (MemoryBlock*)(uintptr_t)entry.handle;
+                allocation.offset = entry.offset;
+                allocation.size = entry.size;
+                allocation.allocator->free(allocation);
+                break;
+            }
+            case Type::CommandBuffer: assert(false); break;
+            }
+        }
+
+        static const size_t QueueCapacity = 16384;
+
+        vk::Device device;
+        MpscQueue<Entry, QueueCapacity> queue;
+        std::atomic<uint64_t> retiredCount{ 0 };
+        std::atomic<uint64_t> overflowCount{ 0 };
+        std::mutex overflowMutex;
+        std::vector<Entry> overflow;
+        std::atomic<bool> overflowPending{ false };
+
+        // Owner thread state, buckets keep their capacity so the steady state doesn't allocate
+        std::vector<std::vector<Entry>> frames;
+        std::vector<vk::CommandBuffer> cmdBufferScratch;
+        Stats stats;
+    };
+}
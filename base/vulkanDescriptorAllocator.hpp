@@ -0,0 +1,307 @@
+/*
+* Growable descriptor set allocator
+*
+* Persistent sets come from a chain of generically sized pools, a new pool is added whenever the
+* current one is exhausted.  Transient sets only live for one frame: every frame slot owns the
+* pools its transient sets came from, and those pools are reset and returned to a free list when
+* the slot is reused.  Persistent sets can also be cached by their layout and bindings, so
+* identical requests share one set instead of allocating and writing a new one.  The allocator
+* is meant to be used from the thread recording the frames.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <unordered_map>
+
+#include "common.hpp"
+
+namespace vkx {
+
+    // Resource bound to a descriptor set binding, used to describe cached sets
+    struct DescriptorBinding {
+        uint32_t binding{ 0 };
+        vk::DescriptorType type{ vk::DescriptorType::eUniformBuffer };
+        vk::DescriptorBufferInfo bufferInfo;
+        vk::DescriptorImageInfo imageInfo;
+
+        static DescriptorBinding buffer(uint32_t binding, vk::DescriptorType type, const vk::DescriptorBufferInfo& bufferInfo) {
+            DescriptorBinding result;
+            result.binding = binding;
+            result.type = type;
+            result.bufferInfo = bufferInfo;
+            return result;
+        }
+
+        static DescriptorBinding image(uint32_t binding, vk::DescriptorType type, const vk::DescriptorImageInfo& imageInfo) {
+            DescriptorBinding result;
+            result.binding = binding;
+            result.type = type;
+            result.imageInfo = imageInfo;
+            return result;
+        }
+
+        bool isImage() const {
+            switch (type) {
+            case vk::DescriptorType::eSampler:
+            case vk::DescriptorType::eCombinedImageSampler:
+            case vk::DescriptorType::eSampledImage:
+            case vk::DescriptorType::eStorageImage:
+            case vk::DescriptorType::eInputAttachment:
+                return true;
+            default:
+                return false;
+            }
+        }
+    };
+
+    class DescriptorAllocator {
+    public:
+        struct Stats {
+            uint64_t poolsCreated{ 0 };
+            uint64_t poolResets{ 0 };
+            uint64_t persistentSets{ 0 };
+            uint64_t transientSets{ 0 };
+            uint64_t cacheHits{ 0 };
+            uint64_t cacheMisses{ 0 };
+            // Frames that had to create a pool or allocate a persistent set, zero in the steady state
+            uint64_t allocatingFrames{ 0 };
+            uint64_t frames{ 0 };
+        };
+
+        // Every pool holds setsPerPool sets, with descriptors of each type in proportion to the default ratios
+        explicit DescriptorAllocator(const vk::Device& device, uint32_t setsPerPool = 256) : device(device), setsPerPool(setsPerPool) {
+            poolRatios = {
+                { vk::DescriptorType::eSampler, 0.5f },
+                { vk::DescriptorType::eCombinedImageSampler, 4.0f },
+                { vk::DescriptorType::eSampledImage, 2.0f },
+                { vk::DescriptorType::eStorageImage, 1.0f },
+                { vk::DescriptorType::eUniformTexelBuffer, 0.5f },
+                { vk::DescriptorType::eStorageTexelBuffer, 0.5f },
+                { vk::DescriptorType::eUniformBuffer, 2.0f },
+                { vk::DescriptorType::eStorageBuffer, 2.0f },
+                { vk::DescriptorType::eUniformBufferDynamic, 1.0f },
+                { vk::DescriptorType::eStorageBufferDynamic, 0.5f },
+                { vk::DescriptorType::eInputAttachment, 0.5f },
+            };
+        }
+
+        DescriptorAllocator(const DescriptorAllocator&) = delete;
+        DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+        void destroy() {
+            for (const auto& pool : persistentPools) {
+                device.destroyDescriptorPool(pool);
+            }
+            persistentPools.clear();
+            for (auto& frame : frames) {
+                for (const auto& pool : frame.pools) {
+                    device.destroyDescriptorPool(pool);
+                }
+                frame.pools.clear();
+            }
+            for (const auto& pool : freePools) {
+                device.destroyDescriptorPool(pool);
+            }
+            freePools.clear();
+            cache.clear();
+        }
+
+        // Resets the transient pools of the frame slot, call once its fence has signalled
+        void beginFrame(uint32_t frame) {
+            if (allocatedThisFrame) {
+                ++stats.allocatingFrames;
+            }
+            allocatedThisFrame = false;
+            ++stats.frames;
+
+            if (frame >= frames.size()) {
+                frames.resize(frame + 1);
+            }
+            currentFrame = frame;
+            for (const auto& pool : frames[frame].pools) {
+                device.resetDescriptorPool(pool);
+                freePools.push_back(pool);
+                ++stats.poolResets;
+            }
+            frames[frame].pools.clear();
+            frames[frame].remainingSets = 0;
+        }
+
+        // Set living until the allocator is destroyed
+        vk::DescriptorSet allocate(const vk::DescriptorSetLayout& layout) {
+            allocatedThisFrame = true;
+            ++stats.persistentSets;
+            if (persistentPools.empty() || !persistentRemainingSets) {
+                persistentPools.push_back(createPool());
+                persistentRemainingSets = setsPerPool;
+            }
+            vk::DescriptorSet result;
+            if (!tryAllocate(persistentPools.back(), layout, result)) {
+                // Out of descriptors of one of the types before running out of sets
+                persistentPools.push_back(createPool());
+                persistentRemainingSets = setsPerPool;
+                if (!tryAllocate(persistentPools.back(), layout, result)) {
+                    throw std::runtime_error("Descriptor set layout doesn't fit an empty descriptor pool");
+                }
+            }
+            --persistentRemainingSets;
+            return result;
+        }
+
+        // Set valid for the current frame only, it must not be referenced by command buffers of later frames
+        vk::DescriptorSet allocateTransient(const vk::DescriptorSetLayout& layout) {
+            if (frames.empty()) {
+                beginFrame(0);
+            }
+            ++stats.transientSets;
+            Frame& frame = frames[currentFrame];
+            if (frame.pools.empty() || !frame.remainingSets) {
+                frame.pools.push_back(acquireTransientPool());
+                frame.remainingSets = setsPerPool;
+            }
+            vk::DescriptorSet result;
+            if (!tryAllocate(frame.pools.back(), layout, result)) {
+                frame.pools.push_back(acquireTransientPool());
+                frame.remainingSets = setsPerPool;
+                if (!tryAllocate(frame.pools.back(), layout, result)) {
+                    throw std::runtime_error("Descriptor set layout doesn't fit an empty descriptor pool");
+                }
+            }
+            --frame.remainingSets;
+            return result;
+        }
+
+        // Persistent set with the given bindings written, shared by all requests with the same layout
+        // and bindings.  Cached sets are never freed, so only cache sets of long lived resources.
+        vk::DescriptorSet getCachedSet(const vk::DescriptorSetLayout& layout, const std::vector<DescriptorBinding>& bindings) {
+            keyScratch.clear();
+            keyScratch.push_back(toKey(layout));
+            for (const auto& binding : bindings) {
+                keyScratch.push_back(((uint64_t)binding.binding << 32) | (uint64_t)binding.type);
+                if (binding.isImage()) {
+                    keyScratch.push_back(toKey(binding.imageInfo.sampler));
+                    keyScratch.push_back(toKey(binding.imageInfo.imageView));
+                    keyScratch.push_back((uint64_t)binding.imageInfo.imageLayout);
+                } else {
+                    keyScratch.push_back(toKey(binding.bufferInfo.buffer));
+                    keyScratch.push_back(binding.bufferInfo.offset);
+                    keyScratch.push_back(binding.bufferInfo.range);
+                }
+            }
+            uint64_t hash = 14695981039346656037ull;
+            for (uint64_t value : keyScratch) {
+                hash = (hash ^ value) * 1099511628211ull;
+            }
+
+            auto& entries = cache[hash];
+            for (const auto& entry : entries) {
+                if (entry.key == keyScratch) {
+                    ++stats.cacheHits;
+                    return entry.set;
+                }
+            }
+            ++stats.cacheMisses;
+
+            vk::DescriptorSet set = allocate(layout);
+            std::vector<vk::WriteDescriptorSet> writes;
+            writes.reserve(bindings.size());
+            for (const auto& binding : bindings) {
+                vk::WriteDescriptorSet write;
+                write.dstSet = set;
+                write.dstBinding = binding.binding;
+                write.descriptorCount = 1;
+                write.descriptorType = binding.type;
+                if (binding.isImage()) {
+                    write.pImageInfo = &binding.imageInfo;
+                } else {
+                    write.pBufferInfo = &binding.bufferInfo;
+                }
+                writes.push_back(write);
+            }
+            device.updateDescriptorSets(writes, {});
+            entries.push_back({ keyScratch, set });
+            return set;
+        }
+
+        const Stats& getStats() const {
+            return stats;
+        }
+
+    private:
+        struct Frame {
+            std::vector<vk::DescriptorPool> pools;
+            uint32_t remainingSets{ 0 };
+        };
+
+        struct CacheEntry {
+            std::vector<uint64_t> key;
+            vk::DescriptorSet set;
+        };
+
+        template <typename T>
+        static uint64_t toKey(const T& handle) {
+            uint64_t result = 0;
+            memcpy(&result, &handle, sizeof(T));
+            return result;
+        }
+
+        vk::DescriptorPool createPool() {
+            allocatedThisFrame = true;
+            ++stats.poolsCreated;
+            std::vector<vk::DescriptorPoolSize> poolSizes;
+            for (const auto& ratio : poolRatios) {
+                poolSizes.push_back(vk::DescriptorPoolSize(ratio.first, std::max(1u, (uint32_t)(ratio.second * setsPerPool))));
+            }
+            vk::DescriptorPoolCreateInfo poolInfo;
+            poolInfo.maxSets = setsPerPool;
+            poolInfo.poolSizeCount = (uint32_t)poolSizes.size();
+            poolInfo.pPoolSizes = poolSizes.data();
+            return device.createDescriptorPool(poolInfo);
+        }
+
+        vk::DescriptorPool acquireTransientPool() {
+            if (freePools.empty()) {
+                return createPool();
+            }
+            vk::DescriptorPool pool = freePools.back();
+            freePools.pop_back();
+            return pool;
+        }
+
+        // Exhausted pools report different errors depending on the implementation, so any failure moves on to a new pool
+        bool tryAllocate(const vk::DescriptorPool& pool, const vk::DescriptorSetLayout& layout, vk::DescriptorSet& result) {
+            VkDescriptorSetLayout setLayout = (VkDescriptorSetLayout)layout;
+            VkDescriptorSetAllocateInfo allocInfo = {};
+            allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+            allocInfo.descriptorPool = (VkDescriptorPool)pool;
+            allocInfo.descriptorSetCount = 1;
+            allocInfo.pSetLayouts = &setLayout;
+            VkDescriptorSet set = VK_NULL_HANDLE;
+            if (VK_SUCCESS != vkAllocateDescriptorSets((VkDevice)device, &allocInfo, &set)) {
+                return false;
+            }
+            result = vk::DescriptorSet(set);
+            return true;
+        }
+
+        vk::Device device;
+        uint32_t setsPerPool;
+        std::vector<std::pair<vk::DescriptorType, float>> poolRatios;
+
+        std::vector<vk::DescriptorPool> persistentPools;
+        uint32_t persistentRemainingSets{ 0 };
+
+        std::vector<Frame> frames;
+        uint32_t currentFrame{ 0 };
+        // Reset transient pools ready for reuse
+        std::vector<vk::DescriptorPool> freePools;
+
+        std::unordered_map<uint64_t, std::vector<CacheEntry>> cache;
+        std::vector<uint64_t> keyScratch;
+
+        bool allocatedThisFrame{ false };
+        Stats stats;
+    };
+}
@@ -8,6 +8,7 @@
 #pragma once
 
 #include "vulkanExampleBase.h"
+#include "json.hpp"
 
 using namespace vkx;
 
@@ -19,15 +20,20 @@ ExampleBase::ExampleBase(bool enableValidation) : swapChain(*this) {
     assert(libLoaded);
 #else
 
-#ifdef WIN32
-    for (int32_t i = 0; i < __argc; i++) {
-        if (__argv[i] == std::string("-validation")) {
-            enableValidation = true;
-        }
+    if (hasCommandLineFlag("-validation")) {
+        enableValidation = true;
     }
-#endif
 
-    glfwInit();
+    enableGpuProfiler = hasCommandLineFlag("-profile");
+    optimizeMeshes = !hasCommandLineFlag("-rawmeshes");
+    headless = hasCommandLineFlag("-headless");
+    if (headless) {
+        benchmark.frameCount = std::max(1, atoi(getCommandLineOption("-frames", "300").c_str()));
+        benchmark.warmupFrames = std::max(0, atoi(getCommandLineOption("-warmup", "10").c_str()));
+        benchmark.outputPath = getCommandLineOption("-benchmark", getExecutableName() + "_benchmark");
+    } else {
+        glfwInit();
+    }
     // Android Vulkan initialization is handled in APP_CMD_INIT_WINDOW event
     initVulkan(enableValidation);
 #endif
@@ -40,11 +46,7 @@ ExampleBase::~ExampleBase() {
     if (descriptorPool) {
         device.destroyDescriptorPool(descriptorPool);
     }
-    if (!primaryCmdBuffers.empty()) {
-        device.freeCommandBuffers(cmdPool, primaryCmdBuffers);
-        primaryCmdBuffers.clear();
-    }
-    if (!drawCmdBuffers.empty()) {
+    if (!drawCmdBuffers.empty() && drawCmdBufferPools.empty()) {
         device.freeCommandBuffers(cmdPool, drawCmdBuffers);
         drawCmdBuffers.clear();
     }
@@ -62,6 +64,15 @@ ExampleBase::~ExampleBase() {
     }
     depthStencil.destroy();
 
+    if (textureStreamer) {
+        auto stats = textureStreamer->getStats();
+        if (statsEnabled()) {
+            std::cout << "Texture streaming: " << stats.completed << " of " << stats.requested << " textures, " << stats.bytesUploaded
+                << " bytes in " << stats.batches << " batches, " << stats.failed << " failed" << std::endl;
+        }
+        textureStreamer.reset();
+    }
+
     if (textureLoader) {
         delete textureLoader;
     }
@@ -70,16 +81,50 @@ ExampleBase::~ExampleBase() {
         delete textOverlay;
     }
 
-    device.destroySemaphore(semaphores.acquireComplete);
-    device.destroySemaphore(semaphores.renderComplete);
+    destroyFrameSlots();
+
+    if (frameTimes.getCount() && statsEnabled()) {
+        std::cout << std::fixed << std::setprecision(2) << "Frame time: p50 " << frameTimes.percentile(0.5f) << " ms, p95 "
+            << frameTimes.percentile(0.95f) << " ms, p99 " << frameTimes.percentile(0.99f) << " ms, max " << frameTimes.getMax()
+            << " ms over " << frameTimes.getCount() << " frames" << std::endl;
+    }
+    if (enableGpuProfiler) {
+        writeCpuTrace();
+    }
+
+    if (gpuProfiler) {
+        // Frames still in flight at shutdown aren't part of the trace
+        std::string tracePath = getExecutableName() + "_gpu_trace.json";
+        if (gpuProfiler->writeChromeTrace(tracePath)) {
+            std::cout << "GPU trace: " << gpuProfiler->getTraceEventCount() << " zones written to " << tracePath
+                << ", " << gpuProfiler->getDroppedFrames() << " frames dropped" << std::endl;
+        }
+        gpuProfiler->destroy();
+        gpuProfiler.reset();
+    }
+
+    // Command buffers recorded in parallel are freed with their worker pools, so everything
+    // still referencing them has to be released first
+    if (!workerCmdPools.empty()) {
+        device.waitIdle();
+        deletionQueue->releaseAll();
+        for (const auto& pool : workerCmdPools) {
+            device.destroyCommandPool(pool);
+        }
+        workerCmdPools.clear();
+        drawCmdBuffers.clear();
+        drawCmdBufferPools.clear();
+    }
 
     destroyContext();
 
 #if defined(__ANDROID__)
     // todo : android cleanup (if required)
 #else
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if (!headless) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
 #endif
 }
 
@@ -92,16 +137,28 @@ void ExampleBase::run() {
     state->onInputEvent = VulkanExample::handleAppInput;
     androidApp = state;
 #else
-    setupWindow(); 
+    if (headless) {
+        camera.setAspectRatio(size);
+    } else {
+        setupWindow();
+    }
 
 //	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
 
 
     prepare();
+    if (statsEnabled()) {
+        std::cout << "Pipelines: " << pipelineStats->count << " created in " << pipelineStats->getMilliseconds() << " ms, "
+            << (pipelineStats->initialCacheSize ? "warm" : "cold") << " pipeline cache (" << pipelineStats->initialCacheSize << " bytes loaded)" << std::endl;
+    }
 #endif
 
-    renderLoop();
+    if (headless) {
+        runBenchmark();
+    } else {
+        renderLoop();
+    }
 
     // Once we exit the render loop, wait for everything to become idle before proceeding to the descructor.
     queue.waitIdle();
@@ -113,17 +170,11 @@ void ExampleBase::initVulkan(bool enableValidation) {
     // Find a suitable depth format
     depthFormat = getSupportedDepthFormat(physicalDevice);
 
-    // Create synchronization objects
-    vk::SemaphoreCreateInfo semaphoreCreateInfo;
-    // Create a semaphore used to synchronize image presentation
-    // Ensures that the image is displayed before we start submitting new commands to the queu
-    semaphores.acquireComplete = device.createSemaphore(semaphoreCreateInfo);
-    // Create a semaphore used to synchronize command submission
-    // Ensures that the image is not presented until all commands have been sumbitted and executed
-    semaphores.renderComplete = device.createSemaphore(semaphoreCreateInfo);
+    // Create the per frame synchronization objects and command pools
+    createFrameSlots();
 
     // Set up submit info structure
-    // Semaphores will stay the same during application lifetime
+    // The semaphore members are pointed at the current frame slot's semaphores by prepareFrame
     // Command buffer submission info is set by each example
     submitInfo = vk::SubmitInfo();
     submitInfo.pWaitDstStageMask = &submitPipelineStages;
@@ -163,10 +214,14 @@ void ExampleBase::renderLoop() {
         // Render frame
         if (prepared) {
             auto tStart = std::chrono::high_resolution_clock::now();
-            render();
+            {
+                VKX_CPU_ZONE("Render");
+                render();
+            }
             frameCounter++;
             auto tEnd = std::chrono::high_resolution_clock::now();
             auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+            frameTimes.add((float)tDiff);
             frameTimer = tDiff / 1000.0f;
             // Convert to clamped timer value
             if (!paused) {
@@ -186,11 +241,18 @@ void ExampleBase::renderLoop() {
     }
 #else
     auto tStart = std::chrono::high_resolution_clock::now();
+    bool firstFrame = true;
     while (!glfwWindowShouldClose(window)) {
+        VKX_CPU_ZONE("Frame");
         auto tEnd = std::chrono::high_resolution_clock::now();
         auto tDiff = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
         auto tDiffSeconds = tDiff / 1000.0f;
         tStart = tEnd;
+        // The first interval includes everything since the loop was entered
+        if (!firstFrame) {
+            frameTimes.add(tDiff);
+        }
+        firstFrame = false;
         glfwPollEvents();
 
         if (glfwJoystickPresent(0)) {
@@ -243,14 +305,28 @@ void ExampleBase::renderLoop() {
             memset(&gamePadState.axes, 0, sizeof(gamePadState.axes));
         }
 
-
-        render();
-        update(tDiffSeconds);
-
+        {
+            VKX_CPU_ZONE("Render");
+            render();
+        }
+        {
+            VKX_CPU_ZONE("Update");
+            update(tDiffSeconds);
+        }
     }
 #endif
 }
 
+void ExampleBase::writeCpuTrace() {
+    std::string tracePath = getExecutableName() + "_cpu_trace.json";
+    int64_t zoneCount = CpuProfiler::writeChromeTrace(tracePath);
+    if (zoneCount >= 0) {
+        std::cout << "CPU trace: " << zoneCount << " zones written to " << tracePath << std::endl;
+    } else {
+        std::cout << "CPU trace: failed to write " << tracePath << std::endl;
+    }
+}
+
 std::string ExampleBase::getWindowTitle() {
     std::string device(deviceProperties.deviceName);
     std::string windowTitle;
@@ -271,12 +347,28 @@ void ExampleBase::prepare() {
     }
     cmdPool = getCommandPool();
 
-    swapChain.create(size, enableVsync);
+    if (headless) {
+        swapChain.createOffscreen(size, framesInFlight + 1);
+    } else {
+        swapChain.create(size, enableVsync);
+    }
     setupDepthStencil();
     setupRenderPass();
     setupRenderPassBeginInfo();
     setupFrameBuffer();
 
+    if (enableGpuProfiler) {
+        if (GpuProfiler::isSupported(*this)) {
+            gpuProfiler = std::make_unique<GpuProfiler>(*this, framesInFlight);
+        } else {
+            std::cout << "GPU profiler disabled, the graphics queue doesn't support timestamps" << std::endl;
+        }
+    }
+
+    // Created here rather than with the frame slots, so derived constructors can change their sizes
+    uniformArena.create(*this, framesInFlight, frameUniformArenaSize);
+    updateQueue.create(*this, framesInFlight, frameUpdateStagingSize);
+
     // Create a simple texture loader class
     textureLoader = new TextureLoader(*this);
 #if defined(__ANDROID__)
@@ -291,14 +383,41 @@ void ExampleBase::prepare() {
         updateTextOverlay();
     }
 }
-MeshBuffer ExampleBase::loadMesh(const std::string& filename, const MeshLayout& vertexLayout, float scale) {
+MeshBuffer ExampleBase::loadMesh(const std::string& filename, const MeshLayout& vertexLayout, float scale, uint32_t lodCount, uint32_t options) {
     MeshLoader loader;
 #if defined(__ANDROID__)
     loader.assetManager = androidApp->activity->assetManager;
 #endif
-    loader.load(filename);
-    assert(loader.m_Entries.size() > 0);
-    return loader.createBuffers(*this, vertexLayout, scale);
+    loader.options = options | (optimizeMeshes ? MeshLoader::OPTION_OPTIMIZE : 0);
+    loader.lodCount = lodCount;
+    // Converts the meshes of a scene on the worker threads
+    loader.jobSystem = &getJobSystem();
+    auto start = std::chrono::high_resolution_clock::now();
+    MeshBuffer result = loader.loadBuffers(*this, filename, vertexLayout, scale);
+    auto duration = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start);
+    if (!statsEnabled()) {
+        return result;
+    }
+    // Compare a cold start (Assimp import) with a warm one (cache hit) by running an example twice
+    std::cout << "Mesh " << filename << (loader.loadedFromCache ? " loaded from cache" : " imported") << " in " << duration.count() << " ms, peak memory " << getPeakMemoryMB() << " MB" << std::endl;
+    if (optimizeMeshes && !loader.loadedFromCache) {
+        const auto& stats = loader.optimizeStats;
+        std::cout << "    vertices " << stats.verticesBefore << " -> " << stats.verticesAfter
+            << ", ACMR " << stats.cacheBefore.acmr << " -> " << stats.cacheAfter.acmr
+            << ", ATVR " << stats.cacheBefore.atvr << " -> " << stats.cacheAfter.atvr
+            << ", overfetch " << stats.fetchBefore.overfetch << " -> " << stats.fetchAfter.overfetch << std::endl;
+    }
+    if (result.lods.size() > 1) {
+        std::cout << "    LOD triangles";
+        for (const auto& lod : result.lods) {
+            std::cout << " " << lod.indexCount / 3 << " (error " << lod.error << ")";
+        }
+        std::cout << std::endl;
+    }
+    if (!result.clusters.empty()) {
+        std::cout << "    clusters " << result.clusters.size() << ", " << result.indexCount / 3 / result.clusters.size() << " triangles average" << std::endl;
+    }
+    return result;
 }
 
 vk::SubmitInfo ExampleBase::prepareSubmitInfo(
@@ -324,32 +443,411 @@ void ExampleBase::updateTextOverlay() {
 
     std::stringstream ss;
     ss << std::fixed << std::setprecision(2) << (frameTimer * 1000.0f) << "ms (" << lastFPS << " fps)";
+    ss << ", draw recording " << drawRecordTime << "ms";
+    if (drawChunkCount > 1) {
+        ss << " (" << drawChunkCount << " chunks)";
+    }
     textOverlay->addText(ss.str(), 5.0f, 25.0f, TextOverlay::alignLeft);
     textOverlay->addText(deviceProperties.deviceName, 5.0f, 45.0f, TextOverlay::alignLeft);
+    if (frameTimes.getCount()) {
+        std::stringstream frameTimeText;
+        frameTimeText << std::fixed << std::setprecision(2) << "frame p50 " << frameTimes.percentile(0.5f) << "ms, p95 "
+            << frameTimes.percentile(0.95f) << "ms, p99 " << frameTimes.percentile(0.99f) << "ms";
+        textOverlay->addText(frameTimeText.str(), 5.0f, 65.0f, TextOverlay::alignLeft);
+    }
+    if (gpuProfiler) {
+        // Per pass breakdown anchored to the bottom left, nested zones are indented
+        std::vector<std::string> lines;
+        for (const auto& zone : gpuProfiler->getResults()) {
+            std::stringstream line;
+            line << std::fixed << std::setprecision(3) << std::string(zone.depth * 2, ' ') << zone.name << " " << zone.duration << "ms";
+            lines.push_back(line.str());
+        }
+        if (gpuProfiler->hasStatistics()) {
+            const auto& statistics = gpuProfiler->getStatistics();
+            std::stringstream line;
+            line << "VS " << statistics.vertexShaderInvocations << ", FS " << statistics.fragmentShaderInvocations
+                << ", primitives " << statistics.clippingPrimitives;
+            lines.push_back(line.str());
+        }
+        float y = (float)size.height - 20.0f * (lines.size() + 1);
+        for (const auto& line : lines) {
+            textOverlay->addText(line, 5.0f, y, TextOverlay::alignLeft);
+            y += 20.0f;
+        }
+    }
     getOverlayText(textOverlay);
     textOverlay->endTextUpdate();
 
-    trashCommandBuffers(textCmdBuffers);
     populateSubCommandBuffers(textCmdBuffers, [&](const vk::CommandBuffer& cmdBuffer) {
         textOverlay->writeCommandBuffer(cmdBuffer);
     });
-    primaryCmdBuffersDirty = true;
 }
 
 void ExampleBase::getOverlayText(vkx::TextOverlay *textOverlay) {
     // Can be overriden in derived class
 }
 
+void ExampleBase::createFrameSlots() {
+    vk::SemaphoreCreateInfo semaphoreCreateInfo;
+    vk::CommandPoolCreateInfo cmdPoolInfo;
+    cmdPoolInfo.queueFamilyIndex = graphicsQueueIndex;
+    cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient;
+
+    frameSlots.resize(framesInFlight);
+    for (auto& slot : frameSlots) {
+        slot.fence = device.createFence(vk::FenceCreateInfo());
+        // Signalled once the image is acquired, waited on by the frame submit
+        slot.acquireComplete = device.createSemaphore(semaphoreCreateInfo);
+        // Signalled by the frame submit, waited on by the presentation
+        slot.renderComplete = device.createSemaphore(semaphoreCreateInfo);
+        slot.cmdPool = device.createCommandPool(cmdPoolInfo);
+
+        vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
+        cmdBufAllocateInfo.commandPool = slot.cmdPool;
+        cmdBufAllocateInfo.commandBufferCount = headless ? 3 : 1;
+        auto cmdBuffers = device.allocateCommandBuffers(cmdBufAllocateInfo);
+        slot.primaryCmdBuffer = cmdBuffers[0];
+        if (headless) {
+            slot.acquireCmdBuffer = cmdBuffers[1];
+            slot.presentCmdBuffer = cmdBuffers[2];
+        }
+    }
+    frameSlotIndex = 0;
+    semaphores.acquireComplete = frameSlots[0].acquireComplete;
+    semaphores.renderComplete = frameSlots[0].renderComplete;
+
+    if (headless && physicalDevice.getQueueFamilyProperties()[graphicsQueueIndex].timestampValidBits) {
+        vk::QueryPoolCreateInfo queryPoolInfo;
+        queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+        queryPoolInfo.queryCount = framesInFlight * 2;
+        benchmark.queryPool = device.createQueryPool(queryPoolInfo);
+    }
+}
+
+void ExampleBase::destroyFrameSlots() {
+    device.waitIdle();
+    deletionQueue->releaseAll();
+    for (auto& slot : frameSlots) {
+        spareSubCmdBuffers.insert(spareSubCmdBuffers.end(), slot.retiredSubCmdBuffers.begin(), slot.retiredSubCmdBuffers.end());
+        device.destroyCommandPool(slot.cmdPool);
+        device.destroySemaphore(slot.renderComplete);
+        device.destroySemaphore(slot.acquireComplete);
+        device.destroyFence(slot.fence);
+    }
+    frameSlots.clear();
+    if (!spareSubCmdBuffers.empty()) {
+        device.freeCommandBuffers(getCommandPool(), spareSubCmdBuffers);
+        spareSubCmdBuffers.clear();
+    }
+    auto arenaStats = uniformArena.getStats();
+    if (arenaStats.allocations && statsEnabled()) {
+        std::cout << "Uniform arena: " << arenaStats.allocations << " allocations, " << arenaStats.bytes / 1024 << " KiB over "
+            << arenaStats.frames << " frames, at most " << arenaStats.peakFrameBytes / 1024 << " KiB per frame, one buffer mapped once" << std::endl;
+    }
+    uniformArena.destroy();
+    auto updateStats = updateQueue.getStats();
+    if (updateStats.updates && statsEnabled()) {
+        std::cout << "Update queue: " << updateStats.updates << " updates (" << updateStats.bytes / 1024 << " KiB) coalesced into "
+            << updateStats.copyRegions << " copy regions (" << updateStats.bytesCopied / 1024 << " KiB) in " << updateStats.copyCommands
+            << " copy commands over " << updateStats.frames << " frames, at most " << updateStats.peakFrameBytes / 1024 << " KiB staged per frame" << std::endl;
+    }
+    updateQueue.destroy();
+    if (benchmark.queryPool) {
+        device.destroyQueryPool(benchmark.queryPool);
+        benchmark.queryPool = vk::QueryPool();
+    }
+    semaphores.acquireComplete = vk::Semaphore();
+    semaphores.renderComplete = vk::Semaphore();
+}
+
+void ExampleBase::beginFrameSlot() {
+    frameSlotIndex = (frameSlotIndex + 1) % (uint32_t)frameSlots.size();
+    FrameSlot& slot = frameSlots[frameSlotIndex];
+    // This is where the CPU waits for the GPU.  It only blocks when the CPU is framesInFlight frames ahead,
+    // so the preparation of this frame overlaps the execution of the previous ones.
+    if (slot.submitted) {
+        VKX_CPU_ZONE("Wait for frame slot");
+        device.waitForFences(slot.fence, VK_TRUE, UINT64_MAX);
+        device.resetFences(slot.fence);
+        slot.submitted = false;
+        readBenchmarkTimestamps(frameSlotIndex);
+    }
+    deletionQueue->release(frameSlotIndex);
+    spareSubCmdBuffers.insert(spareSubCmdBuffers.end(), slot.retiredSubCmdBuffers.begin(), slot.retiredSubCmdBuffers.end());
+    slot.retiredSubCmdBuffers.clear();
+    descriptorAllocator->beginFrame(frameSlotIndex);
+    device.resetCommandPool(slot.cmdPool, vk::CommandPoolResetFlags());
+    uniformArena.beginFrame(frameSlotIndex);
+    updateQueue.beginFrame(frameSlotIndex);
+    semaphores.acquireComplete = slot.acquireComplete;
+    semaphores.renderComplete = slot.renderComplete;
+}
+
+void ExampleBase::waitForFrameSlots() {
+    std::vector<vk::Fence> fences;
+    for (const auto& slot : frameSlots) {
+        if (slot.submitted) {
+            fences.push_back(slot.fence);
+        }
+    }
+    if (!fences.empty()) {
+        VKX_CPU_ZONE("Wait for frame slots");
+        device.waitForFences(fences, VK_TRUE, UINT64_MAX);
+    }
+}
+
 void ExampleBase::prepareFrame() {
-    if (primaryCmdBuffersDirty) {
-        buildCommandBuffers();
+    VKX_CPU_ZONE("Prepare frame");
+    uint64_t createdObjectCount = getCreatedObjectCount();
+    frameCreatedObjectCount = createdObjectCount - lastCreatedObjectCount;
+    lastCreatedObjectCount = createdObjectCount;
+
+    bool rerecord = false;
+    if (textureStreamer && textureStreamer->update()) {
+        // The callbacks may rewrite descriptor sets referenced by the frames in flight, which also
+        // invalidates the draw command buffers recorded with them.  This only happens when textures arrive.
+        waitForFrameSlots();
+        textureStreamer->dispatchReady();
+        rerecord = true;
+    }
+
+    beginFrameSlot();
+    frameSubmitTime = 0.0f;
+
+    // Swap the fallbacks the draw commands were recorded with for the pipelines that finished compiling
+    uint64_t completedAsyncCount = stateCache->getCompletedAsyncCount();
+    if (completedAsyncCount != asyncPipelineCount) {
+        asyncPipelineCount = completedAsyncCount;
+        rerecord = true;
+    }
+    if (rerecord) {
+        updateDrawCommandBuffers();
+    }
+    if (headless) {
+        acquireOffscreenImage();
+    } else {
+        // Acquire the next image from the swap chaing
+        currentBuffer = swapChain.acquireNextImage(semaphores.acquireComplete);
     }
-    // Acquire the next image from the swap chaing
-    currentBuffer = swapChain.acquireNextImage(semaphores.acquireComplete);
 }
 
 void ExampleBase::submitFrame() {
-    swapChain.queuePresent(semaphores.renderComplete);
+    VKX_CPU_ZONE("Submit frame");
+    if (headless) {
+        presentOffscreenImage();
+    } else {
+        swapChain.queuePresent(semaphores.renderComplete);
+    }
+}
+
+void ExampleBase::acquireOffscreenImage() {
+    FrameSlot& slot = getFrameSlot();
+    currentBuffer = (currentBuffer + 1) % swapChain.imageCount;
+
+    // Signal the acquire semaphore the frame's submits wait on, as the swap chain would
+    vk::SubmitInfo acquireInfo;
+    acquireInfo.signalSemaphoreCount = 1;
+    acquireInfo.pSignalSemaphores = &semaphores.acquireComplete;
+    if (benchmark.queryPool) {
+        uint32_t query = frameSlotIndex * 2;
+        vk::CommandBufferBeginInfo cmdBufInfo;
+        cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+        slot.acquireCmdBuffer.begin(cmdBufInfo);
+        slot.acquireCmdBuffer.resetQueryPool(benchmark.queryPool, query, 2);
+        slot.acquireCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, benchmark.queryPool, query);
+        slot.acquireCmdBuffer.end();
+        acquireInfo.commandBufferCount = 1;
+        acquireInfo.pCommandBuffers = &slot.acquireCmdBuffer;
+        slot.benchmarkFrame = benchmark.currentFrame;
+    }
+    auto queueLock = lockQueue();
+    queue.submit(acquireInfo, vk::Fence());
+}
+
+void ExampleBase::presentOffscreenImage() {
+    FrameSlot& slot = getFrameSlot();
+
+    // Consume the render semaphore as the presentation would
+    vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+    vk::SubmitInfo presentInfo;
+    presentInfo.waitSemaphoreCount = 1;
+    presentInfo.pWaitSemaphores = &semaphores.renderComplete;
+    presentInfo.pWaitDstStageMask = &waitStage;
+    if (benchmark.queryPool) {
+        // Latched once all work submitted for the frame has completed
+        vk::CommandBufferBeginInfo cmdBufInfo;
+        cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+        slot.presentCmdBuffer.begin(cmdBufInfo);
+        slot.presentCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, benchmark.queryPool, frameSlotIndex * 2 + 1);
+        slot.presentCmdBuffer.end();
+        presentInfo.commandBufferCount = 1;
+        presentInfo.pCommandBuffers = &slot.presentCmdBuffer;
+    }
+    {
+        auto queueLock = lockQueue();
+        queue.submit(presentInfo, slot.fence);
+    }
+    slot.submitted = true;
+}
+
+void ExampleBase::readBenchmarkTimestamps(uint32_t slotIndex) {
+    FrameSlot& slot = frameSlots[slotIndex];
+    if (!benchmark.queryPool || slot.benchmarkFrame == UINT32_MAX) {
+        return;
+    }
+
+    // The slot fence has signalled, so the results are available without waiting
+    std::array<uint64_t, 2> timestamps;
+    vk::ArrayProxy<uint64_t> proxy{ timestamps };
+    device.getQueryPoolResults(benchmark.queryPool, slotIndex * 2, 2, proxy, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    // The top of pipe timestamp may be latched while the previous frame is still executing, only count the
+    // time the GPU actually spent on this frame
+    uint64_t start = std::max(timestamps[0], benchmark.lastGpuEnd);
+    uint64_t end = std::max(timestamps[1], start);
+    benchmark.lastGpuEnd = end;
+    benchmark.frames[slot.benchmarkFrame].gpuTime = (float)((double)(end - start) * deviceProperties.limits.timestampPeriod / 1e6);
+    slot.benchmarkFrame = UINT32_MAX;
+}
+
+void ExampleBase::runBenchmark() {
+    // A fixed time step and a scripted camera make the frames identical from run to run
+    const float frameTime = 1.0f / 60.0f;
+    const float orbitStep = glm::two_pi<float>() / (float)benchmark.frameCount;
+    benchmark.frames.clear();
+    benchmark.frames.resize(benchmark.frameCount);
+    std::cout << "Benchmark: rendering " << benchmark.frameCount << " frames headless at " << size.width << "x" << size.height << std::endl;
+    uint64_t steadyCreatedObjects = 0;
+    for (uint32_t i = 0; i < benchmark.frameCount; ++i) {
+        benchmark.currentFrame = i;
+        camera.rotate(glm::vec2(orbitStep, 0.0f));
+        // Arriving textures and finished pipeline compiles legitimately create objects or record command buffers again
+        const bool steady = i >= benchmark.warmupFrames && (!textureStreamer || textureStreamer->isIdle()) &&
+            stateCache->getStats().asyncCompiles == stateCache->getCompletedAsyncCount() && stateCache->getCompletedAsyncCount() == asyncPipelineCount;
+        const uint64_t createdObjectsBefore = getCreatedObjectCount();
+
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        render();
+        update(frameTime);
+        auto frameEnd = std::chrono::high_resolution_clock::now();
+
+        BenchmarkFrame& frame = benchmark.frames[i];
+        frame.cpuTime = std::chrono::duration<float, std::milli>(frameEnd - frameStart).count();
+        frame.submitTime = frameSubmitTime;
+        frame.createdObjects = (uint32_t)(getCreatedObjectCount() - createdObjectsBefore);
+        if (steady) {
+            steadyCreatedObjects += frame.createdObjects;
+        }
+    }
+
+    // Collect the timestamps of the frames still in flight
+    queue.waitIdle();
+    device.waitIdle();
+    uint32_t slotCount = (uint32_t)frameSlots.size();
+    for (uint32_t i = 1; i <= slotCount; ++i) {
+        uint32_t slotIndex = (frameSlotIndex + i) % slotCount;
+        FrameSlot& slot = frameSlots[slotIndex];
+        if (slot.submitted) {
+            device.waitForFences(slot.fence, VK_TRUE, UINT64_MAX);
+            device.resetFences(slot.fence);
+            slot.submitted = false;
+        }
+        readBenchmarkTimestamps(slotIndex);
+    }
+
+    writeBenchmarkResults();
+    // Frame slots exist so that rendering a frame creates nothing, fail the run if that regressed
+    if (steadyCreatedObjects) {
+        throw std::runtime_error("Benchmark: " + std::to_string(steadyCreatedObjects) + " Vulkan objects created after the warm-up, expected none");
+    }
+}
+
+namespace {
+    struct BenchmarkSummary {
+        float mean{ 0.0f };
+        float p50{ 0.0f };
+        float p95{ 0.0f };
+        float p99{ 0.0f };
+        float max{ 0.0f };
+    };
+
+    // Negative values mark missing samples and are ignored
+    BenchmarkSummary summarize(std::vector<float> values) {
+        BenchmarkSummary result;
+        values.erase(std::remove_if(values.begin(), values.end(), [](float v) { return v < 0.0f; }), values.end());
+        if (values.empty()) {
+            return result;
+        }
+        std::sort(values.begin(), values.end());
+        auto percentile = [&](float p) {
+            return values[std::min(values.size() - 1, (size_t)(p * values.size()))];
+        };
+        for (float v : values) {
+            result.mean += v;
+        }
+        result.mean /= values.size();
+        result.p50 = percentile(0.50f);
+        result.p95 = percentile(0.95f);
+        result.p99 = percentile(0.99f);
+        result.max = values.back();
+        return result;
+    }
+
+    nlohmann::json toJson(const BenchmarkSummary& summary) {
+        nlohmann::json result;
+        result["mean"] = summary.mean;
+        result["p50"] = summary.p50;
+        result["p95"] = summary.p95;
+        result["p99"] = summary.p99;
+        result["max"] = summary.max;
+        return result;
+    }
+}
+
+void ExampleBase::writeBenchmarkResults() {
+    std::vector<float> cpuTimes, submitTimes, gpuTimes;
+    for (const auto& frame : benchmark.frames) {
+        cpuTimes.push_back(frame.cpuTime);
+        submitTimes.push_back(frame.submitTime);
+        gpuTimes.push_back(frame.gpuTime);
+    }
+    auto cpu = summarize(cpuTimes);
+    auto submit = summarize(submitTimes);
+    auto gpu = summarize(gpuTimes);
+
+    std::ofstream csv(benchmark.outputPath + ".csv");
+    csv << "frame,cpu_ms,submit_ms,created_objects,gpu_ms" << std::endl;
+    for (size_t i = 0; i < benchmark.frames.size(); ++i) {
+        const auto& frame = benchmark.frames[i];
+        csv << i << "," << frame.cpuTime << "," << frame.submitTime << "," << frame.createdObjects << ",";
+        if (frame.gpuTime >= 0.0f) {
+            csv << frame.gpuTime;
+        }
+        csv << std::endl;
+    }
+
+    nlohmann::json result;
+    result["example"] = getExecutableName();
+    result["title"] = title;
+    result["device"] = std::string(deviceProperties.deviceName);
+    result["width"] = size.width;
+    result["height"] = size.height;
+    result["frames"] = benchmark.frameCount;
+    result["framesInFlight"] = framesInFlight;
+    result["cpu_ms"] = toJson(cpu);
+    result["submit_ms"] = toJson(submit);
+    if (benchmark.queryPool) {
+        result["gpu_ms"] = toJson(gpu);
+    }
+    std::ofstream json(benchmark.outputPath + ".json");
+    json << result.dump(4) << std::endl;
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "Benchmark: cpu " << cpu.mean << " ms (p95 " << cpu.p95 << "), submit " << submit.mean << " ms (p95 " << submit.p95 << ")";
+    if (benchmark.queryPool) {
+        std::cout << ", gpu " << gpu.mean << " ms (p95 " << gpu.p95 << ")";
+    }
+    std::cout << ", written to " << benchmark.outputPath << ".csv/.json" << std::endl;
 }
 
 #if defined(__ANDROID__)
@@ -479,14 +977,10 @@ void ExampleBase::FramebufferSizeHandler(GLFWwindow* window, int width, int heig
 void ExampleBase::setupWindow() {
     bool fullscreen = false;
 
-#ifdef _WIN32
     // Check command line arguments
-    for (int32_t i = 0; i < __argc; i++) {
-        if (__argv[i] == std::string("-fullscreen")) {
-            fullscreen = true;
-        }
+    if (hasCommandLineFlag("-fullscreen")) {
+        fullscreen = true;
     }
-#endif
 
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
     auto monitor = glfwGetPrimaryMonitor();
@@ -519,7 +1013,7 @@ void ExampleBase::setupWindow() {
 #endif
 
 void ExampleBase::setupDepthStencil() {
-    depthStencil.destroy();
+    trash(depthStencil);
 
     vk::ImageAspectFlags aspect = vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
     vk::ImageCreateInfo image;
@@ -590,7 +1084,7 @@ void ExampleBase::setupRenderPass() {
     attachments[0].loadOp = vk::AttachmentLoadOp::eClear;
     attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
     attachments[0].initialLayout = vk::ImageLayout::eUndefined;
-    attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+    attachments[0].finalLayout = swapChain.presentLayout;
 
     // Depth attachment
     attachments[1].format = depthFormat;
@@ -668,11 +1162,9 @@ void ExampleBase::windowResize(const glm::uvec2& newSize) {
     windowResized();
 
     // Can be overriden in derived class
-    updateDrawCommandBuffers();
-
     // Command buffers need to be recreated as they may store
     // references to the recreated frame buffer
-    buildCommandBuffers();
+    updateDrawCommandBuffers();
 
     viewChanged();
 
@@ -21,6 +21,12 @@
 #include "vulkanTextureLoader.hpp"
 #include "vulkanMeshLoader.hpp"
 #include "vulkanTextOverlay.hpp"
+#include "jobSystem.hpp"
+#include "vulkanTextureStreamer.hpp"
+#include "vulkanProfiler.hpp"
+#include "vulkanUniformArena.hpp"
+#include "vulkanUpdateQueue.hpp"
+#include "vulkanRenderGraph.hpp"
 
 #define GAMEPAD_BUTTON_A 0x1000
 #define GAMEPAD_BUTTON_B 0x1001
@@ -35,20 +41,6 @@
 #define ENABLE_VALIDATION true
 
 namespace vkx {
-    struct UpdateOperation {
-        const vk::Buffer buffer;
-        const vk::DeviceSize size;
-        const vk::DeviceSize offset;
-        const uint32_t* data;
-
-        template <typename T>
-        UpdateOperation(const vk::Buffer& buffer, const T& data, vk::DeviceSize offset = 0) : buffer(buffer), size(sizeof(T)), offset(offset), data((uint32_t*)&data) {
-            assert(0 == (sizeof(T) % 4));
-            assert(0 == (offset % 4));
-        }
-    };
-
-
     class ExampleBase : public Context {
     protected:
         ExampleBase(bool enableValidation);
@@ -73,10 +65,10 @@ namespace vkx {
     protected:
         bool enableVsync{ false };
         // Command buffers used for rendering
-        std::vector<vk::CommandBuffer> primaryCmdBuffers;
         std::vector<vk::CommandBuffer> textCmdBuffers;
         std::vector<vk::CommandBuffer> drawCmdBuffers;
-        bool primaryCmdBuffersDirty{ true };
+        // Pools the draw command buffers were allocated from when recorded in parallel, empty otherwise
+        std::vector<vk::CommandPool> drawCmdBufferPools;
         std::vector<vk::ClearValue> clearValues;
         vk::RenderPassBeginInfo renderPassBeginInfo;
 
@@ -92,51 +84,147 @@ namespace vkx {
             renderPassBeginInfo.pClearValues = clearValues.data();
         }
 
-        virtual void buildCommandBuffers() final {
+        // Resources owned by one frame in flight.  A slot is only reused once its fence has signalled,
+        // so none of these objects are created or destroyed while rendering.
+        struct FrameSlot {
+            vk::Fence fence;
+            // Set when the fence was passed to a submit and has to be waited on before reusing the slot
+            bool submitted{ false };
+            vk::Semaphore acquireComplete;
+            vk::Semaphore renderComplete;
+            // Reset as a whole when the slot is reused
+            vk::CommandPool cmdPool;
+            vk::CommandBuffer primaryCmdBuffer;
+            // Headless only, stand in for the image acquire and present and write the frame timestamps
+            vk::CommandBuffer acquireCmdBuffer;
+            vk::CommandBuffer presentCmdBuffer;
+            // Benchmark frame whose timestamps were written by this slot, UINT32_MAX if none
+            uint32_t benchmarkFrame{ UINT32_MAX };
+            // Secondary command buffers replaced while this slot was current, spare once its fence signalled
+            std::vector<vk::CommandBuffer> retiredSubCmdBuffers;
+        };
+
+        // Number of frames the CPU may prepare ahead of the GPU
+        uint32_t framesInFlight{ 2 };
+        // Bytes of per-object and per-pass constants one frame may allocate from the uniform arena
+        vk::DeviceSize frameUniformArenaSize{ 256 * 1024 };
+        // Uniform data that only lives for one frame, with a region per frame slot.  Allocate after
+        // prepareFrame and bind the returned offsets to eUniformBufferDynamic descriptors of
+        // uniformArena.getDescriptor(sizeof(block)).
+        UniformArena uniformArena;
+        // Bytes of buffer updates one frame may stage
+        vk::DeviceSize frameUpdateStagingSize{ 1024 * 1024 };
+        // Buffer updates applied at the start of the next frame's primary command buffer, replacing
+        // mapped writes or updateBuffer for device local buffers
+        UpdateQueue updateQueue;
+        std::vector<FrameSlot> frameSlots;
+        uint32_t frameSlotIndex{ 0 };
+        // Secondary command buffers of the context pool no frame may still execute, reused by populateSubCommandBuffers
+        std::vector<vk::CommandBuffer> spareSubCmdBuffers;
+        // Vulkan objects created through the context during the previous frame, zero in the steady state
+        uint64_t frameCreatedObjectCount{ 0 };
+        uint64_t lastCreatedObjectCount{ 0 };
+        // Background pipeline compiles seen so far, the draw commands are recorded again when one completes
+        uint64_t asyncPipelineCount{ 0 };
+
+        // Headless benchmark (-headless): renders a fixed number of frames (-frames) into offscreen images with a
+        // scripted camera orbit, then writes the per frame timings to <-benchmark>.csv and <-benchmark>.json
+        struct BenchmarkFrame {
+            // Milliseconds, gpuTime is negative if timestamps aren't supported
+            float cpuTime{ 0.0f };
+            float submitTime{ 0.0f };
+            float gpuTime{ -1.0f };
+            // Vulkan objects created through the context during the frame
+            uint32_t createdObjects{ 0 };
+        };
+
+        struct Benchmark {
+            uint32_t frameCount{ 300 };
+            // Frames (-warmup) after which no more Vulkan objects may be created, except while textures
+            // stream in or pipelines compile in the background
+            uint32_t warmupFrames{ 10 };
+            std::string outputPath;
+            std::vector<BenchmarkFrame> frames;
+            uint32_t currentFrame{ 0 };
+            // Two timestamps per frame slot, null if the graphics queue doesn't support timestamps
+            vk::QueryPool queryPool;
+            uint64_t lastGpuEnd{ 0 };
+        } benchmark;
+
+        // CPU time spent in queue submits for the current frame, in milliseconds
+        float frameSubmitTime{ 0.0f };
+        // CPU time between the starts of consecutive frames of the render loop
+        FrameTimeHistogram frameTimes;
+        // Writes the CPU zones of all threads to <exe>_cpu_trace.json (F2, and at exit with -profile)
+        void writeCpuTrace();
+
+        FrameSlot& getFrameSlot() {
+            return frameSlots[frameSlotIndex];
+        }
+
+        void createFrameSlots();
+        void destroyFrameSlots();
+        // Moves on to the next frame slot, waiting for the GPU to finish with it if necessary
+        void beginFrameSlot();
+        // Waits for every submitted frame slot without retiring it, beginFrameSlot still does that
+        void waitForFrameSlots();
+        // Headless replacements for the swap chain image acquire and present
+        void acquireOffscreenImage();
+        void presentOffscreenImage();
+        // Reads the timestamps of the last benchmark frame rendered with the slot, once its fence has signalled
+        void readBenchmarkTimestamps(uint32_t slotIndex);
+        void runBenchmark();
+        void writeBenchmarkResults();
+
+        // Records the primary command buffer of the current frame slot for the acquired swap chain image.
+        // It only executes the secondary draw and text command buffers, so it is cheap enough to record
+        // every frame, and the slot's command buffer is known to be idle.
+        void buildPrimaryCommandBuffer() {
             if (drawCmdBuffers.empty()) {
                 throw std::runtime_error("Draw command buffers have not been populated.");
             }
-            trashCommandBuffers(primaryCmdBuffers);
-
-            // FIXME find a better way to ensure that the draw and text buffers are no longer in use before 
-            // executing them within this command buffer.
-            queue.waitIdle();
-
-            // Destroy command buffers if already present
-            if (primaryCmdBuffers.empty()) {
-                // Create one command buffer per image in the swap chain
-
-                // Command buffers store a reference to the
-                // frame buffer inside their render pass info
-                // so for static usage without having to rebuild
-                // them each frame, we use one per frame buffer
-                vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
-                cmdBufAllocateInfo.commandPool = cmdPool;
-                cmdBufAllocateInfo.commandBufferCount = swapChain.imageCount;
-                primaryCmdBuffers = device.allocateCommandBuffers(cmdBufAllocateInfo);
-            }
 
+            VKX_CPU_ZONE("Record primary");
+            const auto& cmdBuffer = getFrameSlot().primaryCmdBuffer;
             vk::CommandBufferBeginInfo cmdBufInfo;
-            for (size_t i = 0; i < swapChain.imageCount; ++i) {
-                const auto& cmdBuffer = primaryCmdBuffers[i];
-                cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-                cmdBuffer.begin(cmdBufInfo);
+            cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+            cmdBuffer.begin(cmdBufInfo);
 
-                // Let child classes execute operations outside the renderpass, like buffer barriers or query pool operations
-                updatePrimaryCommandBuffer(cmdBuffer);
+            if (gpuProfiler) {
+                gpuProfiler->beginFrame(cmdBuffer);
+            }
+            {
+                GpuProfiler::Zone frameZone(gpuProfiler.get(), cmdBuffer, "Frame");
+                {
+                    GpuProfiler::Zone updateZone(gpuProfiler.get(), cmdBuffer, "Buffer updates");
+                    updateQueue.record(cmdBuffer);
+                }
+                {
+                    // Let child classes execute operations outside the renderpass, like buffer barriers or query pool operations
+                    GpuProfiler::Zone prePassZone(gpuProfiler.get(), cmdBuffer, "Pre-pass");
+                    updatePrimaryCommandBuffer(cmdBuffer);
+                }
 
-                renderPassBeginInfo.framebuffer = framebuffers[i];
-                cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
-                if (!drawCmdBuffers.empty()) {
-                    cmdBuffer.executeCommands(drawCmdBuffers[i]);
+                // Timestamps can't be written between the secondaries, so the render pass is measured as a whole
+                GpuProfiler::Zone renderPassZone(gpuProfiler.get(), cmdBuffer, "Render pass");
+                if (gpuProfiler) {
+                    gpuProfiler->beginStatistics(cmdBuffer);
                 }
+                renderPassBeginInfo.framebuffer = framebuffers[currentBuffer];
+                cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eSecondaryCommandBuffers);
+                // One secondary command buffer per draw chunk, in chunk order
+                uint32_t drawChunks = (uint32_t)drawCmdBuffers.size() / swapChain.imageCount;
+                cmdBuffer.executeCommands(drawChunks, &drawCmdBuffers[currentBuffer * drawChunks]);
                 if (enableTextOverlay && !textCmdBuffers.empty() && textOverlay && textOverlay->visible) {
-                    cmdBuffer.executeCommands(textCmdBuffers[i]);
+                    cmdBuffer.executeCommands(textCmdBuffers[currentBuffer]);
                 }
                 cmdBuffer.endRenderPass();
-                cmdBuffer.end();
+                if (gpuProfiler) {
+                    gpuProfiler->endStatistics(cmdBuffer);
+                }
             }
-            primaryCmdBuffersDirty = false;
+            finishPrimaryCommandBuffer(cmdBuffer);
+            cmdBuffer.end();
         }
     protected:
         // Last frame time, measured using a high performance timer (if available)
@@ -144,7 +232,6 @@ namespace vkx {
         // Frame counter to display fps
         uint32_t frameCounter{ 0 };
         uint32_t lastFPS{ 0 };
-        std::list<UpdateOperation> pendingUpdates;
 
         // Color buffer format
         vk::Format colorformat{ vk::Format::eB8G8R8A8Unorm };
@@ -175,7 +262,6 @@ namespace vkx {
             vk::Semaphore acquireComplete;
             // Command buffer submission and execution
             vk::Semaphore renderComplete;
-            vk::Semaphore transferComplete;
         } semaphores;
 
         // Simple texture loader
@@ -187,6 +273,16 @@ namespace vkx {
     protected:
         // Command buffer pool
         vk::CommandPool cmdPool;
+        // One pool per job system worker, used for parallel recording
+        std::vector<vk::CommandPool> workerCmdPools;
+        std::unique_ptr<JobSystem> jobSystem;
+        std::unique_ptr<TextureStreamer> textureStreamer;
+        // GPU timings of the frame phases (-profile), null if disabled or timestamps aren't supported.
+        // Derived classes can add zones to command buffers recorded every frame, e.g. in updatePrimaryCommandBuffer.
+        std::unique_ptr<GpuProfiler> gpuProfiler;
+        bool enableGpuProfiler{ false };
+        // Optimize meshes for the vertex cache, overdraw and vertex fetch when they are imported, disabled with -rawmeshes
+        bool optimizeMeshes{ true };
 
         bool prepared = false;
         vk::Extent2D size{ 1280, 720 };
@@ -234,7 +330,7 @@ namespace vkx {
         // true if application has focused, false if moved to background
         bool focused = false;
 #else 
-        GLFWwindow* window;
+        GLFWwindow* window{ nullptr };
 #endif
 
         // Setup the vulkan instance, enable required extensions and connect to the physical device (GPU)
@@ -277,7 +373,7 @@ namespace vkx {
             }
             fpsTimer += (float)frameTimer;
             if (fpsTimer > 1.0f) {
-                if (!enableTextOverlay) {
+                if (!enableTextOverlay && !headless) {
                     std::string windowTitle = getWindowTitle();
                     glfwSetWindowTitle(window, windowTitle.c_str());
                 }
@@ -335,28 +431,44 @@ namespace vkx {
         virtual void setupRenderPass();
 
 
+        // Records one secondary command buffer per swap chain image.  The buffers replaced are retired to the
+        // current frame slot and reused once it completes, so re-recording in steady state allocates nothing.
         void populateSubCommandBuffers(std::vector<vk::CommandBuffer>& cmdBuffers, std::function<void(const vk::CommandBuffer& commandBuffer)> f) {
-            if (!cmdBuffers.empty()) {
+            if (frameSlots.empty()) {
                 trashCommandBuffers(cmdBuffers);
+            } else {
+                auto& retired = frameSlots[frameSlotIndex].retiredSubCmdBuffers;
+                retired.insert(retired.end(), cmdBuffers.begin(), cmdBuffers.end());
+                cmdBuffers.clear();
             }
 
-            vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
-            cmdBufAllocateInfo.commandPool = getCommandPool();
-            cmdBufAllocateInfo.commandBufferCount = swapChain.imageCount;
-            cmdBufAllocateInfo.level = vk::CommandBufferLevel::eSecondary;
-            cmdBuffers = device.allocateCommandBuffers(cmdBufAllocateInfo);
+            const uint32_t spareCount = std::min<uint32_t>(swapChain.imageCount, (uint32_t)spareSubCmdBuffers.size());
+            cmdBuffers.assign(spareSubCmdBuffers.end() - spareCount, spareSubCmdBuffers.end());
+            spareSubCmdBuffers.resize(spareSubCmdBuffers.size() - spareCount);
+            if (spareCount < swapChain.imageCount) {
+                vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
+                cmdBufAllocateInfo.commandPool = getCommandPool();
+                cmdBufAllocateInfo.commandBufferCount = swapChain.imageCount - spareCount;
+                cmdBufAllocateInfo.level = vk::CommandBufferLevel::eSecondary;
+                auto allocated = device.allocateCommandBuffers(cmdBufAllocateInfo);
+                countCreatedObjects(allocated.size());
+                cmdBuffers.insert(cmdBuffers.end(), allocated.begin(), allocated.end());
+            }
 
             vk::CommandBufferInheritanceInfo inheritance;
             inheritance.renderPass = renderPass;
             inheritance.subpass = 0;
+            if (gpuProfiler && gpuProfiler->hasStatistics()) {
+                inheritance.pipelineStatistics = gpuProfiler->getStatisticsFlags();
+            }
             vk::CommandBufferBeginInfo beginInfo;
             beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse;
             beginInfo.pInheritanceInfo = &inheritance;
             for (size_t i = 0; i < swapChain.imageCount; ++i) {
                 currentBuffer = i;
                 inheritance.framebuffer = framebuffers[i];
+                // The context pool allows resetting single buffers, so begin resets a reused one
                 vk::CommandBuffer& cmdBuffer = cmdBuffers[i];
-                cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
                 cmdBuffer.begin(beginInfo);
                 f(cmdBuffer);
                 cmdBuffer.end();
@@ -364,126 +476,176 @@ namespace vkx {
             currentBuffer = 0;
         }
 
-        virtual void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) {}
-
-        virtual void updateDrawCommandBuffers() final {
-            populateSubCommandBuffers(drawCmdBuffers, [&](const vk::CommandBuffer& cmdBuffer) {
-                updateDrawCommandBuffer(cmdBuffer);
-            });
-            primaryCmdBuffersDirty = true;
+        // Job system shared by the example, created on first use
+        JobSystem& getJobSystem() {
+            if (!jobSystem) {
+                jobSystem = std::make_unique<JobSystem>();
+            }
+            return *jobSystem;
         }
 
-        // Pure virtual function to be overriden by the dervice class
-        // Called in case of an event where e.g. the framebuffer has to be rebuild and thus
-        // all command buffers that may reference this
-        virtual void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommand) = 0;
-
-        void drawCurrentCommandBuffer(const vk::Semaphore& semaphore = vk::Semaphore()) {
-            vk::Fence fence = swapChain.getSubmitFence();
-            {
-                uint32_t fenceIndex = currentBuffer;
-                dumpster.push_back([fenceIndex, this] {
-                    swapChain.clearSubmitFence(fenceIndex);
-                });
+        // Asynchronous texture loader, created on first use and updated at the start of every frame
+        TextureStreamer& getTextureStreamer() {
+            if (!textureStreamer) {
+                textureStreamer = std::make_unique<TextureStreamer>(*this, getJobSystem());
+#if defined(__ANDROID__)
+                textureStreamer->assetManager = androidApp->activity->assetManager;
+#endif
             }
+            return *textureStreamer;
+        }
 
-            // Command buffer(s) to be sumitted to the queue
-            std::vector<vk::Semaphore> waitSemaphores{ { semaphore == vk::Semaphore() ? semaphores.acquireComplete : semaphore } };
-            std::vector<vk::PipelineStageFlags> waitStages{ submitPipelineStages };
-            if (semaphores.transferComplete) {
-                auto transferComplete = semaphores.transferComplete;
-                semaphores.transferComplete = vk::Semaphore();
-                waitSemaphores.push_back(transferComplete);
-                waitStages.push_back(vk::PipelineStageFlagBits::eTransfer);
-                dumpster.push_back([transferComplete, this] {
-                    device.destroySemaphore(transferComplete);
-                });
+        // Release secondary command buffers allocated either from the context pool (cmdBufferPools empty)
+        // or from the worker pools
+        void trashSubCommandBuffers(std::vector<vk::CommandBuffer>& cmdBuffers, std::vector<vk::CommandPool>& cmdBufferPools) {
+            if (cmdBufferPools.empty()) {
+                trashCommandBuffers(cmdBuffers);
+                return;
             }
-
-            emptyDumpster(fence);
-
-            vk::Semaphore transferPending;
-            std::vector<vk::Semaphore> signalSemaphores{ { semaphores.renderComplete } };
-            if (!pendingUpdates.empty()) {
-                transferPending = device.createSemaphore(vk::SemaphoreCreateInfo());
-                signalSemaphores.push_back(transferPending);
+            for (size_t i = 0; i < cmdBuffers.size(); ++i) {
+                trashCommandBuffer(cmdBuffers[i], cmdBufferPools[i]);
             }
+            cmdBuffers.clear();
+            cmdBufferPools.clear();
+        }
 
-            {
-                vk::SubmitInfo submitInfo;
-                submitInfo.waitSemaphoreCount = (uint32_t)waitSemaphores.size();
-                submitInfo.pWaitSemaphores = waitSemaphores.data();
-                submitInfo.pWaitDstStageMask = waitStages.data();
-                submitInfo.signalSemaphoreCount = signalSemaphores.size();
-                submitInfo.pSignalSemaphores = signalSemaphores.data();
-                submitInfo.commandBufferCount = 1;
-                submitInfo.pCommandBuffers = &primaryCmdBuffers[currentBuffer];
-                // Submit to queue
-                queue.submit(submitInfo, fence);
+        // Records chunkCount secondary command buffers per swap chain image, stored image major.  The chunks
+        // of an image are recorded concurrently on the job system workers, each allocating from its own
+        // command pool, so f must only touch state that is safe to read from several threads.
+        void populateParallelSubCommandBuffers(std::vector<vk::CommandBuffer>& cmdBuffers, std::vector<vk::CommandPool>& cmdBufferPools, uint32_t chunkCount, std::function<void(const vk::CommandBuffer& commandBuffer, uint32_t chunkIndex)> f) {
+            trashSubCommandBuffers(cmdBuffers, cmdBufferPools);
+
+            JobSystem& jobs = getJobSystem();
+            if (workerCmdPools.empty()) {
+                vk::CommandPoolCreateInfo cmdPoolInfo;
+                cmdPoolInfo.queueFamilyIndex = graphicsQueueIndex;
+                for (uint32_t i = 0; i < jobs.getWorkerCount(); ++i) {
+                    workerCmdPools.push_back(device.createCommandPool(cmdPoolInfo));
+                }
             }
 
-            executePendingTransfers(transferPending);
-            recycle();
-        }
+            cmdBuffers.resize(swapChain.imageCount * chunkCount);
+            cmdBufferPools.resize(cmdBuffers.size());
 
-        void executePendingTransfers(vk::Semaphore transferPending) {
-            if (!pendingUpdates.empty()) {
-                vk::Fence transferFence = device.createFence(vk::FenceCreateInfo());
-                semaphores.transferComplete = device.createSemaphore(vk::SemaphoreCreateInfo());
-                assert(transferPending);
-                assert(semaphores.transferComplete);
-                // Command buffers store a reference to the
-                // frame buffer inside their render pass info
-                // so for static usage without having to rebuild
-                // them each frame, we use one per frame buffer
-                vk::CommandBuffer transferCmdBuffer;
-                {
+            vk::CommandBufferInheritanceInfo inheritance;
+            inheritance.renderPass = renderPass;
+            inheritance.subpass = 0;
+            if (gpuProfiler && gpuProfiler->hasStatistics()) {
+                inheritance.pipelineStatistics = gpuProfiler->getStatisticsFlags();
+            }
+            vk::CommandBufferBeginInfo beginInfo;
+            beginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue | vk::CommandBufferUsageFlagBits::eSimultaneousUse;
+            beginInfo.pInheritanceInfo = &inheritance;
+            for (size_t i = 0; i < swapChain.imageCount; ++i) {
+                currentBuffer = i;
+                inheritance.framebuffer = framebuffers[i];
+                jobs.parallelFor(0, chunkCount, 1, [&](uint32_t begin, uint32_t end) {
                     vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
-                    cmdBufAllocateInfo.commandPool = cmdPool;
+                    cmdBufAllocateInfo.commandPool = workerCmdPools[jobs.getWorkerIndex()];
                     cmdBufAllocateInfo.commandBufferCount = 1;
-                    transferCmdBuffer = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
-                }
+                    cmdBufAllocateInfo.level = vk::CommandBufferLevel::eSecondary;
+                    for (uint32_t chunk = begin; chunk < end; ++chunk) {
+                        size_t index = i * chunkCount + chunk;
+                        vk::CommandBuffer cmdBuffer = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+                        countCreatedObjects();
+                        cmdBuffer.begin(beginInfo);
+                        f(cmdBuffer, chunk);
+                        cmdBuffer.end();
+                        cmdBuffers[index] = cmdBuffer;
+                        cmdBufferPools[index] = cmdBufAllocateInfo.commandPool;
+                    }
+                });
+            }
+            currentBuffer = 0;
+        }
 
+        virtual void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) {}
+        // Called after the renderpass, e.g. for timestamps closing the frame
+        virtual void finishPrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) {}
 
-                {
-                    vk::CommandBufferBeginInfo cmdBufferBeginInfo;
-                    cmdBufferBeginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
-                    transferCmdBuffer.begin(cmdBufferBeginInfo);
-                    for (const auto& update : pendingUpdates) {
-                        transferCmdBuffer.updateBuffer(update.buffer, update.offset, update.size, update.data);
-                    }
-                    transferCmdBuffer.end();
+        virtual void updateDrawCommandBuffers() final {
+            VKX_CPU_ZONE("Record draw");
+            auto recordStart = std::chrono::high_resolution_clock::now();
+            if (drawChunkCount > 1) {
+                populateParallelSubCommandBuffers(drawCmdBuffers, drawCmdBufferPools, drawChunkCount, [&](const vk::CommandBuffer& cmdBuffer, uint32_t chunkIndex) {
+                    updateDrawCommandBufferChunk(cmdBuffer, chunkIndex, drawChunkCount);
+                });
+            } else {
+                // Buffers of the context pool are recycled by populateSubCommandBuffers
+                if (!drawCmdBufferPools.empty()) {
+                    trashSubCommandBuffers(drawCmdBuffers, drawCmdBufferPools);
                 }
+                populateSubCommandBuffers(drawCmdBuffers, [&](const vk::CommandBuffer& cmdBuffer) {
+                    updateDrawCommandBuffer(cmdBuffer);
+                });
+            }
+            auto recordEnd = std::chrono::high_resolution_clock::now();
+            drawRecordTime = std::chrono::duration<float, std::milli>(recordEnd - recordStart).count();
+        }
 
-                {
-                    vk::PipelineStageFlags stageFlagBits = vk::PipelineStageFlagBits::eAllCommands;
-                    vk::SubmitInfo transferSubmitInfo;
-                    transferSubmitInfo.pWaitDstStageMask = &stageFlagBits;
-                    transferSubmitInfo.pWaitSemaphores = &transferPending;
-                    transferSubmitInfo.signalSemaphoreCount = 1;
-                    transferSubmitInfo.pSignalSemaphores = &semaphores.transferComplete;
-                    transferSubmitInfo.waitSemaphoreCount = 1;
-                    transferSubmitInfo.commandBufferCount = 1;
-                    transferSubmitInfo.pCommandBuffers = &transferCmdBuffer;
-                    queue.submit(transferSubmitInfo, transferFence);
-                }
+        // Pure virtual function to be overriden by the dervice class
+        // Called in case of an event where e.g. the framebuffer has to be rebuild and thus
+        // all command buffers that may reference this
+        virtual void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommand) = 0;
 
-                recycler.push({ transferFence, [transferPending, transferCmdBuffer, this] {
-                    device.destroySemaphore(transferPending);
-                    device.freeCommandBuffers(cmdPool, transferCmdBuffer);
-                } });
-                pendingUpdates.clear();
+        // Used instead of updateDrawCommandBuffer when drawChunkCount is above 1.  Records the part of the
+        // draw list belonging to chunkIndex, called concurrently from the job system workers.
+        virtual void updateDrawCommandBufferChunk(const vk::CommandBuffer& drawCommand, uint32_t chunkIndex, uint32_t chunkCount) {
+            if (0 == chunkIndex) {
+                updateDrawCommandBuffer(drawCommand);
             }
         }
 
+        // Number of chunks the draw list is split into for parallel recording, 1 records serially
+        uint32_t drawChunkCount{ 1 };
+        // CPU time of the last updateDrawCommandBuffers call, in milliseconds
+        float drawRecordTime{ 0.0f };
+
+        void drawCurrentCommandBuffer(const vk::Semaphore& semaphore = vk::Semaphore()) {
+            VKX_CPU_ZONE("Draw");
+            FrameSlot& slot = getFrameSlot();
+            buildPrimaryCommandBuffer();
+
+            // Anything trashed so far is released once this frame's fence has signalled
+            deletionQueue->collect(frameSlotIndex);
+
+            // Uploads still recorded in an open batch must reach the queue ahead of the frame that uses them
+            flushUploads();
+
+            vk::Semaphore waitSemaphore = semaphore == vk::Semaphore() ? semaphores.acquireComplete : semaphore;
+            vk::SubmitInfo submitInfo;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitSemaphores = &waitSemaphore;
+            submitInfo.pWaitDstStageMask = &submitPipelineStages;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &semaphores.renderComplete;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &slot.primaryCmdBuffer;
+
+            // Submit to queue, the slot fence covers the frame including its buffer updates.  When headless the fence
+            // goes with the present submit instead, so it also covers the frame's closing timestamp.
+            {
+                VKX_CPU_ZONE("Queue submit");
+                auto submitStart = std::chrono::high_resolution_clock::now();
+                auto queueLock = lockQueue();
+                queue.submit(submitInfo, headless ? vk::Fence() : slot.fence);
+                frameSubmitTime += std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - submitStart).count();
+            }
+            slot.submitted = true;
+        }
+
         // Prepare commonly used Vulkan functions
         virtual void prepare();
 
-        // Load a mesh (using ASSIMP) and create vulkan vertex and index buffers with given vertex layout
+        // Load a mesh (through the binary mesh cache, using ASSIMP on a miss) and create vulkan vertex and index buffers with given vertex layout.
+        // lodCount > 1 appends simplified levels of detail to the index buffer, see MeshBuffer::lods and LodSelector.
+        // options are added to the MeshLoader options, e.g. MeshLoader::OPTION_CLUSTERS for MeshBuffer::clusters.
         vkx::MeshBuffer loadMesh(
             const std::string& filename,
             const vkx::MeshLayout& vertexLayout,
-            float scale = 1.0f);
+            float scale = 1.0f,
+            uint32_t lodCount = 1,
+            uint32_t options = 0);
 
         // Start the main render loop
         void renderLoop();
@@ -534,8 +696,11 @@ namespace vkx {
             case GLFW_KEY_F1:
                 if (enableTextOverlay) {
                     textOverlay->visible = !textOverlay->visible;
-                    primaryCmdBuffersDirty = true;
                 }
+                break;
+
+            case GLFW_KEY_F2:
+                writeCpuTrace();
                 break;
 
 			case GLFW_KEY_ESCAPE:
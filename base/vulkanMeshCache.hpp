@@ -0,0 +1,278 @@
+/*
+* Binary cache for imported meshes
+*
+* Stores the final interleaved vertex data, index data, LOD ranges and clusters produced by the mesh loader,
+* keyed by a hash of the source file contents, the import flags, the loader options, the
+* number of requested LODs, the vertex layout and the scale.  Files the importer read besides the
+* source (such as the .mtl materials of an .obj) are stored with their content hashes and checked on
+* load, so editing them invalidates the entry.  Cache files are memory mapped on load so the data can
+* be copied straight into the staging ring without going through Assimp.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "mappedFile.hpp"
+
+namespace vkx {
+
+    // Range of the index buffer drawing one level of detail, error is the object space distance
+    // the simplified surface may deviate from the full detail one
+    struct MeshLod {
+        uint32_t firstIndex{ 0 };
+        uint32_t indexCount{ 0 };
+        float error{ 0.0f };
+    };
+
+    // Range of the index buffer with bounds for culling it as a whole, see MeshClusterizer.  Matches the
+    // std430 layout of struct { vec4 sphere; vec4 cone; uint firstIndex; uint indexCount; uvec2 padding; }
+    struct MeshCluster {
+        // xyz center, w radius of the bounding sphere
+        glm::vec4 sphere;
+        // xyz axis, w cutoff of the normal cone
+        glm::vec4 cone;
+        uint32_t firstIndex{ 0 };
+        uint32_t indexCount{ 0 };
+        uint32_t padding[2]{};
+    };
+
+    class MeshCache {
+    public:
+        // Bump whenever the importer output or the file layout changes
+        static const uint32_t VERSION = 6;
+
+        // File the entry was derived from besides the source, with the hash of its contents at import time
+        struct Dependency {
+            std::string path;
+            uint64_t hash{ 0 };
+        };
+
+        struct Key {
+            uint64_t sourceHash{ 0 };
+            uint32_t importFlags{ 0 };
+            // Post processing done by the loader after the import, see MeshLoader::options
+            uint32_t options{ 0 };
+            // Requested LODs, see MeshLoader::lodCount
+            uint32_t lodCount{ 1 };
+            float scale{ 1.0f };
+            std::vector<uint32_t> layout;
+
+            uint64_t hash() const {
+                const uint32_t version = VERSION;
+                uint64_t result = hashBytes(&version, sizeof(version));
+                result = hashBytes(&sourceHash, sizeof(sourceHash), result);
+                result = hashBytes(&importFlags, sizeof(importFlags), result);
+                result = hashBytes(&options, sizeof(options), result);
+                result = hashBytes(&lodCount, sizeof(lodCount), result);
+                result = hashBytes(&scale, sizeof(scale), result);
+                return hashBytes(layout.data(), layout.size() * sizeof(uint32_t), result);
+            }
+        };
+
+        // View of a cache entry, pointing into the mapped file
+        struct Entry {
+            const void* vertexData{ nullptr };
+            uint64_t vertexBytes{ 0 };
+            const uint32_t* indexData{ nullptr };
+            uint32_t indexCount{ 0 };
+            glm::vec3 dimMin;
+            glm::vec3 dimMax;
+            glm::vec3 dimSize;
+            // Ranges of quantized layout components, see MeshDequantization
+            glm::vec4 positionDequantization;
+            glm::vec4 uvDequantization;
+            // Generated LODs, may be fewer than requested
+            const MeshLod* lods{ nullptr };
+            uint32_t lodCount{ 0 };
+            const MeshCluster* clusters{ nullptr };
+            uint32_t clusterCount{ 0 };
+            std::vector<Dependency> dependencies;
+        };
+
+        explicit MeshCache(const std::string& directory) : directory(directory) {}
+
+        bool isEnabled() const {
+            return !directory.empty();
+        }
+
+        std::string getEntryPath(const Key& key) const {
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.mesh", (unsigned long long)key.hash());
+            return directory + name;
+        }
+
+        // Map the entry for key, returns false if it doesn't exist, doesn't match or one of its dependencies changed
+        bool load(const Key& key, MappedFile& file, Entry& entry) const {
+            if (!isEnabled() || !file.open(getEntryPath(key))) {
+                return false;
+            }
+
+            if (file.size < sizeof(Header)) {
+                return false;
+            }
+            Header header;
+            memcpy(&header, file.data, sizeof(Header));
+            if (header.magic != MAGIC || header.version != VERSION || header.sourceHash != key.sourceHash ||
+                header.importFlags != key.importFlags || header.options != key.options || header.lodCount != key.lodCount || header.scale != key.scale || header.layoutCount != key.layout.size()) {
+                return false;
+            }
+
+            size_t layoutBytes = key.layout.size() * sizeof(uint32_t);
+            size_t indexBytes = (size_t)header.indexCount * sizeof(uint32_t);
+            size_t lodBytes = (size_t)header.lodEntries * sizeof(MeshLod);
+            size_t clusterBytes = (size_t)header.clusterCount * sizeof(MeshCluster);
+            if (file.size != sizeof(Header) + layoutBytes + header.vertexBytes + indexBytes + lodBytes + clusterBytes + header.dependencyBytes) {
+                return false;
+            }
+            const uint8_t* cursor = file.data + sizeof(Header);
+            if (layoutBytes && memcmp(cursor, key.layout.data(), layoutBytes)) {
+                return false;
+            }
+            cursor += layoutBytes;
+
+            entry.vertexData = cursor;
+            entry.vertexBytes = header.vertexBytes;
+            entry.indexData = (const uint32_t*)(cursor + header.vertexBytes);
+            entry.indexCount = header.indexCount;
+            entry.dimMin = glm::make_vec3(header.dimMin);
+            entry.dimMax = glm::make_vec3(header.dimMax);
+            entry.dimSize = glm::make_vec3(header.dimSize);
+            entry.positionDequantization = glm::make_vec4(header.positionDequantization);
+            entry.uvDequantization = glm::make_vec4(header.uvDequantization);
+            entry.lods = (const MeshLod*)(cursor + header.vertexBytes + indexBytes);
+            entry.lodCount = header.lodEntries;
+            entry.clusters = (const MeshCluster*)(cursor + header.vertexBytes + indexBytes + lodBytes);
+            entry.clusterCount = header.clusterCount;
+
+            // Each dependency is a uint64_t content hash, a uint32_t path length and the path
+            const uint8_t* dependency = cursor + header.vertexBytes + indexBytes + lodBytes + clusterBytes;
+            const uint8_t* end = dependency + header.dependencyBytes;
+            entry.dependencies.resize(header.dependencyCount);
+            for (auto& item : entry.dependencies) {
+                uint32_t pathLength;
+                if (end - dependency < (ptrdiff_t)(sizeof(item.hash) + sizeof(pathLength))) {
+                    return false;
+                }
+                memcpy(&item.hash, dependency, sizeof(item.hash));
+                memcpy(&pathLength, dependency + sizeof(item.hash), sizeof(pathLength));
+                dependency += sizeof(item.hash) + sizeof(pathLength);
+                if ((size_t)(end - dependency) < pathLength) {
+                    return false;
+                }
+                item.path.assign((const char*)dependency, pathLength);
+                dependency += pathLength;
+                if (hashFile(item.path) != item.hash) {
+                    return false;
+                }
+            }
+            return dependency == end;
+        }
+
+        // Write the entry to a temporary file first so concurrent readers never see a partial entry
+        bool store(const Key& key, const Entry& entry) const {
+            if (!isEnabled()) {
+                return false;
+            }
+
+            Header header;
+            header.sourceHash = key.sourceHash;
+            header.importFlags = key.importFlags;
+            header.options = key.options;
+            header.lodCount = key.lodCount;
+            header.lodEntries = entry.lodCount;
+            header.clusterCount = entry.clusterCount;
+            header.dependencyCount = (uint32_t)entry.dependencies.size();
+            std::vector<uint8_t> dependencies;
+            for (const auto& item : entry.dependencies) {
+                const uint32_t pathLength = (uint32_t)item.path.size();
+                const size_t offset = dependencies.size();
+                dependencies.resize(offset + sizeof(item.hash) + sizeof(pathLength) + pathLength);
+                uint8_t* out = dependencies.data() + offset;
+                memcpy(out, &item.hash, sizeof(item.hash));
+                memcpy(out + sizeof(item.hash), &pathLength, sizeof(pathLength));
+                memcpy(out + sizeof(item.hash) + sizeof(pathLength), item.path.data(), pathLength);
+            }
+            header.dependencyBytes = (uint32_t)dependencies.size();
+            header.scale = key.scale;
+            header.layoutCount = (uint32_t)key.layout.size();
+            header.vertexBytes = entry.vertexBytes;
+            header.indexCount = entry.indexCount;
+            memcpy(header.dimMin, &entry.dimMin, sizeof(header.dimMin));
+            memcpy(header.dimMax, &entry.dimMax, sizeof(header.dimMax));
+            memcpy(header.dimSize, &entry.dimSize, sizeof(header.dimSize));
+            memcpy(header.positionDequantization, &entry.positionDequantization, sizeof(header.positionDequantization));
+            memcpy(header.uvDequantization, &entry.uvDequantization, sizeof(header.uvDequantization));
+
+            std::string path = getEntryPath(key);
+            std::string tempPath = path + ".tmp";
+            FILE* file = fopen(tempPath.c_str(), "wb");
+            if (!file) {
+                return false;
+            }
+            // Empty sections may come with null pointers, which fwrite doesn't accept
+            auto write = [file](const void* data, size_t size, size_t count) {
+                return !count || fwrite(data, size, count, file) == count;
+            };
+            bool written =
+                write(&header, sizeof(Header), 1) &&
+                write(key.layout.data(), sizeof(uint32_t), key.layout.size()) &&
+                write(entry.vertexData, 1, (size_t)entry.vertexBytes) &&
+                write(entry.indexData, sizeof(uint32_t), entry.indexCount) &&
+                write(entry.lods, sizeof(MeshLod), entry.lodCount) &&
+                write(entry.clusters, sizeof(MeshCluster), entry.clusterCount) &&
+                write(dependencies.data(), 1, dependencies.size());
+            written = (fclose(file) == 0) && written;
+            if (written) {
+                // rename won't replace an existing file on Windows
+                remove(path.c_str());
+                written = rename(tempPath.c_str(), path.c_str()) == 0;
+            }
+            if (!written) {
+                remove(tempPath.c_str());
+            }
+            return written;
+        }
+
+    private:
+        static const uint32_t MAGIC = 0x4853454d; // "MESH"
+
+        // Followed by layoutCount uint32_t layout entries, vertexBytes of vertex data, indexCount uint32_t indices
+        // lodEntries MeshLod ranges into the indices, clusterCount MeshCluster ranges of the first LOD and
+        // dependencyBytes of dependencyCount dependencies
+        struct Header {
+            uint32_t magic{ MAGIC };
+            uint32_t version{ VERSION };
+            uint64_t sourceHash{ 0 };
+            uint32_t importFlags{ 0 };
+            float scale{ 1.0f };
+            uint64_t vertexBytes{ 0 };
+            uint32_t indexCount{ 0 };
+            uint32_t layoutCount{ 0 };
+            float dimMin[3];
+            float dimMax[3];
+            float dimSize[3];
+            uint32_t options{ 0 };
+            float positionDequantization[4];
+            float uvDequantization[4];
+            uint32_t lodCount{ 0 };
+            uint32_t lodEntries{ 0 };
+            uint32_t clusterCount{ 0 };
+            uint32_t dependencyCount{ 0 };
+            uint32_t dependencyBytes{ 0 };
+            uint32_t padding{ 0 };
+        };
+
+        std::string directory;
+    };
+}
@@ -0,0 +1,264 @@
+/*
+* Cluster (meshlet) decomposition of indexed triangle lists
+*
+* Triangles are grouped into clusters of at most MAX_VERTICES vertices and MAX_TRIANGLES triangles,
+* grown greedily over shared vertices so every cluster is a compact patch of the surface.  The index
+* buffer is reordered so each cluster is a contiguous range that can be drawn with a regular indexed
+* draw, no mesh shaders needed.  The triangles inside a cluster are ordered for the vertex cache.  Every cluster gets a bounding sphere for frustum culling and a normal
+* cone for backface culling of the whole cluster.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vulkanMeshCache.hpp"
+#include "vulkanMeshOptimizer.hpp"
+
+namespace vkx {
+
+    class MeshClusterizer {
+    public:
+        // The usual meshlet limits, so the clusters could be fed to mesh shaders as well
+        static const uint32_t MAX_VERTICES = 64;
+        static const uint32_t MAX_TRIANGLES = 124;
+        // Unemitted triangles looked at for the closest one when a cluster can't grow over shared vertices
+        static const uint32_t SEED_SEARCH = 64;
+        // Weight of the normal deviation against the distance when growing a cluster
+        static constexpr float NORMAL_WEIGHT = 4.0f;
+
+        // Reorder the triangles of indices into clusters and return the clusters in index buffer order.
+        // Front faces are counter clockwise in a right handed frame, as loaded by MeshLoader with the
+        // default flags.
+        static std::vector<MeshCluster> build(std::vector<uint32_t>& indices, const void* positions, uint32_t positionStride, uint32_t vertexCount, uint32_t maxVertices = MAX_VERTICES, uint32_t maxTriangles = MAX_TRIANGLES) {
+            auto position = [&](uint32_t vertex) {
+                glm::vec3 result;
+                memcpy(&result, (const uint8_t*)positions + (size_t)vertex * positionStride, sizeof(result));
+                return result;
+            };
+
+            const uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+            std::vector<glm::vec3> centroids(triangleCount);
+            std::vector<glm::vec3> normals(triangleCount);
+            for (uint32_t i = 0; i < triangleCount; ++i) {
+                glm::vec3 p0 = position(indices[i * 3 + 0]);
+                glm::vec3 p1 = position(indices[i * 3 + 1]);
+                glm::vec3 p2 = position(indices[i * 3 + 2]);
+                centroids[i] = (p0 + p1 + p2) / 3.0f;
+                glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                float length = glm::length(normal);
+                normals[i] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+            }
+
+            // Triangles around each vertex, in compressed row form
+            std::vector<uint32_t> offsets(vertexCount + 1, 0);
+            for (auto index : indices) {
+                ++offsets[index + 1];
+            }
+            for (uint32_t i = 0; i < vertexCount; ++i) {
+                offsets[i + 1] += offsets[i];
+            }
+            std::vector<uint32_t> adjacency(indices.size());
+            {
+                std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+                for (uint32_t i = 0; i < indices.size(); ++i) {
+                    adjacency[fill[indices[i]]++] = i / 3;
+                }
+            }
+
+            std::vector<MeshCluster> clusters;
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            std::vector<uint8_t> emitted(triangleCount, 0);
+            // Cluster a vertex was last added to
+            std::vector<uint32_t> vertexCluster(vertexCount, INVALID);
+            std::vector<uint32_t> clusterVertices;
+            std::vector<uint32_t> localIndex(vertexCount);
+            std::vector<uint32_t> local;
+            uint32_t cursor = 0;
+            uint32_t emittedCount = 0;
+
+            while (emittedCount < triangleCount) {
+                const uint32_t clusterIndex = (uint32_t)clusters.size();
+                MeshCluster cluster;
+                cluster.firstIndex = (uint32_t)result.size();
+                clusterVertices.clear();
+                glm::vec3 centroidSum(0.0f);
+                glm::vec3 normalSum(0.0f);
+
+                auto newVertices = [&](uint32_t triangle) {
+                    uint32_t count = 0;
+                    for (uint32_t corner = 0; corner < 3; ++corner) {
+                        count += vertexCluster[indices[triangle * 3 + corner]] != clusterIndex;
+                    }
+                    return count;
+                };
+
+                uint32_t triangle = nextSeed(indices, emitted, centroids, cursor, centroidSum, 0, newVertices, maxVertices);
+                while (triangle != INVALID) {
+                    emitted[triangle] = 1;
+                    ++emittedCount;
+                    for (uint32_t corner = 0; corner < 3; ++corner) {
+                        uint32_t vertex = indices[triangle * 3 + corner];
+                        result.push_back(vertex);
+                        if (vertexCluster[vertex] != clusterIndex) {
+                            vertexCluster[vertex] = clusterIndex;
+                            clusterVertices.push_back(vertex);
+                        }
+                    }
+                    centroidSum += centroids[triangle];
+                    normalSum += normals[triangle];
+                    const uint32_t clusterTriangles = (uint32_t)(result.size() - cluster.firstIndex) / 3;
+                    if (clusterTriangles == maxTriangles) {
+                        break;
+                    }
+
+                    // Prefer the triangle adding the fewest vertices, then the closest one, with triangles
+                    // facing away from the cluster counting as further away to keep the normal cone narrow
+                    const glm::vec3 center = centroidSum / (float)clusterTriangles;
+                    const float normalLength = glm::length(normalSum);
+                    const glm::vec3 axis = normalLength > 0.0f ? normalSum / normalLength : glm::vec3(0.0f);
+                    triangle = INVALID;
+                    uint32_t bestVertices = 4;
+                    float bestCost = FLT_MAX;
+                    for (auto vertex : clusterVertices) {
+                        for (uint32_t k = offsets[vertex]; k < offsets[vertex + 1]; ++k) {
+                            uint32_t candidate = adjacency[k];
+                            if (emitted[candidate]) {
+                                continue;
+                            }
+                            uint32_t added = newVertices(candidate);
+                            if (clusterVertices.size() + added > maxVertices || added > bestVertices) {
+                                continue;
+                            }
+                            float cost = glm::length(centroids[candidate] - center) * (1.0f + NORMAL_WEIGHT * (1.0f - glm::dot(normals[candidate], axis)));
+                            if (added < bestVertices || cost < bestCost) {
+                                triangle = candidate;
+                                bestVertices = added;
+                                bestCost = cost;
+                            }
+                        }
+                    }
+                    if (triangle == INVALID) {
+                        // Nothing left around the cluster, continue with the closest unconnected triangle
+                        triangle = nextSeed(indices, emitted, centroids, cursor, center, (uint32_t)clusterVertices.size(), newVertices, maxVertices);
+                    }
+                }
+
+                cluster.indexCount = (uint32_t)result.size() - cluster.firstIndex;
+                optimizeCluster(cluster, result, clusterVertices, localIndex, local);
+                computeBounds(cluster, result, clusterVertices, position);
+                clusters.push_back(cluster);
+            }
+
+            indices.swap(result);
+            return clusters;
+        }
+
+        // Bounding sphere of the cluster's vertices and the cone around the normals of its triangles.
+        // The cluster faces away from a viewer at p if
+        // dot(sphere.xyz - p, cone.xyz) >= cone.w * length(sphere.xyz - p) + sphere.w
+        template <typename PositionFn>
+        static void computeBounds(MeshCluster& cluster, const std::vector<uint32_t>& indices, const std::vector<uint32_t>& vertices, const PositionFn& position) {
+            glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+            for (auto vertex : vertices) {
+                glm::vec3 p = position(vertex);
+                minimum = glm::min(minimum, p);
+                maximum = glm::max(maximum, p);
+            }
+            glm::vec3 center = (minimum + maximum) * 0.5f;
+            float radius = 0.0f;
+            for (auto vertex : vertices) {
+                radius = std::max(radius, glm::length(position(vertex) - center));
+            }
+            cluster.sphere = glm::vec4(center, radius);
+
+            glm::vec3 normalSum(0.0f);
+            std::vector<glm::vec3> normals;
+            normals.reserve(cluster.indexCount / 3);
+            for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i += 3) {
+                glm::vec3 p0 = position(indices[i]);
+                glm::vec3 normal = glm::cross(position(indices[i + 1]) - p0, position(indices[i + 2]) - p0);
+                float length = glm::length(normal);
+                if (length > 0.0f) {
+                    normals.push_back(normal / length);
+                    normalSum += normals.back();
+                }
+            }
+
+            // A cone of half angle a contains all normals, the cutoff is sin(a).  Wider cones never cull.
+            cluster.cone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            float length = glm::length(normalSum);
+            if (length == 0.0f) {
+                return;
+            }
+            glm::vec3 axis = normalSum / length;
+            float minimumDot = 1.0f;
+            for (const auto& normal : normals) {
+                minimumDot = std::min(minimumDot, glm::dot(normal, axis));
+            }
+            if (minimumDot > 0.0f) {
+                cluster.cone = glm::vec4(axis, sqrtf(1.0f - minimumDot * minimumDot));
+            }
+        }
+
+    private:
+        enum : uint32_t { INVALID = 0xffffffff };
+
+        // Vertex cache order for the triangles of a cluster, optimized on cluster local indices so the cost
+        // doesn't depend on the size of the mesh
+        static void optimizeCluster(const MeshCluster& cluster, std::vector<uint32_t>& indices, const std::vector<uint32_t>& vertices, std::vector<uint32_t>& localIndex, std::vector<uint32_t>& local) {
+            for (uint32_t i = 0; i < vertices.size(); ++i) {
+                localIndex[vertices[i]] = i;
+            }
+            local.assign(indices.begin() + cluster.firstIndex, indices.begin() + cluster.firstIndex + cluster.indexCount);
+            for (auto& index : local) {
+                index = localIndex[index];
+            }
+            MeshOptimizer::optimizeVertexCache(local, (uint32_t)vertices.size());
+            for (uint32_t i = 0; i < cluster.indexCount; ++i) {
+                indices[cluster.firstIndex + i] = vertices[local[i]];
+            }
+        }
+
+        // Of the next SEED_SEARCH unemitted triangles after cursor the closest one to center that fits
+        template <typename NewVerticesFn>
+        static uint32_t nextSeed(const std::vector<uint32_t>& indices, const std::vector<uint8_t>& emitted, const std::vector<glm::vec3>& centroids, uint32_t& cursor, const glm::vec3& center, uint32_t clusterVertices, const NewVerticesFn& newVertices, uint32_t maxVertices) {
+            const uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+            while (cursor < triangleCount && emitted[cursor]) {
+                ++cursor;
+            }
+            uint32_t result = INVALID;
+            float bestDistance = FLT_MAX;
+            uint32_t looked = 0;
+            for (uint32_t i = cursor; i < triangleCount && looked < SEED_SEARCH; ++i) {
+                if (emitted[i]) {
+                    continue;
+                }
+                ++looked;
+                if (clusterVertices + newVertices(i) > maxVertices) {
+                    continue;
+                }
+                // A new cluster starts with the first one
+                if (!clusterVertices) {
+                    return i;
+                }
+                float distance = glm::length(centroids[i] - center);
+                if (distance < bestDistance) {
+                    result = i;
+                    bestDistance = distance;
+                }
+            }
+            return result;
+        }
+    };
+}
@@ -28,6 +28,9 @@
 #include <assimp/scene.h>     
 #include <assimp/postprocess.h>
 #include <assimp/cimport.h>
+#if !defined(__ANDROID__)
+#include <assimp/DefaultIOSystem.h>
+#endif
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -37,6 +40,11 @@
 #endif
 
 #include "vulkanTools.h"
+#include "jobSystem.hpp"
+#include "vulkanMeshCache.hpp"
+#include "vulkanMeshOptimizer.hpp"
+#include "vulkanMeshSimplifier.hpp"
+#include "vulkanMeshClusterizer.hpp"
 
 namespace vkx {
     typedef enum VertexLayout {
@@ -47,18 +55,45 @@ namespace vkx {
         VERTEX_LAYOUT_TANGENT = 0x4,
         VERTEX_LAYOUT_BITANGENT = 0x5,
         VERTEX_LAYOUT_DUMMY_FLOAT = 0x6,
-        VERTEX_LAYOUT_DUMMY_VEC4 = 0x7
+        VERTEX_LAYOUT_DUMMY_VEC4 = 0x7,
+        // Packed components, see MeshDequantization for the ranges.  Positions are read as vec4 with w = 1,
+        // normals, tangents and bitangents are octahedral encoded unit vectors.
+        VERTEX_LAYOUT_POSITION_HALF = 0x8,
+        VERTEX_LAYOUT_POSITION_SNORM16 = 0x9,
+        VERTEX_LAYOUT_NORMAL_OCT16 = 0xA,
+        VERTEX_LAYOUT_TANGENT_OCT16 = 0xB,
+        VERTEX_LAYOUT_BITANGENT_OCT16 = 0xC,
+        VERTEX_LAYOUT_UV_UNORM16 = 0xD,
+        VERTEX_LAYOUT_COLOR_UNORM8 = 0xE
     } VertexLayout;
 
     using MeshLayout = std::vector<VertexLayout>;
 
     using MeshBufferInfo = CreateBufferResult;
 
+    // Maps quantized layout components back to their original range, value * scale + offset
+    struct MeshDequantization {
+        // xyz offset and w uniform scale for VERTEX_LAYOUT_POSITION_SNORM16
+        glm::vec4 position{ 0.0f, 0.0f, 0.0f, 1.0f };
+        // xy offset and zw scale for VERTEX_LAYOUT_UV_UNORM16
+        glm::vec4 uv{ 0.0f, 0.0f, 1.0f, 1.0f };
+
+        // Translation and uniform scale, can be folded into the model matrix without touching normals
+        glm::mat4 positionTransform() const {
+            return glm::scale(glm::translate(glm::mat4(), glm::vec3(position)), glm::vec3(position.w));
+        }
+    };
+
     struct MeshBuffer {
         MeshBufferInfo vertices;
         MeshBufferInfo indices;
         uint32_t indexCount{ 0 };
         glm::vec3 dim;
+        MeshDequantization dequantization;
+        // Index ranges of the levels of detail, lods[0] is the full detail mesh (indexCount indices)
+        std::vector<MeshLod> lods;
+        // Culling clusters of the full detail indices, empty unless loaded with MeshLoader::OPTION_CLUSTERS
+        std::vector<MeshCluster> clusters;
 
         void destroy() {
             vertices.destroy();
@@ -66,18 +101,72 @@ namespace vkx {
         }
     };
 
+    // Get the size of a single vertex layout component
+    static uint32_t componentSize(VertexLayout layoutDetail) {
+        switch (layoutDetail) {
+            // UV only has two components
+        case VERTEX_LAYOUT_UV:
+            return 2 * sizeof(float);
+        case VERTEX_LAYOUT_DUMMY_FLOAT:
+            return sizeof(float);
+        case VERTEX_LAYOUT_DUMMY_VEC4:
+            return 4 * sizeof(float);
+        case VERTEX_LAYOUT_POSITION_HALF:
+        case VERTEX_LAYOUT_POSITION_SNORM16:
+            return 4 * sizeof(uint16_t);
+        case VERTEX_LAYOUT_NORMAL_OCT16:
+        case VERTEX_LAYOUT_TANGENT_OCT16:
+        case VERTEX_LAYOUT_BITANGENT_OCT16:
+        case VERTEX_LAYOUT_UV_UNORM16:
+            return 2 * sizeof(uint16_t);
+        case VERTEX_LAYOUT_COLOR_UNORM8:
+            return 4 * sizeof(uint8_t);
+        default:
+            return 3 * sizeof(float);
+        }
+    }
+
+    // Get the attribute format of a single vertex layout component
+    static vk::Format componentFormat(VertexLayout layoutDetail) {
+        switch (layoutDetail) {
+        case VERTEX_LAYOUT_UV:
+            return vk::Format::eR32G32Sfloat;
+        case VERTEX_LAYOUT_POSITION_HALF:
+            return vk::Format::eR16G16B16A16Sfloat;
+        case VERTEX_LAYOUT_POSITION_SNORM16:
+            return vk::Format::eR16G16B16A16Snorm;
+        case VERTEX_LAYOUT_NORMAL_OCT16:
+        case VERTEX_LAYOUT_TANGENT_OCT16:
+        case VERTEX_LAYOUT_BITANGENT_OCT16:
+            return vk::Format::eR16G16Snorm;
+        case VERTEX_LAYOUT_UV_UNORM16:
+            return vk::Format::eR16G16Unorm;
+        case VERTEX_LAYOUT_COLOR_UNORM8:
+            return vk::Format::eR8G8B8A8Unorm;
+        default:
+            return vk::Format::eR32G32B32Sfloat;
+        }
+    }
+
+    // Octahedral encoding of a unit vector into two 16 bit snorm values, decode in the shader with
+    // n = vec3(e, 1 - abs(e.x) - abs(e.y)); n.xy += mix(vec2(max(-n.z, 0)), -vec2(max(-n.z, 0)), step(0, n.xy)); normalize(n)
+    static uint32_t packOctahedral(const glm::vec3& v) {
+        float length = fabs(v.x) + fabs(v.y) + fabs(v.z);
+        if (length == 0.0f) {
+            return glm::packSnorm2x16(glm::vec2(0.0f));
+        }
+        glm::vec2 e = glm::vec2(v.x, v.y) / length;
+        if (v.z < 0.0f) {
+            e = (glm::vec2(1.0f) - glm::abs(glm::vec2(e.y, e.x))) * glm::vec2(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return glm::packSnorm2x16(e);
+    }
+
     // Get vertex size from vertex layout
     static uint32_t vertexSize(const MeshLayout& layout) {
         uint32_t vSize = 0;
         for (auto& layoutDetail : layout) {
-            switch (layoutDetail) {
-                // UV only has two components
-            case VERTEX_LAYOUT_UV:
-                vSize += 2 * sizeof(float);
-                break;
-            default:
-                vSize += 3 * sizeof(float);
-            }
+            vSize += componentSize(layoutDetail);
         }
         return vSize;
     }
@@ -109,7 +198,7 @@ namespace vkx {
             uint32_t binding = 0;
             for (auto& layoutDetail : layout) {
                 // vk::Format (layout)
-                vk::Format format = (layoutDetail == VERTEX_LAYOUT_UV) ? vk::Format::eR32G32Sfloat : vk::Format::eR32G32B32Sfloat;
+                vk::Format format = componentFormat(layoutDetail);
 
                 attributeDescriptions.push_back(
                     vertexInputAttributeDescription(
@@ -119,7 +208,7 @@ namespace vkx {
                         offset));
 
                 // Offset
-                offset += (layoutDetail == VERTEX_LAYOUT_UV) ? (2 * sizeof(float)) : (3 * sizeof(float));
+                offset += componentSize(layoutDetail);
                 binding++;
             }
 
@@ -130,7 +219,7 @@ namespace vkx {
             vertexInputState.pVertexAttributeDescriptions = attributeDescriptions.data();
         }
 
-        void drawIndexed(const vk::CommandBuffer& cmdBuffer) {
+        void drawIndexed(const vk::CommandBuffer& cmdBuffer, uint32_t lod = 0) {
             if (pipeline) {
                 cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
             }
@@ -139,8 +228,46 @@ namespace vkx {
             }
             cmdBuffer.bindVertexBuffers(vertexBufferBinding, buffers.vertices.buffer, vk::DeviceSize());
             cmdBuffer.bindIndexBuffer(buffers.indices.buffer, 0, vk::IndexType::eUint32);
-            cmdBuffer.drawIndexed(buffers.indexCount, 1, 0, 0, 0);
+            if (buffers.lods.empty()) {
+                cmdBuffer.drawIndexed(buffers.indexCount, 1, 0, 0, 0);
+            } else {
+                const MeshLod& range = buffers.lods[std::min<size_t>(lod, buffers.lods.size() - 1)];
+                cmdBuffer.drawIndexed(range.indexCount, 1, range.firstIndex, 0, 0);
+            }
+        }
+    };
+
+    // Picks the coarsest level of detail whose error projects to at most pixelThreshold pixels
+    class LodSelector {
+    public:
+        LodSelector() {}
+
+        LodSelector(const glm::mat4& projection, const glm::mat4& view, float viewportHeight, float pixelThreshold = 1.0f)
+            : cameraPosition(glm::inverse(view)[3]), pixelThreshold(pixelThreshold) {
+            // Pixels covered by one unit at distance one from the camera
+            projectionScale = projection[1][1] * viewportHeight * 0.5f;
+        }
+
+        // center is the world space center of the mesh, scale its uniform world scale
+        uint32_t select(const MeshBuffer& mesh, const glm::vec3& center, float scale = 1.0f) const {
+            float radius = glm::length(mesh.dim) * 0.5f * scale;
+            // Nearest point of the bounding sphere, the camera may be inside of it
+            float distance = std::max(glm::length(center - cameraPosition) - radius, 1e-4f);
+            float pixelsPerUnit = fabs(projectionScale) * scale / distance;
+            uint32_t result = 0;
+            for (uint32_t i = 1; i < mesh.lods.size(); ++i) {
+                if (mesh.lods[i].error * pixelsPerUnit > pixelThreshold) {
+                    break;
+                }
+                result = i;
+            }
+            return result;
         }
+
+    private:
+        glm::vec3 cameraPosition;
+        float projectionScale{ 1.0f };
+        float pixelThreshold{ 1.0f };
     };
 
 
@@ -194,11 +321,13 @@ namespace vkx {
         struct {
             vk::Buffer buf;
             vk::DeviceMemory mem;
+            MemoryAllocation allocation;
         } vertexBuffer;
 
         struct {
             vk::Buffer buf;
             vk::DeviceMemory mem;
+            MemoryAllocation allocation;
             uint32_t count;
         } indexBuffer;
 
@@ -214,15 +343,77 @@ namespace vkx {
             m_Entries.clear();
         }
 
+        // Post processing done after the Assimp import, part of the mesh cache key so the cost is only paid on a miss
+        enum Options {
+            // Weld identical vertices and optimize for the vertex cache, overdraw and vertex fetch (see MeshOptimizer)
+            OPTION_OPTIMIZE = 0x1,
+            // Split the full detail indices into clusters with bounds for GPU culling (see MeshClusterizer)
+            OPTION_CLUSTERS = 0x2,
+        };
+        uint32_t options{ 0 };
+        // Levels of detail to generate, each one with about half the triangles of the previous one.  They share
+        // the vertex buffer, which is welded for it, and are appended to the index buffer.
+        uint32_t lodCount{ 1 };
+
+        static const int DEFAULT_FLAGS = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
+
         // Loads the mesh with some default flags
         bool load(const std::string& filename) {
-            int flags = aiProcess_FlipWindingOrder | aiProcess_Triangulate | aiProcess_PreTransformVertices | aiProcess_CalcTangentSpace | aiProcess_GenSmoothNormals;
-
-            return load(filename, flags);
+            return load(filename, DEFAULT_FLAGS);
         }
 
         // Load the mesh with custom flags
         bool load(const std::string& filename, int flags) {
+            readScene(filename, flags);
+            return parse(pScene, filename);
+        }
+
+        // Job system the meshes of loadBuffers are converted on, serially if not set
+        JobSystem* jobSystem{ nullptr };
+
+        // Files the last import read besides the source, such as the .mtl materials of an .obj
+        std::vector<std::string> dependencies;
+
+    private:
+#if !defined(__ANDROID__)
+        // Records the files opened by the importer
+        class RecordingIOSystem : public Assimp::DefaultIOSystem {
+        public:
+            std::vector<std::string> opened;
+
+            Assimp::IOStream* Open(const char* file, const char* mode = "rb") override {
+                Assimp::IOStream* result = DefaultIOSystem::Open(file, mode);
+                if (result) {
+                    opened.push_back(file);
+                }
+                return result;
+            }
+        };
+#endif
+
+        // Vertices and faces of a single aiMesh converted by one job
+        struct ImportChunk {
+            uint32_t mesh{ 0 };
+            uint32_t firstVertex{ 0 };
+            uint32_t vertexCount{ 0 };
+            uint32_t firstFace{ 0 };
+            uint32_t faceCount{ 0 };
+            // First vertex of the mesh in the output
+            uint32_t vertexBase{ 0 };
+            // Counted and bounded by the first pass
+            uint32_t triangleCount{ 0 };
+            uint32_t firstIndex{ 0 };
+            glm::vec3 posMin{ FLT_MAX };
+            glm::vec3 posMax{ -FLT_MAX };
+            glm::vec2 uvMin{ FLT_MAX };
+            glm::vec2 uvMax{ -FLT_MAX };
+        };
+
+        // Vertices and faces per chunk, large meshes are split so they don't end up on a single worker
+        static const uint32_t IMPORT_CHUNK_SIZE = 64 * 1024;
+
+        // Read the file into pScene, which stays alive until the next import or FreeScene
+        void readScene(const std::string& filename, int flags) {
 #if defined(__ANDROID__)
             // Meshes are stored inside the apk on Android (compressed)
             // So they need to be loaded via the asset manager
@@ -240,16 +431,24 @@ namespace vkx {
             pScene = Importer.ReadFileFromMemory(meshData, size, flags);
 
             free(meshData);
+            dependencies.clear();
 #else
+            // Owned by the importer
+            RecordingIOSystem* ioSystem = new RecordingIOSystem();
+            Importer.SetIOHandler(ioSystem);
             pScene = Importer.ReadFile(filename.c_str(), flags);
+            dependencies.clear();
+            for (const auto& file : ioSystem->opened) {
+                if (file != filename && std::find(dependencies.begin(), dependencies.end(), file) == dependencies.end()) {
+                    dependencies.push_back(file);
+                }
+            }
 #endif
             if (!pScene) {
                 throw std::runtime_error("Unable to parse " + filename);
             }
-            return parse(pScene, filename);
         }
 
-    private:
         bool parse(const aiScene* pScene, const std::string& Filename) {
             m_Entries.resize(pScene->mNumMeshes);
 
@@ -268,33 +467,38 @@ namespace vkx {
             return true;
         }
 
-        void InitMesh(unsigned int index, const aiMesh* paiMesh, const aiScene* pScene) {
-            m_Entries[index].MaterialIndex = paiMesh->mMaterialIndex;
-
+        static glm::vec3 materialColor(const aiMesh* paiMesh, const aiScene* pScene) {
             aiColor3D pColor(0.f, 0.f, 0.f);
             pScene->mMaterials[paiMesh->mMaterialIndex]->Get(AI_MATKEY_COLOR_DIFFUSE, pColor);
+            return glm::vec3(pColor.r, pColor.g, pColor.b);
+        }
 
+        static Vertex makeVertex(const aiMesh* paiMesh, unsigned int i, const glm::vec3& color) {
             aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
+            const aiVector3D* pPos = &(paiMesh->mVertices[i]);
+            const aiVector3D* pNormal = &(paiMesh->mNormals[i]);
+            const aiVector3D* pTexCoord = paiMesh->HasTextureCoords(0) ? &(paiMesh->mTextureCoords[0][i]) : &Zero3D;
+            const aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[i]) : &Zero3D;
+            const aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[i]) : &Zero3D;
+
+            return Vertex(glm::vec3(pPos->x, -pPos->y, pPos->z),
+                glm::vec2(pTexCoord->x, pTexCoord->y),
+                glm::vec3(pNormal->x, pNormal->y, pNormal->z),
+                glm::vec3(pTangent->x, pTangent->y, pTangent->z),
+                glm::vec3(pBiTangent->x, pBiTangent->y, pBiTangent->z),
+                color);
+        }
 
-            for (unsigned int i = 0; i < paiMesh->mNumVertices; i++) {
-                aiVector3D* pPos = &(paiMesh->mVertices[i]);
-                aiVector3D* pNormal = &(paiMesh->mNormals[i]);
-                aiVector3D *pTexCoord;
-                if (paiMesh->HasTextureCoords(0)) {
-                    pTexCoord = &(paiMesh->mTextureCoords[0][i]);
-                } else {
-                    pTexCoord = &Zero3D;
-                }
-                aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[i]) : &Zero3D;
-                aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[i]) : &Zero3D;
+        void InitMesh(unsigned int index, const aiMesh* paiMesh, const aiScene* pScene) {
+            m_Entries[index].MaterialIndex = paiMesh->mMaterialIndex;
+            m_Entries[index].Vertices.reserve(paiMesh->mNumVertices);
+            m_Entries[index].Indices.reserve(paiMesh->mNumFaces * 3);
 
-                Vertex v(glm::vec3(pPos->x, -pPos->y, pPos->z),
-                    glm::vec2(pTexCoord->x, pTexCoord->y),
-                    glm::vec3(pNormal->x, pNormal->y, pNormal->z),
-                    glm::vec3(pTangent->x, pTangent->y, pTangent->z),
-                    glm::vec3(pBiTangent->x, pBiTangent->y, pBiTangent->z),
-                    glm::vec3(pColor.r, pColor.g, pColor.b)
-                    );
+            const glm::vec3 color = materialColor(paiMesh, pScene);
+
+            for (unsigned int i = 0; i < paiMesh->mNumVertices; i++) {
+                const aiVector3D* pPos = &(paiMesh->mVertices[i]);
+                Vertex v = makeVertex(paiMesh, i, color);
 
                 dim.max.x = fmax(pPos->x, dim.max.x);
                 dim.max.y = fmax(pPos->y, dim.max.y);
@@ -319,86 +523,474 @@ namespace vkx {
             }
         }
 
+        // Inverse of MeshDequantization together with the import scale, applied when writing vertices
+        struct Quantization {
+            float scale;
+            glm::vec3 posOffset;
+            float posScale;
+            glm::vec2 uvOffset;
+            glm::vec2 uvScale;
+
+            Quantization(float scale, const MeshDequantization& dequantization) : scale(scale) {
+                posOffset = glm::vec3(dequantization.position);
+                posScale = 1.0f / dequantization.position.w;
+                uvOffset = glm::vec2(dequantization.uv.x, dequantization.uv.y);
+                uvScale = glm::vec2(1.0f) / glm::vec2(dequantization.uv.z, dequantization.uv.w);
+            }
+        };
+
+        // Positions are quantized relative to the bounding cube, UVs relative to their bounding rectangle
+        static MeshDequantization computeDequantization(const glm::vec3& posMin, const glm::vec3& posMax, const glm::vec2& uvMin, const glm::vec2& uvMax) {
+            MeshDequantization dequantization;
+            glm::vec3 extent = (posMax - posMin) * 0.5f;
+            float radius = std::max(extent.x, std::max(extent.y, extent.z));
+            dequantization.position = glm::vec4(posMin + extent, radius > 0.0f ? radius : 1.0f);
+            glm::vec2 uvRange = uvMax - uvMin;
+            dequantization.uv = glm::vec4(uvMin, uvRange.x > 0.0f ? uvRange.x : 1.0f, uvRange.y > 0.0f ? uvRange.y : 1.0f);
+            return dequantization;
+        }
+
+        // Write a vertex according to layout and return the end of its data.  Every component is a multiple
+        // of 4 bytes, packed ones are written as 32 bit words.
+        static float* writeVertex(float* out, const MeshLayout& layout, const Vertex& vertex, const Quantization& quantization) {
+            auto writePacked = [&](uint32_t value) {
+                memcpy(out++, &value, sizeof(value));
+            };
+            // Write vertex data depending on layout
+            for (auto& layoutDetail : layout) {
+                switch (layoutDetail) {
+                case VERTEX_LAYOUT_POSITION:
+                    *out++ = vertex.m_pos.x * quantization.scale;
+                    *out++ = vertex.m_pos.y * quantization.scale;
+                    *out++ = vertex.m_pos.z * quantization.scale;
+                    break;
+                case VERTEX_LAYOUT_POSITION_HALF:
+                    writePacked(glm::packHalf2x16(glm::vec2(vertex.m_pos.x, vertex.m_pos.y) * quantization.scale));
+                    writePacked(glm::packHalf2x16(glm::vec2(vertex.m_pos.z * quantization.scale, 1.0f)));
+                    break;
+                case VERTEX_LAYOUT_POSITION_SNORM16: {
+                    glm::vec3 pos = (vertex.m_pos * quantization.scale - quantization.posOffset) * quantization.posScale;
+                    writePacked(glm::packSnorm2x16(glm::vec2(pos.x, pos.y)));
+                    writePacked(glm::packSnorm2x16(glm::vec2(pos.z, 1.0f)));
+                    break;
+                }
+                case VERTEX_LAYOUT_NORMAL_OCT16:
+                    writePacked(packOctahedral(glm::vec3(vertex.m_normal.x, -vertex.m_normal.y, vertex.m_normal.z)));
+                    break;
+                case VERTEX_LAYOUT_TANGENT_OCT16:
+                    writePacked(packOctahedral(vertex.m_tangent));
+                    break;
+                case VERTEX_LAYOUT_BITANGENT_OCT16:
+                    writePacked(packOctahedral(vertex.m_binormal));
+                    break;
+                case VERTEX_LAYOUT_UV_UNORM16:
+                    writePacked(glm::packUnorm2x16((vertex.m_tex - quantization.uvOffset) * quantization.uvScale));
+                    break;
+                case VERTEX_LAYOUT_COLOR_UNORM8:
+                    writePacked(glm::packUnorm4x8(glm::vec4(vertex.m_color, 1.0f)));
+                    break;
+                case VERTEX_LAYOUT_NORMAL:
+                    *out++ = vertex.m_normal.x;
+                    *out++ = -vertex.m_normal.y;
+                    *out++ = vertex.m_normal.z;
+                    break;
+                case VERTEX_LAYOUT_UV:
+                    *out++ = vertex.m_tex.s;
+                    *out++ = vertex.m_tex.t;
+                    break;
+                case VERTEX_LAYOUT_COLOR:
+                    *out++ = vertex.m_color.r;
+                    *out++ = vertex.m_color.g;
+                    *out++ = vertex.m_color.b;
+                    break;
+                case VERTEX_LAYOUT_TANGENT:
+                    *out++ = vertex.m_tangent.x;
+                    *out++ = vertex.m_tangent.y;
+                    *out++ = vertex.m_tangent.z;
+                    break;
+                case VERTEX_LAYOUT_BITANGENT:
+                    *out++ = vertex.m_binormal.x;
+                    *out++ = vertex.m_binormal.y;
+                    *out++ = vertex.m_binormal.z;
+                    break;
+                // Dummy layout components for padding
+                case VERTEX_LAYOUT_DUMMY_FLOAT:
+                    *out++ = 0.0f;
+                    break;
+                case VERTEX_LAYOUT_DUMMY_VEC4:
+                    *out++ = 0.0f;
+                    *out++ = 0.0f;
+                    *out++ = 0.0f;
+                    *out++ = 0.0f;
+                    break;
+                }
+            }
+            return out;
+        }
+
+        // Run f on every chunk, in parallel if there is a job system
+        template <typename F>
+        void forEachChunk(std::vector<ImportChunk>& chunks, const F& f) {
+            if (!jobSystem) {
+                for (auto& chunk : chunks) {
+                    f(chunk);
+                }
+                return;
+            }
+            jobSystem->parallelFor(0, (uint32_t)chunks.size(), 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    f(chunks[i]);
+                }
+            });
+        }
+
     public:
-        // Create vertex and index buffer with given layout
-        // Note : Only does staging if a valid command buffer and transfer queue are passed
-        MeshBuffer createBuffers(const Context& context, const std::vector<VertexLayout>& layout, float scale) {
+        // Interleave the loaded vertices according to layout and merge the indices of all entries.
+        // The ranges of quantized components are returned in dequantization.
+        void interleave(const MeshLayout& layout, float scale, std::vector<float>& vertexBuffer, std::vector<uint32_t>& indexBuffer, MeshDequantization& dequantization) const {
+            glm::vec3 posMin(FLT_MAX), posMax(-FLT_MAX);
+            glm::vec2 uvMin(FLT_MAX), uvMax(-FLT_MAX);
+            for (const auto& entry : m_Entries) {
+                for (const auto& vertex : entry.Vertices) {
+                    posMin = glm::min(posMin, vertex.m_pos * scale);
+                    posMax = glm::max(posMax, vertex.m_pos * scale);
+                    uvMin = glm::min(uvMin, vertex.m_tex);
+                    uvMax = glm::max(uvMax, vertex.m_tex);
+                }
+            }
+            dequantization = numVertices ? computeDequantization(posMin, posMax, uvMin, uvMax) : MeshDequantization();
+            const Quantization quantization(scale, dequantization);
+
+            vertexBuffer.resize(numVertices * (vertexSize(layout) / sizeof(float)));
+            float* out = vertexBuffer.data();
+            for (const auto& entry : m_Entries) {
+                for (const auto& vertex : entry.Vertices) {
+                    out = writeVertex(out, layout, vertex, quantization);
+                }
+            }
+            assert(out == vertexBuffer.data() + vertexBuffer.size());
 
-            std::vector<float> vertexBuffer;
-            for (int m = 0; m < m_Entries.size(); m++) {
-                for (int i = 0; i < m_Entries[m].Vertices.size(); i++) {
-                    // Push vertex data depending on layout
-                    for (auto& layoutDetail : layout) {
-                        // Position
+            size_t indexCount = 0;
+            for (const auto& entry : m_Entries) {
+                indexCount += entry.Indices.size();
+            }
+            indexBuffer.clear();
+            indexBuffer.reserve(indexCount);
+            for (const auto& entry : m_Entries) {
+                // Entry indices are relative to the first vertex of the entry
+                for (auto index : entry.Indices) {
+                    indexBuffer.push_back(index + entry.vertexBase);
+                }
+            }
+        }
+
+        // Same result as load followed by interleave, but the meshes of the scene are converted straight into
+        // the pre-sized vertex and index buffers without building m_Entries.  The meshes are split into chunks
+        // that are converted in parallel on jobSystem, if set, and the Assimp scene is released right after.
+        void importBuffers(const std::string& filename, int flags, const MeshLayout& layout, float scale, std::vector<float>& vertexBuffer, std::vector<uint32_t>& indexBuffer, MeshDequantization& dequantization) {
+            readScene(filename, flags);
+            const aiScene* scene = pScene;
+
+            std::vector<ImportChunk> chunks;
+            numVertices = 0;
+            for (uint32_t m = 0; m < scene->mNumMeshes; ++m) {
+                const aiMesh* mesh = scene->mMeshes[m];
+                const uint32_t size = std::max(mesh->mNumVertices, mesh->mNumFaces);
+                for (uint32_t first = 0; first < size; first += IMPORT_CHUNK_SIZE) {
+                    ImportChunk chunk;
+                    chunk.mesh = m;
+                    chunk.firstVertex = std::min(first, mesh->mNumVertices);
+                    chunk.vertexCount = std::min(first + IMPORT_CHUNK_SIZE, mesh->mNumVertices) - chunk.firstVertex;
+                    chunk.firstFace = std::min(first, mesh->mNumFaces);
+                    chunk.faceCount = std::min(first + IMPORT_CHUNK_SIZE, mesh->mNumFaces) - chunk.firstFace;
+                    chunk.vertexBase = numVertices;
+                    chunks.push_back(chunk);
+                }
+                numVertices += mesh->mNumVertices;
+            }
+
+            // First pass counts the triangles and bounds the vertices so the output can be sized and quantized
+            forEachChunk(chunks, [&](ImportChunk& chunk) {
+                const aiMesh* mesh = scene->mMeshes[chunk.mesh];
+                for (uint32_t i = chunk.firstFace; i < chunk.firstFace + chunk.faceCount; ++i) {
+                    chunk.triangleCount += mesh->mFaces[i].mNumIndices == 3;
+                }
+                for (uint32_t i = chunk.firstVertex; i < chunk.firstVertex + chunk.vertexCount; ++i) {
+                    const aiVector3D& pos = mesh->mVertices[i];
+                    chunk.posMin = glm::min(chunk.posMin, glm::vec3(pos.x, pos.y, pos.z));
+                    chunk.posMax = glm::max(chunk.posMax, glm::vec3(pos.x, pos.y, pos.z));
+                    glm::vec2 uv(0.0f);
+                    if (mesh->HasTextureCoords(0)) {
+                        uv = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+                    }
+                    chunk.uvMin = glm::min(chunk.uvMin, uv);
+                    chunk.uvMax = glm::max(chunk.uvMax, uv);
+                }
+            });
+
+            uint32_t indexCount = 0;
+            glm::vec2 uvMin(FLT_MAX), uvMax(-FLT_MAX);
+            for (auto& chunk : chunks) {
+                chunk.firstIndex = indexCount;
+                indexCount += chunk.triangleCount * 3;
+                dim.min = glm::min(dim.min, chunk.posMin);
+                dim.max = glm::max(dim.max, chunk.posMax);
+                uvMin = glm::min(uvMin, chunk.uvMin);
+                uvMax = glm::max(uvMax, chunk.uvMax);
+            }
+            dim.size = dim.max - dim.min;
+            // Bounds of the flipped and scaled positions written to the vertices
+            const glm::vec3 corner0 = glm::vec3(dim.min.x, -dim.min.y, dim.min.z) * scale;
+            const glm::vec3 corner1 = glm::vec3(dim.max.x, -dim.max.y, dim.max.z) * scale;
+            dequantization = numVertices ? computeDequantization(glm::min(corner0, corner1), glm::max(corner0, corner1), uvMin, uvMax) : MeshDequantization();
+            const Quantization quantization(scale, dequantization);
+
+            // Second pass writes every chunk to its own range of the output
+            const size_t floatsPerVertex = vertexSize(layout) / sizeof(float);
+            vertexBuffer.resize(numVertices * floatsPerVertex);
+            indexBuffer.resize(indexCount);
+            forEachChunk(chunks, [&](ImportChunk& chunk) {
+                const aiMesh* mesh = scene->mMeshes[chunk.mesh];
+                const glm::vec3 color = materialColor(mesh, scene);
+                float* out = vertexBuffer.data() + (chunk.vertexBase + chunk.firstVertex) * floatsPerVertex;
+                for (uint32_t i = chunk.firstVertex; i < chunk.firstVertex + chunk.vertexCount; ++i) {
+                    out = writeVertex(out, layout, makeVertex(mesh, i, color), quantization);
+                }
+                uint32_t* indices = indexBuffer.data() + chunk.firstIndex;
+                for (uint32_t i = chunk.firstFace; i < chunk.firstFace + chunk.faceCount; ++i) {
+                    const aiFace& face = mesh->mFaces[i];
+                    if (face.mNumIndices == 3) {
+                        *indices++ = face.mIndices[0] + chunk.vertexBase;
+                        *indices++ = face.mIndices[1] + chunk.vertexBase;
+                        *indices++ = face.mIndices[2] + chunk.vertexBase;
+                    }
+                }
+            });
+
+            Importer.FreeScene();
+            pScene = nullptr;
+        }
+
+        // Weld identical vertices, reorder the triangles for the post transform cache and overdraw and the
+        // vertices for fetch locality.  Results are stored in optimizeStats.
+        // Overdraw sorting reads float positions, it is skipped for quantized positions.
+        void optimizeBuffers(const MeshLayout& layout, std::vector<float>& vertexBuffer, std::vector<uint32_t>& indexBuffer) {
+            int32_t positionOffset = -1;
+            uint32_t offset = 0;
+            for (auto& layoutDetail : layout) {
+                if (layoutDetail == VERTEX_LAYOUT_POSITION) {
+                    positionOffset = (int32_t)offset;
+                    break;
+                }
+                offset += componentSize(layoutDetail);
+            }
+            optimizeStats = MeshOptimizer::optimize(vertexBuffer, vertexSize(layout), positionOffset, indexBuffer);
+        }
+
+        // Object space positions of the vertices, returns false if the layout has no position
+        bool decodePositions(const MeshLayout& layout, const MeshDequantization& dequantization, const std::vector<float>& vertexBuffer, std::vector<glm::vec3>& positions) const {
+            const uint32_t stride = vertexSize(layout);
+            const uint32_t count = (uint32_t)(vertexBuffer.size() * sizeof(float) / stride);
+            positions.resize(count);
+            uint32_t offset = 0;
+            for (auto& layoutDetail : layout) {
+                if (layoutDetail == VERTEX_LAYOUT_POSITION || layoutDetail == VERTEX_LAYOUT_POSITION_HALF || layoutDetail == VERTEX_LAYOUT_POSITION_SNORM16) {
+                    const uint8_t* source = (const uint8_t*)vertexBuffer.data() + offset;
+                    for (uint32_t i = 0; i < count; ++i, source += stride) {
                         if (layoutDetail == VERTEX_LAYOUT_POSITION) {
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_pos.x * scale);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_pos.y * scale);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_pos.z * scale);
-                        }
-                        // Normal
-                        if (layoutDetail == VERTEX_LAYOUT_NORMAL) {
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_normal.x);
-                            vertexBuffer.push_back(-m_Entries[m].Vertices[i].m_normal.y);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_normal.z);
-                        }
-                        // Texture coordinates
-                        if (layoutDetail == VERTEX_LAYOUT_UV) {
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_tex.s);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_tex.t);
-                        }
-                        // Color
-                        if (layoutDetail == VERTEX_LAYOUT_COLOR) {
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_color.r);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_color.g);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_color.b);
+                            memcpy(&positions[i], source, sizeof(glm::vec3));
+                            continue;
                         }
-                        // Tangent
-                        if (layoutDetail == VERTEX_LAYOUT_TANGENT) {
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_tangent.x);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_tangent.y);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_tangent.z);
-                        }
-                        // Bitangent
-                        if (layoutDetail == VERTEX_LAYOUT_BITANGENT) {
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_binormal.x);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_binormal.y);
-                            vertexBuffer.push_back(m_Entries[m].Vertices[i].m_binormal.z);
-                        }
-                        // Dummy layout components for padding
-                        if (layoutDetail == VERTEX_LAYOUT_DUMMY_FLOAT) {
-                            vertexBuffer.push_back(0.0f);
-                        }
-                        if (layoutDetail == VERTEX_LAYOUT_DUMMY_VEC4) {
-                            vertexBuffer.push_back(0.0f);
-                            vertexBuffer.push_back(0.0f);
-                            vertexBuffer.push_back(0.0f);
-                            vertexBuffer.push_back(0.0f);
+                        uint32_t packed[2];
+                        memcpy(packed, source, sizeof(packed));
+                        if (layoutDetail == VERTEX_LAYOUT_POSITION_HALF) {
+                            positions[i] = glm::vec3(glm::unpackHalf2x16(packed[0]), glm::unpackHalf2x16(packed[1]).x);
+                        } else {
+                            glm::vec3 pos(glm::unpackSnorm2x16(packed[0]), glm::unpackSnorm2x16(packed[1]).x);
+                            positions[i] = pos * dequantization.position.w + glm::vec3(dequantization.position);
                         }
                     }
+                    return true;
                 }
+                offset += componentSize(layoutDetail);
             }
-            MeshBuffer meshBuffer;
-            meshBuffer.vertices.size = vertexBuffer.size() * sizeof(float);
+            return false;
+        }
+
+        // Reorder the full detail indices into clusters, see OPTION_CLUSTERS.  Run before generateLods, the
+        // clusters only cover lods[0].
+        void buildClusters(const MeshLayout& layout, const MeshDequantization& dequantization, const std::vector<float>& vertexBuffer, std::vector<uint32_t>& indexBuffer, std::vector<MeshCluster>& clusters) const {
+            clusters.clear();
+            std::vector<glm::vec3> positions;
+            if (!decodePositions(layout, dequantization, vertexBuffer, positions)) {
+                return;
+            }
+            clusters = MeshClusterizer::build(indexBuffer, positions.data(), sizeof(glm::vec3), (uint32_t)positions.size());
+        }
+
+        // Simplify the indices into lodCount - 1 coarser levels of detail appended to indexBuffer.  The chain stops
+        // early if a level can't be simplified any further.  lods[0] is the full detail range.
+        void generateLods(const MeshLayout& layout, const MeshDequantization& dequantization, const std::vector<float>& vertexBuffer, std::vector<uint32_t>& indexBuffer, std::vector<MeshLod>& lods) const {
+            lods.assign(1, MeshLod{ 0, (uint32_t)indexBuffer.size(), 0.0f });
+            if (lodCount <= 1) {
+                return;
+            }
+
+            // Without positions there is nothing to simplify
+            std::vector<glm::vec3> positions;
+            if (!decodePositions(layout, dequantization, vertexBuffer, positions)) {
+                return;
+            }
+            const uint32_t count = (uint32_t)positions.size();
+
+            // Every level is simplified from the previous one, so their errors add up
+            std::vector<uint32_t> lod(indexBuffer);
+            float error = 0.0f;
+            while (lods.size() < lodCount) {
+                float lodError = 0.0f;
+                std::vector<uint32_t> simplified = MeshSimplifier::simplify(lod, positions.data(), sizeof(glm::vec3), count, lod.size() / 6 * 3, FLT_MAX, &lodError);
+                if (simplified.empty() || simplified.size() == lod.size()) {
+                    break;
+                }
+                lod.swap(simplified);
+                MeshOptimizer::optimizeVertexCache(lod, count);
+                error += lodError;
+                lods.push_back(MeshLod{ (uint32_t)indexBuffer.size(), (uint32_t)lod.size(), error });
+                indexBuffer.insert(indexBuffer.end(), lod.begin(), lod.end());
+            }
+        }
+
+        // Create vertex and index buffer with given layout
+        MeshBuffer createBuffers(const Context& context, const std::vector<VertexLayout>& layout, float scale) {
+            std::vector<float> vertexBuffer;
+            std::vector<uint32_t> indexBuffer;
+            MeshDequantization dequantization;
+            interleave(layout, scale, vertexBuffer, indexBuffer, dequantization);
+            std::vector<MeshLod> lods;
+            std::vector<MeshCluster> clusters;
+            postProcess(layout, dequantization, vertexBuffer, indexBuffer, lods, clusters);
 
             dim.min *= scale;
             dim.max *= scale;
             dim.size *= scale;
 
+            return createBuffers(context, vertexBuffer.data(), vertexBuffer.size() * sizeof(float), indexBuffer.data(), (uint32_t)indexBuffer.size(), dim.size, dequantization, lods.data(), (uint32_t)lods.size(), clusters.data(), (uint32_t)clusters.size());
+        }
+
+        // Key of the mesh cache entry loadBuffers uses for the file with the current options
+        MeshCache::Key getCacheKey(const std::string& filename, const MeshLayout& layout, float scale, int flags = DEFAULT_FLAGS) const {
+            MappedFile source;
+            if (!source.open(filename)) {
+                throw std::runtime_error("Unable to open " + filename);
+            }
+            MeshCache::Key key;
+            key.sourceHash = hashBytes(source.data, source.size);
+            key.importFlags = (uint32_t)flags;
+            key.options = options;
+            key.lodCount = lodCount;
+            key.scale = scale;
+            key.layout.assign(layout.begin(), layout.end());
+            return key;
+        }
+
+        // Load the mesh through the binary mesh cache, Assimp only runs if there is no matching cache entry.
+        // The cache entry is mapped and copied straight into the staging ring.
+        MeshBuffer loadBuffers(const Context& context, const std::string& filename, const MeshLayout& layout, float scale, int flags = DEFAULT_FLAGS) {
+            MeshCache cache(getCachePath());
+            MeshCache::Key key;
+            loadedFromCache = false;
+            if (cache.isEnabled()) {
+                key = getCacheKey(filename, layout, scale, flags);
+
+                MappedFile cached;
+                MeshCache::Entry entry;
+                if (cache.load(key, cached, entry)) {
+                    loadedFromCache = true;
+                    dim.min = entry.dimMin;
+                    dim.max = entry.dimMax;
+                    dim.size = entry.dimSize;
+                    numVertices = (uint32_t)(entry.vertexBytes / vertexSize(layout));
+                    MeshDequantization dequantization;
+                    dequantization.position = entry.positionDequantization;
+                    dequantization.uv = entry.uvDequantization;
+                    return createBuffers(context, entry.vertexData, entry.vertexBytes, entry.indexData, entry.indexCount, dim.size, dequantization, entry.lods, entry.lodCount, entry.clusters, entry.clusterCount);
+                }
+            }
+
+            std::vector<float> vertexBuffer;
             std::vector<uint32_t> indexBuffer;
-            for (uint32_t m = 0; m < m_Entries.size(); m++) {
-                uint32_t indexBase = (uint32_t)indexBuffer.size();
-                for (uint32_t i = 0; i < m_Entries[m].Indices.size(); i++) {
-                    indexBuffer.push_back(m_Entries[m].Indices[i] + indexBase);
+            MeshDequantization dequantization;
+            importBuffers(filename, flags, layout, scale, vertexBuffer, indexBuffer, dequantization);
+            assert(numVertices > 0);
+            std::vector<MeshLod> lods;
+            std::vector<MeshCluster> clusters;
+            postProcess(layout, dequantization, vertexBuffer, indexBuffer, lods, clusters);
+            dim.min *= scale;
+            dim.max *= scale;
+            dim.size *= scale;
+
+            if (cache.isEnabled()) {
+                MeshCache::Entry entry;
+                entry.vertexData = vertexBuffer.data();
+                entry.vertexBytes = vertexBuffer.size() * sizeof(float);
+                entry.indexData = indexBuffer.data();
+                entry.indexCount = (uint32_t)indexBuffer.size();
+                entry.dimMin = dim.min;
+                entry.dimMax = dim.max;
+                entry.dimSize = dim.size;
+                entry.positionDequantization = dequantization.position;
+                entry.uvDequantization = dequantization.uv;
+                entry.lods = lods.data();
+                entry.lodCount = (uint32_t)lods.size();
+                entry.clusters = clusters.data();
+                entry.clusterCount = (uint32_t)clusters.size();
+                for (const auto& dependency : dependencies) {
+                    MeshCache::Dependency item;
+                    item.path = dependency;
+                    item.hash = hashFile(dependency);
+                    entry.dependencies.push_back(item);
+                }
+                if (!cache.store(key, entry)) {
+                    std::cerr << "Unable to write mesh cache entry for " << filename << std::endl;
                 }
             }
 
-            meshBuffer.indexCount = (uint32_t)indexBuffer.size();
-            // Use staging buffer to move vertex and index buffer to device local memory
+            return createBuffers(context, vertexBuffer.data(), vertexBuffer.size() * sizeof(float), indexBuffer.data(), (uint32_t)indexBuffer.size(), dim.size, dequantization, lods.data(), (uint32_t)lods.size(), clusters.data(), (uint32_t)clusters.size());
+        }
+
+        // True if the last loadBuffers call was served from the mesh cache
+        bool loadedFromCache{ false };
+        // Results of the last optimizeBuffers call, not set if the optimized data came from the mesh cache
+        MeshOptimizer::Stats optimizeStats;
+
+    private:
+        // Welding, clustering and LOD generation as requested by options and lodCount.  Clusters come first
+        // so the LODs are simplified from the final full detail order.
+        void postProcess(const MeshLayout& layout, const MeshDequantization& dequantization, std::vector<float>& vertexBuffer, std::vector<uint32_t>& indexBuffer, std::vector<MeshLod>& lods, std::vector<MeshCluster>& clusters) {
+            if ((options & (OPTION_OPTIMIZE | OPTION_CLUSTERS)) || lodCount > 1) {
+                optimizeBuffers(layout, vertexBuffer, indexBuffer);
+            }
+            if (options & OPTION_CLUSTERS) {
+                buildClusters(layout, dequantization, vertexBuffer, indexBuffer, clusters);
+            }
+            generateLods(layout, dequantization, vertexBuffer, indexBuffer, lods);
+        }
+
+        MeshBuffer createBuffers(const Context& context, const void* vertexData, vk::DeviceSize vertexBytes, const uint32_t* indexData, uint32_t indexCount, const glm::vec3& size, const MeshDequantization& dequantization, const MeshLod* lods, uint32_t lodCount, const MeshCluster* clusters, uint32_t clusterCount) {
+            MeshBuffer meshBuffer;
+            meshBuffer.lods.assign(lods, lods + lodCount);
+            meshBuffer.clusters.assign(clusters, clusters + clusterCount);
+            // The coarser levels follow the full detail indices
+            meshBuffer.indexCount = lodCount ? lods[0].indexCount : indexCount;
+            // Use staging buffer to move vertex and index buffer to device local memory, both in one submit
+            context.beginUploadBatch();
             // Vertex buffer
-            meshBuffer.vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
+            meshBuffer.vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBytes, vertexData);
             // Index buffer
-            meshBuffer.indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
-            meshBuffer.dim = dim.size;
+            meshBuffer.indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexCount * sizeof(uint32_t), indexData);
+            context.endUploadBatch();
+            meshBuffer.dim = size;
+            meshBuffer.dequantization = dequantization;
             return meshBuffer;
         }
     };
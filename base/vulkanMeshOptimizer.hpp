@@ -0,0 +1,475 @@
+/*
+* Vertex cache, overdraw and vertex fetch optimization for indexed triangle lists
+*
+* Runs on the interleaved output of the mesh loader before it is written to the mesh cache:
+* identical vertices are welded, triangles are reordered for the post transform vertex cache
+* (Tipsify, Sander et al. 2007), clusters of triangles are sorted front to back for lower
+* overdraw and finally the vertices are reordered to the order of first use.
+*
+* The vertex cache order trades some vertex fetch for fewer transformed vertices: fanning around a
+* vertex revisits neighbours whose cache lines may have been evicted, so on meshes whose input order
+* was already linear (grids, tori) up to 20-25% more bytes are fetched than in the input order.  The
+* overdraw sort is dropped when it would add more vertex fetch than its threshold allows.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mappedFile.hpp"
+
+namespace vkx {
+
+    class MeshOptimizer {
+    public:
+        // Modelled FIFO cache size, small enough to hold on all current GPUs
+        static const uint32_t CACHE_SIZE = 16;
+        // Modelled vertex fetch cache (16 KiB), in lines of FETCH_LINE_SIZE bytes
+        static const uint32_t FETCH_LINE_SIZE = 64;
+        static const uint32_t FETCH_CACHE_LINES = 256;
+
+        struct VertexCacheStats {
+            uint32_t triangles{ 0 };
+            uint32_t vertices{ 0 };
+            uint32_t misses{ 0 };
+            // Average cache miss ratio, transformed vertices per triangle (0.5 best, 3.0 worst)
+            float acmr{ 0.0f };
+            // Average transform to vertex ratio (1.0 best)
+            float atvr{ 0.0f };
+        };
+
+        struct VertexFetchStats {
+            uint64_t bytesFetched{ 0 };
+            // Bytes fetched relative to the size of the vertex buffer (1.0 best)
+            float overfetch{ 0.0f };
+        };
+
+        struct Stats {
+            uint32_t verticesBefore{ 0 };
+            uint32_t verticesAfter{ 0 };
+            VertexCacheStats cacheBefore;
+            VertexCacheStats cacheAfter;
+            VertexFetchStats fetchBefore;
+            VertexFetchStats fetchAfter;
+        };
+
+        // Run all passes on an interleaved vertex buffer, positionOffset is the byte offset of the
+        // vec3 position in a vertex (overdraw sorting is skipped if it is negative).
+        // A threshold > 1 allows the overdraw pass to trade that much cache efficiency for better sorting.
+        static Stats optimize(std::vector<float>& vertices, uint32_t vertexStride, int32_t positionOffset, std::vector<uint32_t>& indices, float overdrawThreshold = 1.05f) {
+            assert(vertexStride % sizeof(float) == 0);
+            Stats stats;
+            uint32_t vertexCount = (uint32_t)(vertices.size() * sizeof(float) / vertexStride);
+            stats.verticesBefore = vertexCount;
+            stats.cacheBefore = analyzeVertexCache(indices, vertexCount);
+            stats.fetchBefore = analyzeVertexFetch(indices, vertexCount, vertexStride);
+
+            std::vector<uint32_t> remap;
+            uint32_t uniqueCount = weldVertices(vertices.data(), vertexCount, vertexStride, remap);
+            for (auto& index : indices) {
+                index = remap[index];
+            }
+            std::vector<float> welded(uniqueCount * vertexStride / sizeof(float));
+            remapVertices(welded.data(), vertices.data(), vertexCount, vertexStride, remap);
+            vertices.swap(welded);
+            vertexCount = uniqueCount;
+
+            optimizeVertexCache(indices, vertexCount);
+            if (positionOffset >= 0) {
+                // Sorted clusters no longer share vertices with their neighbours, which costs vertex fetch.  Keep the
+                // sorted order only if that cost stays within the threshold as well.
+                std::vector<uint32_t> sorted = indices;
+                optimizeOverdraw(sorted, (const uint8_t*)vertices.data() + positionOffset, vertexStride, vertexCount, overdrawThreshold);
+                if (analyzeFetchedOrder(sorted, vertexCount, vertexStride).bytesFetched <= analyzeFetchedOrder(indices, vertexCount, vertexStride).bytesFetched * overdrawThreshold) {
+                    indices.swap(sorted);
+                }
+            }
+            vertexCount = optimizeVertexFetch(vertices, vertexStride, indices);
+
+            stats.verticesAfter = vertexCount;
+            stats.cacheAfter = analyzeVertexCache(indices, vertexCount);
+            stats.fetchAfter = analyzeVertexFetch(indices, vertexCount, vertexStride);
+            return stats;
+        }
+
+        // Build a remap table that maps every vertex to the first vertex with identical bytes,
+        // numbered in order of first appearance.  Returns the number of unique vertices.
+        static uint32_t weldVertices(const void* vertices, uint32_t vertexCount, uint32_t vertexStride, std::vector<uint32_t>& remap) {
+            const uint8_t* data = (const uint8_t*)vertices;
+            remap.assign(vertexCount, INVALID);
+
+            // Open addressing table of vertex indices, kept at most half full
+            uint32_t tableSize = 1;
+            while (tableSize < vertexCount * 2) {
+                tableSize *= 2;
+            }
+            std::vector<uint32_t> table(tableSize, INVALID);
+
+            uint32_t uniqueCount = 0;
+            for (uint32_t i = 0; i < vertexCount; ++i) {
+                const uint8_t* vertex = data + (size_t)i * vertexStride;
+                uint32_t slot = (uint32_t)hashBytes(vertex, vertexStride) & (tableSize - 1);
+                for (uint32_t probe = 1;; ++probe) {
+                    uint32_t existing = table[slot];
+                    if (existing == INVALID) {
+                        table[slot] = i;
+                        remap[i] = uniqueCount++;
+                        break;
+                    }
+                    if (!memcmp(vertex, data + (size_t)existing * vertexStride, vertexStride)) {
+                        remap[i] = remap[existing];
+                        break;
+                    }
+                    slot = (slot + probe) & (tableSize - 1);
+                }
+            }
+            return uniqueCount;
+        }
+
+        // Copy the vertices to their remapped location, vertices mapped to INVALID are dropped
+        static void remapVertices(void* destination, const void* vertices, uint32_t vertexCount, uint32_t vertexStride, const std::vector<uint32_t>& remap) {
+            for (uint32_t i = 0; i < vertexCount; ++i) {
+                if (remap[i] != INVALID) {
+                    memcpy((uint8_t*)destination + (size_t)remap[i] * vertexStride, (const uint8_t*)vertices + (size_t)i * vertexStride, vertexStride);
+                }
+            }
+        }
+
+        // Tipsify: fan out from the current vertex, emitting all of its remaining triangles, then continue with
+        // the adjacent vertex that will stay in the cache longest.  Dead ends fall back to recently used vertices.
+        static void optimizeVertexCache(std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = CACHE_SIZE) {
+            const uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+            if (!triangleCount) {
+                return;
+            }
+            Adjacency adjacency(indices, vertexCount);
+            std::vector<uint32_t> live = adjacency.counts;
+            std::vector<uint32_t> timestamps(vertexCount, 0);
+            std::vector<uint8_t> emitted(triangleCount, 0);
+            std::vector<uint32_t> deadEnd;
+            deadEnd.reserve(indices.size());
+            std::vector<uint32_t> candidates;
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+
+            uint32_t timestamp = cacheSize + 1;
+            uint32_t cursor = 0;
+            uint32_t current = nextLiveVertex(live, cursor);
+            while (current != INVALID) {
+                candidates.clear();
+                for (uint32_t k = adjacency.offsets[current]; k < adjacency.offsets[current + 1]; ++k) {
+                    uint32_t triangle = adjacency.triangles[k];
+                    if (emitted[triangle]) {
+                        continue;
+                    }
+                    emitted[triangle] = 1;
+                    for (uint32_t corner = 0; corner < 3; ++corner) {
+                        uint32_t vertex = indices[triangle * 3 + corner];
+                        result.push_back(vertex);
+                        deadEnd.push_back(vertex);
+                        candidates.push_back(vertex);
+                        --live[vertex];
+                        if (timestamp - timestamps[vertex] > cacheSize) {
+                            timestamps[vertex] = timestamp++;
+                        }
+                    }
+                }
+
+                // Prefer the candidate that entered the cache earliest if it survives emitting its remaining triangles
+                uint32_t best = INVALID;
+                int32_t bestPriority = -1;
+                for (auto vertex : candidates) {
+                    if (!live[vertex]) {
+                        continue;
+                    }
+                    int32_t priority = 0;
+                    if (timestamp - timestamps[vertex] + 2 * live[vertex] <= cacheSize) {
+                        priority = (int32_t)(timestamp - timestamps[vertex]);
+                    }
+                    if (priority > bestPriority) {
+                        best = vertex;
+                        bestPriority = priority;
+                    }
+                }
+                while (best == INVALID && !deadEnd.empty()) {
+                    uint32_t vertex = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (live[vertex]) {
+                        best = vertex;
+                    }
+                }
+                if (best == INVALID) {
+                    best = nextLiveVertex(live, cursor);
+                }
+                current = best;
+            }
+            assert(result.size() == indices.size());
+            indices.swap(result);
+        }
+
+        // Split the cache optimized triangle order into clusters and sort the clusters so that the ones facing
+        // outwards are drawn first.  Clusters end where the cache gets flushed (all three vertices miss) and,
+        // within the threshold, where the running ACMR is low enough that a split costs little cache efficiency.
+        static void optimizeOverdraw(std::vector<uint32_t>& indices, const void* positions, uint32_t positionStride, uint32_t vertexCount, float threshold = 1.05f, uint32_t cacheSize = CACHE_SIZE) {
+            const uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+            if (triangleCount < 2) {
+                return;
+            }
+            // Hard boundaries: triangles that miss the cache on all three vertices
+            std::vector<uint32_t> clusters;
+            {
+                std::vector<uint32_t> timestamps(vertexCount, 0);
+                uint32_t timestamp = cacheSize + 1;
+                for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+                    uint32_t misses = 0;
+                    for (uint32_t corner = 0; corner < 3; ++corner) {
+                        uint32_t vertex = indices[triangle * 3 + corner];
+                        if (timestamp - timestamps[vertex] > cacheSize) {
+                            timestamps[vertex] = timestamp++;
+                            ++misses;
+                        }
+                    }
+                    if (triangle == 0 || misses == 3) {
+                        clusters.push_back(triangle);
+                    }
+                }
+            }
+
+            // Soft boundaries: restart the cache at every hard cluster and split further wherever the ACMR since the
+            // last split is within threshold of the ACMR of the whole hard cluster
+            std::vector<uint32_t> softClusters;
+            {
+                std::vector<uint32_t> timestamps(vertexCount, 0);
+                uint32_t timestamp = 0;
+                for (size_t c = 0; c < clusters.size(); ++c) {
+                    uint32_t begin = clusters[c];
+                    uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+                    timestamp += cacheSize + 1;
+                    uint32_t clusterMisses = 0;
+                    for (uint32_t triangle = begin; triangle < end; ++triangle) {
+                        for (uint32_t corner = 0; corner < 3; ++corner) {
+                            uint32_t vertex = indices[triangle * 3 + corner];
+                            if (timestamp - timestamps[vertex] > cacheSize) {
+                                timestamps[vertex] = timestamp++;
+                                ++clusterMisses;
+                            }
+                        }
+                    }
+                    float clusterAcmr = (float)clusterMisses / (float)(end - begin);
+
+                    timestamp += cacheSize + 1;
+                    softClusters.push_back(begin);
+                    uint32_t start = begin;
+                    uint32_t misses = 0;
+                    for (uint32_t triangle = begin; triangle < end; ++triangle) {
+                        for (uint32_t corner = 0; corner < 3; ++corner) {
+                            uint32_t vertex = indices[triangle * 3 + corner];
+                            if (timestamp - timestamps[vertex] > cacheSize) {
+                                timestamps[vertex] = timestamp++;
+                                ++misses;
+                            }
+                        }
+                        float acmr = (float)misses / (float)(triangle + 1 - start);
+                        if (triangle + 1 < end && acmr <= clusterAcmr * threshold) {
+                            softClusters.push_back(triangle + 1);
+                            start = triangle + 1;
+                            misses = 0;
+                            // Start the next cluster with a cold cache as it may be drawn after any other cluster
+                            timestamp += cacheSize + 1;
+                        }
+                    }
+                }
+            }
+
+            // Soft boundaries add cold starts to the cache optimized order, fall back to the hard boundaries (which
+            // only split where the cache was cold anyway) if that costs more than the threshold allows
+            std::vector<uint32_t> result = sortClusters(indices, softClusters, positions, positionStride);
+            if (analyzeVertexCache(result, vertexCount, cacheSize).misses > analyzeVertexCache(indices, vertexCount, cacheSize).misses * threshold) {
+                result = sortClusters(indices, clusters, positions, positionStride);
+            }
+            indices.swap(result);
+        }
+
+        // Reorder the vertices to the order in which the indices first reference them, unreferenced
+        // vertices are dropped.  Returns the new vertex count.
+        static uint32_t optimizeVertexFetch(std::vector<float>& vertices, uint32_t vertexStride, std::vector<uint32_t>& indices) {
+            const uint32_t vertexCount = (uint32_t)(vertices.size() * sizeof(float) / vertexStride);
+            std::vector<uint32_t> remap(vertexCount, INVALID);
+            uint32_t next = 0;
+            for (auto& index : indices) {
+                if (remap[index] == INVALID) {
+                    remap[index] = next++;
+                }
+                index = remap[index];
+            }
+            std::vector<float> result(next * vertexStride / sizeof(float));
+            remapVertices(result.data(), vertices.data(), vertexCount, vertexStride, remap);
+            vertices.swap(result);
+            return next;
+        }
+
+        // Simulate a FIFO post transform cache
+        static VertexCacheStats analyzeVertexCache(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t cacheSize = CACHE_SIZE) {
+            VertexCacheStats stats;
+            stats.triangles = (uint32_t)(indices.size() / 3);
+            std::vector<uint32_t> timestamps(vertexCount, 0);
+            std::vector<uint8_t> referenced(vertexCount, 0);
+            uint32_t timestamp = cacheSize + 1;
+            for (auto index : indices) {
+                if (timestamp - timestamps[index] > cacheSize) {
+                    timestamps[index] = timestamp++;
+                    ++stats.misses;
+                }
+                if (!referenced[index]) {
+                    referenced[index] = 1;
+                    ++stats.vertices;
+                }
+            }
+            stats.acmr = stats.triangles ? (float)stats.misses / (float)stats.triangles : 0.0f;
+            stats.atvr = stats.vertices ? (float)stats.misses / (float)stats.vertices : 0.0f;
+            return stats;
+        }
+
+        // Simulate a FIFO cache of FETCH_CACHE_LINES lines for the vertex reads of every cache miss
+        static VertexFetchStats analyzeVertexFetch(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexStride, uint32_t cacheSize = CACHE_SIZE) {
+            VertexFetchStats stats;
+            const uint64_t lineCount = ((uint64_t)vertexCount * vertexStride + FETCH_LINE_SIZE - 1) / FETCH_LINE_SIZE;
+            std::vector<uint32_t> vertexTimestamps(vertexCount, 0);
+            std::vector<uint32_t> lineTimestamps((size_t)lineCount, 0);
+            uint32_t vertexTimestamp = cacheSize + 1;
+            uint32_t lineTimestamp = FETCH_CACHE_LINES + 1;
+            for (auto index : indices) {
+                if (vertexTimestamp - vertexTimestamps[index] <= cacheSize) {
+                    continue;
+                }
+                vertexTimestamps[index] = vertexTimestamp++;
+                uint64_t first = (uint64_t)index * vertexStride / FETCH_LINE_SIZE;
+                uint64_t last = ((uint64_t)index * vertexStride + vertexStride - 1) / FETCH_LINE_SIZE;
+                for (uint64_t line = first; line <= last; ++line) {
+                    if (lineTimestamp - lineTimestamps[(size_t)line] > FETCH_CACHE_LINES) {
+                        lineTimestamps[(size_t)line] = lineTimestamp++;
+                        stats.bytesFetched += FETCH_LINE_SIZE;
+                    }
+                }
+            }
+            const uint64_t vertexBytes = (uint64_t)vertexCount * vertexStride;
+            stats.overfetch = vertexBytes ? (float)((double)stats.bytesFetched / (double)vertexBytes) : 0.0f;
+            return stats;
+        }
+
+    private:
+        enum : uint32_t { INVALID = 0xffffffff };
+
+        // Vertex fetch of indices once optimizeVertexFetch has put the vertices in order of first use
+        static VertexFetchStats analyzeFetchedOrder(const std::vector<uint32_t>& indices, uint32_t vertexCount, uint32_t vertexStride) {
+            std::vector<uint32_t> remap(vertexCount, INVALID);
+            std::vector<uint32_t> remapped(indices.size());
+            uint32_t next = 0;
+            for (size_t i = 0; i < indices.size(); ++i) {
+                if (remap[indices[i]] == INVALID) {
+                    remap[indices[i]] = next++;
+                }
+                remapped[i] = remap[indices[i]];
+            }
+            return analyzeVertexFetch(remapped, next, vertexStride);
+        }
+
+        // Triangles using each vertex, in compressed row form
+        struct Adjacency {
+            std::vector<uint32_t> counts;
+            std::vector<uint32_t> offsets;
+            std::vector<uint32_t> triangles;
+
+            Adjacency(const std::vector<uint32_t>& indices, uint32_t vertexCount) : counts(vertexCount, 0), offsets(vertexCount + 1, 0), triangles(indices.size()) {
+                for (auto index : indices) {
+                    ++counts[index];
+                }
+                for (uint32_t i = 0; i < vertexCount; ++i) {
+                    offsets[i + 1] = offsets[i] + counts[i];
+                }
+                std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+                for (uint32_t i = 0; i < indices.size(); ++i) {
+                    triangles[cursor[indices[i]]++] = i / 3;
+                }
+            }
+        };
+
+        // Order the clusters by how far they face away from the mesh center, outwards facing clusters first
+        static std::vector<uint32_t> sortClusters(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& clusters, const void* positions, uint32_t positionStride) {
+            const uint32_t triangleCount = (uint32_t)(indices.size() / 3);
+            auto position = [&](uint32_t vertex) {
+                glm::vec3 result;
+                memcpy(&result, (const uint8_t*)positions + (size_t)vertex * positionStride, sizeof(result));
+                return result;
+            };
+
+            glm::vec3 meshCenter(0.0f);
+            float meshArea = 0.0f;
+            std::vector<glm::vec3> clusterCenters(clusters.size(), glm::vec3(0.0f));
+            std::vector<glm::vec3> clusterNormals(clusters.size(), glm::vec3(0.0f));
+            for (size_t c = 0; c < clusters.size(); ++c) {
+                uint32_t begin = clusters[c];
+                uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+                float clusterArea = 0.0f;
+                for (uint32_t triangle = begin; triangle < end; ++triangle) {
+                    glm::vec3 p0 = position(indices[triangle * 3 + 0]);
+                    glm::vec3 p1 = position(indices[triangle * 3 + 1]);
+                    glm::vec3 p2 = position(indices[triangle * 3 + 2]);
+                    glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+                    float area = glm::length(normal);
+                    glm::vec3 center = (p0 + p1 + p2) / 3.0f;
+                    clusterCenters[c] += center * area;
+                    clusterNormals[c] += normal;
+                    clusterArea += area;
+                }
+                meshCenter += clusterCenters[c];
+                meshArea += clusterArea;
+                clusterCenters[c] = clusterArea > 0.0f ? clusterCenters[c] / clusterArea : position(indices[begin * 3]);
+            }
+            if (meshArea > 0.0f) {
+                meshCenter /= meshArea;
+            }
+            std::vector<float> sortKeys(clusters.size());
+            for (size_t c = 0; c < clusters.size(); ++c) {
+                float length = glm::length(clusterNormals[c]);
+                glm::vec3 normal = length > 0.0f ? clusterNormals[c] / length : glm::vec3(0.0f);
+                sortKeys[c] = glm::dot(clusterCenters[c] - meshCenter, normal);
+            }
+
+            std::vector<uint32_t> order(clusters.size());
+            for (uint32_t c = 0; c < order.size(); ++c) {
+                order[c] = c;
+            }
+            std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+                return sortKeys[a] > sortKeys[b];
+            });
+
+            std::vector<uint32_t> result;
+            result.reserve(indices.size());
+            for (auto c : order) {
+                uint32_t begin = clusters[c];
+                uint32_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+                result.insert(result.end(), indices.begin() + begin * 3, indices.begin() + end * 3);
+            }
+            return result;
+        }
+
+        static uint32_t nextLiveVertex(const std::vector<uint32_t>& live, uint32_t& cursor) {
+            while (cursor < live.size()) {
+                if (live[cursor]) {
+                    return cursor;
+                }
+                ++cursor;
+            }
+            return INVALID;
+        }
+    };
+}
@@ -0,0 +1,387 @@
+/*
+* Quadric error metric mesh simplification (Garland and Heckbert 1997)
+*
+* Edges are collapsed into one of their end points, so a simplified index set references the
+* same vertex buffer as the input and all levels of detail of a mesh can share one vertex buffer.
+* Vertices on attribute seams (several vertices with the same position) only move along the seam,
+* vertices on open borders only along the border and vertices on non manifold edges stay in place.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mappedFile.hpp"
+
+namespace vkx {
+
+    class MeshSimplifier {
+    public:
+        // Collapse edges in order of increasing error until the index count is at most targetIndexCount or the next
+        // collapse would move the surface further than targetError (object space units).  Returns the new indices,
+        // resultError receives the largest error of the collapses that were done.
+        static std::vector<uint32_t> simplify(const std::vector<uint32_t>& indices, const void* positions, uint32_t positionStride, uint32_t vertexCount, size_t targetIndexCount, float targetError = FLT_MAX, float* resultError = nullptr) {
+            auto position = [&](uint32_t vertex) {
+                glm::vec3 result;
+                memcpy(&result, (const uint8_t*)positions + (size_t)vertex * positionStride, sizeof(result));
+                return result;
+            };
+
+            // Vertices sharing a position are one vertex for topology and error, the first one represents the group
+            std::vector<uint32_t> canonical(vertexCount);
+            {
+                std::unordered_map<uint64_t, std::vector<uint32_t>> groups;
+                for (uint32_t i = 0; i < vertexCount; ++i) {
+                    glm::vec3 p = position(i);
+                    auto& group = groups[hashBytes(&p, sizeof(p))];
+                    canonical[i] = i;
+                    for (auto other : group) {
+                        if (position(other) == p) {
+                            canonical[i] = other;
+                            break;
+                        }
+                    }
+                    if (canonical[i] == i) {
+                        group.push_back(i);
+                    }
+                }
+            }
+
+            std::vector<uint32_t> result = indices;
+            std::vector<Quadric> quadrics(vertexCount);
+            accumulateQuadrics(result, canonical, position, quadrics);
+
+            float maxError = 0.0f;
+            std::vector<uint32_t> remap(vertexCount);
+            std::vector<uint8_t> kinds(vertexCount);
+            std::vector<uint8_t> locked(vertexCount);
+            // Vertices in use per group, as linked lists
+            std::vector<uint32_t> wedgeHead(vertexCount);
+            std::vector<uint32_t> wedgeNext(vertexCount);
+            std::vector<std::pair<uint32_t, uint32_t>> moves;
+            std::vector<uint32_t> neighbors;
+            std::vector<uint32_t> shared;
+            std::vector<Collapse> collapses;
+            std::unordered_map<uint64_t, uint32_t> edges;
+            while (result.size() > targetIndexCount) {
+                const uint32_t triangleCount = (uint32_t)(result.size() / 3);
+
+                // Classify the vertex groups by the edges of the current mesh
+                edges.clear();
+                std::fill(wedgeHead.begin(), wedgeHead.end(), INVALID);
+                std::fill(remap.begin(), remap.end(), INVALID);
+                for (uint32_t i = 0; i < result.size(); ++i) {
+                    uint32_t vertex = result[i];
+                    if (remap[vertex] == INVALID) {
+                        remap[vertex] = vertex;
+                        wedgeNext[vertex] = wedgeHead[canonical[vertex]];
+                        wedgeHead[canonical[vertex]] = vertex;
+                    }
+                    ++edges[edgeKey(canonical[vertex], canonical[result[i - i % 3 + (i + 1) % 3]])];
+                }
+                std::fill(kinds.begin(), kinds.end(), KIND_MANIFOLD);
+                for (const auto& edge : edges) {
+                    uint32_t a = (uint32_t)(edge.first >> 32);
+                    uint32_t b = (uint32_t)edge.first;
+                    if (edge.second > 2) {
+                        kinds[a] = kinds[b] = KIND_LOCKED;
+                    } else if (edge.second == 1) {
+                        kinds[a] = std::max<uint8_t>(kinds[a], KIND_BORDER);
+                        kinds[b] = std::max<uint8_t>(kinds[b], KIND_BORDER);
+                    }
+                }
+
+                // Collapses of one vertex into the other end point of one of its edges
+                collapses.clear();
+                for (uint32_t i = 0; i < result.size(); ++i) {
+                    uint32_t from = result[i];
+                    uint32_t to = result[i - i % 3 + (i + 1) % 3];
+                    for (uint32_t direction = 0; direction < 2; ++direction, std::swap(from, to)) {
+                        uint32_t cf = canonical[from];
+                        uint32_t ct = canonical[to];
+                        if (cf == ct || kinds[cf] == KIND_LOCKED) {
+                            continue;
+                        }
+                        bool border = edges[edgeKey(cf, ct)] == 1;
+                        if (kinds[cf] == KIND_BORDER && !border) {
+                            continue;
+                        }
+                        Quadric quadric = quadrics[cf];
+                        quadric.add(quadrics[ct]);
+                        collapses.push_back({ from, to, quadric.error(position(to)), border });
+                    }
+                }
+                std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+                    return a.error < b.error;
+                });
+
+                // Triangles around each vertex group, in compressed row form
+                std::vector<uint32_t> offsets(vertexCount + 1, 0);
+                for (auto vertex : result) {
+                    ++offsets[canonical[vertex] + 1];
+                }
+                for (uint32_t i = 0; i < vertexCount; ++i) {
+                    offsets[i + 1] += offsets[i];
+                }
+                std::vector<uint32_t> adjacency(result.size());
+                {
+                    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+                    for (uint32_t i = 0; i < result.size(); ++i) {
+                        adjacency[cursor[canonical[result[i]]]++] = i / 3;
+                    }
+                }
+
+                // Collapse in order of error, each collapse locks the one ring of the removed vertex for this pass
+                // so the validity checks only ever see original triangles
+                std::fill(locked.begin(), locked.end(), 0);
+                const uint32_t trianglesToRemove = (uint32_t)((result.size() - targetIndexCount + 2) / 3);
+                uint32_t removed = 0;
+                bool errorLimited = false;
+                for (const auto& collapse : collapses) {
+                    if (removed >= trianglesToRemove) {
+                        break;
+                    }
+                    float error = sqrtf(std::max(collapse.error, 0.0f));
+                    if (error > targetError) {
+                        errorLimited = true;
+                        break;
+                    }
+                    uint32_t cf = canonical[collapse.from];
+                    uint32_t ct = canonical[collapse.to];
+                    if (locked[cf] || locked[ct]) {
+                        continue;
+                    }
+
+                    // Link condition: the end points may only share the vertices opposite the collapsed edge
+                    neighbors.clear();
+                    for (uint32_t k = offsets[cf]; k < offsets[cf + 1]; ++k) {
+                        for (uint32_t corner = 0; corner < 3; ++corner) {
+                            neighbors.push_back(canonical[result[adjacency[k] * 3 + corner]]);
+                        }
+                    }
+                    std::sort(neighbors.begin(), neighbors.end());
+                    neighbors.erase(std::unique(neighbors.begin(), neighbors.end()), neighbors.end());
+                    shared.clear();
+                    for (uint32_t k = offsets[ct]; k < offsets[ct + 1]; ++k) {
+                        for (uint32_t corner = 0; corner < 3; ++corner) {
+                            uint32_t neighbor = canonical[result[adjacency[k] * 3 + corner]];
+                            if (neighbor != cf && neighbor != ct && std::binary_search(neighbors.begin(), neighbors.end(), neighbor) &&
+                                std::find(shared.begin(), shared.end(), neighbor) == shared.end()) {
+                                shared.push_back(neighbor);
+                            }
+                        }
+                    }
+                    if (shared.size() > (collapse.border ? 1u : 2u)) {
+                        continue;
+                    }
+
+                    // Every vertex of the group moves to the vertex of the target group it shares a triangle with.  That
+                    // only exists, and is unique, for all of them if the edge runs inside an attribute chart or along a seam.
+                    moves.clear();
+                    bool matched = true;
+                    for (uint32_t wedge = wedgeHead[cf]; wedge != INVALID && matched; wedge = wedgeNext[wedge]) {
+                        uint32_t match = INVALID;
+                        for (uint32_t k = offsets[cf]; k < offsets[cf + 1] && matched; ++k) {
+                            const uint32_t* triangle = &result[adjacency[k] * 3];
+                            if (triangle[0] != wedge && triangle[1] != wedge && triangle[2] != wedge) {
+                                continue;
+                            }
+                            for (uint32_t corner = 0; corner < 3; ++corner) {
+                                if (canonical[triangle[corner]] == ct) {
+                                    matched = match == INVALID || match == triangle[corner];
+                                    match = triangle[corner];
+                                }
+                            }
+                        }
+                        matched = matched && match != INVALID;
+                        moves.push_back({ wedge, match });
+                    }
+                    if (!matched) {
+                        continue;
+                    }
+
+                    // Reject collapses that flip a remaining triangle or fold it onto a triangle around the target,
+                    // which is what is left of closed shapes collapsing into themselves
+                    bool flips = false;
+                    glm::vec3 target = position(collapse.to);
+                    for (uint32_t k = offsets[cf]; k < offsets[cf + 1] && !flips; ++k) {
+                        const uint32_t* triangle = &result[adjacency[k] * 3];
+                        if (canonical[triangle[0]] == ct || canonical[triangle[1]] == ct || canonical[triangle[2]] == ct) {
+                            continue;
+                        }
+                        for (uint32_t j = offsets[ct]; j < offsets[ct + 1] && !flips; ++j) {
+                            uint32_t matches = 0;
+                            for (uint32_t corner = 0; corner < 3; ++corner) {
+                                uint32_t vertex = canonical[triangle[corner]];
+                                const uint32_t* other = &result[adjacency[j] * 3];
+                                matches += vertex != cf && (canonical[other[0]] == vertex || canonical[other[1]] == vertex || canonical[other[2]] == vertex);
+                            }
+                            flips = matches == 2;
+                        }
+                        glm::vec3 p[3] = { position(triangle[0]), position(triangle[1]), position(triangle[2]) };
+                        glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                        for (uint32_t corner = 0; corner < 3; ++corner) {
+                            if (canonical[triangle[corner]] == cf) {
+                                p[corner] = target;
+                            }
+                        }
+                        glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                        flips = flips || glm::dot(before, after) <= 0.0f;
+                    }
+                    if (flips) {
+                        continue;
+                    }
+
+                    for (const auto& move : moves) {
+                        remap[move.first] = move.second;
+                    }
+                    quadrics[ct].add(quadrics[cf]);
+                    for (uint32_t k = offsets[cf]; k < offsets[cf + 1]; ++k) {
+                        for (uint32_t corner = 0; corner < 3; ++corner) {
+                            locked[canonical[result[adjacency[k] * 3 + corner]]] = 1;
+                        }
+                    }
+                    maxError = std::max(maxError, error);
+                    removed += collapse.border ? 1 : 2;
+                }
+
+                // Drop the triangles that became degenerate
+                uint32_t write = 0;
+                for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+                    uint32_t a = remap[result[triangle * 3 + 0]];
+                    uint32_t b = remap[result[triangle * 3 + 1]];
+                    uint32_t c = remap[result[triangle * 3 + 2]];
+                    if (canonical[a] == canonical[b] || canonical[b] == canonical[c] || canonical[a] == canonical[c]) {
+                        continue;
+                    }
+                    result[write++] = a;
+                    result[write++] = b;
+                    result[write++] = c;
+                }
+                bool progress = write < result.size();
+                result.resize(write);
+                if (!progress || errorLimited) {
+                    break;
+                }
+            }
+
+            if (resultError) {
+                *resultError = maxError;
+            }
+            return result;
+        }
+
+    private:
+        enum : uint32_t { INVALID = 0xffffffff };
+
+        enum Kind : uint8_t {
+            KIND_MANIFOLD,
+            // Only collapses along an open border edge
+            KIND_BORDER,
+            // On a non manifold edge, never collapses
+            KIND_LOCKED,
+        };
+
+        // Border edges get a plane perpendicular to the surface, weighted higher to keep the outline
+        static constexpr float BORDER_WEIGHT = 10.0f;
+
+        struct Collapse {
+            uint32_t from;
+            uint32_t to;
+            float error;
+            bool border;
+        };
+
+        // Sum of squared distances to a set of weighted planes, error() is the weighted mean
+        struct Quadric {
+            float a00{ 0 }, a11{ 0 }, a22{ 0 }, a01{ 0 }, a02{ 0 }, a12{ 0 };
+            float b0{ 0 }, b1{ 0 }, b2{ 0 };
+            float c{ 0 };
+            float weight{ 0 };
+
+            void addPlane(const glm::vec3& n, float d, float w) {
+                a00 += w * n.x * n.x;
+                a11 += w * n.y * n.y;
+                a22 += w * n.z * n.z;
+                a01 += w * n.x * n.y;
+                a02 += w * n.x * n.z;
+                a12 += w * n.y * n.z;
+                b0 += w * n.x * d;
+                b1 += w * n.y * d;
+                b2 += w * n.z * d;
+                c += w * d * d;
+                weight += w;
+            }
+
+            void add(const Quadric& q) {
+                a00 += q.a00; a11 += q.a11; a22 += q.a22;
+                a01 += q.a01; a02 += q.a02; a12 += q.a12;
+                b0 += q.b0; b1 += q.b1; b2 += q.b2;
+                c += q.c;
+                weight += q.weight;
+            }
+
+            // Squared distance
+            float error(const glm::vec3& p) const {
+                float result =
+                    a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+                    2.0f * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+                    2.0f * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+                return weight > 0.0f ? result / weight : 0.0f;
+            }
+        };
+
+        static uint64_t edgeKey(uint32_t a, uint32_t b) {
+            return a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a;
+        }
+
+        // Area weighted triangle planes, plus perpendicular planes along open borders
+        template <typename PositionFn>
+        static void accumulateQuadrics(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& canonical, const PositionFn& position, std::vector<Quadric>& quadrics) {
+            std::unordered_map<uint64_t, uint32_t> edges;
+            for (uint32_t i = 0; i < indices.size(); ++i) {
+                ++edges[edgeKey(canonical[indices[i]], canonical[indices[i - i % 3 + (i + 1) % 3]])];
+            }
+            for (uint32_t triangle = 0; triangle < indices.size() / 3; ++triangle) {
+                const uint32_t* t = &indices[triangle * 3];
+                glm::vec3 p[3] = { position(t[0]), position(t[1]), position(t[2]) };
+                glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+                float area = glm::length(normal);
+                if (area == 0.0f) {
+                    continue;
+                }
+                normal /= area;
+                Quadric quadric;
+                quadric.addPlane(normal, -glm::dot(normal, p[0]), area * 0.5f);
+                for (uint32_t corner = 0; corner < 3; ++corner) {
+                    quadrics[canonical[t[corner]]].add(quadric);
+                }
+                for (uint32_t corner = 0; corner < 3; ++corner) {
+                    uint32_t a = canonical[t[corner]];
+                    uint32_t b = canonical[t[(corner + 1) % 3]];
+                    if (edges[edgeKey(a, b)] != 1) {
+                        continue;
+                    }
+                    glm::vec3 edge = p[(corner + 1) % 3] - p[corner];
+                    float length = glm::length(edge);
+                    glm::vec3 perpendicular = glm::cross(edge / length, normal);
+                    Quadric border;
+                    border.addPlane(perpendicular, -glm::dot(perpendicular, p[corner]), length * length * BORDER_WEIGHT);
+                    quadrics[a].add(border);
+                    quadrics[b].add(border);
+                }
+            }
+        }
+    };
+}
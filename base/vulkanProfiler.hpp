@@ -0,0 +1,311 @@
+/*
+* GPU profiler built on timestamp and pipeline statistics queries
+*
+* Zones bracket commands with a pair of timestamps and a debug marker region, so the same
+* regions show up in frame debuggers and in the profiler.  Every frame in flight has its own
+* range of queries, which is read back without waiting when the frame comes around again.
+* Zones have to be recorded into command buffers that are recorded every frame.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <fstream>
+
+#include "vulkanContext.hpp"
+#include "json.hpp"
+
+namespace vkx {
+
+    class GpuProfiler {
+    public:
+        struct ZoneResult {
+            std::string name;
+            uint32_t depth{ 0 };
+            // Milliseconds, begin is relative to the first zone of the frame
+            float begin{ 0.0f };
+            float duration{ 0.0f };
+        };
+
+        struct PipelineStatistics {
+            uint64_t inputAssemblyPrimitives{ 0 };
+            uint64_t vertexShaderInvocations{ 0 };
+            uint64_t clippingPrimitives{ 0 };
+            uint64_t fragmentShaderInvocations{ 0 };
+            uint64_t computeShaderInvocations{ 0 };
+        };
+
+        // Brackets the commands recorded during its lifetime.  Without a profiler only the debug marker is emitted.
+        class Zone {
+        public:
+            Zone(GpuProfiler* profiler, const vk::CommandBuffer& cmdBuffer, const std::string& name, const glm::vec4& color = glm::vec4(0.8f))
+                : profiler(profiler), cmdBuffer(cmdBuffer) {
+                if (debug::marker::active) {
+                    debug::marker::beginRegion(cmdBuffer, name, color);
+                }
+                if (profiler) {
+                    profiler->beginZone(cmdBuffer, name);
+                }
+            }
+
+            ~Zone() {
+                if (profiler) {
+                    profiler->endZone(cmdBuffer);
+                }
+                if (debug::marker::active) {
+                    debug::marker::endRegion(cmdBuffer);
+                }
+            }
+
+        private:
+            GpuProfiler* profiler;
+            vk::CommandBuffer cmdBuffer;
+        };
+
+        // True if the graphics queue can write timestamps
+        static bool isSupported(const Context& context) {
+            return 0 != context.physicalDevice.getQueueFamilyProperties()[context.graphicsQueueIndex].timestampValidBits;
+        }
+
+        // frameCount is the number of frames in flight, results are available frameCount frames later
+        GpuProfiler(const Context& context, uint32_t frameCount, uint32_t maxZones = 64) : device(context.device), maxZones(maxZones) {
+            timestampPeriod = context.deviceProperties.limits.timestampPeriod;
+            frames.resize(frameCount);
+
+            vk::QueryPoolCreateInfo queryPoolInfo;
+            queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+            queryPoolInfo.queryCount = frameCount * maxZones * 2;
+            timestampPool = device.createQueryPool(queryPoolInfo);
+
+            // Pipeline statistics are optional, and secondary command buffers can only contribute to them
+            // when queries may be inherited
+            if (context.deviceFeatures.pipelineStatisticsQuery && context.deviceFeatures.inheritedQueries) {
+                queryPoolInfo.queryType = vk::QueryType::ePipelineStatistics;
+                queryPoolInfo.queryCount = frameCount;
+                queryPoolInfo.pipelineStatistics = getStatisticsFlags();
+                statisticsPool = device.createQueryPool(queryPoolInfo);
+            }
+        }
+
+        void destroy() {
+            device.destroyQueryPool(timestampPool);
+            if (statisticsPool) {
+                device.destroyQueryPool(statisticsPool);
+            }
+        }
+
+        // Flags secondary command buffers executed during the statistics query have to inherit
+        vk::QueryPipelineStatisticFlags getStatisticsFlags() const {
+            return vk::QueryPipelineStatisticFlagBits::eInputAssemblyPrimitives |
+                vk::QueryPipelineStatisticFlagBits::eVertexShaderInvocations |
+                vk::QueryPipelineStatisticFlagBits::eClippingPrimitives |
+                vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations |
+                vk::QueryPipelineStatisticFlagBits::eComputeShaderInvocations;
+        }
+
+        // Record at the start of the frame's first command buffer.  Reads back the results of the frame
+        // that last used this frame's queries, then resets them.
+        void beginFrame(const vk::CommandBuffer& cmdBuffer) {
+            frameIndex = (frameIndex + 1) % (uint32_t)frames.size();
+            Frame& frame = frames[frameIndex];
+            readResults(frame);
+
+            frame.zones.clear();
+            frame.statistics = false;
+            frame.frameNumber = frameNumber++;
+            openZones.clear();
+            cmdBuffer.resetQueryPool(timestampPool, frameIndex * maxZones * 2, maxZones * 2);
+            if (statisticsPool) {
+                cmdBuffer.resetQueryPool(statisticsPool, frameIndex, 1);
+            }
+        }
+
+        void beginZone(const vk::CommandBuffer& cmdBuffer, const std::string& name) {
+            Frame& frame = frames[frameIndex];
+            if (frame.zones.size() >= maxZones) {
+                // Out of queries, the zone is dropped but the nesting is kept intact
+                openZones.push_back(UINT32_MAX);
+                return;
+            }
+            PendingZone zone;
+            zone.name = name;
+            zone.depth = (uint32_t)openZones.size();
+            openZones.push_back((uint32_t)frame.zones.size());
+            cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timestampPool, getQuery(frame.zones.size(), 0));
+            frame.zones.push_back(zone);
+        }
+
+        void endZone(const vk::CommandBuffer& cmdBuffer) {
+            assert(!openZones.empty());
+            uint32_t zone = openZones.back();
+            openZones.pop_back();
+            if (zone != UINT32_MAX) {
+                cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timestampPool, getQuery(zone, 1));
+            }
+        }
+
+        // Pipeline statistics for the frame, once per frame and outside of a render pass
+        void beginStatistics(const vk::CommandBuffer& cmdBuffer) {
+            if (statisticsPool) {
+                cmdBuffer.beginQuery(statisticsPool, frameIndex, vk::QueryControlFlags());
+                frames[frameIndex].statistics = true;
+            }
+        }
+
+        void endStatistics(const vk::CommandBuffer& cmdBuffer) {
+            if (statisticsPool) {
+                cmdBuffer.endQuery(statisticsPool, frameIndex);
+            }
+        }
+
+        bool hasStatistics() const {
+            return (bool)statisticsPool;
+        }
+
+        // Zones of the most recent frame with results, in recording order
+        const std::vector<ZoneResult>& getResults() const {
+            return results;
+        }
+
+        const PipelineStatistics& getStatistics() const {
+            return statistics;
+        }
+
+        // Frames whose results weren't available in time and were skipped
+        uint32_t getDroppedFrames() const {
+            return droppedFrames;
+        }
+
+        size_t getTraceEventCount() const {
+            return traceEvents.size();
+        }
+
+        // Writes every zone read back so far in the Chrome trace event format (chrome://tracing, Perfetto)
+        bool writeChromeTrace(const std::string& filename) const {
+            nlohmann::json events = nlohmann::json::array();
+            for (const auto& traceEvent : traceEvents) {
+                nlohmann::json event;
+                event["name"] = traceEvent.name;
+                event["cat"] = "gpu";
+                event["ph"] = "X";
+                event["ts"] = traceEvent.timestamp;
+                event["dur"] = traceEvent.duration;
+                event["pid"] = 0;
+                event["tid"] = 0;
+                event["args"]["frame"] = traceEvent.frameNumber;
+                events.push_back(event);
+            }
+            nlohmann::json trace;
+            trace["traceEvents"] = events;
+            trace["displayTimeUnit"] = "ms";
+            std::ofstream file(filename);
+            if (!file) {
+                return false;
+            }
+            file << trace.dump();
+            return (bool)file;
+        }
+
+    private:
+        struct PendingZone {
+            std::string name;
+            uint32_t depth{ 0 };
+        };
+
+        struct Frame {
+            std::vector<PendingZone> zones;
+            bool statistics{ false };
+            uint64_t frameNumber{ 0 };
+        };
+
+        struct TraceEvent {
+            std::string name;
+            // Microseconds
+            double timestamp;
+            double duration;
+            uint64_t frameNumber;
+        };
+
+        uint32_t getQuery(size_t zone, uint32_t end) const {
+            return (frameIndex * maxZones + (uint32_t)zone) * 2 + end;
+        }
+
+        void readResults(const Frame& frame) {
+            if (frame.zones.empty()) {
+                return;
+            }
+
+            // Value and availability for each query, nothing blocks if the frame hasn't finished yet
+            uint32_t queryCount = (uint32_t)frame.zones.size() * 2;
+            std::vector<uint64_t> timestamps(queryCount * 2);
+            vk::ArrayProxy<uint64_t> proxy{ timestamps };
+            device.getQueryPoolResults(timestampPool, frameIndex * maxZones * 2, queryCount, proxy, 2 * sizeof(uint64_t),
+                vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+            for (uint32_t i = 0; i < queryCount; ++i) {
+                if (!timestamps[i * 2 + 1]) {
+                    ++droppedFrames;
+                    return;
+                }
+            }
+
+            uint64_t frameBegin = timestamps[0];
+            if (!traceBegin) {
+                traceBegin = frameBegin;
+            }
+            results.resize(frame.zones.size());
+            for (size_t i = 0; i < frame.zones.size(); ++i) {
+                uint64_t begin = timestamps[i * 4];
+                uint64_t end = std::max(timestamps[i * 4 + 2], begin);
+                ZoneResult& result = results[i];
+                result.name = frame.zones[i].name;
+                result.depth = frame.zones[i].depth;
+                result.begin = (float)toMilliseconds(begin >= frameBegin ? begin - frameBegin : 0);
+                result.duration = (float)toMilliseconds(end - begin);
+                if (traceEvents.size() < maxTraceEvents && begin >= traceBegin) {
+                    traceEvents.push_back({ result.name, toMilliseconds(begin - traceBegin) * 1000.0, result.duration * 1000.0, frame.frameNumber });
+                }
+            }
+
+            if (frame.statistics) {
+                std::array<uint64_t, 6> values;
+                vk::ArrayProxy<uint64_t> statisticsProxy{ values };
+                device.getQueryPoolResults(statisticsPool, frameIndex, 1, statisticsProxy, sizeof(values),
+                    vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+                if (values[5]) {
+                    // In the order of the flag bits
+                    statistics.inputAssemblyPrimitives = values[0];
+                    statistics.vertexShaderInvocations = values[1];
+                    statistics.clippingPrimitives = values[2];
+                    statistics.fragmentShaderInvocations = values[3];
+                    statistics.computeShaderInvocations = values[4];
+                }
+            }
+        }
+
+        double toMilliseconds(uint64_t ticks) const {
+            return (double)ticks * timestampPeriod / 1.0e6;
+        }
+
+        // Caps the memory used by the trace, roughly an hour at a handful of zones and 60 fps
+        static const size_t maxTraceEvents = 1024 * 1024;
+
+        vk::Device device;
+        uint32_t maxZones;
+        float timestampPeriod{ 1.0f };
+        vk::QueryPool timestampPool;
+        vk::QueryPool statisticsPool;
+
+        std::vector<Frame> frames;
+        uint32_t frameIndex{ 0 };
+        uint64_t frameNumber{ 0 };
+        // Indices of the zones begun but not ended yet, UINT32_MAX for dropped zones
+        std::vector<uint32_t> openZones;
+
+        std::vector<ZoneResult> results;
+        PipelineStatistics statistics;
+        uint32_t droppedFrames{ 0 };
+        uint64_t traceBegin{ 0 };
+        std::vector<TraceEvent> traceEvents;
+    };
+}
@@ -0,0 +1,629 @@
+/*
+* Render graph for offscreen passes
+*
+* Passes declare the images they render to and the images they sample.  Compiling the graph culls the
+* passes that contribute nothing to an exported image, creates the images, render passes and
+* framebuffers, places images whose lifetimes don't overlap in the same memory and plans a single
+* batched barrier per pass from the layout and access each image was last used with.  Executing the
+* graph records the passes into the caller's command buffer (typically the frame's primary, ahead of
+* the main render pass), so the passes need no submit or semaphores of their own.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkanContext.hpp"
+#include "vulkanProfiler.hpp"
+
+namespace vkx {
+
+    class RenderGraph {
+    public:
+        using Resource = uint32_t;
+        using RecordFunction = std::function<void(const vk::CommandBuffer&)>;
+
+        struct Stats {
+            uint32_t passCount{ 0 };
+            uint32_t culledPassCount{ 0 };
+            uint32_t imageCount{ 0 };
+            uint32_t memoryBlockCount{ 0 };
+            // pipelineBarrier calls and the image barriers batched into them, per execution
+            uint32_t barrierCount{ 0 };
+            uint32_t imageBarrierCount{ 0 };
+            // Memory the images would need with one allocation each, and the memory they share
+            vk::DeviceSize unaliasedBytes{ 0 };
+            vk::DeviceSize aliasedBytes{ 0 };
+        };
+
+        // Passed to the setup function of addPass to declare what the pass accesses
+        class PassBuilder {
+        public:
+            // Cleared at the start of the pass
+            void writeColor(Resource image, const std::array<float, 4>& clearColor = { { 0.0f, 0.0f, 0.0f, 0.0f } }) {
+                vk::ClearValue clearValue;
+                clearValue.color = vk::ClearColorValue(clearColor);
+                graph.addAccess(pass, image, Usage::ColorWrite, clearValue);
+            }
+
+            void writeDepth(Resource image, float clearDepth = 1.0f) {
+                vk::ClearValue clearValue;
+                clearValue.depthStencil = vk::ClearDepthStencilValue(clearDepth, 0);
+                graph.addAccess(pass, image, Usage::DepthWrite, clearValue);
+            }
+
+            // Sampled by the fragment shaders of the pass
+            void readTexture(Resource image) {
+                graph.addAccess(pass, image, Usage::TextureRead, vk::ClearValue());
+            }
+
+        private:
+            friend class RenderGraph;
+            PassBuilder(RenderGraph& graph, uint32_t pass) : graph(graph), pass(pass) {}
+            RenderGraph& graph;
+            const uint32_t pass;
+        };
+
+        RenderGraph(const Context& context) : context(context) {}
+
+        // Images only live in the graph, their contents don't survive from one execution to the next
+        Resource createImage(const std::string& name, const glm::uvec2& size, vk::Format format) {
+            Image image;
+            image.name = name;
+            image.size = size;
+            image.format = format;
+            images.push_back(image);
+            return (Resource)images.size() - 1;
+        }
+
+        // Passes are executed in the order they are added, so they can only read images written by earlier passes
+        uint32_t addPass(const std::string& name, const std::function<void(PassBuilder&)>& setup, const RecordFunction& record) {
+            Pass pass;
+            pass.name = name;
+            pass.record = record;
+            passes.push_back(pass);
+            PassBuilder builder(*this, (uint32_t)passes.size() - 1);
+            setup(builder);
+            return builder.pass;
+        }
+
+        // Exported images are sampled by the fragment shaders of work recorded after the graph, e.g. the main
+        // render pass.  Takes effect on the next compile.
+        void setExported(Resource image, bool exported = true) {
+            images[image].exported = exported;
+        }
+
+        // (Re)creates the Vulkan objects of the graph.  Views and render passes change, descriptor sets
+        // referencing the images have to be updated afterwards.
+        void compile() {
+            destroy();
+            cull();
+            computeLifetimes();
+            createImages();
+            aliasMemory();
+            createRenderPasses();
+            planBarriers();
+            compiled = true;
+        }
+
+        void execute(const vk::CommandBuffer& cmdBuffer, GpuProfiler* profiler = nullptr) const {
+            assert(compiled);
+            for (const auto& pass : passes) {
+                if (pass.culled) {
+                    continue;
+                }
+                GpuProfiler::Zone zone(profiler, cmdBuffer, pass.name);
+                if (!pass.barriers.empty()) {
+                    cmdBuffer.pipelineBarrier(pass.srcStages, pass.dstStages, vk::DependencyFlags(), nullptr, nullptr, pass.barriers);
+                }
+                vk::RenderPassBeginInfo renderPassBeginInfo;
+                renderPassBeginInfo.renderPass = pass.renderPass;
+                renderPassBeginInfo.framebuffer = pass.framebuffer;
+                renderPassBeginInfo.renderArea.extent = vk::Extent2D(pass.extent.x, pass.extent.y);
+                renderPassBeginInfo.clearValueCount = (uint32_t)pass.clearValues.size();
+                renderPassBeginInfo.pClearValues = pass.clearValues.data();
+                cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+                cmdBuffer.setViewport(0, vkx::viewport(pass.extent));
+                cmdBuffer.setScissor(0, vkx::rect2D(pass.extent));
+                pass.record(cmdBuffer);
+                cmdBuffer.endRenderPass();
+            }
+            if (!exportBarriers.empty()) {
+                cmdBuffer.pipelineBarrier(exportSrcStages, vk::PipelineStageFlagBits::eFragmentShader, vk::DependencyFlags(), nullptr, nullptr, exportBarriers);
+            }
+        }
+
+        // For pipeline creation, null if the pass was culled
+        vk::RenderPass getRenderPass(uint32_t pass) const {
+            return passes[pass].renderPass;
+        }
+
+        bool isCulled(uint32_t pass) const {
+            return passes[pass].culled;
+        }
+
+        // For sampling an image written by the graph, in passes reading it or after the graph has executed
+        vk::DescriptorImageInfo getDescriptor(Resource image) const {
+            assert(images[image].view);
+            return vk::DescriptorImageInfo(sampler, images[image].view, vk::ImageLayout::eShaderReadOnlyOptimal);
+        }
+
+        const Stats& getStats() const {
+            return stats;
+        }
+
+        // Destroys the compiled objects, the declarations are kept.  The objects are retired to the deletion
+        // queue, as frames still in flight may use them.
+        void destroy() {
+            if (!compiled) {
+                return;
+            }
+            for (auto& pass : passes) {
+                context.trash(pass.framebuffer);
+                context.trash(pass.renderPass);
+                pass.barriers.clear();
+                pass.clearValues.clear();
+                pass.srcStages = vk::PipelineStageFlags();
+                pass.dstStages = vk::PipelineStageFlags();
+            }
+            for (auto& image : images) {
+                context.trash(image.view);
+                context.trash(image.image);
+            }
+            for (auto& block : blocks) {
+                context.trash(block.allocation);
+            }
+            blocks.clear();
+            exportBarriers.clear();
+            exportSrcStages = vk::PipelineStageFlags();
+            context.trash(sampler);
+            stats = Stats();
+            compiled = false;
+        }
+
+    private:
+        enum class Usage { ColorWrite, DepthWrite, TextureRead };
+
+        struct Access {
+            Resource image;
+            Usage usage;
+            vk::ClearValue clearValue;
+        };
+
+        // Layout, stages and access an image is used with
+        struct State {
+            vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+            vk::PipelineStageFlags stages;
+            vk::AccessFlags access;
+        };
+
+        struct Pass {
+            std::string name;
+            std::vector<Access> accesses;
+            RecordFunction record;
+            // Compiled
+            bool culled{ false };
+            vk::RenderPass renderPass;
+            vk::Framebuffer framebuffer;
+            glm::uvec2 extent;
+            std::vector<vk::ClearValue> clearValues;
+            std::vector<vk::ImageMemoryBarrier> barriers;
+            vk::PipelineStageFlags srcStages;
+            vk::PipelineStageFlags dstStages;
+        };
+
+        struct Image {
+            std::string name;
+            glm::uvec2 size;
+            vk::Format format{ vk::Format::eUndefined };
+            bool exported{ false };
+            // Compiled.  Lifetime in pass indices, exported images live until the end of the graph.
+            bool used{ false };
+            bool sampled{ false };
+            uint32_t firstPass{ 0 };
+            uint32_t lastPass{ 0 };
+            // Stored by a pass, i.e. read by a later pass or exported
+            bool stored{ false };
+            State lastState;
+            vk::Image image;
+            vk::ImageView view;
+            vk::MemoryRequirements requirements;
+            uint32_t block{ 0 };
+        };
+
+        // Memory shared by images with disjoint lifetimes, ordered by their first pass
+        struct MemoryBlock {
+            vk::MemoryRequirements requirements;
+            MemoryAllocation allocation;
+            std::vector<Resource> images;
+        };
+
+        static bool isDepthFormat(vk::Format format) {
+            switch (format) {
+            case vk::Format::eD16Unorm:
+            case vk::Format::eX8D24UnormPack32:
+            case vk::Format::eD32Sfloat:
+            case vk::Format::eD16UnormS8Uint:
+            case vk::Format::eD24UnormS8Uint:
+            case vk::Format::eD32SfloatS8Uint:
+                return true;
+            default:
+                return false;
+            }
+        }
+
+        static vk::ImageAspectFlags getBarrierAspect(vk::Format format) {
+            switch (format) {
+            case vk::Format::eD16UnormS8Uint:
+            case vk::Format::eD24UnormS8Uint:
+            case vk::Format::eD32SfloatS8Uint:
+                return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+            default:
+                return isDepthFormat(format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor;
+            }
+        }
+
+        static State getState(Usage usage) {
+            State state;
+            switch (usage) {
+            case Usage::ColorWrite:
+                state.layout = vk::ImageLayout::eColorAttachmentOptimal;
+                state.stages = vk::PipelineStageFlagBits::eColorAttachmentOutput;
+                state.access = vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite;
+                break;
+            case Usage::DepthWrite:
+                state.layout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+                state.stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+                state.access = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+                break;
+            case Usage::TextureRead:
+                state.layout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                state.stages = vk::PipelineStageFlagBits::eFragmentShader;
+                state.access = vk::AccessFlagBits::eShaderRead;
+                break;
+            }
+            return state;
+        }
+
+        static vk::AccessFlags getWriteAccess(vk::AccessFlags access) {
+            return access & (vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite | vk::AccessFlagBits::eShaderWrite);
+        }
+
+        void addAccess(uint32_t pass, Resource image, Usage usage, const vk::ClearValue& clearValue) {
+            if (image >= images.size()) {
+                throw std::runtime_error("Render graph pass " + passes[pass].name + " uses an unknown image");
+            }
+            for (const auto& access : passes[pass].accesses) {
+                if (access.image == image) {
+                    throw std::runtime_error("Render graph pass " + passes[pass].name + " uses " + images[image].name + " more than once");
+                }
+            }
+            if (usage == Usage::DepthWrite && !isDepthFormat(images[image].format)) {
+                throw std::runtime_error("Render graph image " + images[image].name + " doesn't have a depth format");
+            }
+            passes[pass].accesses.push_back({ image, usage, clearValue });
+        }
+
+        // Walks the passes backwards from the exported images, a pass is needed if something needed reads what it writes
+        void cull() {
+            std::vector<bool> needed(images.size(), false);
+            for (size_t i = 0; i < images.size(); ++i) {
+                needed[i] = images[i].exported;
+            }
+            for (size_t i = passes.size(); i-- > 0;) {
+                auto& pass = passes[i];
+                pass.culled = true;
+                for (const auto& access : pass.accesses) {
+                    if (access.usage != Usage::TextureRead && needed[access.image]) {
+                        pass.culled = false;
+                    }
+                }
+                if (!pass.culled) {
+                    for (const auto& access : pass.accesses) {
+                        if (access.usage == Usage::TextureRead) {
+                            needed[access.image] = true;
+                        }
+                    }
+                }
+            }
+            stats.passCount = (uint32_t)passes.size();
+            stats.culledPassCount = (uint32_t)std::count_if(passes.begin(), passes.end(), [](const Pass& pass) { return pass.culled; });
+        }
+
+        void computeLifetimes() {
+            for (auto& image : images) {
+                image.used = false;
+                image.sampled = image.exported;
+                image.stored = image.exported;
+            }
+            for (uint32_t i = 0; i < passes.size(); ++i) {
+                if (passes[i].culled) {
+                    continue;
+                }
+                for (const auto& access : passes[i].accesses) {
+                    auto& image = images[access.image];
+                    if (access.usage == Usage::TextureRead) {
+                        if (!image.used) {
+                            throw std::runtime_error("Render graph pass " + passes[i].name + " reads " + image.name + " before it is written");
+                        }
+                        image.sampled = true;
+                        image.stored = true;
+                    } else if (!image.used) {
+                        image.firstPass = i;
+                    }
+                    image.used = true;
+                    image.lastPass = i;
+                }
+            }
+            for (auto& image : images) {
+                if (image.exported && image.used) {
+                    image.lastPass = (uint32_t)passes.size();
+                }
+            }
+        }
+
+        void createImages() {
+            for (auto& image : images) {
+                if (!image.used) {
+                    continue;
+                }
+                bool depth = isDepthFormat(image.format);
+                vk::ImageCreateInfo imageCreateInfo;
+                imageCreateInfo.imageType = vk::ImageType::e2D;
+                imageCreateInfo.format = image.format;
+                imageCreateInfo.extent = vk::Extent3D(image.size.x, image.size.y, 1);
+                imageCreateInfo.mipLevels = 1;
+                imageCreateInfo.arrayLayers = 1;
+                imageCreateInfo.samples = vk::SampleCountFlagBits::e1;
+                imageCreateInfo.tiling = vk::ImageTiling::eOptimal;
+                imageCreateInfo.usage = depth ? vk::ImageUsageFlagBits::eDepthStencilAttachment : vk::ImageUsageFlagBits::eColorAttachment;
+                if (image.sampled) {
+                    imageCreateInfo.usage |= vk::ImageUsageFlagBits::eSampled;
+                }
+                image.image = context.device.createImage(imageCreateInfo);
+                context.countCreatedObjects();
+                image.requirements = context.device.getImageMemoryRequirements(image.image);
+                ++stats.imageCount;
+                stats.unaliasedBytes += image.requirements.size;
+            }
+        }
+
+        // Largest images first, each goes into the first block whose images it doesn't overlap in time
+        void aliasMemory() {
+            std::vector<Resource> order;
+            for (Resource i = 0; i < images.size(); ++i) {
+                if (images[i].used) {
+                    order.push_back(i);
+                }
+            }
+            std::stable_sort(order.begin(), order.end(), [&](Resource a, Resource b) {
+                return images[a].requirements.size > images[b].requirements.size;
+            });
+
+            for (Resource index : order) {
+                auto& image = images[index];
+                uint32_t blockIndex = 0;
+                for (; blockIndex < blocks.size(); ++blockIndex) {
+                    const auto& block = blocks[blockIndex];
+                    if (!(block.requirements.memoryTypeBits & image.requirements.memoryTypeBits) || block.requirements.size < image.requirements.size) {
+                        continue;
+                    }
+                    bool disjoint = std::none_of(block.images.begin(), block.images.end(), [&](Resource other) {
+                        return image.firstPass <= images[other].lastPass && images[other].firstPass <= image.lastPass;
+                    });
+                    if (disjoint) {
+                        break;
+                    }
+                }
+                if (blockIndex == blocks.size()) {
+                    blocks.push_back(MemoryBlock());
+                    blocks.back().requirements = image.requirements;
+                }
+                auto& block = blocks[blockIndex];
+                block.requirements.memoryTypeBits &= image.requirements.memoryTypeBits;
+                block.requirements.alignment = std::max(block.requirements.alignment, image.requirements.alignment);
+                block.images.push_back(index);
+                image.block = blockIndex;
+            }
+
+            for (auto& block : blocks) {
+                std::sort(block.images.begin(), block.images.end(), [&](Resource a, Resource b) {
+                    return images[a].firstPass < images[b].firstPass;
+                });
+                uint32_t memoryType = context.getMemoryType(block.requirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal);
+                block.allocation = context.allocator->allocate(block.requirements, memoryType, MemoryAllocator::ResourceType::Optimal);
+                for (Resource index : block.images) {
+                    auto& image = images[index];
+                    context.device.bindImageMemory(image.image, block.allocation.memory, block.allocation.offset);
+
+                    vk::ImageViewCreateInfo viewCreateInfo;
+                    viewCreateInfo.image = image.image;
+                    viewCreateInfo.viewType = vk::ImageViewType::e2D;
+                    viewCreateInfo.format = image.format;
+                    viewCreateInfo.subresourceRange = vk::ImageSubresourceRange(isDepthFormat(image.format) ? vk::ImageAspectFlagBits::eDepth : vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+                    image.view = context.device.createImageView(viewCreateInfo);
+                    context.countCreatedObjects();
+                }
+                stats.aliasedBytes += block.requirements.size;
+            }
+            stats.memoryBlockCount = (uint32_t)blocks.size();
+
+            vk::SamplerCreateInfo samplerCreateInfo;
+            samplerCreateInfo.magFilter = vk::Filter::eLinear;
+            samplerCreateInfo.minFilter = vk::Filter::eLinear;
+            samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eLinear;
+            samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+            samplerCreateInfo.addressModeV = samplerCreateInfo.addressModeU;
+            samplerCreateInfo.addressModeW = samplerCreateInfo.addressModeU;
+            samplerCreateInfo.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+            sampler = context.device.createSampler(samplerCreateInfo);
+            context.countCreatedObjects();
+        }
+
+        // One single subpass render pass per pass.  The attachments stay in their attachment layouts, the
+        // transitions are part of the planned barriers.
+        void createRenderPasses() {
+            for (auto& pass : passes) {
+                if (pass.culled) {
+                    continue;
+                }
+                std::vector<vk::AttachmentDescription> attachments;
+                std::vector<vk::AttachmentReference> colorReferences;
+                vk::AttachmentReference depthReference;
+                std::vector<vk::ImageView> views;
+                bool hasDepth = false;
+                pass.extent = glm::uvec2();
+                // Color attachments in declaration order, followed by the depth attachment
+                for (int depthPass = 0; depthPass < 2; ++depthPass) {
+                    for (const auto& access : pass.accesses) {
+                        if (access.usage == Usage::TextureRead || (access.usage == Usage::DepthWrite) != (depthPass == 1)) {
+                            continue;
+                        }
+                        const auto& image = images[access.image];
+                        if (pass.extent == glm::uvec2()) {
+                            pass.extent = image.size;
+                        } else if (pass.extent != image.size) {
+                            throw std::runtime_error("Render graph pass " + pass.name + " has attachments of different sizes");
+                        }
+                        vk::ImageLayout layout = getState(access.usage).layout;
+                        vk::AttachmentDescription attachment;
+                        attachment.format = image.format;
+                        attachment.loadOp = vk::AttachmentLoadOp::eClear;
+                        // Attachments nobody reads afterwards, like most depth buffers, are never written to memory
+                        attachment.storeOp = (image.stored && image.lastPass > (uint32_t)(&pass - passes.data())) ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
+                        attachment.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+                        attachment.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+                        attachment.initialLayout = layout;
+                        attachment.finalLayout = layout;
+                        if (depthPass) {
+                            depthReference = vk::AttachmentReference((uint32_t)attachments.size(), layout);
+                            hasDepth = true;
+                        } else {
+                            colorReferences.push_back(vk::AttachmentReference((uint32_t)attachments.size(), layout));
+                        }
+                        attachments.push_back(attachment);
+                        views.push_back(image.view);
+                        pass.clearValues.push_back(access.clearValue);
+                    }
+                }
+                if (attachments.empty()) {
+                    throw std::runtime_error("Render graph pass " + pass.name + " has no attachments");
+                }
+
+                vk::SubpassDescription subpass;
+                subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+                subpass.colorAttachmentCount = (uint32_t)colorReferences.size();
+                subpass.pColorAttachments = colorReferences.data();
+                subpass.pDepthStencilAttachment = hasDepth ? &depthReference : nullptr;
+
+                vk::RenderPassCreateInfo renderPassInfo;
+                renderPassInfo.attachmentCount = (uint32_t)attachments.size();
+                renderPassInfo.pAttachments = attachments.data();
+                renderPassInfo.subpassCount = 1;
+                renderPassInfo.pSubpasses = &subpass;
+                pass.renderPass = context.device.createRenderPass(renderPassInfo);
+                context.countCreatedObjects();
+
+                vk::FramebufferCreateInfo framebufferInfo;
+                framebufferInfo.renderPass = pass.renderPass;
+                framebufferInfo.attachmentCount = (uint32_t)views.size();
+                framebufferInfo.pAttachments = views.data();
+                framebufferInfo.width = pass.extent.x;
+                framebufferInfo.height = pass.extent.y;
+                framebufferInfo.layers = 1;
+                pass.framebuffer = context.device.createFramebuffer(framebufferInfo);
+                context.countCreatedObjects();
+            }
+        }
+
+        // The state of every image is tracked through the passes.  An image's first use discards its contents
+        // and waits for the last use of the memory: by the image before it in its block, or, for the first
+        // image of a block, by the last image of the block in the previous execution.
+        void planBarriers() {
+            for (auto& image : images) {
+                image.lastState = State();
+            }
+            for (uint32_t i = 0; i < passes.size(); ++i) {
+                if (passes[i].culled) {
+                    continue;
+                }
+                for (const auto& access : passes[i].accesses) {
+                    images[access.image].lastState = getState(access.usage);
+                }
+            }
+            for (auto& image : images) {
+                if (image.exported && image.used) {
+                    image.lastState = getState(Usage::TextureRead);
+                }
+            }
+
+            auto addBarrier = [&](std::vector<vk::ImageMemoryBarrier>& barriers, vk::PipelineStageFlags& srcStages, const Image& image, const State& from, const State& to) {
+                vk::ImageMemoryBarrier barrier;
+                barrier.srcAccessMask = getWriteAccess(from.access);
+                barrier.dstAccessMask = to.access;
+                barrier.oldLayout = from.layout;
+                barrier.newLayout = to.layout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = image.image;
+                barrier.subresourceRange = vk::ImageSubresourceRange(getBarrierAspect(image.format), 0, 1, 0, 1);
+                barriers.push_back(barrier);
+                srcStages |= from.stages ? from.stages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+            };
+
+            std::vector<State> current(images.size());
+            std::vector<bool> started(images.size(), false);
+            for (uint32_t i = 0; i < passes.size(); ++i) {
+                auto& pass = passes[i];
+                if (pass.culled) {
+                    continue;
+                }
+                for (const auto& access : pass.accesses) {
+                    const auto& image = images[access.image];
+                    State to = getState(access.usage);
+                    if (!started[access.image]) {
+                        const auto& block = blocks[image.block];
+                        auto position = std::find(block.images.begin(), block.images.end(), access.image);
+                        Resource previous = position == block.images.begin() ? block.images.back() : *(position - 1);
+                        State from = images[previous].lastState;
+                        from.layout = vk::ImageLayout::eUndefined;
+                        addBarrier(pass.barriers, pass.srcStages, image, from, to);
+                        started[access.image] = true;
+                    } else {
+                        const State& from = current[access.image];
+                        if (from.layout != to.layout || getWriteAccess(from.access) || getWriteAccess(to.access)) {
+                            addBarrier(pass.barriers, pass.srcStages, image, from, to);
+                        }
+                    }
+                    pass.dstStages |= to.stages;
+                    current[access.image] = to;
+                }
+                if (!pass.barriers.empty()) {
+                    ++stats.barrierCount;
+                    stats.imageBarrierCount += (uint32_t)pass.barriers.size();
+                }
+            }
+
+            State exportState = getState(Usage::TextureRead);
+            for (Resource i = 0; i < images.size(); ++i) {
+                if (images[i].exported && images[i].used && current[i].layout != exportState.layout) {
+                    addBarrier(exportBarriers, exportSrcStages, images[i], current[i], exportState);
+                }
+            }
+            if (!exportBarriers.empty()) {
+                ++stats.barrierCount;
+                stats.imageBarrierCount += (uint32_t)exportBarriers.size();
+            }
+        }
+
+        const Context& context;
+        std::vector<Image> images;
+        std::vector<Pass> passes;
+        std::vector<MemoryBlock> blocks;
+        std::vector<vk::ImageMemoryBarrier> exportBarriers;
+        vk::PipelineStageFlags exportSrcStages;
+        vk::Sampler sampler;
+        Stats stats;
+        bool compiled{ false };
+    };
+}
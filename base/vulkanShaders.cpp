@@ -7,12 +7,16 @@
 //
 
 #include "vulkanShaders.h"
+#include "vulkanTools.h"
+#include "mappedFile.hpp"
+#include "jobSystem.hpp"
+#include <unordered_map>
 #include <GlslangToSpv.h>
 
 using namespace vkx;
 using namespace vkx::shader;
 
-void init_resources(TBuiltInResource &Resources) {
+static void init_resources(TBuiltInResource &Resources) {
     Resources.maxLights = 32;
     Resources.maxClipPlanes = 6;
     Resources.maxTextureUnits = 32;
@@ -127,36 +131,178 @@ void shader::finalizeGlsl() {
     glslang::FinalizeProcess();
 }
 
+// The resource limits never change, so build them once.  Being a static the padding
+// is zero initialized, which makes the structure safe to hash.
+static const TBuiltInResource& getResources() {
+    static TBuiltInResource resources;
+    static std::once_flag once;
+    std::call_once(once, [] { init_resources(resources); });
+    return resources;
+}
+
+// Bump whenever the compile options change
+static const uint32_t SPV_CACHE_VERSION = 1;
+
+static uint64_t spvCacheKey(const vk::ShaderStageFlagBits shaderType, const std::string& shaderSource) {
+    const TBuiltInResource& resources = getResources();
+    uint32_t header[2] = { SPV_CACHE_VERSION, (uint32_t)shaderType };
+    uint64_t hash = hashBytes(header, sizeof(header));
+    hash = hashBytes(&resources, sizeof(resources), hash);
+    return hashBytes(shaderSource.data(), shaderSource.size(), hash);
+}
+
+static std::string spvCachePath(uint64_t key) {
+    const std::string& cachePath = getCachePath();
+    if (cachePath.empty()) {
+        return cachePath;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.spv", (unsigned long long)key);
+    return cachePath + name;
+}
+
+static std::mutex spvCacheMutex;
+static std::unordered_map<uint64_t, SpvBuffer> spvCache;
+static CompileStats compileStats;
+
+static bool findCachedSpv(uint64_t key, SpvBuffer& result) {
+    {
+        std::lock_guard<std::mutex> lock(spvCacheMutex);
+        auto itr = spvCache.find(key);
+        if (itr != spvCache.end()) {
+            result = itr->second;
+            ++compileStats.memoryHits;
+            return true;
+        }
+    }
+
+    std::string path = spvCachePath(key);
+    MappedFile file;
+    if (path.empty() || !file.open(path)) {
+        return false;
+    }
+    // Anything that isn't a SPIR-V module is ignored and will be overwritten
+    if (file.size % sizeof(uint32_t) || file.size < 5 * sizeof(uint32_t) || *(const uint32_t*)file.data != 0x07230203) {
+        return false;
+    }
+    result.assign((const uint32_t*)file.data, (const uint32_t*)(file.data + file.size));
+
+    std::lock_guard<std::mutex> lock(spvCacheMutex);
+    spvCache[key] = result;
+    ++compileStats.diskHits;
+    return true;
+}
+
+static void storeCachedSpv(uint64_t key, const SpvBuffer& spv, double milliseconds) {
+    {
+        std::lock_guard<std::mutex> lock(spvCacheMutex);
+        spvCache[key] = spv;
+        ++compileStats.compiled;
+        compileStats.compileMilliseconds += milliseconds;
+    }
+
+    std::string path = spvCachePath(key);
+    if (path.empty()) {
+        return;
+    }
+    // Write to a temporary file first so concurrent processes never read a partial module
+    std::string tempPath = path + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.write((const char*)spv.data(), spv.size() * sizeof(uint32_t))) {
+            return;
+        }
+    }
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str())) {
+        remove(tempPath.c_str());
+    }
+}
+
 //
 // Compile a given string containing GLSL into SPV for use by VK
 //
-std::vector<uint32_t> shader::glslToSpv(const vk::ShaderStageFlagBits shaderType, const std::string& shaderSource) {
+static SpvBuffer compileGlsl(const vk::ShaderStageFlagBits shaderType, const std::string& shaderSource) {
     std::vector<uint32_t> result;
-    TBuiltInResource Resources;
-    init_resources(Resources);
 
     // Enable SPIR-V and Vulkan rules when parsing GLSL
     EShMessages messages = (EShMessages)(EShMsgSpvRules | EShMsgVulkanRules);
     EShLanguage stage = FindLanguage(shaderType);
-    glslang::TShader *shader = new glslang::TShader(stage);
-    {
-        const char *shaderStrings[1] = { shaderSource.c_str() };
-        shader->setStrings(shaderStrings, 1);
-        if (!shader->parse(&Resources, 100, false, messages)) {
-            auto log = shader->getInfoLog();
-            throw new std::runtime_error(log);
-        }
+    glslang::TShader shader(stage);
+    const char *shaderStrings[1] = { shaderSource.c_str() };
+    shader.setStrings(shaderStrings, 1);
+    if (!shader.parse(&getResources(), 100, false, messages)) {
+        throw std::runtime_error(shader.getInfoLog());
     }
 
-    glslang::TProgram &program = *new glslang::TProgram;
-    program.addShader(shader);
+    // Declared after the shader, so it's destroyed first
+    glslang::TProgram program;
+    program.addShader(&shader);
     if (!program.link(messages)) {
-        throw new std::runtime_error(shader->getInfoLog());
+        throw std::runtime_error(program.getInfoLog());
     }
     glslang::GlslangToSpv(*program.getIntermediate(stage), result);
     return result;
 }
 
+std::vector<uint32_t> shader::glslToSpv(const vk::ShaderStageFlagBits shaderType, const std::string& shaderSource) {
+    uint64_t key = spvCacheKey(shaderType, shaderSource);
+    SpvBuffer result;
+    if (findCachedSpv(key, result)) {
+        return result;
+    }
+    auto start = std::chrono::high_resolution_clock::now();
+    result = compileGlsl(shaderType, shaderSource);
+    storeCachedSpv(key, result, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    return result;
+}
+
+std::vector<SpvBuffer> shader::glslToSpv(const std::vector<GlslSource>& sources, JobSystem* jobSystem) {
+    std::vector<SpvBuffer> results(sources.size());
+    std::vector<std::string> errors(sources.size());
+    uint32_t count = (uint32_t)sources.size();
+    auto compile = [&](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; ++i) {
+            // Exceptions must not escape a job, rethrow the first one once everything has finished
+            try {
+                results[i] = glslToSpv(sources[i].stage, sources[i].source);
+            } catch (const std::exception& e) {
+                errors[i] = e.what();
+                if (errors[i].empty()) {
+                    errors[i] = "Unknown error compiling shader";
+                }
+            }
+        }
+    };
+
+    if (jobSystem && jobSystem->getWorkerCount() > 1 && count > 1) {
+        jobSystem->parallelFor(0, count, 1, compile);
+    } else {
+        compile(0, count);
+    }
+
+    for (const auto& error : errors) {
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+    }
+    return results;
+}
+
+CompileStats shader::getCompileStats() {
+    std::lock_guard<std::mutex> lock(spvCacheMutex);
+    return compileStats;
+}
+
+std::string shader::getSpvCachePath(const vk::ShaderStageFlagBits shaderType, const std::string& shaderSource) {
+    return spvCachePath(spvCacheKey(shaderType, shaderSource));
+}
+
+void shader::clearMemoryCache() {
+    std::lock_guard<std::mutex> lock(spvCacheMutex);
+    spvCache.clear();
+}
+
 vk::ShaderModule shader::glslToShaderModule(const vk::Device& device, const vk::ShaderStageFlagBits shaderType, const std::string& shaderSource) {
     std::vector<uint32_t> spv = shader::glslToSpv(shaderType, shaderSource);
     vk::ShaderModuleCreateInfo moduleCreateInfo;
@@ -7,18 +7,42 @@
 
 #pragma once
 
+#include <string>
 #include <vector>
 #include <algorithm>
 #include <vulkan/vulkan.hpp>
 
 namespace vkx {
+    class JobSystem;
+
     namespace shader {
         using SpvBuffer = std::vector<uint32_t>;
         void initGlsl();
         void finalizeGlsl();
         void initDebugReport(const vk::Instance& instance);
 
+        struct GlslSource {
+            vk::ShaderStageFlagBits stage;
+            std::string source;
+        };
+
+        struct CompileStats {
+            uint32_t compiled{ 0 };
+            uint32_t memoryHits{ 0 };
+            uint32_t diskHits{ 0 };
+            // Time spent inside glslang
+            double compileMilliseconds{ 0 };
+        };
+
+        // Results are cached in memory and in the cache directory, keyed by the source, the stage and the resource limits
         SpvBuffer glslToSpv(vk::ShaderStageFlagBits shaderType, const std::string& shaderSource);
+        // Compile many shaders, concurrently on the workers of jobSystem if one is given.  The results are in the same order as sources.
+        std::vector<SpvBuffer> glslToSpv(const std::vector<GlslSource>& sources, JobSystem* jobSystem = nullptr);
         vk::ShaderModule glslToShaderModule(const vk::Device& device, const vk::ShaderStageFlagBits shaderType, const std::string& shaderSource);
+        CompileStats getCompileStats();
+        // Cache file the module for a source is stored in, empty when there is no cache directory
+        std::string getSpvCachePath(vk::ShaderStageFlagBits shaderType, const std::string& shaderSource);
+        // Drop the in memory cache so the next lookups go to the cache directory
+        void clearMemoryCache();
     }
 }
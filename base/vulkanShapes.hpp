@@ -11,6 +11,7 @@
 #pragma once
 
 #include "vulkanOffscreen.hpp"
+#include "vulkanMeshLoader.hpp"
 #include "vulkanTools.h"
 #include "shapes.h"
 #include "easings.hpp"
@@ -47,7 +48,7 @@ namespace vkx {
             glm::vec3 color;
         };
 
-        // Contains the instanced data
+        // Contains the instanced data, host visible since the visible instances are rewritten every update
         using InstanceBuffer = vkx::CreateBufferResult;
         InstanceBuffer instanceBuffer;
 
@@ -55,6 +56,17 @@ namespace vkx {
         using IndirectBuffer = vkx::CreateBufferResult;
         IndirectBuffer indirectBuffer;
 
+        // All instances, instanceBuffer only holds the ones drawn this frame
+        std::vector<InstanceData> instances;
+        std::vector<InstanceData> visibleInstances;
+        std::vector<vk::DrawIndirectCommand> indirectCommands;
+        // Bounds and levels of detail of each shape for the LodSelector.  The shapes have no coarser
+        // mesh, their second level is empty so instances smaller than a pixel aren't drawn.
+        std::vector<vkx::MeshBuffer> shapeLods;
+        bool useLods{ true };
+        uint32_t visibleInstanceCount{ 0 };
+        uint32_t triangleCount{ 0 };
+
         struct UboVS {
             glm::mat4 projection;
             glm::mat4 view;
@@ -91,16 +103,19 @@ namespace vkx {
 
         ShapesRenderer(const vkx::Context& context, bool stereo = false) : Parent(context), stereo(stereo) {
             srand((uint32_t)time(NULL));
+            useLods = !vkx::hasCommandLineFlag("-nolods");
         }
 
         ~ShapesRenderer() {
             queue.waitIdle();
             device.waitIdle();
             context.device.freeCommandBuffers(cmdPool, cmdBuffer);
-            context.device.destroyPipeline(pipelines.solid);
-            context.device.destroyPipelineLayout(pipelineLayout);
-            context.device.destroyDescriptorSetLayout(descriptorSetLayout);
+            context.stateCache->release(pipelines.solid);
+            context.stateCache->release(pipelineLayout);
+            context.stateCache->release(descriptorSetLayout);
             uniformData.vsScene.destroy();
+            instanceBuffer.destroy();
+            indirectBuffer.destroy();
         }
 
         void buildCommandBuffer() {
@@ -203,6 +218,25 @@ namespace vkx {
             for (auto& vertex : vertexData) {
                 vertex.position *= 0.2f;
             }
+            // The shapes are centered on the origin, none of their points is further from the full
+            // shape than its farthest vertex
+            shapeLods.resize(shapes.size());
+            for (size_t i = 0; i < shapes.size(); ++i) {
+                const auto& shape = shapes[i];
+                glm::vec3 minimum(FLT_MAX), maximum(-FLT_MAX);
+                float radius = 0.0f;
+                for (size_t v = shape.baseVertex; v < shape.baseVertex + shape.vertices; ++v) {
+                    const glm::vec3& position = vertexData[v].position;
+                    minimum = glm::min(minimum, position);
+                    maximum = glm::max(maximum, position);
+                    radius = std::max(radius, glm::length(position));
+                }
+                auto& mesh = shapeLods[i];
+                mesh.dim = maximum - minimum;
+                mesh.lods.resize(2);
+                mesh.lods[0].indexCount = (uint32_t)shape.vertices;
+                mesh.lods[1].error = radius;
+            }
             meshes = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexData);
         }
 
@@ -226,12 +260,12 @@ namespace vkx {
                 vkx::descriptorSetLayoutBinding(uniformType, vk::ShaderStageFlagBits::eVertex, 0),
             };
 
-            descriptorSetLayout = context.device.createDescriptorSetLayout(
+            descriptorSetLayout = context.stateCache->acquireDescriptorSetLayout(
                 vk::DescriptorSetLayoutCreateInfo()
                 .setBindingCount((uint32_t)setLayoutBindings.size())
                 .setPBindings(setLayoutBindings.data()));
 
-            pipelineLayout = context.device.createPipelineLayout(
+            pipelineLayout = context.stateCache->acquirePipelineLayout(
                 vk::PipelineLayoutCreateInfo()
                 .setPSetLayouts(&descriptorSetLayout)
                 .setSetLayoutCount(1));
@@ -285,11 +319,13 @@ namespace vkx {
 
             // Instacing pipeline
             // Load shaders
-            std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStages;
+            std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
             {
                 vkx::shader::initGlsl();
-                shaderStages[0] = context.loadGlslShader(getAssetPath() + "shaders/indirect/indirect.vert", vk::ShaderStageFlagBits::eVertex);
-                shaderStages[1] = context.loadGlslShader(getAssetPath() + "shaders/indirect/indirect.frag", vk::ShaderStageFlagBits::eFragment);
+                shaderStages = context.loadGlslShaders({
+                    { getAssetPath() + "shaders/indirect/indirect.vert", vk::ShaderStageFlagBits::eVertex },
+                    { getAssetPath() + "shaders/indirect/indirect.frag", vk::ShaderStageFlagBits::eFragment },
+                });
                 vkx::shader::finalizeGlsl();
             }
 
@@ -351,33 +387,32 @@ namespace vkx {
             pipelineCreateInfo.stageCount = (uint32_t)shaderStages.size();
             pipelineCreateInfo.pStages = shaderStages.data();
 
-            pipelines.solid = context.device.createGraphicsPipelines(context.pipelineCache, pipelineCreateInfo, nullptr)[0];
+            pipelines.solid = context.stateCache->acquireGraphicsPipeline(pipelineCreateInfo);
         }
 
         void prepareIndirectData() {
-            std::vector<vk::DrawIndirectCommand> indirectData;
-            indirectData.resize(SHAPES_COUNT);
+            indirectCommands.resize(SHAPES_COUNT);
             for (auto i = 0; i < SHAPES_COUNT; ++i) {
-                auto& drawIndirectCommand = indirectData[i];
+                auto& drawIndirectCommand = indirectCommands[i];
                 const auto& shapeData = shapes[i];
                 drawIndirectCommand.firstInstance = i * INSTANCES_PER_SHAPE;
                 drawIndirectCommand.instanceCount = INSTANCES_PER_SHAPE;
                 drawIndirectCommand.firstVertex = (uint32_t)shapeData.baseVertex;
                 drawIndirectCommand.vertexCount = (uint32_t)shapeData.vertices;
             }
-            indirectBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectData);
+            indirectBuffer = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, indirectCommands);
+            indirectBuffer.map();
         }
 
         void prepareInstanceData() {
-            std::vector<InstanceData> instanceData;
-            instanceData.resize(INSTANCE_COUNT);
+            instances.resize(INSTANCE_COUNT);
 
             std::mt19937 rndGenerator((uint32_t)time(nullptr));
             std::uniform_real_distribution<float> uniformDist(0.0, 1.0);
             std::exponential_distribution<float> expDist(1);
 
             for (auto i = 0; i < INSTANCE_COUNT; i++) {
-                auto& instance = instanceData[i];
+                auto& instance = instances[i];
                 instance.rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
                 float theta = 2 * (float)M_PI * uniformDist(rndGenerator);
                 float phi = acos(1 - 2 * uniformDist(rndGenerator));
@@ -386,7 +421,53 @@ namespace vkx {
                 instance.pos *= instance.scale * (1.0f + expDist(rndGenerator) / 2.0f) * 4.0f;
             }
 
-            instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+            visibleInstances = instances;
+            instanceBuffer = context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, instances);
+            instanceBuffer.map();
+        }
+
+        // World space position of an instance's origin, same rotation as indirect.vert
+        glm::vec3 instancePosition(const InstanceData& instance) const {
+            float halfAngle = (uboVS.time * 100.0f / instance.scale) * 0.5f * 3.14159f / 180.0f;
+            glm::vec4 q = glm::normalize(glm::vec4(instance.rot * sin(halfAngle), cos(halfAngle)));
+            glm::vec3 axis(q);
+            return instance.pos + 2.0f * glm::cross(axis, glm::cross(axis, instance.pos) + q.w * instance.pos);
+        }
+
+        // Pick the level of detail of every instance from its projected size in either eye, and write the
+        // instances that are drawn and their per shape counts for the next submit
+        void updateLods(const std::array<glm::mat4, 2>& projections, const std::array<glm::mat4, 2>& views) {
+            const float viewportHeight = (float)framebufferSize.y;
+            const vkx::LodSelector selectors[2] = {
+                vkx::LodSelector(projections[0], views[0], viewportHeight),
+                vkx::LodSelector(projections[1], views[1], viewportHeight),
+            };
+            visibleInstanceCount = 0;
+            triangleCount = 0;
+            for (uint32_t shape = 0; shape < SHAPES_COUNT; ++shape) {
+                const auto& mesh = shapeLods[shape];
+                const uint32_t first = shape * INSTANCES_PER_SHAPE;
+                uint32_t count = 0;
+                for (uint32_t i = first; i < first + INSTANCES_PER_SHAPE; ++i) {
+                    const auto& instance = instances[i];
+                    if (useLods) {
+                        glm::vec3 position = instancePosition(instance);
+                        uint32_t lod = std::min(selectors[0].select(mesh, position, instance.scale), selectors[1].select(mesh, position, instance.scale));
+                        if (mesh.lods[lod].indexCount == 0) {
+                            continue;
+                        }
+                    }
+                    visibleInstances[first + count++] = instance;
+                }
+                auto& command = indirectCommands[shape];
+                command.instanceCount = count;
+                if (count) {
+                    instanceBuffer.copy(count * sizeof(InstanceData), &visibleInstances[first], first * sizeof(InstanceData));
+                }
+                visibleInstanceCount += count;
+                triangleCount += count * command.vertexCount / 3;
+            }
+            indirectBuffer.copy(indirectCommands);
         }
 
         void prepareUniformBuffers() {
@@ -421,6 +502,8 @@ namespace vkx {
             uboVS.projection = projections[1];
             uboVS.view = views[1];
             uniformData.vsScene.copy(uboVS, uniformData.vsScene.alignment);
+
+            updateLods(projections, views);
 #if 0
             frameTimer = deltaTime;
             if (!paused) {
@@ -461,6 +544,7 @@ namespace vkx {
             submitInfo.pSignalSemaphores = signalSemaphores.data();
             submitInfo.commandBufferCount = 1;
             submitInfo.pCommandBuffers = &cmdBuffer;
+            auto queueLock = context.lockQueue();
             context.queue.submit(submitInfo, VK_NULL_HANDLE);
         }
     };
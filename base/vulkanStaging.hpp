@@ -0,0 +1,280 @@
+/*
+* Persistent staging ring buffer for uploads to device local memory
+*
+* Uploads are copied into a persistently mapped, host visible ring buffer and the
+* copy commands are recorded into a shared command buffer.  Regions of the ring are
+* reclaimed once the fence of the submit that consumed them has signalled, so no
+* staging buffers, command buffers or fences are created per upload.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <deque>
+
+#include "common.hpp"
+#include "vulkanTools.h"
+
+namespace vkx {
+
+    // Identifies the submit containing a given upload.  Tokens increase monotonically,
+    // so an upload is complete once every submit up to and including its token has completed.
+    using UploadToken = uint64_t;
+
+    class StagingRing {
+    public:
+        struct Stats {
+            uint64_t uploadCount{ 0 };
+            uint64_t submitCount{ 0 };
+            uint64_t bytesStaged{ 0 };
+            // Number of times an upload had to wait for the GPU to free ring space
+            uint64_t stallCount{ 0 };
+        };
+
+        // queueMutex is held around each submit, whoever else submits to queue must hold it as well
+        StagingRing(const vk::Device& device, const vk::Queue& queue, const std::shared_ptr<std::mutex>& queueMutex, uint32_t queueFamilyIndex, const CreateBufferResult& ringBuffer)
+            : device(device), queue(queue), queueMutex(queueMutex), buffer(ringBuffer) {
+            capacity = buffer.size;
+            mappedBase = (uint8_t*)buffer.map();
+
+            vk::CommandPoolCreateInfo cmdPoolInfo;
+            cmdPoolInfo.queueFamilyIndex = queueFamilyIndex;
+            cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer | vk::CommandPoolCreateFlagBits::eTransient;
+            cmdPool = device.createCommandPool(cmdPoolInfo);
+        }
+
+        // Copy size bytes into the ring and let recordCopy(cmdBuffer, srcBuffer, srcOffset) record the
+        // commands that consume them.  Returns the token of the submit the commands will be part of.
+        template <typename F>
+        UploadToken upload(const void* data, vk::DeviceSize size, vk::DeviceSize alignment, F recordCopy) {
+            std::lock_guard<std::mutex> lock(mutex);
+            assert(size <= capacity);
+            vk::DeviceSize offset = allocate(size, std::max<vk::DeviceSize>(alignment, 4));
+            memcpy(mappedBase + offset, data, size);
+            recordCopy(currentCommandBuffer(), buffer.buffer, offset);
+            ++stats.uploadCount;
+            stats.bytesStaged += size;
+            return flushIfUnbatched();
+        }
+
+        // Record commands into the pending submit without using ring memory
+        template <typename F>
+        UploadToken record(F f) {
+            std::lock_guard<std::mutex> lock(mutex);
+            f(currentCommandBuffer());
+            return flushIfUnbatched();
+        }
+
+        // Destroy a resource (typically an oversized staging buffer) once the pending submit has completed
+        void retain(const CreateBufferResult& resource) {
+            std::lock_guard<std::mutex> lock(mutex);
+            currentCommandBuffer();
+            pending.retained.push_back(resource);
+        }
+
+        // While a batch is open uploads accumulate in a single command buffer, which is submitted by endBatch
+        void beginBatch() {
+            std::lock_guard<std::mutex> lock(mutex);
+            ++batchDepth;
+        }
+
+        UploadToken endBatch() {
+            std::lock_guard<std::mutex> lock(mutex);
+            assert(batchDepth > 0);
+            if (--batchDepth) {
+                return nextToken;
+            }
+            return submitPending();
+        }
+
+        // Submit any recorded uploads
+        UploadToken flush() {
+            std::lock_guard<std::mutex> lock(mutex);
+            return submitPending();
+        }
+
+        bool isComplete(UploadToken token) {
+            std::lock_guard<std::mutex> lock(mutex);
+            reclaim();
+            return token <= completedToken;
+        }
+
+        // Block until the submit identified by token has completed, submitting it first if necessary
+        void wait(UploadToken token) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (token == nextToken && pending.cmdBuffer) {
+                submitPending();
+            }
+            while (token > completedToken && !inFlight.empty()) {
+                device.waitForFences(inFlight.front().fence, VK_TRUE, UINT64_MAX);
+                reclaim();
+            }
+        }
+
+        vk::DeviceSize getCapacity() const {
+            return capacity;
+        }
+
+        Stats getStats() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats;
+        }
+
+        void destroy() {
+            std::lock_guard<std::mutex> lock(mutex);
+            submitPending();
+            for (auto& submission : inFlight) {
+                device.waitForFences(submission.fence, VK_TRUE, UINT64_MAX);
+            }
+            reclaim();
+            for (const auto& fence : freeFences) {
+                device.destroyFence(fence);
+            }
+            freeFences.clear();
+            if (cmdPool) {
+                device.destroyCommandPool(cmdPool);
+                cmdPool = vk::CommandPool();
+            }
+            freeCommandBuffers.clear();
+            buffer.destroy();
+        }
+
+    private:
+        struct Submission {
+            UploadToken token{ 0 };
+            vk::CommandBuffer cmdBuffer;
+            vk::Fence fence;
+            // Ring position following the last byte used by this submit
+            vk::DeviceSize endPosition{ 0 };
+            std::vector<CreateBufferResult> retained;
+        };
+
+        // Ring positions increase monotonically, the offset in the buffer is position % capacity
+        vk::DeviceSize allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+            while (true) {
+                vk::DeviceSize start = alignUp(headPosition, alignment);
+                // Don't let an allocation straddle the end of the buffer
+                if ((start % capacity) + size > capacity) {
+                    start = alignUp(start, capacity);
+                }
+                if (start + size - tailPosition <= capacity) {
+                    headPosition = start + size;
+                    return start % capacity;
+                }
+
+                // Not enough space, push out what has been recorded and wait for the oldest submit
+                ++stats.stallCount;
+                submitPending();
+                if (inFlight.empty()) {
+                    // Everything has been consumed, restart at the beginning of the buffer
+                    headPosition = tailPosition = alignUp(headPosition, capacity);
+                    continue;
+                }
+                device.waitForFences(inFlight.front().fence, VK_TRUE, UINT64_MAX);
+                reclaim();
+            }
+        }
+
+        vk::CommandBuffer currentCommandBuffer() {
+            if (!pending.cmdBuffer) {
+                if (freeCommandBuffers.empty()) {
+                    vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
+                    cmdBufAllocateInfo.commandPool = cmdPool;
+                    cmdBufAllocateInfo.commandBufferCount = 1;
+                    pending.cmdBuffer = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+                } else {
+                    pending.cmdBuffer = freeCommandBuffers.back();
+                    freeCommandBuffers.pop_back();
+                }
+                vk::CommandBufferBeginInfo beginInfo;
+                beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+                pending.cmdBuffer.begin(beginInfo);
+            }
+            return pending.cmdBuffer;
+        }
+
+        UploadToken flushIfUnbatched() {
+            UploadToken token = nextToken;
+            if (!batchDepth) {
+                submitPending();
+            }
+            return token;
+        }
+
+        UploadToken submitPending() {
+            if (!pending.cmdBuffer) {
+                // Nothing pending, the most recent submit is the one to wait on
+                return nextToken - 1;
+            }
+
+            // Make the transfer writes visible to everything submitted to the queue afterwards, so
+            // consumers on the same queue don't need to wait on the token before using the data
+            vk::MemoryBarrier memoryBarrier;
+            memoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            memoryBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+            pending.cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), memoryBarrier, nullptr, nullptr);
+            pending.cmdBuffer.end();
+
+            if (freeFences.empty()) {
+                pending.fence = device.createFence(vk::FenceCreateInfo());
+            } else {
+                pending.fence = freeFences.back();
+                freeFences.pop_back();
+            }
+
+            vk::SubmitInfo submitInfo;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &pending.cmdBuffer;
+            {
+                std::lock_guard<std::mutex> queueLock(*queueMutex);
+                queue.submit(submitInfo, pending.fence);
+            }
+            ++stats.submitCount;
+
+            pending.token = nextToken++;
+            pending.endPosition = headPosition;
+            inFlight.push_back(std::move(pending));
+            pending = Submission();
+            return inFlight.back().token;
+        }
+
+        // Release ring space, command buffers and fences of completed submits
+        void reclaim() {
+            while (!inFlight.empty() && vk::Result::eSuccess == device.getFenceStatus(inFlight.front().fence)) {
+                auto& submission = inFlight.front();
+                device.resetFences(submission.fence);
+                freeFences.push_back(submission.fence);
+                submission.cmdBuffer.reset(vk::CommandBufferResetFlags());
+                freeCommandBuffers.push_back(submission.cmdBuffer);
+                for (auto& retained : submission.retained) {
+                    retained.destroy();
+                }
+                tailPosition = submission.endPosition;
+                completedToken = submission.token;
+                inFlight.pop_front();
+            }
+        }
+
+        vk::Device device;
+        vk::Queue queue;
+        std::shared_ptr<std::mutex> queueMutex;
+        CreateBufferResult buffer;
+        uint8_t* mappedBase{ nullptr };
+        vk::DeviceSize capacity{ 0 };
+        vk::DeviceSize headPosition{ 0 };
+        vk::DeviceSize tailPosition{ 0 };
+
+        vk::CommandPool cmdPool;
+        std::vector<vk::CommandBuffer> freeCommandBuffers;
+        std::vector<vk::Fence> freeFences;
+
+        Submission pending;
+        std::deque<Submission> inFlight;
+        uint32_t batchDepth{ 0 };
+        UploadToken nextToken{ 1 };
+        UploadToken completedToken{ 0 };
+        Stats stats;
+        mutable std::mutex mutex;
+    };
+}
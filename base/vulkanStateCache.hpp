@@ -0,0 +1,801 @@
+/*
+* Hash-consed cache of pipeline state objects
+*
+* Descriptor set layouts, pipeline layouts and pipelines are looked up by their full create info.
+* The create info is serialized into a key of 64 bit words (every field and array it points to,
+* with shader modules, layouts and render passes by handle) so identical requests share one object.
+* Objects are reference counted, releasing the last reference retires the object to the deletion
+* queue.  Graphics pipelines can also be compiled on a background thread, callers draw with a
+* fallback pipeline until the real one is ready.
+*
+* Extension structures chained through pNext aren't part of the key and aren't supported.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "common.hpp"
+#include "cpuProfiler.hpp"
+#include "vulkanDeletionQueue.hpp"
+
+namespace vkx {
+
+    class StateCache {
+        struct Entry;
+
+    public:
+        struct Stats {
+            uint64_t hits{ 0 };
+            uint64_t misses{ 0 };
+            uint64_t asyncCompiles{ 0 };
+            // Objects currently referenced, including pipelines still compiling
+            uint64_t liveObjects{ 0 };
+            // Time spent creating the pipelines of all misses, on any thread
+            uint64_t compileNanoseconds{ 0 };
+
+            double getCompileMilliseconds() const {
+                return (double)compileNanoseconds / 1.0e6;
+            }
+        };
+
+        // Reference to a graphics pipeline that may still be compiling on the background thread
+        class AsyncPipeline {
+        public:
+            // The compiled pipeline, or fallback as long as it isn't ready
+            vk::Pipeline get(const vk::Pipeline& fallback) const {
+                uint64_t handle = entry ? entry->handle.load(std::memory_order_acquire) : 0;
+                return handle ? fromHandle<vk::Pipeline>(handle) : fallback;
+            }
+
+            bool isReady() const {
+                return entry && entry->handle.load(std::memory_order_acquire);
+            }
+
+            explicit operator bool() const {
+                return entry != nullptr;
+            }
+
+        private:
+            friend class StateCache;
+            Entry* entry{ nullptr };
+        };
+
+        // Called with the duration of every pipeline creation, from the thread that created it
+        using CompileCallback = std::function<void(std::chrono::high_resolution_clock::duration)>;
+
+        StateCache(const vk::Device& device, const vk::PipelineCache& pipelineCache, const std::shared_ptr<DeletionQueue>& deletionQueue, const CompileCallback& onCompile = CompileCallback())
+            : device(device), pipelineCache(pipelineCache), deletionQueue(deletionQueue), onCompile(onCompile) {}
+
+        StateCache(const StateCache&) = delete;
+        StateCache& operator=(const StateCache&) = delete;
+
+        ~StateCache() {
+            destroy();
+        }
+
+        // Destroys all objects, referenced or not.  The device must be idle.
+        void destroy() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            workCondition.notify_all();
+            if (worker.joinable()) {
+                worker.join();
+            }
+            for (const auto& bucket : entries) {
+                for (const auto& entry : bucket.second) {
+                    uint64_t handle = entry->handle.load(std::memory_order_relaxed);
+                    if (!handle) {
+                        continue;
+                    }
+                    switch (entry->kind) {
+                    case Kind::DescriptorSetLayout: device.destroyDescriptorSetLayout(fromHandle<vk::DescriptorSetLayout>(handle)); break;
+                    case Kind::PipelineLayout: device.destroyPipelineLayout(fromHandle<vk::PipelineLayout>(handle)); break;
+                    case Kind::GraphicsPipeline:
+                    case Kind::ComputePipeline: device.destroyPipeline(fromHandle<vk::Pipeline>(handle)); break;
+                    }
+                }
+            }
+            entries.clear();
+            byHandle.clear();
+            compileQueue.clear();
+        }
+
+        vk::DescriptorSetLayout acquireDescriptorSetLayout(const vk::DescriptorSetLayoutCreateInfo& createInfo) {
+            assert(!createInfo.pNext);
+            std::vector<uint64_t> key;
+            KeyWriter writer{ key };
+            writer.add((uint64_t)Kind::DescriptorSetLayout);
+            writer.add((VkFlags)createInfo.flags);
+            writer.add(createInfo.bindingCount);
+            for (uint32_t i = 0; i < createInfo.bindingCount; ++i) {
+                const auto& binding = createInfo.pBindings[i];
+                writer.add(binding.binding);
+                writer.add((uint64_t)binding.descriptorType);
+                writer.add(binding.descriptorCount);
+                writer.add((VkFlags)binding.stageFlags);
+                writer.add(binding.pImmutableSamplers != nullptr);
+                if (binding.pImmutableSamplers) {
+                    for (uint32_t j = 0; j < binding.descriptorCount; ++j) {
+                        writer.addHandle(binding.pImmutableSamplers[j]);
+                    }
+                }
+            }
+            return acquire<vk::DescriptorSetLayout>(Kind::DescriptorSetLayout, key, [&] {
+                return device.createDescriptorSetLayout(createInfo);
+            });
+        }
+
+        vk::PipelineLayout acquirePipelineLayout(const vk::PipelineLayoutCreateInfo& createInfo) {
+            assert(!createInfo.pNext);
+            std::vector<uint64_t> key;
+            KeyWriter writer{ key };
+            writer.add((uint64_t)Kind::PipelineLayout);
+            writer.add((VkFlags)createInfo.flags);
+            writer.add(createInfo.setLayoutCount);
+            for (uint32_t i = 0; i < createInfo.setLayoutCount; ++i) {
+                writer.addHandle(createInfo.pSetLayouts[i]);
+            }
+            writer.add(createInfo.pushConstantRangeCount);
+            for (uint32_t i = 0; i < createInfo.pushConstantRangeCount; ++i) {
+                const auto& range = createInfo.pPushConstantRanges[i];
+                writer.add((VkFlags)range.stageFlags);
+                writer.add(range.offset);
+                writer.add(range.size);
+            }
+            return acquire<vk::PipelineLayout>(Kind::PipelineLayout, key, [&] {
+                return device.createPipelineLayout(createInfo);
+            });
+        }
+
+        // Render pass compatibility is approximated by the render pass handle and subpass index
+        vk::Pipeline acquireGraphicsPipeline(const vk::GraphicsPipelineCreateInfo& createInfo) {
+            GraphicsPipelineDesc desc(createInfo);
+            std::vector<uint64_t> key;
+            desc.writeKey(key);
+            return acquire<vk::Pipeline>(Kind::GraphicsPipeline, key, [&] {
+                return compile(desc);
+            });
+        }
+
+        // Returns immediately, a miss is compiled on the background thread.  Draw with
+        // AsyncPipeline::get(fallback) and record again once isReady() turns true.
+        AsyncPipeline acquireGraphicsPipelineAsync(const vk::GraphicsPipelineCreateInfo& createInfo) {
+            std::unique_ptr<GraphicsPipelineDesc> desc(new GraphicsPipelineDesc(createInfo));
+            std::vector<uint64_t> key;
+            desc->writeKey(key);
+            AsyncPipeline result;
+            std::lock_guard<std::mutex> lock(mutex);
+            result.entry = find(key);
+            if (result.entry) {
+                ++stats.hits;
+                ++result.entry->refCount;
+                return result;
+            }
+            ++stats.misses;
+            ++stats.asyncCompiles;
+            result.entry = insert(Kind::GraphicsPipeline, key, 0);
+            result.entry->pending = std::move(desc);
+            compileQueue.push_back(result.entry);
+            if (!worker.joinable()) {
+                worker = std::thread([this] { compileLoop(); });
+            }
+            workCondition.notify_one();
+            return result;
+        }
+
+        vk::Pipeline acquireComputePipeline(const vk::ComputePipelineCreateInfo& createInfo) {
+            assert(!createInfo.pNext && !createInfo.stage.pNext);
+            std::vector<uint64_t> key;
+            KeyWriter writer{ key };
+            writer.add((uint64_t)Kind::ComputePipeline);
+            writer.add((VkFlags)createInfo.flags);
+            writeStageKey(writer, createInfo.stage);
+            writer.addHandle(createInfo.layout);
+            writer.addHandle(createInfo.basePipelineHandle);
+            writer.add((uint64_t)(int64_t)createInfo.basePipelineIndex);
+            return acquire<vk::Pipeline>(Kind::ComputePipeline, key, [&] {
+                auto start = std::chrono::high_resolution_clock::now();
+                vk::Pipeline result = device.createComputePipelines(pipelineCache, createInfo, nullptr)[0];
+                recordCompile(std::chrono::high_resolution_clock::now() - start);
+                return result;
+            });
+        }
+
+        // Drops a reference and resets the handle.  The last reference retires the object to the deletion queue.
+        template <typename T>
+        void release(T& object) {
+            if (!object) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            auto itr = byHandle.find(toHandle(object));
+            if (itr == byHandle.end()) {
+                throw std::runtime_error("Releasing an object that doesn't come from the state cache");
+            }
+            releaseLocked(itr->second);
+            object = T();
+        }
+
+        void release(AsyncPipeline& pipeline) {
+            if (!pipeline.entry) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            releaseLocked(pipeline.entry);
+            pipeline.entry = nullptr;
+        }
+
+        // Increases whenever a background compile finishes, command buffers recorded with
+        // fallback pipelines should be recorded again when it changes
+        uint64_t getCompletedAsyncCount() const {
+            return completedAsyncCount.load(std::memory_order_acquire);
+        }
+
+        Stats getStats() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            Stats result = stats;
+            result.liveObjects = 0;
+            for (const auto& bucket : entries) {
+                result.liveObjects += bucket.second.size();
+            }
+            result.compileNanoseconds = compileNanoseconds.load(std::memory_order_relaxed);
+            return result;
+        }
+
+    private:
+        enum class Kind : uint32_t {
+            DescriptorSetLayout,
+            PipelineLayout,
+            GraphicsPipeline,
+            ComputePipeline,
+        };
+
+        struct KeyWriter {
+            std::vector<uint64_t>& words;
+
+            void add(uint64_t value) {
+                words.push_back(value);
+            }
+
+            void addFloat(float value) {
+                uint32_t bits;
+                memcpy(&bits, &value, sizeof(float));
+                add(bits);
+            }
+
+            template <typename T>
+            void addHandle(const T& handle) {
+                add(toHandle(handle));
+            }
+
+            void addBytes(const void* data, size_t size) {
+                add(size);
+                const uint8_t* bytes = (const uint8_t*)data;
+                for (size_t offset = 0; offset < size; offset += sizeof(uint64_t)) {
+                    uint64_t word = 0;
+                    memcpy(&word, bytes + offset, std::min(sizeof(uint64_t), size - offset));
+                    add(word);
+                }
+            }
+        };
+
+        // Copy of a shader stage and everything it points to
+        struct ShaderStageDesc {
+            vk::PipelineShaderStageCreateInfo info;
+            std::string entryPoint;
+            vk::SpecializationInfo specialization;
+            std::vector<vk::SpecializationMapEntry> mapEntries;
+            std::vector<uint8_t> data;
+
+            // The desc must not move afterwards, the create info points into it
+            void copy(const vk::PipelineShaderStageCreateInfo& source) {
+                assert(!source.pNext);
+                info = source;
+                entryPoint = source.pName;
+                info.pName = entryPoint.c_str();
+                if (source.pSpecializationInfo) {
+                    const auto& sourceSpecialization = *source.pSpecializationInfo;
+                    mapEntries.assign(sourceSpecialization.pMapEntries, sourceSpecialization.pMapEntries + sourceSpecialization.mapEntryCount);
+                    const uint8_t* sourceData = (const uint8_t*)sourceSpecialization.pData;
+                    data.assign(sourceData, sourceData + sourceSpecialization.dataSize);
+                    specialization.mapEntryCount = (uint32_t)mapEntries.size();
+                    specialization.pMapEntries = mapEntries.data();
+                    specialization.dataSize = data.size();
+                    specialization.pData = data.data();
+                    info.pSpecializationInfo = &specialization;
+                }
+            }
+        };
+
+        // Deep copy of a graphics pipeline create info, so misses can be compiled after the caller returned
+        struct GraphicsPipelineDesc {
+            vk::GraphicsPipelineCreateInfo info;
+            std::vector<ShaderStageDesc> stageDescs;
+            std::vector<vk::PipelineShaderStageCreateInfo> stages;
+            vk::PipelineVertexInputStateCreateInfo vertexInput;
+            std::vector<vk::VertexInputBindingDescription> vertexBindings;
+            std::vector<vk::VertexInputAttributeDescription> vertexAttributes;
+            vk::PipelineInputAssemblyStateCreateInfo inputAssembly;
+            vk::PipelineTessellationStateCreateInfo tessellation;
+            vk::PipelineViewportStateCreateInfo viewport;
+            std::vector<vk::Viewport> viewports;
+            std::vector<vk::Rect2D> scissors;
+            vk::PipelineRasterizationStateCreateInfo rasterization;
+            vk::PipelineMultisampleStateCreateInfo multisample;
+            std::vector<vk::SampleMask> sampleMask;
+            vk::PipelineDepthStencilStateCreateInfo depthStencil;
+            vk::PipelineColorBlendStateCreateInfo colorBlend;
+            std::vector<vk::PipelineColorBlendAttachmentState> blendAttachments;
+            vk::PipelineDynamicStateCreateInfo dynamic;
+            std::vector<vk::DynamicState> dynamicStates;
+
+            explicit GraphicsPipelineDesc(const vk::GraphicsPipelineCreateInfo& source) {
+                assert(!source.pNext);
+                info = source;
+
+                stageDescs.resize(source.stageCount);
+                for (uint32_t i = 0; i < source.stageCount; ++i) {
+                    stageDescs[i].copy(source.pStages[i]);
+                    stages.push_back(stageDescs[i].info);
+                }
+                info.pStages = stages.data();
+
+                bool dynamicViewport = false, dynamicScissor = false;
+                if (source.pDynamicState) {
+                    dynamic = *source.pDynamicState;
+                    dynamicStates.assign(dynamic.pDynamicStates, dynamic.pDynamicStates + dynamic.dynamicStateCount);
+                    dynamic.pDynamicStates = dynamicStates.data();
+                    info.pDynamicState = &dynamic;
+                    for (const auto& state : dynamicStates) {
+                        dynamicViewport |= state == vk::DynamicState::eViewport;
+                        dynamicScissor |= state == vk::DynamicState::eScissor;
+                    }
+                }
+                if (source.pVertexInputState) {
+                    vertexInput = *source.pVertexInputState;
+                    vertexBindings.assign(vertexInput.pVertexBindingDescriptions, vertexInput.pVertexBindingDescriptions + vertexInput.vertexBindingDescriptionCount);
+                    vertexAttributes.assign(vertexInput.pVertexAttributeDescriptions, vertexInput.pVertexAttributeDescriptions + vertexInput.vertexAttributeDescriptionCount);
+                    vertexInput.pVertexBindingDescriptions = vertexBindings.data();
+                    vertexInput.pVertexAttributeDescriptions = vertexAttributes.data();
+                    info.pVertexInputState = &vertexInput;
+                }
+                if (source.pInputAssemblyState) {
+                    inputAssembly = *source.pInputAssemblyState;
+                    info.pInputAssemblyState = &inputAssembly;
+                }
+                if (source.pTessellationState) {
+                    tessellation = *source.pTessellationState;
+                    info.pTessellationState = &tessellation;
+                }
+                if (source.pViewportState) {
+                    viewport = *source.pViewportState;
+                    // Dynamic viewports and scissors ignore the arrays, only their counts matter
+                    if (viewport.pViewports && !dynamicViewport) {
+                        viewports.assign(viewport.pViewports, viewport.pViewports + viewport.viewportCount);
+                    }
+                    if (viewport.pScissors && !dynamicScissor) {
+                        scissors.assign(viewport.pScissors, viewport.pScissors + viewport.scissorCount);
+                    }
+                    viewport.pViewports = viewports.empty() ? nullptr : viewports.data();
+                    viewport.pScissors = scissors.empty() ? nullptr : scissors.data();
+                    info.pViewportState = &viewport;
+                }
+                if (source.pRasterizationState) {
+                    rasterization = *source.pRasterizationState;
+                    info.pRasterizationState = &rasterization;
+                }
+                if (source.pMultisampleState) {
+                    multisample = *source.pMultisampleState;
+                    if (multisample.pSampleMask) {
+                        uint32_t words = ((uint32_t)multisample.rasterizationSamples + 31) / 32;
+                        sampleMask.assign(multisample.pSampleMask, multisample.pSampleMask + words);
+                        multisample.pSampleMask = sampleMask.data();
+                    }
+                    info.pMultisampleState = &multisample;
+                }
+                if (source.pDepthStencilState) {
+                    depthStencil = *source.pDepthStencilState;
+                    info.pDepthStencilState = &depthStencil;
+                }
+                if (source.pColorBlendState) {
+                    colorBlend = *source.pColorBlendState;
+                    blendAttachments.assign(colorBlend.pAttachments, colorBlend.pAttachments + colorBlend.attachmentCount);
+                    colorBlend.pAttachments = blendAttachments.data();
+                    info.pColorBlendState = &colorBlend;
+                }
+            }
+
+            GraphicsPipelineDesc(const GraphicsPipelineDesc&) = delete;
+            GraphicsPipelineDesc& operator=(const GraphicsPipelineDesc&) = delete;
+
+            void writeKey(std::vector<uint64_t>& key) const {
+                KeyWriter writer{ key };
+                writer.add((uint64_t)Kind::GraphicsPipeline);
+                writer.add((VkFlags)info.flags);
+                writer.add(info.stageCount);
+                for (const auto& stage : stages) {
+                    writeStageKey(writer, stage);
+                }
+
+                writer.add(info.pVertexInputState != nullptr);
+                if (info.pVertexInputState) {
+                    writer.add(vertexBindings.size());
+                    for (const auto& binding : vertexBindings) {
+                        writer.add(binding.binding);
+                        writer.add(binding.stride);
+                        writer.add((uint64_t)binding.inputRate);
+                    }
+                    writer.add(vertexAttributes.size());
+                    for (const auto& attribute : vertexAttributes) {
+                        writer.add(attribute.location);
+                        writer.add(attribute.binding);
+                        writer.add((uint64_t)attribute.format);
+                        writer.add(attribute.offset);
+                    }
+                }
+
+                writer.add(info.pInputAssemblyState != nullptr);
+                if (info.pInputAssemblyState) {
+                    writer.add((uint64_t)inputAssembly.topology);
+                    writer.add(inputAssembly.primitiveRestartEnable);
+                }
+
+                writer.add(info.pTessellationState != nullptr);
+                if (info.pTessellationState) {
+                    writer.add(tessellation.patchControlPoints);
+                }
+
+                writer.add(info.pViewportState != nullptr);
+                if (info.pViewportState) {
+                    writer.add(viewport.viewportCount);
+                    writer.add(viewport.scissorCount);
+                    writer.add(viewports.size());
+                    for (const auto& view : viewports) {
+                        writer.addFloat(view.x);
+                        writer.addFloat(view.y);
+                        writer.addFloat(view.width);
+                        writer.addFloat(view.height);
+                        writer.addFloat(view.minDepth);
+                        writer.addFloat(view.maxDepth);
+                    }
+                    writer.add(scissors.size());
+                    for (const auto& scissor : scissors) {
+                        writer.add((uint32_t)scissor.offset.x);
+                        writer.add((uint32_t)scissor.offset.y);
+                        writer.add(scissor.extent.width);
+                        writer.add(scissor.extent.height);
+                    }
+                }
+
+                writer.add(info.pRasterizationState != nullptr);
+                if (info.pRasterizationState) {
+                    writer.add(rasterization.depthClampEnable);
+                    writer.add(rasterization.rasterizerDiscardEnable);
+                    writer.add((uint64_t)rasterization.polygonMode);
+                    writer.add((VkFlags)rasterization.cullMode);
+                    writer.add((uint64_t)rasterization.frontFace);
+                    writer.add(rasterization.depthBiasEnable);
+                    writer.addFloat(rasterization.depthBiasConstantFactor);
+                    writer.addFloat(rasterization.depthBiasClamp);
+                    writer.addFloat(rasterization.depthBiasSlopeFactor);
+                    writer.addFloat(rasterization.lineWidth);
+                }
+
+                writer.add(info.pMultisampleState != nullptr);
+                if (info.pMultisampleState) {
+                    writer.add((uint64_t)multisample.rasterizationSamples);
+                    writer.add(multisample.sampleShadingEnable);
+                    writer.addFloat(multisample.minSampleShading);
+                    writer.add(sampleMask.size());
+                    for (const auto& mask : sampleMask) {
+                        writer.add(mask);
+                    }
+                    writer.add(multisample.alphaToCoverageEnable);
+                    writer.add(multisample.alphaToOneEnable);
+                }
+
+                writer.add(info.pDepthStencilState != nullptr);
+                if (info.pDepthStencilState) {
+                    writer.add(depthStencil.depthTestEnable);
+                    writer.add(depthStencil.depthWriteEnable);
+                    writer.add((uint64_t)depthStencil.depthCompareOp);
+                    writer.add(depthStencil.depthBoundsTestEnable);
+                    writer.add(depthStencil.stencilTestEnable);
+                    for (const auto& op : { depthStencil.front, depthStencil.back }) {
+                        writer.add((uint64_t)op.failOp);
+                        writer.add((uint64_t)op.passOp);
+                        writer.add((uint64_t)op.depthFailOp);
+                        writer.add((uint64_t)op.compareOp);
+                        writer.add(op.compareMask);
+                        writer.add(op.writeMask);
+                        writer.add(op.reference);
+                    }
+                    writer.addFloat(depthStencil.minDepthBounds);
+                    writer.addFloat(depthStencil.maxDepthBounds);
+                }
+
+                writer.add(info.pColorBlendState != nullptr);
+                if (info.pColorBlendState) {
+                    writer.add(colorBlend.logicOpEnable);
+                    writer.add((uint64_t)colorBlend.logicOp);
+                    writer.add(blendAttachments.size());
+                    for (const auto& attachment : blendAttachments) {
+                        writer.add(attachment.blendEnable);
+                        writer.add((uint64_t)attachment.srcColorBlendFactor);
+                        writer.add((uint64_t)attachment.dstColorBlendFactor);
+                        writer.add((uint64_t)attachment.colorBlendOp);
+                        writer.add((uint64_t)attachment.srcAlphaBlendFactor);
+                        writer.add((uint64_t)attachment.dstAlphaBlendFactor);
+                        writer.add((uint64_t)attachment.alphaBlendOp);
+                        writer.add((VkFlags)attachment.colorWriteMask);
+                    }
+                    for (float constant : colorBlend.blendConstants) {
+                        writer.addFloat(constant);
+                    }
+                }
+
+                writer.add(info.pDynamicState != nullptr);
+                if (info.pDynamicState) {
+                    writer.add(dynamicStates.size());
+                    for (const auto& state : dynamicStates) {
+                        writer.add((uint64_t)state);
+                    }
+                }
+
+                writer.addHandle(info.layout);
+                writer.addHandle(info.renderPass);
+                writer.add(info.subpass);
+                writer.addHandle(info.basePipelineHandle);
+                writer.add((uint64_t)(int64_t)info.basePipelineIndex);
+            }
+        };
+
+        struct Entry {
+            Kind kind;
+            uint64_t hash;
+            std::vector<uint64_t> key;
+            // Zero while the pipeline is compiling in the background
+            std::atomic<uint64_t> handle{ 0 };
+            uint32_t refCount{ 0 };
+            bool failed{ false };
+            // Create info kept alive until the background compile ran
+            std::unique_ptr<GraphicsPipelineDesc> pending;
+        };
+
+        template <typename T>
+        static uint64_t toHandle(const T& object) {
+            static_assert(sizeof(T) <= sizeof(uint64_t), "Not a Vulkan handle");
+            uint64_t handle = 0;
+            memcpy(&handle, &object, sizeof(T));
+            return handle;
+        }
+
+        template <typename T>
+        static T fromHandle(uint64_t handle) {
+            T object;
+            memcpy(&object, &handle, sizeof(T));
+            return object;
+        }
+
+        static uint64_t hashKey(const std::vector<uint64_t>& key) {
+            uint64_t hash = 14695981039346656037ull;
+            for (uint64_t value : key) {
+                hash = (hash ^ value) * 1099511628211ull;
+            }
+            return hash;
+        }
+
+        static void writeStageKey(KeyWriter& writer, const vk::PipelineShaderStageCreateInfo& stage) {
+            writer.add((VkFlags)stage.flags);
+            writer.add((VkFlags)stage.stage);
+            writer.addHandle(stage.module);
+            writer.addBytes(stage.pName, strlen(stage.pName));
+            writer.add(stage.pSpecializationInfo != nullptr);
+            if (stage.pSpecializationInfo) {
+                const auto& specialization = *stage.pSpecializationInfo;
+                writer.add(specialization.mapEntryCount);
+                for (uint32_t i = 0; i < specialization.mapEntryCount; ++i) {
+                    writer.add(specialization.pMapEntries[i].constantID);
+                    writer.add(specialization.pMapEntries[i].offset);
+                    writer.add(specialization.pMapEntries[i].size);
+                }
+                writer.addBytes(specialization.pData, specialization.dataSize);
+            }
+        }
+
+        // Mutex held
+        Entry* find(const std::vector<uint64_t>& key) {
+            auto itr = entries.find(hashKey(key));
+            if (itr == entries.end()) {
+                return nullptr;
+            }
+            for (const auto& entry : itr->second) {
+                if (entry->key == key) {
+                    return entry.get();
+                }
+            }
+            return nullptr;
+        }
+
+        // Mutex held, returns the entry with one reference
+        Entry* insert(Kind kind, const std::vector<uint64_t>& key, uint64_t handle) {
+            std::unique_ptr<Entry> entry(new Entry());
+            entry->kind = kind;
+            entry->hash = hashKey(key);
+            entry->key = key;
+            entry->handle.store(handle, std::memory_order_release);
+            entry->refCount = 1;
+            Entry* result = entry.get();
+            entries[result->hash].push_back(std::move(entry));
+            if (handle) {
+                byHandle[handle] = result;
+            }
+            return result;
+        }
+
+        // Mutex held
+        void releaseLocked(Entry* entry) {
+            assert(entry->refCount);
+            if (--entry->refCount) {
+                return;
+            }
+            uint64_t handle = entry->handle.load(std::memory_order_relaxed);
+            if (!handle && !entry->failed) {
+                // Still compiling, the background thread removes the entry when it's done
+                return;
+            }
+            if (handle) {
+                switch (entry->kind) {
+                case Kind::DescriptorSetLayout: deletionQueue->retire(fromHandle<vk::DescriptorSetLayout>(handle)); break;
+                case Kind::PipelineLayout: deletionQueue->retire(fromHandle<vk::PipelineLayout>(handle)); break;
+                case Kind::GraphicsPipeline:
+                case Kind::ComputePipeline: deletionQueue->retire(fromHandle<vk::Pipeline>(handle)); break;
+                }
+                byHandle.erase(handle);
+            }
+            remove(entry);
+        }
+
+        // Mutex held
+        void remove(Entry* entry) {
+            // Erasing from the bucket deletes the entry
+            uint64_t hash = entry->hash;
+            auto& bucket = entries[hash];
+            for (auto itr = bucket.begin(); itr != bucket.end(); ++itr) {
+                if (itr->get() == entry) {
+                    bucket.erase(itr);
+                    break;
+                }
+            }
+            if (bucket.empty()) {
+                entries.erase(hash);
+            }
+        }
+
+        // Mutex held, adds a reference and waits if the object is still compiling in the background
+        uint64_t reference(std::unique_lock<std::mutex>& lock, Entry* entry) {
+            ++entry->refCount;
+            completedCondition.wait(lock, [&] { return entry->handle.load(std::memory_order_relaxed) || entry->failed; });
+            if (entry->failed) {
+                releaseLocked(entry);
+                throw std::runtime_error("Background pipeline compile failed");
+            }
+            return entry->handle.load(std::memory_order_relaxed);
+        }
+
+        template <typename T, typename F>
+        T acquire(Kind kind, const std::vector<uint64_t>& key, const F& create) {
+            std::unique_lock<std::mutex> lock(mutex);
+            Entry* entry = find(key);
+            if (entry) {
+                ++stats.hits;
+                return fromHandle<T>(reference(lock, entry));
+            }
+            ++stats.misses;
+            // Create outside the lock, an identical request racing in between just creates a duplicate
+            lock.unlock();
+            T object = create();
+            lock.lock();
+            entry = find(key);
+            if (entry) {
+                destroyDuplicate(object);
+                return fromHandle<T>(reference(lock, entry));
+            }
+            return fromHandle<T>(insert(kind, key, toHandle(object))->handle);
+        }
+
+        void destroyDuplicate(const vk::DescriptorSetLayout& layout) {
+            device.destroyDescriptorSetLayout(layout);
+        }
+
+        void destroyDuplicate(const vk::PipelineLayout& layout) {
+            device.destroyPipelineLayout(layout);
+        }
+
+        void destroyDuplicate(const vk::Pipeline& pipeline) {
+            device.destroyPipeline(pipeline);
+        }
+
+        void recordCompile(std::chrono::high_resolution_clock::duration duration) {
+            compileNanoseconds += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            if (onCompile) {
+                onCompile(duration);
+            }
+        }
+
+        vk::Pipeline compile(const GraphicsPipelineDesc& desc) {
+            auto start = std::chrono::high_resolution_clock::now();
+            vk::Pipeline result = device.createGraphicsPipelines(pipelineCache, desc.info, nullptr)[0];
+            recordCompile(std::chrono::high_resolution_clock::now() - start);
+            return result;
+        }
+
+        void compileLoop() {
+            VKX_CPU_THREAD_NAME("Pipeline compiler");
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                workCondition.wait(lock, [&] { return stopping || !compileQueue.empty(); });
+                if (stopping) {
+                    return;
+                }
+                Entry* entry = compileQueue.front();
+                compileQueue.pop_front();
+                lock.unlock();
+                vk::Pipeline pipeline;
+                bool failed = false;
+                try {
+                    VKX_CPU_ZONE("Compile pipeline");
+                    pipeline = compile(*entry->pending);
+                } catch (const std::exception& e) {
+                    std::cerr << "Background pipeline compile failed: " << e.what() << std::endl;
+                    failed = true;
+                }
+                lock.lock();
+                entry->pending.reset();
+                entry->failed = failed;
+                if (!failed) {
+                    uint64_t handle = toHandle(pipeline);
+                    entry->handle.store(handle, std::memory_order_release);
+                    byHandle[handle] = entry;
+                }
+                completedAsyncCount.fetch_add(1, std::memory_order_release);
+                completedCondition.notify_all();
+                if (!entry->refCount) {
+                    // Released while compiling
+                    ++entry->refCount;
+                    releaseLocked(entry);
+                }
+            }
+        }
+
+        vk::Device device;
+        vk::PipelineCache pipelineCache;
+        std::shared_ptr<DeletionQueue> deletionQueue;
+        CompileCallback onCompile;
+
+        mutable std::mutex mutex;
+        std::unordered_map<uint64_t, std::vector<std::unique_ptr<Entry>>> entries;
+        std::unordered_map<uint64_t, Entry*> byHandle;
+        Stats stats;
+        std::atomic<uint64_t> compileNanoseconds{ 0 };
+
+        std::thread worker;
+        std::deque<Entry*> compileQueue;
+        std::condition_variable workCondition;
+        std::condition_variable completedCondition;
+        std::atomic<uint64_t> completedAsyncCount{ 0 };
+        bool stopping{ false };
+    };
+}
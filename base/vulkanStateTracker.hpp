@@ -0,0 +1,506 @@
+/*
+* Resource state tracking for pipeline barriers
+*
+* The tracker remembers, for every image subresource and buffer range used in a command buffer, its
+* layout, the last write and the reads since then.  Requiring a resource for a usage works out the
+* dependency that usage actually needs: a layout transition, a memory dependency after a write, an
+* execution dependency for a write after reads, or nothing for a read of visible data.  The
+* dependencies are collected until flush, which merges them into a single pipelineBarrier with
+* adjacent subresources and buffer ranges combined into as few barrier structures as possible.
+*
+* flush is a template over the command buffer, so the tracker can be exercised with a mock on the CPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+
+#include "common.hpp"
+
+namespace vkx {
+
+    class ResourceStateTracker {
+    public:
+        // How a resource is about to be used.  The layout is ignored for buffers.
+        struct Usage {
+            vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+            vk::PipelineStageFlags stages;
+            vk::AccessFlags access;
+
+            static Usage transferSrc() {
+                return { vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead };
+            }
+            static Usage transferDst() {
+                return { vk::ImageLayout::eTransferDstOptimal, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite };
+            }
+            static Usage sampled(vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eFragmentShader, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal) {
+                return { layout, stages, vk::AccessFlagBits::eShaderRead };
+            }
+            static Usage storage(vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eComputeShader, vk::ImageLayout layout = vk::ImageLayout::eGeneral) {
+                return { layout, stages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+            }
+            static Usage colorAttachment() {
+                return { vk::ImageLayout::eColorAttachmentOptimal, vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite };
+            }
+            static Usage depthAttachment() {
+                return { vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests, vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite };
+            }
+            static Usage present() {
+                return { vk::ImageLayout::ePresentSrcKHR, vk::PipelineStageFlagBits::eBottomOfPipe, vk::AccessFlags() };
+            }
+            static Usage vertexBuffer() {
+                return { vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eVertexAttributeRead };
+            }
+            static Usage indexBuffer() {
+                return { vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eVertexInput, vk::AccessFlagBits::eIndexRead };
+            }
+            static Usage indirectBuffer() {
+                return { vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead };
+            }
+            static Usage uniformBuffer(vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eVertexShader) {
+                return { vk::ImageLayout::eUndefined, stages, vk::AccessFlagBits::eUniformRead };
+            }
+            static Usage storageBuffer(vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eComputeShader) {
+                return { vk::ImageLayout::eUndefined, stages, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+            }
+        };
+
+        struct Stats {
+            uint64_t requests{ 0 };
+            // Requests that were already satisfied by the tracked state
+            uint64_t elided{ 0 };
+            uint64_t pipelineBarriers{ 0 };
+            uint64_t imageBarriers{ 0 };
+            uint64_t bufferBarriers{ 0 };
+        };
+
+        // Seeds the state of subresources used before this command buffer, e.g. a texture that is already
+        // in eShaderReadOnlyOptimal.  Untracked subresources start out eUndefined, so their contents are discarded.
+        void setImageState(const vk::Image& image, const vk::ImageSubresourceRange& range, const Usage& usage) {
+            forEachSubresource(image, range, [&](SubresourceState& state, uint32_t, uint32_t, uint32_t) {
+                state = SubresourceState();
+                state.state.layout = usage.layout;
+                state.state.writeStages = usage.stages;
+                state.state.writeAccess = usage.access & writeAccessMask();
+                state.state.readStages = (usage.access & ~writeAccessMask()) ? usage.stages : vk::PipelineStageFlags();
+            });
+        }
+
+        // Needed for ranges using VK_REMAINING_MIP_LEVELS or VK_REMAINING_ARRAY_LAYERS
+        void setImageExtent(const vk::Image& image, uint32_t mipLevels, uint32_t arrayLayers) {
+            auto& tracked = images[(VkImage)image];
+            tracked.mipLevels = mipLevels;
+            tracked.arrayLayers = arrayLayers;
+        }
+
+        // The image is used as described by usage by the commands recorded after the next flush
+        void requireImage(const vk::Image& image, const vk::ImageSubresourceRange& range, const Usage& usage) {
+            ++stats.requests;
+            bool needed = false;
+            forEachSubresource(image, range, [&](SubresourceState& subresource, uint32_t aspect, uint32_t level, uint32_t layer) {
+                if (subresource.batch == batch) {
+                    // Already required since the last flush, only further reads in the same layout can share the barrier
+                    if (subresource.state.layout != usage.layout || (usage.access & writeAccessMask()) || subresource.batchWrites) {
+                        throw std::runtime_error("Conflicting image requirements without a flush in between");
+                    }
+                    if (subresource.pending != NO_BARRIER) {
+                        pendingImages[subresource.pending].dstAccess |= usage.access;
+                        addReader(subresource.state, usage);
+                        needed = true;
+                        return;
+                    }
+                }
+                subresource.batch = batch;
+                subresource.batchWrites = (bool)(usage.access & writeAccessMask());
+                subresource.pending = NO_BARRIER;
+                bool transition = subresource.state.layout != usage.layout;
+                Dependency dependency = resolve(subresource.state, usage, transition);
+                if (transition || dependency.memory) {
+                    PendingImage barrier;
+                    barrier.image = (VkImage)image;
+                    barrier.aspect = 1u << aspect;
+                    barrier.baseLevel = level;
+                    barrier.levelCount = 1;
+                    barrier.baseLayer = layer;
+                    barrier.layerCount = 1;
+                    barrier.oldLayout = transition ? dependency.oldLayout : usage.layout;
+                    barrier.newLayout = usage.layout;
+                    barrier.srcAccess = dependency.srcAccess;
+                    barrier.dstAccess = usage.access;
+                    subresource.pending = (uint32_t)pendingImages.size();
+                    pendingImages.push_back(barrier);
+                }
+                needed |= addDependency(dependency, transition, usage);
+            });
+            if (!needed) {
+                ++stats.elided;
+            }
+        }
+
+        void requireImage(const vk::Image& image, vk::ImageAspectFlags aspectMask, const Usage& usage) {
+            requireImage(image, vk::ImageSubresourceRange(aspectMask, 0, 1, 0, 1), usage);
+        }
+
+        // The range [offset, offset + size) of the buffer is used as described by usage after the next flush
+        void requireBuffer(const vk::Buffer& buffer, vk::DeviceSize offset, vk::DeviceSize size, const Usage& usage) {
+            ++stats.requests;
+            if (size == 0) {
+                ++stats.elided;
+                return;
+            }
+            auto& intervals = buffers[(VkBuffer)buffer];
+            const vk::DeviceSize end = offset + size;
+            splitInterval(intervals, offset);
+            splitInterval(intervals, end);
+            // Fill the gaps with untracked state
+            vk::DeviceSize position = offset;
+            for (auto it = intervals.lower_bound(offset); position < end; ) {
+                if (it == intervals.end() || it->first > position) {
+                    vk::DeviceSize gapEnd = (it == intervals.end()) ? end : std::min(end, it->first);
+                    it = intervals.emplace_hint(it, position, Interval{ gapEnd });
+                }
+                position = it->second.end;
+                ++it;
+            }
+
+            bool needed = false;
+            for (auto it = intervals.lower_bound(offset); it != intervals.end() && it->first < end; ++it) {
+                auto& interval = it->second;
+                if (interval.batch == batch) {
+                    if ((usage.access & writeAccessMask()) || interval.batchWrites) {
+                        throw std::runtime_error("Conflicting buffer requirements without a flush in between");
+                    }
+                    if (interval.pending != NO_BARRIER) {
+                        pendingBuffers[interval.pending].dstAccess |= usage.access;
+                        addReader(interval.state, usage);
+                        needed = true;
+                        continue;
+                    }
+                }
+                interval.batch = batch;
+                interval.batchWrites = (bool)(usage.access & writeAccessMask());
+                interval.pending = NO_BARRIER;
+                Dependency dependency = resolve(interval.state, usage, false);
+                if (dependency.memory) {
+                    PendingBuffer barrier;
+                    barrier.buffer = (VkBuffer)buffer;
+                    barrier.offset = it->first;
+                    barrier.size = interval.end - it->first;
+                    barrier.srcAccess = dependency.srcAccess;
+                    barrier.dstAccess = usage.access;
+                    interval.pending = (uint32_t)pendingBuffers.size();
+                    pendingBuffers.push_back(barrier);
+                }
+                needed |= addDependency(dependency, false, usage);
+            }
+            if (!needed) {
+                ++stats.elided;
+            }
+        }
+
+        // Records the dependencies required since the last flush as a single pipelineBarrier, if any are needed
+        template <typename CommandBuffer>
+        void flush(const CommandBuffer& cmdBuffer) {
+            if (srcStages || dstStages) {
+                std::vector<vk::ImageMemoryBarrier> imageBarriers = mergeImageBarriers();
+                std::vector<vk::BufferMemoryBarrier> bufferBarriers = mergeBufferBarriers();
+                cmdBuffer.pipelineBarrier(srcStages, dstStages, vk::DependencyFlags(), nullptr, bufferBarriers, imageBarriers);
+                ++stats.pipelineBarriers;
+                stats.imageBarriers += imageBarriers.size();
+                stats.bufferBarriers += bufferBarriers.size();
+            }
+            pendingImages.clear();
+            pendingBuffers.clear();
+            srcStages = vk::PipelineStageFlags();
+            dstStages = vk::PipelineStageFlags();
+            ++batch;
+        }
+
+        // Last tracked layout of a subresource, eUndefined if it hasn't been used
+        vk::ImageLayout getImageLayout(const vk::Image& image, vk::ImageAspectFlagBits aspect, uint32_t level = 0, uint32_t layer = 0) const {
+            auto it = images.find((VkImage)image);
+            if (it == images.end()) {
+                return vk::ImageLayout::eUndefined;
+            }
+            auto subresource = it->second.subresources.find(subresourceKey(aspectIndex((VkImageAspectFlags)aspect), level, layer));
+            return subresource == it->second.subresources.end() ? vk::ImageLayout::eUndefined : subresource->second.state.layout;
+        }
+
+        const Stats& getStats() const {
+            return stats;
+        }
+
+        // Forgets all tracked state, for reuse with another command buffer
+        void reset() {
+            if (!pendingImages.empty() || !pendingBuffers.empty() || srcStages || dstStages) {
+                throw std::runtime_error("State tracker reset with unflushed requirements");
+            }
+            images.clear();
+            buffers.clear();
+        }
+
+    private:
+        static const uint32_t NO_BARRIER = UINT32_MAX;
+
+        struct State {
+            vk::ImageLayout layout{ vk::ImageLayout::eUndefined };
+            // Last write (or layout transition), and the stages and accesses it has been made visible to
+            vk::PipelineStageFlags writeStages;
+            vk::AccessFlags writeAccess;
+            vk::PipelineStageFlags visibleStages;
+            vk::AccessFlags visibleAccess;
+            // Reads since the last write
+            vk::PipelineStageFlags readStages;
+            // Set once a barrier has made the last write available, later writes only need to wait for the reads
+            bool available{ false };
+        };
+
+        struct SubresourceState {
+            State state;
+            // Flush batch of the last requirement and its barrier, to merge further reads of the same batch
+            uint64_t batch{ UINT64_MAX };
+            bool batchWrites{ false };
+            uint32_t pending{ NO_BARRIER };
+        };
+
+        struct Interval : public SubresourceState {
+            Interval(vk::DeviceSize end = 0) : end(end) {}
+            vk::DeviceSize end;
+        };
+
+        struct TrackedImage {
+            uint32_t mipLevels{ 0 };
+            uint32_t arrayLayers{ 0 };
+            std::unordered_map<uint64_t, SubresourceState> subresources;
+        };
+
+        struct Dependency {
+            vk::PipelineStageFlags srcStages;
+            vk::AccessFlags srcAccess;
+            vk::ImageLayout oldLayout{ vk::ImageLayout::eUndefined };
+            bool execution{ false };
+            bool memory{ false };
+        };
+
+        struct PendingImage {
+            VkImage image;
+            uint32_t aspect;
+            uint32_t baseLevel, levelCount;
+            uint32_t baseLayer, layerCount;
+            vk::ImageLayout oldLayout, newLayout;
+            vk::AccessFlags srcAccess, dstAccess;
+        };
+
+        struct PendingBuffer {
+            VkBuffer buffer;
+            vk::DeviceSize offset, size;
+            vk::AccessFlags srcAccess, dstAccess;
+        };
+
+        static vk::AccessFlags writeAccessMask() {
+            return vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eDepthStencilAttachmentWrite |
+                vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eHostWrite | vk::AccessFlagBits::eMemoryWrite;
+        }
+
+        static uint32_t aspectIndex(VkImageAspectFlags aspect) {
+            uint32_t index = 0;
+            while (!(aspect & 1)) {
+                aspect >>= 1;
+                ++index;
+            }
+            return index;
+        }
+
+        static uint64_t subresourceKey(uint32_t aspect, uint32_t level, uint32_t layer) {
+            return ((uint64_t)aspect << 56) | ((uint64_t)level << 32) | layer;
+        }
+
+        template <typename F>
+        void forEachSubresource(const vk::Image& image, const vk::ImageSubresourceRange& range, F&& f) {
+            auto& tracked = images[(VkImage)image];
+            uint32_t levelCount = range.levelCount;
+            uint32_t layerCount = range.layerCount;
+            if (levelCount == VK_REMAINING_MIP_LEVELS || layerCount == VK_REMAINING_ARRAY_LAYERS) {
+                if (!tracked.mipLevels) {
+                    throw std::runtime_error("Remaining levels or layers of an image without setImageExtent");
+                }
+                if (levelCount == VK_REMAINING_MIP_LEVELS) {
+                    levelCount = tracked.mipLevels - range.baseMipLevel;
+                }
+                if (layerCount == VK_REMAINING_ARRAY_LAYERS) {
+                    layerCount = tracked.arrayLayers - range.baseArrayLayer;
+                }
+            }
+            VkImageAspectFlags aspects = (VkImageAspectFlags)range.aspectMask;
+            for (uint32_t aspect = 0; aspects >> aspect; ++aspect) {
+                if (!(aspects & (1u << aspect))) {
+                    continue;
+                }
+                for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + levelCount; ++level) {
+                    for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + layerCount; ++layer) {
+                        f(tracked.subresources[subresourceKey(aspect, level, layer)], aspect, level, layer);
+                    }
+                }
+            }
+        }
+
+        // Works out what usage needs to wait for and updates the state to include the usage
+        static Dependency resolve(State& state, const Usage& usage, bool transition) {
+            Dependency dependency;
+            vk::AccessFlags writes = usage.access & writeAccessMask();
+            if (transition || writes) {
+                // Write after read only needs an execution dependency, write after write also a memory dependency
+                dependency.srcStages = state.available ? state.readStages : state.writeStages | state.readStages;
+                dependency.srcAccess = state.available ? vk::AccessFlags() : state.writeAccess;
+                dependency.oldLayout = state.layout;
+                dependency.execution = (bool)dependency.srcStages;
+                dependency.memory = (bool)dependency.srcAccess;
+
+                // A layout transition counts as a write completing before usage.stages
+                state.layout = usage.layout;
+                state.writeStages = usage.stages;
+                state.writeAccess = writes;
+                state.visibleStages = usage.stages;
+                state.visibleAccess = usage.access;
+                state.readStages = (usage.access & ~writeAccessMask()) ? usage.stages : vk::PipelineStageFlags();
+                state.available = false;
+            } else {
+                // Read after write needs the write made visible, unless an earlier barrier already did
+                bool visible = !(usage.stages & ~state.visibleStages) && !(usage.access & ~state.visibleAccess);
+                if (state.writeStages && !visible) {
+                    dependency.srcStages = state.writeStages;
+                    dependency.srcAccess = state.writeAccess;
+                    dependency.execution = true;
+                    dependency.memory = (bool)dependency.srcAccess;
+                    state.available = true;
+                    state.visibleStages |= usage.stages;
+                    state.visibleAccess |= usage.access;
+                }
+                state.readStages |= usage.stages;
+            }
+            return dependency;
+        }
+
+        // Another read sharing a barrier that is still pending
+        void addReader(State& state, const Usage& usage) {
+            state.available = true;
+            state.visibleStages |= usage.stages;
+            state.visibleAccess |= usage.access;
+            state.readStages |= usage.stages;
+            dstStages |= usage.stages;
+        }
+
+        bool addDependency(const Dependency& dependency, bool transition, const Usage& usage) {
+            if (!transition && !dependency.execution && !dependency.memory) {
+                return false;
+            }
+            // Transitions of resources nothing has touched yet only wait for the start of the pipeline
+            srcStages |= dependency.srcStages ? dependency.srcStages : vk::PipelineStageFlags(vk::PipelineStageFlagBits::eTopOfPipe);
+            dstStages |= usage.stages;
+            return true;
+        }
+
+        // Adjacent layers are merged first, then adjacent levels with the same layers, then aspects
+        std::vector<vk::ImageMemoryBarrier> mergeImageBarriers() {
+            auto sameBarrier = [](const PendingImage& a, const PendingImage& b) {
+                return a.image == b.image && a.oldLayout == b.oldLayout && a.newLayout == b.newLayout && a.srcAccess == b.srcAccess && a.dstAccess == b.dstAccess;
+            };
+            auto barrierKey = [](const PendingImage& p) {
+                return std::make_tuple(p.image, (int)p.oldLayout, (int)p.newLayout, (VkAccessFlags)p.srcAccess, (VkAccessFlags)p.dstAccess);
+            };
+            auto mergeRuns = [&](std::vector<PendingImage>& pending, auto key, auto adjacent, auto merge) {
+                std::sort(pending.begin(), pending.end(), [&](const PendingImage& a, const PendingImage& b) {
+                    return std::make_tuple(barrierKey(a), key(a)) < std::make_tuple(barrierKey(b), key(b));
+                });
+                size_t out = 0;
+                for (size_t i = 0; i < pending.size(); ++i) {
+                    if (out > 0 && sameBarrier(pending[out - 1], pending[i]) && adjacent(pending[out - 1], pending[i])) {
+                        merge(pending[out - 1], pending[i]);
+                    } else {
+                        pending[out++] = pending[i];
+                    }
+                }
+                pending.resize(out);
+            };
+
+            mergeRuns(pendingImages, [](const PendingImage& p) { return std::make_tuple(p.aspect, p.baseLevel, p.levelCount, p.baseLayer); },
+                [](const PendingImage& a, const PendingImage& b) { return a.aspect == b.aspect && a.baseLevel == b.baseLevel && a.levelCount == b.levelCount && a.baseLayer + a.layerCount == b.baseLayer; },
+                [](PendingImage& a, const PendingImage& b) { a.layerCount += b.layerCount; });
+            mergeRuns(pendingImages, [](const PendingImage& p) { return std::make_tuple(p.aspect, p.baseLayer, p.layerCount, p.baseLevel); },
+                [](const PendingImage& a, const PendingImage& b) { return a.aspect == b.aspect && a.baseLayer == b.baseLayer && a.layerCount == b.layerCount && a.baseLevel + a.levelCount == b.baseLevel; },
+                [](PendingImage& a, const PendingImage& b) { a.levelCount += b.levelCount; });
+            mergeRuns(pendingImages, [](const PendingImage& p) { return std::make_tuple(p.baseLevel, p.levelCount, p.baseLayer, p.layerCount); },
+                [](const PendingImage& a, const PendingImage& b) { return a.baseLevel == b.baseLevel && a.levelCount == b.levelCount && a.baseLayer == b.baseLayer && a.layerCount == b.layerCount; },
+                [](PendingImage& a, const PendingImage& b) { a.aspect |= b.aspect; });
+
+            std::vector<vk::ImageMemoryBarrier> result;
+            result.reserve(pendingImages.size());
+            for (const auto& pending : pendingImages) {
+                vk::ImageMemoryBarrier barrier;
+                barrier.srcAccessMask = pending.srcAccess;
+                barrier.dstAccessMask = pending.dstAccess;
+                barrier.oldLayout = pending.oldLayout;
+                barrier.newLayout = pending.newLayout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = vk::Image(pending.image);
+                barrier.subresourceRange = vk::ImageSubresourceRange((vk::ImageAspectFlags)pending.aspect, pending.baseLevel, pending.levelCount, pending.baseLayer, pending.layerCount);
+                result.push_back(barrier);
+            }
+            return result;
+        }
+
+        std::vector<vk::BufferMemoryBarrier> mergeBufferBarriers() {
+            std::sort(pendingBuffers.begin(), pendingBuffers.end(), [](const PendingBuffer& a, const PendingBuffer& b) {
+                return std::make_tuple(a.buffer, a.offset) < std::make_tuple(b.buffer, b.offset);
+            });
+            std::vector<vk::BufferMemoryBarrier> result;
+            for (const auto& pending : pendingBuffers) {
+                if (!result.empty()) {
+                    auto& last = result.back();
+                    if ((VkBuffer)last.buffer == pending.buffer && last.offset + last.size == pending.offset && last.srcAccessMask == pending.srcAccess && last.dstAccessMask == pending.dstAccess) {
+                        last.size += pending.size;
+                        continue;
+                    }
+                }
+                vk::BufferMemoryBarrier barrier;
+                barrier.srcAccessMask = pending.srcAccess;
+                barrier.dstAccessMask = pending.dstAccess;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.buffer = vk::Buffer(pending.buffer);
+                barrier.offset = pending.offset;
+                barrier.size = pending.size;
+                result.push_back(barrier);
+            }
+            return result;
+        }
+
+        // Makes offset the start of an interval, if it lies inside one
+        static void splitInterval(std::map<vk::DeviceSize, Interval>& intervals, vk::DeviceSize offset) {
+            auto it = intervals.upper_bound(offset);
+            if (it == intervals.begin()) {
+                return;
+            }
+            --it;
+            if (it->first < offset && offset < it->second.end) {
+                Interval tail = it->second;
+                it->second.end = offset;
+                intervals.emplace(offset, tail);
+            }
+        }
+
+        std::unordered_map<VkImage, TrackedImage> images;
+        std::unordered_map<VkBuffer, std::map<vk::DeviceSize, Interval>> buffers;
+        std::vector<PendingImage> pendingImages;
+        std::vector<PendingBuffer> pendingBuffers;
+        vk::PipelineStageFlags srcStages;
+        vk::PipelineStageFlags dstStages;
+        uint64_t batch{ 0 };
+        Stats stats;
+    };
+}
@@ -13,6 +13,7 @@
 
 #include "common.hpp"
 #include "vulkanTools.h"
+#include "vulkanContext.hpp"
 
 namespace vkx {
     struct SwapChainImage {
@@ -27,6 +28,8 @@ namespace vkx {
         vk::SurfaceKHR surface;
         vk::SwapchainKHR swapChain;
         vk::PresentInfoKHR presentInfo;
+        // Backing images when rendering headless, see createOffscreen
+        std::vector<CreateImageResult> offscreenImages;
 
     public:
         std::vector<SwapChainImage> images;
@@ -36,6 +39,8 @@ namespace vkx {
         uint32_t currentImage{ 0 };
         // Index of the deteced graphics and presenting device queue
         uint32_t queueNodeIndex = UINT32_MAX;
+        // Layout render passes leave the images in at the end of a frame
+        vk::ImageLayout presentLayout{ vk::ImageLayout::ePresentSrcKHR };
 
         SwapChain(const vkx::Context& context) : context(context) {
             presentInfo.swapchainCount = 1;
@@ -188,6 +193,46 @@ namespace vkx {
             }
         }
 
+        // Creates plain device local images in place of a swap chain, for rendering without a window.
+        // Nothing is presented, so the images are left ready to be copied from.
+        void createOffscreen(const vk::Extent2D& size, uint32_t count) {
+            cleanupOffscreen();
+            colorFormat = vk::Format::eB8G8R8A8Unorm;
+            presentLayout = vk::ImageLayout::eTransferSrcOptimal;
+            currentImage = 0;
+
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = colorFormat;
+            imageCreateInfo.extent = vk::Extent3D{ size.width, size.height, 1 };
+            imageCreateInfo.mipLevels = 1;
+            imageCreateInfo.arrayLayers = 1;
+            imageCreateInfo.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+
+            vk::ImageViewCreateInfo colorAttachmentView;
+            colorAttachmentView.format = colorFormat;
+            colorAttachmentView.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eColor;
+            colorAttachmentView.subresourceRange.levelCount = 1;
+            colorAttachmentView.subresourceRange.layerCount = 1;
+            colorAttachmentView.viewType = vk::ImageViewType::e2D;
+
+            imageCount = count;
+            offscreenImages.resize(imageCount);
+            images.resize(imageCount);
+            for (uint32_t i = 0; i < imageCount; i++) {
+                offscreenImages[i] = context.createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+                colorAttachmentView.image = offscreenImages[i].image;
+                offscreenImages[i].view = context.device.createImageView(colorAttachmentView);
+                images[i].image = offscreenImages[i].image;
+                images[i].view = offscreenImages[i].view;
+                images[i].fence = vk::Fence();
+            }
+        }
+
+        bool isOffscreen() const {
+            return !offscreenImages.empty();
+        }
+
         std::vector<vk::Framebuffer> createFramebuffers(vk::FramebufferCreateInfo framebufferCreateInfo) {
             // Verify that the first attachment is null
             assert(framebufferCreateInfo.pAttachments[0] == vk::ImageView());
@@ -247,17 +292,32 @@ namespace vkx {
         vk::Result queuePresent(vk::Semaphore waitSemaphore) {
             presentInfo.waitSemaphoreCount = waitSemaphore ? 1 : 0;
             presentInfo.pWaitSemaphores = &waitSemaphore;
+            auto queueLock = context.lockQueue();
             return context.queue.presentKHR(presentInfo);
         }
 
         // Free all Vulkan resources used by the swap chain
         void cleanup() {
+            if (isOffscreen()) {
+                cleanupOffscreen();
+                return;
+            }
             for (uint32_t i = 0; i < imageCount; i++) {
                 context.device.destroyImageView(images[i].view);
             }
             context.device.destroySwapchainKHR(swapChain);
             context.instance.destroySurfaceKHR(surface);
         }
+
+    private:
+        void cleanupOffscreen() {
+            for (auto& image : offscreenImages) {
+                image.destroy();
+            }
+            offscreenImages.clear();
+            images.clear();
+            imageCount = 0;
+        }
     };
 }
 
@@ -88,10 +88,10 @@ namespace vkx {
             }
             texture.destroy();
             vertexBuffer.destroy();
-            context.device.destroyDescriptorSetLayout(descriptorSetLayout);
             context.device.destroyDescriptorPool(descriptorPool);
-            context.device.destroyPipelineLayout(pipelineLayout);
-            context.device.destroyPipeline(pipeline);
+            context.stateCache->release(pipeline);
+            context.stateCache->release(pipelineLayout);
+            context.stateCache->release(descriptorSetLayout);
         }
 
         // Prepare all vulkan resources required to render the font
@@ -108,7 +108,8 @@ namespace vkx {
             cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
 
             // Vertex buffer
-            vk::DeviceSize bufferSize = MAX_CHAR_COUNT * sizeof(glm::vec4);
+            // Four vertices per character
+            vk::DeviceSize bufferSize = MAX_CHAR_COUNT * 4 * sizeof(glm::vec4);
             vertexBuffer = context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, bufferSize);
 
             // Font texture
@@ -168,7 +169,7 @@ namespace vkx {
                     setLayoutBindings.data(),
                     setLayoutBindings.size());
 
-            descriptorSetLayout = context.device.createDescriptorSetLayout(descriptorSetLayoutInfo);
+            descriptorSetLayout = context.stateCache->acquireDescriptorSetLayout(descriptorSetLayoutInfo);
 
             // vk::Pipeline layout
             vk::PipelineLayoutCreateInfo pipelineLayoutInfo =
@@ -176,7 +177,7 @@ namespace vkx {
                     &descriptorSetLayout,
                     1);
 
-            pipelineLayout = context.device.createPipelineLayout(pipelineLayoutInfo);
+            pipelineLayout = context.stateCache->acquirePipelineLayout(pipelineLayoutInfo);
 
             // Descriptor set
             vk::DescriptorSetAllocateInfo descriptorSetAllocInfo =
@@ -279,8 +280,10 @@ namespace vkx {
             pipelineCreateInfo.stageCount = shaderStages.size();
             pipelineCreateInfo.pStages = shaderStages.data();
 
-            context.trashPipeline(pipeline);
-            pipeline = context.device.createGraphicsPipelines(context.pipelineCache, pipelineCreateInfo, nullptr)[0];
+            // Acquire before releasing, so recreating the pipeline for an unchanged render pass is a cache hit
+            vk::Pipeline newPipeline = context.stateCache->acquireGraphicsPipeline(pipelineCreateInfo);
+            context.stateCache->release(pipeline);
+            pipeline = newPipeline;
         }
 
         // Map buffer 
@@ -322,6 +325,9 @@ namespace vkx {
 
             // Generate a uv mapped quad per char in the new text
             for (auto letter : text) {
+                if (numLetters == MAX_CHAR_COUNT) {
+                    break;
+                }
                 stb_fontchar *charData = &stbFontData[(uint32_t)letter - STB_FIRST_CHAR];
 
                 mapped->x = (x + (float)charData->x0 * charW);
@@ -362,7 +368,7 @@ namespace vkx {
 
         // Needs to be called by the application
         void writeCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
-            debug::marker::Marker(cmdBuffer, "Text overlay", glm::vec4(1.0f, 0.94f, 0.3f, 1.0f));
+            debug::marker::Marker marker(cmdBuffer, "Text overlay", glm::vec4(1.0f, 0.94f, 0.3f, 1.0f));
             vk::Viewport viewport = vkx::viewport((float)framebufferWidth, (float)framebufferHeight, 0.0f, 1.0f);
             cmdBuffer.setViewport(0, viewport);
             vk::Rect2D scissor = vkx::rect2D(framebufferWidth, framebufferHeight, 0, 0);
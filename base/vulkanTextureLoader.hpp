@@ -23,6 +23,7 @@ namespace vkx {
         vk::Device device;
         vk::Image image;
         vk::DeviceMemory memory;
+        MemoryAllocation allocation;
         vk::Sampler sampler;
         vk::ImageLayout imageLayout{ vk::ImageLayout::eShaderReadOnlyOptimal };
         vk::ImageView view;
@@ -36,6 +37,7 @@ namespace vkx {
             device = created.device;
             image = created.image;
             memory = created.memory;
+            allocation = created.allocation;
             return *this;
         }
 
@@ -52,7 +54,10 @@ namespace vkx {
                 device.destroyImage(image);
                 image = vk::Image();
             }
-            if (memory) {
+            if (allocation) {
+                allocation.free();
+                memory = vk::DeviceMemory();
+            } else if (memory) {
                 device.freeMemory(memory);
                 memory = vk::DeviceMemory();
             }
@@ -174,26 +179,16 @@ namespace vkx {
                 subresourceRange.levelCount = texture.mipLevels;
                 subresourceRange.layerCount = 1;
 
-                // vk::Image barrier for optimal image (target)
-                // Optimal image will be used as destination for the copy
-                setImageLayout(
-                    cmdBuffer,
-                    texture.image,
-                    vk::ImageAspectFlagBits::eColor,
-                    vk::ImageLayout::ePreinitialized,
-                    vk::ImageLayout::eTransferDstOptimal,
-                    subresourceRange);
+                // Optimal image will be used as destination for the copy, its initial contents are discarded
+                ResourceStateTracker tracker;
+                tracker.requireImage(texture.image, subresourceRange, ResourceStateTracker::Usage::transferDst());
+                tracker.flush(cmdBuffer);
 
                 // Copy mip levels from staging buffer
                 cmdBuffer.copyBufferToImage(staging.buffer, texture.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
                 // Change texture image layout to shader read after all mip levels have been copied
-                setImageLayout(
-                    cmdBuffer,
-                    texture.image,
-                    vk::ImageAspectFlagBits::eColor,
-                    vk::ImageLayout::eTransferDstOptimal,
-                    texture.imageLayout,
-                    subresourceRange);
+                tracker.requireImage(texture.image, subresourceRange, ResourceStateTracker::Usage::sampled(context.getShaderStages(), texture.imageLayout));
+                tracker.flush(cmdBuffer);
 
                 // Submit command buffer containing copy and image layout commands
                 cmdBuffer.end();
@@ -206,7 +201,10 @@ namespace vkx {
                 submitInfo.commandBufferCount = 1;
                 submitInfo.pCommandBuffers = &cmdBuffer;
 
-                context.queue.submit(submitInfo, copyFence);
+                {
+                    auto queueLock = context.lockQueue();
+                    context.queue.submit(submitInfo, copyFence);
+                }
                 context.device.waitForFences(copyFence, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
                 context.device.destroyFence(copyFence);
                 staging.destroy();
@@ -241,13 +239,12 @@ namespace vkx {
                 // and can be directly used as textures
                 texture = mappable;
 
-                // Setup image memory barrier
-                setImageLayout(
-                    cmdBuffer,
-                    texture.image,
-                    vk::ImageAspectFlagBits::eColor,
-                    vk::ImageLayout::ePreinitialized,
-                    texture.imageLayout);
+                // Setup image memory barrier, the contents written by the host are kept
+                vk::ImageSubresourceRange subresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1);
+                ResourceStateTracker tracker;
+                tracker.setImageState(texture.image, subresourceRange, { vk::ImageLayout::ePreinitialized, vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostWrite });
+                tracker.requireImage(texture.image, subresourceRange, ResourceStateTracker::Usage::sampled(context.getShaderStages(), texture.imageLayout));
+                tracker.flush(cmdBuffer);
 
                 // Submit command buffer containing copy and image layout commands
                 cmdBuffer.end();
@@ -257,6 +254,7 @@ namespace vkx {
                 vk::SubmitInfo submitInfo;
                 submitInfo.commandBufferCount = 1;
                 submitInfo.pCommandBuffers = &cmdBuffer;
+                auto queueLock = context.lockQueue();
                 context.queue.submit(submitInfo, nullFence);
                 context.queue.waitIdle();
             }
@@ -363,13 +361,9 @@ namespace vkx {
                 subresourceRange.baseMipLevel = 0;
                 subresourceRange.levelCount = texture.mipLevels;
                 subresourceRange.layerCount = 6;
-                setImageLayout(
-                    cmdBuffer,
-                    texture.image,
-                    vk::ImageAspectFlagBits::eColor,
-                    vk::ImageLayout::eUndefined,
-                    vk::ImageLayout::eTransferDstOptimal,
-                    subresourceRange);
+                ResourceStateTracker tracker;
+                tracker.requireImage(texture.image, subresourceRange, ResourceStateTracker::Usage::transferDst());
+                tracker.flush(cmdBuffer);
                 // Setup buffer copy regions for each face including all of it's miplevels
                 std::vector<vk::BufferImageCopy> bufferCopyRegions;
                 {
@@ -394,13 +388,8 @@ namespace vkx {
                 cmdBuffer.copyBufferToImage(staging.buffer, texture.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
                 // Change texture image layout to shader read after all faces have been copied
                 texture.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-                setImageLayout(
-                    cmdBuffer,
-                    texture.image,
-                    vk::ImageAspectFlagBits::eColor,
-                    vk::ImageLayout::eTransferDstOptimal,
-                    vk::ImageLayout::eShaderReadOnlyOptimal,
-                    subresourceRange);
+                tracker.requireImage(texture.image, subresourceRange, ResourceStateTracker::Usage::sampled(context.getShaderStages()));
+                tracker.flush(cmdBuffer);
             });
 
             // Create sampler
@@ -534,26 +523,17 @@ namespace vkx {
             subresourceRange.levelCount = 1;
             subresourceRange.layerCount = texture.layerCount;
 
-            setImageLayout(
-                cmdBuffer,
-                texture.image,
-                vk::ImageAspectFlagBits::eColor,
-                vk::ImageLayout::eUndefined,
-                vk::ImageLayout::eTransferDstOptimal,
-                subresourceRange);
+            ResourceStateTracker tracker;
+            tracker.requireImage(texture.image, subresourceRange, ResourceStateTracker::Usage::transferDst());
+            tracker.flush(cmdBuffer);
 
             // Copy the cube map faces from the staging buffer to the optimal tiled image
             cmdBuffer.copyBufferToImage(staging.buffer, texture.image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegions);
 
             // Change texture image layout to shader read after all faces have been copied
             texture.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-            setImageLayout(
-                cmdBuffer,
-                texture.image,
-                vk::ImageAspectFlagBits::eColor,
-                vk::ImageLayout::eTransferDstOptimal,
-                texture.imageLayout,
-                subresourceRange);
+            tracker.requireImage(texture.image, subresourceRange, ResourceStateTracker::Usage::sampled(context.getShaderStages()));
+            tracker.flush(cmdBuffer);
 
             cmdBuffer.end();
 
@@ -566,7 +546,10 @@ namespace vkx {
             submitInfo.commandBufferCount = 1;
             submitInfo.pCommandBuffers = &cmdBuffer;
 
-            context.queue.submit(submitInfo, copyFence);
+            {
+                auto queueLock = context.lockQueue();
+                context.queue.submit(submitInfo, copyFence);
+            }
 
             context.device.waitForFences(copyFence, VK_TRUE, DEFAULT_FENCE_TIMEOUT);
 
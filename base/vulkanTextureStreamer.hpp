@@ -0,0 +1,460 @@
+/*
+* Asynchronous texture loader
+*
+* Files are decoded and copied into staging buffers on job system workers.  The copies to the
+* device local images are recorded on the main thread and submitted to the transfer queue, with
+* a queue family ownership transfer to the graphics queue when the transfer queue belongs to a
+* different family.  Until a texture is ready its handle resolves to a small placeholder.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkanContext.hpp"
+#include "vulkanTextureLoader.hpp"
+#include "jobSystem.hpp"
+
+namespace vkx {
+
+    class TextureStreamer {
+        struct Request {
+            enum class State { Decoding, Decoded, Uploading, Uploaded, Ready, Failed };
+
+            std::string filename;
+            vk::Format format;
+            std::function<void(const Texture&)> onReady;
+            std::atomic<State> state{ State::Decoding };
+            std::string error;
+
+            // Filled in by the decode job
+            CreateBufferResult staging;
+            vk::Extent3D extent;
+            std::vector<vk::BufferImageCopy> copyRegions;
+
+            Texture texture;
+            const Texture* placeholder{ nullptr };
+        };
+
+    public:
+        // Handle to a texture being streamed in
+        class Handle {
+        public:
+            Handle() {}
+
+            bool isReady() const {
+                return request && request->state == Request::State::Ready;
+            }
+
+            bool isFailed() const {
+                return request && request->state == Request::State::Failed;
+            }
+
+            // The loaded texture once ready, the placeholder until then.  Textures become ready in
+            // dispatchReady, from then on they belong to the caller and must be destroyed like any other texture.
+            const Texture& get() const {
+                return isReady() ? request->texture : *request->placeholder;
+            }
+
+            const vk::DescriptorImageInfo& descriptor() const {
+                return get().descriptor;
+            }
+
+        private:
+            friend class TextureStreamer;
+            Handle(const std::shared_ptr<Request>& request) : request(request) {}
+            std::shared_ptr<Request> request;
+        };
+
+        struct Stats {
+            uint32_t requested{ 0 };
+            uint32_t completed{ 0 };
+            uint32_t failed{ 0 };
+            uint32_t batches{ 0 };
+            uint64_t bytesUploaded{ 0 };
+        };
+
+        TextureStreamer(const Context& context, JobSystem& jobSystem) : context(context), jobSystem(jobSystem) {
+            ownershipTransfer = context.transferQueueIndex != context.graphicsQueueIndex;
+
+            vk::CommandPoolCreateInfo cmdPoolInfo;
+            cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eTransient | vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
+            cmdPoolInfo.queueFamilyIndex = context.transferQueueIndex;
+            transferCmdPool = context.device.createCommandPool(cmdPoolInfo);
+            if (ownershipTransfer) {
+                cmdPoolInfo.queueFamilyIndex = context.graphicsQueueIndex;
+                graphicsCmdPool = context.device.createCommandPool(cmdPoolInfo);
+            }
+
+            createPlaceholder();
+        }
+
+        ~TextureStreamer() {
+            destroy();
+        }
+
+        TextureStreamer(const TextureStreamer&) = delete;
+        TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+#if defined(__ANDROID__)
+        AAssetManager* assetManager = nullptr;
+#endif
+
+        // Queue a 2D texture for loading.  onReady is called from dispatchReady once the texture can be used.
+        Handle load(const std::string& filename, vk::Format format, std::function<void(const Texture&)> onReady = nullptr) {
+            auto request = std::make_shared<Request>();
+            request->filename = filename;
+            request->format = format;
+            request->onReady = onReady;
+            request->placeholder = &placeholder;
+            pending.push_back(request);
+            ++stats.requested;
+
+            Request* target = request.get();
+            jobSystem.run([this, target] { decode(*target); }, decodeCounter);
+            return Handle(request);
+        }
+
+        // Submit the uploads of decoded textures and retire completed ones.  Returns true if
+        // textures became ready, in which case dispatchReady should be called.
+        bool update() {
+            // Without additional workers nobody else will run the decode jobs
+            if (jobSystem.getWorkerCount() == 1) {
+                jobSystem.wait(decodeCounter);
+            }
+
+            std::vector<std::shared_ptr<Request>> decoded;
+            for (auto itr = pending.begin(); itr != pending.end();) {
+                auto state = (*itr)->state.load();
+                if (state == Request::State::Decoded) {
+                    decoded.push_back(*itr);
+                    itr = pending.erase(itr);
+                } else if (state == Request::State::Failed) {
+                    std::cerr << "Unable to stream texture " << (*itr)->filename << ": " << (*itr)->error << std::endl;
+                    ++stats.failed;
+                    itr = pending.erase(itr);
+                } else {
+                    ++itr;
+                }
+            }
+            if (!decoded.empty()) {
+                submit(decoded);
+            }
+
+            while (!inFlight.empty() && vk::Result::eSuccess == context.device.getFenceStatus(inFlight.front().fence)) {
+                retire(inFlight.front());
+                inFlight.pop_front();
+            }
+            return !ready.empty();
+        }
+
+        // Hand over the textures whose uploads have completed and run their onReady callbacks.  Descriptor sets
+        // referencing the placeholder can be rewritten from the callbacks, provided no submitted frame still uses them.
+        void dispatchReady() {
+            auto readyRequests = std::move(ready);
+            ready.clear();
+            for (auto& request : readyRequests) {
+                request->state = Request::State::Ready;
+                if (request->onReady) {
+                    request->onReady(request->texture);
+                }
+            }
+        }
+
+        bool isIdle() const {
+            return pending.empty() && inFlight.empty();
+        }
+
+        const Texture& getPlaceholder() const {
+            return placeholder;
+        }
+
+        const Stats& getStats() const {
+            return stats;
+        }
+
+        void destroy() {
+            if (!transferCmdPool) {
+                return;
+            }
+            // Let the decode jobs finish, they write into requests owned by this object
+            jobSystem.wait(decodeCounter);
+            // Textures that never became ready still belong to the streamer
+            for (auto& batch : inFlight) {
+                context.device.waitForFences(batch.fence, VK_TRUE, UINT64_MAX);
+                for (auto& request : batch.requests) {
+                    request->texture.destroy();
+                    request->state = Request::State::Failed;
+                }
+                retire(batch);
+            }
+            inFlight.clear();
+            for (auto& batch : spareBatches) {
+                context.device.destroyFence(batch.fence);
+                if (batch.semaphore) {
+                    context.device.destroySemaphore(batch.semaphore);
+                }
+            }
+            // The command buffers go with their pools
+            spareBatches.clear();
+            for (auto& request : pending) {
+                request->staging.destroy();
+            }
+            pending.clear();
+            for (auto& request : ready) {
+                request->texture.destroy();
+                request->state = Request::State::Failed;
+            }
+            ready.clear();
+            context.device.destroyCommandPool(transferCmdPool);
+            transferCmdPool = vk::CommandPool();
+            if (graphicsCmdPool) {
+                context.device.destroyCommandPool(graphicsCmdPool);
+                graphicsCmdPool = vk::CommandPool();
+            }
+            placeholder.destroy();
+        }
+
+    private:
+        struct Batch {
+            vk::Fence fence;
+            vk::Semaphore semaphore;
+            vk::CommandBuffer transferCmdBuffer;
+            vk::CommandBuffer graphicsCmdBuffer;
+            std::vector<std::shared_ptr<Request>> requests;
+        };
+
+        // Runs on a job system worker
+        void decode(Request& request) {
+            try {
+#if defined(__ANDROID__)
+                AAsset* asset = AAssetManager_open(assetManager, request.filename.c_str(), AASSET_MODE_STREAMING);
+                if (!asset) {
+                    throw std::runtime_error("Unable to open asset");
+                }
+                std::vector<char> fileData(AAsset_getLength(asset));
+                AAsset_read(asset, fileData.data(), fileData.size());
+                AAsset_close(asset);
+                gli::texture2D tex2D(gli::load(fileData.data(), fileData.size()));
+#else
+                gli::texture2D tex2D(gli::load(request.filename.c_str()));
+#endif
+                if (tex2D.empty()) {
+                    throw std::runtime_error("Unable to decode file");
+                }
+
+                request.extent = vk::Extent3D{ (uint32_t)tex2D[0].dimensions().x, (uint32_t)tex2D[0].dimensions().y, 1 };
+                vk::BufferImageCopy copyRegion;
+                copyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+                copyRegion.imageSubresource.layerCount = 1;
+                copyRegion.imageExtent.depth = 1;
+                for (uint32_t level = 0; level < (uint32_t)tex2D.levels(); ++level) {
+                    copyRegion.imageSubresource.mipLevel = level;
+                    copyRegion.imageExtent.width = (uint32_t)tex2D[level].dimensions().x;
+                    copyRegion.imageExtent.height = (uint32_t)tex2D[level].dimensions().y;
+                    request.copyRegions.push_back(copyRegion);
+                    copyRegion.bufferOffset += tex2D[level].size();
+                }
+                // The allocator is thread safe, so the staging copy happens on the worker as well
+                request.staging = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, tex2D.size(), tex2D.data());
+                request.state = Request::State::Decoded;
+            } catch (const std::exception& e) {
+                request.error = e.what();
+                request.state = Request::State::Failed;
+            }
+        }
+
+        vk::CommandBuffer allocateCommandBuffer(const vk::CommandPool& pool) {
+            vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
+            cmdBufAllocateInfo.commandPool = pool;
+            cmdBufAllocateInfo.commandBufferCount = 1;
+            vk::CommandBuffer cmdBuffer = context.device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+            context.countCreatedObjects();
+            return cmdBuffer;
+        }
+
+        // Reuse the fence, semaphore and command buffers of a retired batch, creating them only while
+        // more batches are in flight than have ever been retired
+        Batch acquireBatch() {
+            Batch batch;
+            if (!spareBatches.empty()) {
+                batch = std::move(spareBatches.back());
+                spareBatches.pop_back();
+                context.device.resetFences(batch.fence);
+            } else {
+                batch.fence = context.device.createFence(vk::FenceCreateInfo());
+                batch.transferCmdBuffer = allocateCommandBuffer(transferCmdPool);
+                context.countCreatedObjects();
+                if (ownershipTransfer) {
+                    batch.semaphore = context.device.createSemaphore(vk::SemaphoreCreateInfo());
+                    batch.graphicsCmdBuffer = allocateCommandBuffer(graphicsCmdPool);
+                    context.countCreatedObjects();
+                }
+            }
+            // Both pools allow individual resets, beginning a command buffer resets it
+            vk::CommandBufferBeginInfo beginInfo;
+            beginInfo.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit;
+            batch.transferCmdBuffer.begin(beginInfo);
+            if (ownershipTransfer) {
+                batch.graphicsCmdBuffer.begin(beginInfo);
+            }
+            return batch;
+        }
+
+        // Record the copies of all decoded textures into one transfer submit
+        void submit(const std::vector<std::shared_ptr<Request>>& requests) {
+            Batch batch = acquireBatch();
+            batch.requests = requests;
+
+            for (auto& request : requests) {
+                Texture& texture = request->texture;
+                texture.device = context.device;
+                texture.extent = request->extent;
+                texture.mipLevels = (uint32_t)request->copyRegions.size();
+
+                vk::ImageCreateInfo imageCreateInfo;
+                imageCreateInfo.imageType = vk::ImageType::e2D;
+                imageCreateInfo.format = request->format;
+                imageCreateInfo.extent = texture.extent;
+                imageCreateInfo.mipLevels = texture.mipLevels;
+                imageCreateInfo.arrayLayers = 1;
+                imageCreateInfo.usage = vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eSampled;
+                texture = context.createImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal);
+
+                vk::ImageMemoryBarrier barrier;
+                barrier.image = texture.image;
+                barrier.subresourceRange = vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, texture.mipLevels, 0, 1);
+                barrier.oldLayout = vk::ImageLayout::eUndefined;
+                barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+                barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+                batch.transferCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, nullptr, barrier);
+
+                batch.transferCmdBuffer.copyBufferToImage(request->staging.buffer, texture.image, vk::ImageLayout::eTransferDstOptimal, request->copyRegions);
+                stats.bytesUploaded += request->staging.size;
+
+                barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+                barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+                if (ownershipTransfer) {
+                    // Release on the transfer queue ...
+                    barrier.dstAccessMask = vk::AccessFlags();
+                    barrier.srcQueueFamilyIndex = context.transferQueueIndex;
+                    barrier.dstQueueFamilyIndex = context.graphicsQueueIndex;
+                    batch.transferCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, vk::DependencyFlags(), nullptr, nullptr, barrier);
+                    // ... and acquire the identical transition on the graphics queue
+                    barrier.srcAccessMask = vk::AccessFlags();
+                    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+                    batch.graphicsCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), nullptr, nullptr, barrier);
+                } else {
+                    barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+                    batch.transferCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), nullptr, nullptr, barrier);
+                }
+
+                texture.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+                createSamplerAndView(texture, request->format);
+                request->state = Request::State::Uploading;
+            }
+
+            batch.transferCmdBuffer.end();
+            vk::SubmitInfo submitInfo;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &batch.transferCmdBuffer;
+            // The transfer queue is queue itself when the device has no dedicated transfer family
+            auto queueLock = context.lockQueue();
+            if (ownershipTransfer) {
+                submitInfo.signalSemaphoreCount = 1;
+                submitInfo.pSignalSemaphores = &batch.semaphore;
+                context.transferQueue.submit(submitInfo, vk::Fence());
+
+                batch.graphicsCmdBuffer.end();
+                vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+                submitInfo = vk::SubmitInfo();
+                submitInfo.waitSemaphoreCount = 1;
+                submitInfo.pWaitSemaphores = &batch.semaphore;
+                submitInfo.pWaitDstStageMask = &waitStage;
+                submitInfo.commandBufferCount = 1;
+                submitInfo.pCommandBuffers = &batch.graphicsCmdBuffer;
+                context.queue.submit(submitInfo, batch.fence);
+            } else {
+                context.transferQueue.submit(submitInfo, batch.fence);
+            }
+            ++stats.batches;
+            inFlight.push_back(std::move(batch));
+        }
+
+        void retire(Batch& batch) {
+            for (auto& request : batch.requests) {
+                request->staging.destroy();
+                if (request->state == Request::State::Uploading) {
+                    request->state = Request::State::Uploaded;
+                    ready.push_back(request);
+                    ++stats.completed;
+                }
+            }
+            // The fence has signalled, so the batch objects can be handed out again
+            batch.requests.clear();
+            spareBatches.push_back(std::move(batch));
+        }
+
+        void createSamplerAndView(Texture& texture, vk::Format format) {
+            vk::SamplerCreateInfo sampler;
+            sampler.magFilter = vk::Filter::eLinear;
+            sampler.minFilter = vk::Filter::eLinear;
+            sampler.mipmapMode = vk::SamplerMipmapMode::eLinear;
+            sampler.maxLod = (float)texture.mipLevels;
+            sampler.maxAnisotropy = 8;
+            sampler.anisotropyEnable = VK_TRUE;
+            sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+            texture.sampler = context.device.createSampler(sampler);
+
+            vk::ImageViewCreateInfo view;
+            view.viewType = vk::ImageViewType::e2D;
+            view.format = format;
+            view.subresourceRange = { vk::ImageAspectFlagBits::eColor, 0, texture.mipLevels, 0, 1 };
+            view.image = texture.image;
+            texture.view = context.device.createImageView(view);
+
+            texture.descriptor.imageLayout = texture.imageLayout;
+            texture.descriptor.imageView = texture.view;
+            texture.descriptor.sampler = texture.sampler;
+        }
+
+        // Small grey checkerboard shown until the real texture has arrived
+        void createPlaceholder() {
+            static const uint32_t size = 4;
+            std::array<uint32_t, size * size> texels;
+            for (uint32_t y = 0; y < size; ++y) {
+                for (uint32_t x = 0; x < size; ++x) {
+                    texels[y * size + x] = ((x ^ y) & 1) ? 0xff808080 : 0xffa0a0a0;
+                }
+            }
+
+            vk::ImageCreateInfo imageCreateInfo;
+            imageCreateInfo.imageType = vk::ImageType::e2D;
+            imageCreateInfo.format = vk::Format::eR8G8B8A8Unorm;
+            imageCreateInfo.extent = vk::Extent3D{ size, size, 1 };
+            imageCreateInfo.mipLevels = 1;
+            imageCreateInfo.arrayLayers = 1;
+            imageCreateInfo.usage = vk::ImageUsageFlagBits::eSampled;
+            placeholder = context.stageToDeviceImage(imageCreateInfo, vk::MemoryPropertyFlagBits::eDeviceLocal, sizeof(texels), texels.data());
+            placeholder.device = context.device;
+            placeholder.extent = imageCreateInfo.extent;
+            placeholder.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+            createSamplerAndView(placeholder, imageCreateInfo.format);
+        }
+
+        Context context;
+        JobSystem& jobSystem;
+        bool ownershipTransfer{ false };
+        vk::CommandPool transferCmdPool;
+        vk::CommandPool graphicsCmdPool;
+        Texture placeholder;
+
+        JobCounter decodeCounter;
+        std::list<std::shared_ptr<Request>> pending;
+        std::deque<Batch> inFlight;
+        std::vector<Batch> spareBatches;
+        std::vector<std::shared_ptr<Request>> ready;
+        Stats stats;
+    };
+}
@@ -10,6 +10,11 @@
 #include <iterator>
 #include <iostream>
 #include <fstream>
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 namespace vkx {
 
@@ -576,5 +581,22 @@ const std::string& getAssetPath() {
 #endif
     }
 
+const std::string& getCachePath() {
+    static std::string path;
+#if !defined(__ANDROID__)
+    static std::once_flag once;
+
+    std::call_once(once, [] {
+        path = getAssetPath() + "../cache/";
+#if defined(_WIN32)
+        _mkdir(path.c_str());
+#else
+        mkdir(path.c_str(), 0755);
+#endif
+    });
+#endif
+    return path;
+}
+
 }
 
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "common.hpp"
+#include "vulkanAllocator.hpp"
 
 // Default fence timeout in nanoseconds
 #define DEFAULT_FENCE_TIMEOUT 100000000000
@@ -100,20 +101,49 @@ namespace vkx {
         vk::DeviceSize alignment{ 0 };
         vk::DeviceSize allocSize{ 0 };
         void* mapped{ nullptr };
+        // Offset of mapped into the resource
+        vk::DeviceSize mappedOffset{ 0 };
+        // Range of a shared memory block the resource is bound to.  If empty, the resource
+        // owns the whole of 'memory'.
+        MemoryAllocation allocation;
 
         template <typename T = void>
         inline T* map(size_t offset = 0, size_t size = VK_WHOLE_SIZE) {
-            mapped = device.mapMemory(memory, offset, size, vk::MemoryMapFlags());
+            if (allocation) {
+                // Suballocated memory blocks stay persistently mapped
+                mapped = allocation.map(offset);
+            } else {
+                mapped = device.mapMemory(memory, offset, size, vk::MemoryMapFlags());
+            }
+            mappedOffset = offset;
             return (T*)mapped;
         }
 
+        // Make host writes through mapped visible to the device, needed for memory types without
+        // HOST_COHERENT.  copy does this on its own.  Offsets are relative to mapped.
+        inline void flush(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) const {
+            if (allocation) {
+                allocation.flush(mappedOffset + offset, size);
+            }
+        }
+
+        // Make device writes visible to reads through mapped, needed for memory types without HOST_COHERENT
+        inline void invalidate(vk::DeviceSize size = VK_WHOLE_SIZE, vk::DeviceSize offset = 0) const {
+            if (allocation) {
+                allocation.invalidate(mappedOffset + offset, size);
+            }
+        }
+
         inline void unmap() {
-            device.unmapMemory(memory);
+            if (!allocation) {
+                device.unmapMemory(memory);
+            }
             mapped = nullptr;
         }
 
         inline void copy(size_t size, const void* data, size_t offset = 0) const {
             memcpy((uint8_t*)mapped + offset, data, size);
+            flush(size, offset);
         }
 
         template<typename T>
@@ -130,7 +160,10 @@ namespace vkx {
             if (mapped) {
                 unmap();
             }
-            if (memory) {
+            if (allocation) {
+                allocation.free();
+                memory = vk::DeviceMemory();
+            } else if (memory) {
                 device.freeMemory(memory);
                 memory = vk::DeviceMemory();
             }
@@ -358,4 +391,7 @@ namespace vkx {
         uint32_t offset);
 
     const std::string& getAssetPath();
+
+    // Writable directory for derived data (mesh, pipeline and shader caches), empty if caching isn't available
+    const std::string& getCachePath();
 }
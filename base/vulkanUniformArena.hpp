@@ -0,0 +1,96 @@
+/*
+* Per frame linear allocator for uniform data
+*
+* One persistently mapped, host coherent buffer is split into a region per frame in flight.  Every
+* allocation copies its data to the next aligned offset of the current frame's region and returns
+* that offset, to be passed as the dynamic offset of an eUniformBufferDynamic binding.  A single
+* descriptor set pointing at the buffer therefore serves all per-object and per-pass constants of
+* all frames.  The region of a frame is simply rewound when the frame slot is reused.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkanContext.hpp"
+
+namespace vkx {
+
+    class UniformArena {
+    public:
+        struct Stats {
+            uint64_t allocations{ 0 };
+            uint64_t bytes{ 0 };
+            // Largest number of bytes allocated in a single frame
+            uint64_t peakFrameBytes{ 0 };
+            uint64_t frames{ 0 };
+        };
+
+        // frameSize is rounded up to the uniform offset alignment of the device
+        void create(const Context& context, uint32_t frameCount, vk::DeviceSize frameSize) {
+            alignment = context.deviceProperties.limits.minUniformBufferOffsetAlignment;
+            this->frameSize = alignUp(frameSize, alignment);
+            if (this->frameSize * frameCount > UINT32_MAX) {
+                throw std::runtime_error("Uniform arena exceeds the range of dynamic offsets");
+            }
+            buffer = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, this->frameSize * frameCount);
+            buffer.map();
+            frameBase = 0;
+            offset = 0;
+        }
+
+        void destroy() {
+            buffer.destroy();
+        }
+
+        // Rewinds the region of frame, once the frame slot's previous submit has completed
+        void beginFrame(uint32_t frame) {
+            vk::DeviceSize used = offset.load(std::memory_order_relaxed);
+            stats.peakFrameBytes = std::max<uint64_t>(stats.peakFrameBytes, used);
+            ++stats.frames;
+            frameBase = frame * frameSize;
+            offset = 0;
+        }
+
+        // Any thread.  Copies size bytes into the current frame and returns their dynamic offset.
+        uint32_t allocate(const void* data, vk::DeviceSize size) {
+            vk::DeviceSize alignedSize = alignUp(size, alignment);
+            vk::DeviceSize local = offset.fetch_add(alignedSize, std::memory_order_relaxed);
+            if (local + size > frameSize) {
+                throw std::runtime_error("Uniform arena exhausted, increase frameUniformArenaSize");
+            }
+            allocationCount.fetch_add(1, std::memory_order_relaxed);
+            byteCount.fetch_add(size, std::memory_order_relaxed);
+            vk::DeviceSize result = frameBase + local;
+            memcpy((uint8_t*)buffer.mapped + result, data, size);
+            return (uint32_t)result;
+        }
+
+        template <typename T>
+        uint32_t allocate(const T& data) {
+            return allocate(&data, sizeof(T));
+        }
+
+        // For a dynamic binding whose block is range bytes, the offset is supplied when binding the set
+        vk::DescriptorBufferInfo getDescriptor(vk::DeviceSize range) const {
+            return vk::DescriptorBufferInfo(buffer.buffer, 0, range);
+        }
+
+        Stats getStats() const {
+            Stats result = stats;
+            result.allocations = allocationCount.load(std::memory_order_relaxed);
+            result.bytes = byteCount.load(std::memory_order_relaxed);
+            return result;
+        }
+
+    private:
+        CreateBufferResult buffer;
+        vk::DeviceSize alignment{ 1 };
+        vk::DeviceSize frameSize{ 0 };
+        vk::DeviceSize frameBase{ 0 };
+        std::atomic<vk::DeviceSize> offset{ 0 };
+        std::atomic<uint64_t> allocationCount{ 0 };
+        std::atomic<uint64_t> byteCount{ 0 };
+        Stats stats;
+    };
+}
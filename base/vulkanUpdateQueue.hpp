@@ -0,0 +1,195 @@
+/*
+* Batched buffer updates recorded into the frame's command buffer
+*
+* Updates are queued on the CPU with their payload.  When the frame's primary command buffer is
+* recorded the queue is sorted by destination, adjacent and overlapping ranges of a buffer are merged
+* (later updates win where they overlap), the merged ranges are packed into the frame's region of a
+* persistently mapped staging buffer and a single copyBuffer with one region per range is issued for
+* each destination buffer.  Nothing is created or submitted per update and the size of an update isn't
+* limited like vkCmdUpdateBuffer.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "vulkanContext.hpp"
+
+namespace vkx {
+
+    class UpdateQueue {
+    public:
+        struct Stats {
+            uint64_t updates{ 0 };
+            uint64_t bytes{ 0 };
+            // Merged ranges actually copied and the copyBuffer commands they were issued with
+            uint64_t copyRegions{ 0 };
+            uint64_t copyCommands{ 0 };
+            uint64_t bytesCopied{ 0 };
+            // Largest number of staging bytes used by a single frame
+            uint64_t peakFrameBytes{ 0 };
+            uint64_t frames{ 0 };
+        };
+
+        void create(const Context& context, uint32_t frameCount, vk::DeviceSize frameSize) {
+            frameSize = alignUp(frameSize, 16);
+            staging = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, frameSize * frameCount);
+            create(staging.buffer, staging.map(), frameSize);
+        }
+
+        // Stages into a buffer owned by the caller, mapped at mapped, with frameSize bytes (a multiple of 16) per frame slot
+        void create(const vk::Buffer& buffer, void* mapped, vk::DeviceSize frameSize) {
+            this->frameSize = frameSize;
+            stagingBuffer = buffer;
+            stagingMapped = (uint8_t*)mapped;
+            frameBase = 0;
+            frameOffset = 0;
+        }
+
+        void destroy() {
+            staging.destroy();
+            stagingBuffer = vk::Buffer();
+            stagingMapped = nullptr;
+            updates.clear();
+            payload.clear();
+        }
+
+        // Rewinds the staging region of frame, once the frame slot's previous submit has completed
+        void beginFrame(uint32_t frame) {
+            stats.peakFrameBytes = std::max<uint64_t>(stats.peakFrameBytes, frameOffset);
+            ++stats.frames;
+            frameBase = frame * frameSize;
+            frameOffset = 0;
+        }
+
+        // Any thread.  The data is copied, so it may change as soon as the call returns.
+        void update(const vk::Buffer& buffer, vk::DeviceSize offset, vk::DeviceSize size, const void* data) {
+            // A copy region of size 0 is invalid, an empty update has nothing to copy anyway
+            if (size == 0) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            Update update;
+            update.buffer = buffer;
+            update.offset = offset;
+            update.size = size;
+            update.payloadOffset = payload.size();
+            update.sequence = (uint32_t)updates.size();
+            payload.insert(payload.end(), (const uint8_t*)data, (const uint8_t*)data + size);
+            updates.push_back(update);
+            ++stats.updates;
+            stats.bytes += size;
+        }
+
+        template <typename T>
+        void update(const vk::Buffer& buffer, const T& data, vk::DeviceSize offset = 0) {
+            update(buffer, offset, sizeof(T), &data);
+        }
+
+        bool empty() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return updates.empty();
+        }
+
+        // Records the queued updates into cmdBuffer, outside of a render pass.  Commands recorded after
+        // them see the new contents, commands submitted earlier (also by previous frames) the old ones.
+        template <typename CommandBuffer>
+        void record(const CommandBuffer& cmdBuffer) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (updates.empty()) {
+                return;
+            }
+
+            // Earlier submits may still read the destinations
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eAllCommands, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, nullptr, nullptr);
+
+            // Group by destination, in offset order.  The stable sort keeps equal offsets in queue order.
+            std::stable_sort(updates.begin(), updates.end(), [](const Update& a, const Update& b) {
+                if (a.buffer != b.buffer) {
+                    return (VkBuffer)a.buffer < (VkBuffer)b.buffer;
+                }
+                return a.offset < b.offset;
+            });
+
+            size_t first = 0;
+            while (first < updates.size()) {
+                const vk::Buffer buffer = updates[first].buffer;
+                regions.clear();
+                while (first < updates.size() && updates[first].buffer == buffer) {
+                    // Extend the range over every update touching or overlapping it
+                    vk::DeviceSize begin = updates[first].offset;
+                    vk::DeviceSize end = begin + updates[first].size;
+                    bool overlapping = false;
+                    size_t last = first + 1;
+                    for (; last < updates.size() && updates[last].buffer == buffer && updates[last].offset <= end; ++last) {
+                        overlapping |= updates[last].offset < end;
+                        end = std::max(end, updates[last].offset + updates[last].size);
+                    }
+                    regions.push_back(vk::BufferCopy(pack(first, last, begin, end, overlapping), begin, end - begin));
+                    stats.bytesCopied += end - begin;
+                    first = last;
+                }
+                cmdBuffer.copyBuffer(stagingBuffer, buffer, regions);
+                stats.copyRegions += regions.size();
+                ++stats.copyCommands;
+            }
+            updates.clear();
+            payload.clear();
+
+            // Same as the staging ring, the new contents are visible to everything recorded afterwards
+            vk::MemoryBarrier memoryBarrier;
+            memoryBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            memoryBarrier.dstAccessMask = vk::AccessFlagBits::eMemoryRead;
+            cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eAllCommands, vk::DependencyFlags(), memoryBarrier, nullptr, nullptr);
+        }
+
+        Stats getStats() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return stats;
+        }
+
+    private:
+        struct Update {
+            vk::Buffer buffer;
+            vk::DeviceSize offset{ 0 };
+            vk::DeviceSize size{ 0 };
+            size_t payloadOffset{ 0 };
+            uint32_t sequence{ 0 };
+        };
+
+        // Writes the range [begin, end) made up of updates [first, last) to staging, returns its offset
+        vk::DeviceSize pack(size_t first, size_t last, vk::DeviceSize begin, vk::DeviceSize end, bool overlapping) {
+            vk::DeviceSize local = alignUp(frameOffset, 16);
+            if (local + (end - begin) > frameSize) {
+                throw std::runtime_error("Update staging exhausted, increase frameUpdateStagingSize");
+            }
+            frameOffset = local + (end - begin);
+            // Updates are placed relative to the start of the range, pointing before it would be undefined
+            uint8_t* target = stagingMapped + (frameBase + local);
+            if (overlapping) {
+                // Apply in queue order so the most recent data ends up in the overlap
+                std::sort(updates.begin() + first, updates.begin() + last, [](const Update& a, const Update& b) {
+                    return a.sequence < b.sequence;
+                });
+            }
+            for (size_t i = first; i < last; ++i) {
+                memcpy(target + (updates[i].offset - begin), payload.data() + updates[i].payloadOffset, updates[i].size);
+            }
+            return frameBase + local;
+        }
+
+        // Only owned when created from a context
+        CreateBufferResult staging;
+        vk::Buffer stagingBuffer;
+        uint8_t* stagingMapped{ nullptr };
+        vk::DeviceSize frameSize{ 0 };
+        vk::DeviceSize frameBase{ 0 };
+        vk::DeviceSize frameOffset{ 0 };
+        std::vector<Update> updates;
+        std::vector<uint8_t> payload;
+        // Reused between records
+        std::vector<vk::BufferCopy> regions;
+        Stats stats;
+        mutable std::mutex mutex;
+    };
+}
@@ -775,19 +775,19 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.toonshading = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.toonshading = createGraphicsPipeline(pipelineCreateInfo);
 
         // Color only pipeline
         shaderStages[0] = loadShader(getAssetPath() + "shaders/debugmarker/colorpass.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/debugmarker/colorpass.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
-        pipelines.color = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.color = createGraphicsPipeline(pipelineCreateInfo);
 
         // Wire frame rendering pipeline
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
         rasterizationState.lineWidth = 1.0f;
 
-        pipelines.wireframe = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.wireframe = createGraphicsPipeline(pipelineCreateInfo);
 
         // Post processing effect
         shaderStages[0] = loadShader(getAssetPath() + "shaders/debugmarker/postprocess.vert.spv", vk::ShaderStageFlagBits::eVertex);
@@ -808,7 +808,7 @@ public:
         blendAttachmentState.srcAlphaBlendFactor = vk::BlendFactor::eSrcAlpha;
         blendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eDstAlpha;
 
-        pipelines.postprocess = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.postprocess = createGraphicsPipeline(pipelineCreateInfo);
 
         // Name shader moduels for debugging
         // Shader module count starts at 2 when text overlay in base class is enabled
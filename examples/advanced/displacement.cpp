@@ -86,11 +86,9 @@ public:
 
         meshes.object.destroy();
 
-        device.destroyBuffer(uniformDataTC.buffer);
-        device.freeMemory(uniformDataTC.memory);
+        uniformDataTC.destroy();
 
-        device.destroyBuffer(uniformDataTE.buffer);
-        device.freeMemory(uniformDataTE.memory);
+        uniformDataTE.destroy();
 
         textures.colorMap.destroy();
         textures.heightMap.destroy();
@@ -314,11 +312,11 @@ public:
         pipelineCreateInfo.renderPass = renderPass;
 
         // Solid pipeline
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
 
         // Wireframe pipeline
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
-        pipelines.wire = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.wire = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Pass through pipelines
@@ -327,11 +325,11 @@ public:
         shaderStages[3] = loadShader(getAssetPath() + "shaders/displacement/passthrough.tese.spv", vk::ShaderStageFlagBits::eTessellationEvaluation);
         // Solid
         rasterizationState.polygonMode = vk::PolygonMode::eFill;
-        pipelines.solidPassThrough = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solidPassThrough = createGraphicsPipeline(pipelineCreateInfo);
 
         // Wireframe
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
-        pipelines.wirePassThrough = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.wirePassThrough = createGraphicsPipeline(pipelineCreateInfo);
 
     }
 
@@ -317,13 +317,13 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.parallaxMapping = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.parallaxMapping = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Normal mapping (no parallax effect)
         shaderStages[0] = loadShader(getAssetPath() + "shaders/parallaxmapping/normalmap.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/parallaxmapping/normalmap.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.normalMapping = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.normalMapping = createGraphicsPipeline(pipelineCreateInfo);
 
     }
 
@@ -54,9 +54,11 @@ public:
         void operator=(const vkx::CreateBufferResult& result) {
             buffer = result.buffer;
             memory = result.memory;
+            allocation = result.allocation;
         }
         vk::Buffer buffer;
         vk::DeviceMemory memory;
+        vkx::MemoryAllocation allocation;
         vk::PipelineVertexInputStateCreateInfo inputState;
         std::vector<vk::VertexInputBindingDescription> bindingDescriptions;
         std::vector<vk::VertexInputAttributeDescription> attributeDescriptions;
@@ -66,10 +68,12 @@ public:
         void operator=(const vkx::CreateBufferResult& result) {
             buffer = result.buffer;
             memory = result.memory;
+            allocation = result.allocation;
         }
         int count;
         vk::Buffer buffer;
         vk::DeviceMemory memory;
+        vkx::MemoryAllocation allocation;
     } indices;
 
     struct {
@@ -120,13 +124,12 @@ public:
         device.destroyDescriptorSetLayout(descriptorSetLayout);
 
         device.destroyBuffer(vertices.buffer);
-        device.freeMemory(vertices.memory);
+        vertices.allocation.free();
 
         device.destroyBuffer(indices.buffer);
-        device.freeMemory(indices.memory);
+        indices.allocation.free();
 
-        device.destroyBuffer(uniformData.vs.buffer);
-        device.freeMemory(uniformData.vs.memory);
+        uniformData.vs.destroy();
     }
 
     // Basic parser fpr AngelCode bitmap font format files
@@ -463,13 +466,13 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.sdf = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.sdf = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Default bitmap font rendering pipeline
         shaderStages[0] = loadShader(getAssetPath() + "shaders/distancefieldfonts/bitmap.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/distancefieldfonts/bitmap.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.bitmap = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.bitmap = createGraphicsPipeline(pipelineCreateInfo);
 
     }
 
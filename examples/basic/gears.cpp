@@ -211,7 +211,7 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
         trashPipeline(pipelines.solid);
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void updateUniformBuffers() {
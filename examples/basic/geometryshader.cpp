@@ -248,7 +248,7 @@ public:
         pipelineCreateInfo.renderPass = renderPass;
 
         // Normal debugging pipeline
-        pipelines.normals = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.normals = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Solid rendering pipeline
@@ -256,7 +256,7 @@ public:
         shaderStages[0] = loadShader(getAssetPath() + "shaders/geometryshader/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/geometryshader/mesh.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelineCreateInfo.stageCount = 2;
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
 
 
     }
@@ -221,11 +221,13 @@ public:
 
         // Instacing pipeline
         // Load shaders
-        std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStages;
+        std::vector<vk::PipelineShaderStageCreateInfo> shaderStages;
         {
             vkx::shader::initGlsl();
-            shaderStages[0] = loadGlslShader(getAssetPath() + "shaders/indirect/indirect.vert", vk::ShaderStageFlagBits::eVertex);
-            shaderStages[1] = loadGlslShader(getAssetPath() + "shaders/indirect/indirect.frag", vk::ShaderStageFlagBits::eFragment);
+            shaderStages = loadGlslShaders({
+                { getAssetPath() + "shaders/indirect/indirect.vert", vk::ShaderStageFlagBits::eVertex },
+                { getAssetPath() + "shaders/indirect/indirect.frag", vk::ShaderStageFlagBits::eFragment },
+            }, &getJobSystem());
             vkx::shader::finalizeGlsl();
         }
 
@@ -288,7 +290,7 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void prepareIndirectData() {
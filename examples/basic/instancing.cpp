@@ -9,6 +9,7 @@
 #include "vulkanExampleBase.h"
 
 #define INSTANCE_COUNT 2048
+#define LOD_COUNT 5
 
 // Vertex layout for this example
 std::vector<vkx::VertexLayout> vertexLayout =
@@ -43,9 +44,19 @@ public:
         uint32_t texIndex;
     };
 
-    // Contains the instanced data
+    // Contains the instanced data, one INSTANCE_COUNT sized region per level of detail so the
+    // draws can bind it at fixed offsets while the number of instances per level changes
     using InstanceBuffer = CreateBufferResult;
     InstanceBuffer instanceBuffer;
+    std::vector<InstanceData> instances;
+    std::vector<std::vector<InstanceData>> lodInstances;
+
+    // One indexed draw per level of detail, instance counts written every frame
+    CreateBufferResult indirectBuffer;
+    std::vector<vk::DrawIndexedIndirectCommand> indirectCommands;
+
+    bool useLods{ true };
+    uint32_t triangleCount{ 0 };
 
     struct UboVS {
         glm::mat4 projection;
@@ -77,6 +88,7 @@ public:
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
         instanceBuffer.destroy();
+        indirectBuffer.destroy();
         meshes.example.destroy();
         uniformData.vsScene.destroy();
         textures.colorMap.destroy();
@@ -89,15 +101,17 @@ public:
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
         // Binding point 0 : Mesh vertex buffer
         cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.example.vertices.buffer, { 0 });
-        // Binding point 1 : Instance data buffer
-        cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, instanceBuffer.buffer, { 0 });
         cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
-        // Render instances
-        cmdBuffer.drawIndexed(meshes.example.indexCount, INSTANCE_COUNT, 0, 0, 0);
+        // Render instances, the index range and instance count of each level come from the indirect buffer
+        for (uint32_t lod = 0; lod < indirectCommands.size(); ++lod) {
+            // Binding point 1 : Instance data buffer
+            cmdBuffer.bindVertexBuffers(INSTANCE_BUFFER_BIND_ID, instanceBuffer.buffer, { lod * INSTANCE_COUNT * sizeof(InstanceData) });
+            cmdBuffer.drawIndexedIndirect(indirectBuffer.buffer, lod * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand));
+        }
     }
 
     void loadMeshes() {
-        meshes.example = loadMesh(getAssetPath() + "models/rock01.dae", vertexLayout, 0.1f);
+        meshes.example = loadMesh(getAssetPath() + "models/rock01.dae", vertexLayout, 0.1f, LOD_COUNT);
     }
 
     void loadTextures() {
@@ -281,7 +295,7 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
 
     }
 
@@ -290,26 +304,69 @@ public:
     }
 
     void prepareInstanceData() {
-        std::vector<InstanceData> instanceData;
-        instanceData.resize(INSTANCE_COUNT);
+        instances.resize(INSTANCE_COUNT);
 
         std::mt19937 rndGenerator(time(NULL));
         std::uniform_real_distribution<double> uniformDist(0.0, 1.0);
 
         for (auto i = 0; i < INSTANCE_COUNT; i++) {
-            instanceData[i].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
+            instances[i].rot = glm::vec3(M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator), M_PI * uniformDist(rndGenerator));
             float theta = 2 * M_PI * uniformDist(rndGenerator);
             float phi = acos(1 - 2 * uniformDist(rndGenerator));
             glm::vec3 pos;
-            instanceData[i].pos = glm::vec3(sin(phi) * cos(theta), sin(theta) * uniformDist(rndGenerator) / 1500.0f, cos(phi)) * 7.5f;
-            instanceData[i].scale = 1.0f + uniformDist(rndGenerator) * 2.0f;
-            instanceData[i].texIndex = rnd(textures.colorMap.layerCount);
+            instances[i].pos = glm::vec3(sin(phi) * cos(theta), sin(theta) * uniformDist(rndGenerator) / 1500.0f, cos(phi)) * 7.5f;
+            instances[i].scale = 1.0f + uniformDist(rndGenerator) * 2.0f;
+            instances[i].texIndex = rnd(textures.colorMap.layerCount);
+        }
+
+        // Instances are sorted into the regions of their level of detail every frame, through the update queue
+        const auto& lods = meshes.example.lods;
+        lodInstances.resize(lods.size());
+        instanceBuffer = stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, std::vector<InstanceData>(lods.size() * INSTANCE_COUNT));
+        indirectCommands.resize(lods.size());
+        for (uint32_t i = 0; i < lods.size(); ++i) {
+            indirectCommands[i].indexCount = lods[i].indexCount;
+            indirectCommands[i].firstIndex = lods[i].firstIndex;
+        }
+        indirectBuffer = stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectCommands);
+        updateLods();
+    }
+
+    // World space position of an instance's origin, same transform as the vertex shader
+    glm::vec3 instancePosition(const InstanceData& instance) const {
+        float s = sin(instance.rot.x), c = cos(instance.rot.x);
+        glm::mat4 mx(glm::vec4(c, s, 0.0f, 0.0f), glm::vec4(-s, c, 0.0f, 0.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        s = sin(instance.rot.y + uboVS.time);
+        c = cos(instance.rot.y + uboVS.time);
+        glm::mat4 my(glm::vec4(c, 0.0f, s, 0.0f), glm::vec4(0.0f, 1.0f, 0.0f, 0.0f), glm::vec4(-s, 0.0f, c, 0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        s = sin(instance.rot.z);
+        c = cos(instance.rot.z);
+        glm::mat4 mz(glm::vec4(1.0f, 0.0f, 0.0f, 0.0f), glm::vec4(0.0f, c, s, 0.0f), glm::vec4(0.0f, -s, c, 0.0f), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        return glm::vec3(glm::vec4(instance.pos, 1.0f) * (mz * my * mx));
+    }
+
+    // Pick the level of detail of every instance from its projected error and queue the
+    // sorted instances and the per level instance counts ahead of the frame's draws
+    void updateLods() {
+        vkx::LodSelector selector(uboVS.projection, uboVS.view, (float)size.height);
+        for (auto& bucket : lodInstances) {
+            bucket.clear();
+        }
+        for (const auto& instance : instances) {
+            uint32_t lod = useLods ? selector.select(meshes.example, instancePosition(instance), instance.scale) : 0;
+            lodInstances[lod].push_back(instance);
         }
 
-        // Staging
-        // Instanced data is static, copy to device local memory 
-        // This results in better performance
-        instanceBuffer = stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        triangleCount = 0;
+        for (uint32_t lod = 0; lod < lodInstances.size(); ++lod) {
+            const auto& bucket = lodInstances[lod];
+            indirectCommands[lod].instanceCount = (uint32_t)bucket.size();
+            triangleCount += indirectCommands[lod].instanceCount * indirectCommands[lod].indexCount / 3;
+            if (!bucket.empty()) {
+                updateQueue.update(instanceBuffer.buffer, lod * INSTANCE_COUNT * sizeof(InstanceData), bucket.size() * sizeof(InstanceData), bucket.data());
+            }
+        }
+        updateQueue.update(indirectBuffer.buffer, 0, indirectCommands.size() * sizeof(vk::DrawIndexedIndirectCommand), indirectCommands.data());
     }
 
     void prepareUniformBuffers() {
@@ -334,9 +391,9 @@ public:
         ExampleBase::prepare();
         loadTextures();
         loadMeshes();
+        prepareUniformBuffers();
         prepareInstanceData();
         setupVertexDescriptions();
-        prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
@@ -349,6 +406,7 @@ public:
         if (!prepared) {
             return;
         }
+        updateLods();
         draw();
         if (!paused) {
             updateUniformBuffer(false);
@@ -358,6 +416,24 @@ public:
     virtual void viewChanged() {
         updateUniformBuffer(true);
     }
+
+    void keyPressed(uint32_t key) override {
+        switch (key) {
+        case GLFW_KEY_L:
+            useLods = !useLods;
+            updateTextOverlay();
+            break;
+        }
+    }
+
+    void getOverlayText(vkx::TextOverlay *textOverlay) override {
+        std::stringstream ss;
+        ss << "LODs " << (useLods ? "on" : "off") << " (L): " << triangleCount << " triangles, instances per LOD";
+        for (const auto& command : indirectCommands) {
+            ss << " " << command.instanceCount;
+        }
+        textOverlay->addText(ss.str(), 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -298,13 +298,13 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
 
         // Wire frame rendering pipeline
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
         rasterizationState.lineWidth = 1.0f;
 
-        pipelines.wireframe = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.wireframe = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -77,12 +77,8 @@ public:
         meshes.example.destroy();
 
         // Destroy MSAA target
-        device.destroyImage(multisampleTarget.color.image);
-        device.destroyImageView(multisampleTarget.color.view);
-        device.freeMemory(multisampleTarget.color.memory);
-        device.destroyImage(multisampleTarget.depth.image);
-        device.destroyImageView(multisampleTarget.depth.view);
-        device.freeMemory(multisampleTarget.depth.memory);
+        multisampleTarget.color.destroy();
+        multisampleTarget.depth.destroy();
 
         textures.colorMap.destroy();
 
@@ -214,7 +210,7 @@ public:
         attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
         attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
         attachments[1].initialLayout = vk::ImageLayout::eUndefined;
-        attachments[1].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+        attachments[1].finalLayout = swapChain.presentLayout;
 
         // Multisampled depth attachment we render to
         attachments[2].format = depthFormat;
@@ -504,7 +500,7 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -503,7 +503,7 @@ public:
         blendAttachmentState.alphaBlendOp = vk::BlendOp::eAdd;
         blendAttachmentState.colorWriteMask = vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA;
 
-        pipelines.particles = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.particles = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Environment rendering pipeline (normal mapped)
@@ -513,7 +513,7 @@ public:
         blendAttachmentState.blendEnable = VK_FALSE;
         depthStencilState.depthWriteEnable = VK_TRUE;
         inputAssemblyState.topology = vk::PrimitiveTopology::eTriangleList;
-        pipelines.environment = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.environment = createGraphicsPipeline(pipelineCreateInfo);
 
         meshes.environment.pipeline = pipelines.environment;
         meshes.environment.pipelineLayout = pipelineLayout;
@@ -51,8 +51,9 @@ public:
 
     struct {
         vk::Pipeline phong;
-        vk::Pipeline wireframe;
-        vk::Pipeline toon;
+        // Compiled in the background, drawn with the phong pipeline until they are ready
+        vkx::StateCache::AsyncPipeline wireframe;
+        vkx::StateCache::AsyncPipeline toon;
     } pipelines;
 
     VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION) {
@@ -65,19 +66,16 @@ public:
     ~VulkanExample() {
         // Clean up used Vulkan resources 
         // Note : Inherited destructor cleans up resources stored in base class
-        device.destroyPipeline(pipelines.phong);
-        if (deviceFeatures.fillModeNonSolid) {
-            device.destroyPipeline(pipelines.wireframe);
-        }
-        device.destroyPipeline(pipelines.toon);
+        stateCache->release(pipelines.wireframe);
+        stateCache->release(pipelines.toon);
+        stateCache->release(pipelines.phong);
 
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
 
         meshes.cube.destroy();
 
-        device.destroyBuffer(uniformDataVS.buffer);
-        device.freeMemory(uniformDataVS.memory);
+        uniformDataVS.destroy();
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
@@ -97,7 +95,7 @@ public:
         // Center : Toon
         viewport.x += viewport.width;
         cmdBuffer.setViewport(0, viewport);
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.toon);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.toon.get(pipelines.phong));
         cmdBuffer.setLineWidth(2.0f);
         cmdBuffer.drawIndexed(meshes.cube.indexCount, 1, 0, 0, 0);
 
@@ -108,7 +106,7 @@ public:
             // Right : Wireframe 
             viewport.x += viewport.width;
             cmdBuffer.setViewport(0, viewport);
-            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.wireframe);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.wireframe.get(pipelines.phong));
             cmdBuffer.drawIndexed(meshes.cube.indexCount, 1, 0, 0, 0);
         }
     }
@@ -255,7 +253,7 @@ public:
         pipelineCreateInfo.flags = vk::PipelineCreateFlagBits::eAllowDerivatives;
 
         // Textured pipeline
-        pipelines.phong = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.phong = stateCache->acquireGraphicsPipeline(pipelineCreateInfo);
 
         // All pipelines created after the base pipeline will be derivatives
         pipelineCreateInfo.flags = vk::PipelineCreateFlagBits::eDerivative;
@@ -269,7 +267,7 @@ public:
         shaderStages[0] = loadShader(getAssetPath() + "shaders/pipelines/toon.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/pipelines/toon.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
-        pipelines.toon = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.toon = stateCache->acquireGraphicsPipelineAsync(pipelineCreateInfo);
 
         // Non solid rendering is not a mandatory Vulkan feature
         if (deviceFeatures.fillModeNonSolid) {
@@ -277,7 +275,7 @@ public:
             rasterizationState.polygonMode = vk::PolygonMode::eLine;
             shaderStages[0] = loadShader(getAssetPath() + "shaders/pipelines/wireframe.vert.spv", vk::ShaderStageFlagBits::eVertex);
             shaderStages[1] = loadShader(getAssetPath() + "shaders/pipelines/wireframe.frag.spv", vk::ShaderStageFlagBits::eFragment);
-            pipelines.wireframe = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+            pipelines.wireframe = stateCache->acquireGraphicsPipelineAsync(pipelineCreateInfo);
         }
     }
 
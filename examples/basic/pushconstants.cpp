@@ -270,7 +270,7 @@ public:
         if (pipelines.solid) {
             trashPipeline(pipelines.solid);
         }
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
 
     }
 
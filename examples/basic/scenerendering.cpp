@@ -59,8 +59,6 @@ private:
     vk::Device device;
     vk::Queue queue;
 
-    vk::DescriptorPool descriptorPool;
-
     // We will be using separate descriptor sets (and bindings)
     // for material and scene related uniforms
     struct {
@@ -70,10 +68,38 @@ private:
 
     vk::DescriptorSet descriptorSetScene;
 
-    vkx::TextureLoader *textureLoader;
+    // Material textures are streamed in, the materials use a placeholder until they arrive
+    vkx::TextureStreamer *textureStreamer;
 
     const aiScene* aScene;
 
+    void writeMaterialDescriptor(size_t index, const vk::DescriptorImageInfo& texDescriptor) {
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
+
+        // todo : only use image sampler descriptor set and use one scene ubo for matrices
+
+        // Binding 0: Diffuse texture
+        writeDescriptorSets.push_back(vk::WriteDescriptorSet(
+            materials[index].descriptorSet,
+            0,
+            0,
+            1,
+            vk::DescriptorType::eCombinedImageSampler,
+            &texDescriptor,
+            nullptr,
+            nullptr
+            ));
+
+        device.updateDescriptorSets(writeDescriptorSets, {});
+    }
+
+    void streamTexture(size_t index, const std::string& filename, vk::Format format) {
+        textureStreamer->load(filename, format, [this, index](const vkx::Texture& texture) {
+            materials[index].diffuse = texture;
+            writeMaterialDescriptor(index, texture.descriptor);
+        });
+    }
+
     // Get materials from the assimp scene and map to our scene structures
     void loadMaterials() {
         materials.resize(aScene->mNumMaterials);
@@ -108,11 +134,11 @@ private:
                 std::cout << "  Diffuse: \"" << texturefile.C_Str() << "\"" << std::endl;
                 std::string fileName = std::string(texturefile.C_Str());
                 std::replace(fileName.begin(), fileName.end(), '\\', '/');
-                materials[i].diffuse = textureLoader->loadTexture(assetPath + fileName, vk::Format::eBc3UnormBlock);
+                streamTexture(i, assetPath + fileName, vk::Format::eBc3UnormBlock);
             } else {
                 std::cout << "  Material has no diffuse, using dummy texture!" << std::endl;
                 // todo : separate pipeline and layout
-                materials[i].diffuse = textureLoader->loadTexture(assetPath + "dummy.ktx", vk::Format::eBc2UnormBlock);
+                streamTexture(i, assetPath + "dummy.ktx", vk::Format::eBc2UnormBlock);
             }
 
             // For scenes with multiple textures per material we would need to check for additional texture types, e.g.:
@@ -122,20 +148,7 @@ private:
             materials[i].pipeline = (materials[i].properties.opacity == 0.0f) ? &pipelines.solid : &pipelines.blending;
         }
 
-        // Generate descriptor sets for the materials
-
-        // Descriptor pool
-        std::vector<vk::DescriptorPoolSize> poolSizes;
-        poolSizes.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 1)); //static_cast<uint32_t>(materials.size())
-        poolSizes.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, static_cast<uint32_t>(materials.size())));
-		
-		vk::DescriptorPoolCreateInfo descriptorPoolInfo(vk::DescriptorPoolCreateFlags(),
-			static_cast<uint32_t>(materials.size()) + 1,
-			static_cast<uint32_t>(poolSizes.size()),
-			poolSizes.data());
-		 
-
-        descriptorPool = device.createDescriptorPool(descriptorPoolInfo);
+        // Generate descriptor sets for the materials, the context's descriptor allocator grows with the material count
 
         // Descriptor set and pipeline layouts
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings;
@@ -183,59 +196,16 @@ private:
 
         // Material descriptor sets
         for (size_t i = 0; i < materials.size(); i++) {
-            // Descriptor set
-            vk::DescriptorSetAllocateInfo allocInfo(
-                    descriptorPool,
-					1,
-                    &descriptorSetLayouts.material);
-
-            materials[i].descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
-
-            vk::DescriptorImageInfo texDescriptor(
-                    materials[i].diffuse.sampler,
-                    materials[i].diffuse.view,
-                    vk::ImageLayout::eGeneral);
-
-            std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
-
-            // todo : only use image sampler descriptor set and use one scene ubo for matrices
-
-            // Binding 0: Diffuse texture
-            writeDescriptorSets.push_back(vk::WriteDescriptorSet(
-                materials[i].descriptorSet,
-				0,
-				0,
-				1,
-                vk::DescriptorType::eCombinedImageSampler,
-				&texDescriptor,
-				nullptr, 
-				nullptr 
-               ));
-
-            device.updateDescriptorSets(writeDescriptorSets, {});
+            materials[i].descriptorSet = context.descriptorAllocator->allocate(descriptorSetLayouts.material);
+            // Replaced by the streamed texture once it has been uploaded
+            writeMaterialDescriptor(i, textureStreamer->getPlaceholder().descriptor);
         }
 
         // Scene descriptor set
-        vk::DescriptorSetAllocateInfo allocInfo =
-            vk::DescriptorSetAllocateInfo(
-                descriptorPool,
-				1,
-                &descriptorSetLayouts.scene);
-        descriptorSetScene = device.allocateDescriptorSets(allocInfo)[0];
-
-        std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
         // Binding 0 : Vertex shader uniform buffer
-        writeDescriptorSets.push_back(vk::WriteDescriptorSet(
-			descriptorSetScene,
-			0,
-			0,
-			1,
-            vk::DescriptorType::eUniformBuffer,
-			nullptr,
-            &uniformBuffer.descriptor,
-			nullptr));
-
-        device.updateDescriptorSets(writeDescriptorSets, {});
+        descriptorSetScene = context.descriptorAllocator->getCachedSet(descriptorSetLayouts.scene, {
+            vkx::DescriptorBinding::buffer(0, vk::DescriptorType::eUniformBuffer, uniformBuffer.descriptor),
+        });
     }
 
     // Load all meshes from the scene and generate the Vulkan resources
@@ -314,10 +284,10 @@ public:
     bool renderSingleScenePart = false;
     uint32_t scenePartIndex = 0;
 
-    Scene(const vkx::Context& context, vkx::TextureLoader *textureloader) : context(context) {
+    Scene(const vkx::Context& context, vkx::TextureStreamer *textureStreamer) : context(context) {
         this->device = context.device;
         this->queue = context.queue;
-        this->textureLoader = textureloader;
+        this->textureStreamer = textureStreamer;
         uniformBuffer = context.createUniformBuffer(uniformData);
     }
 
@@ -332,7 +302,6 @@ public:
         vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material, nullptr);
         vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
-        vkDestroyDescriptorPool(device, descriptorPool, nullptr);
         vkDestroyPipeline(device, pipelines.solid, nullptr);
         vkDestroyPipeline(device, pipelines.blending, nullptr);
         vkDestroyPipeline(device, pipelines.wireframe, nullptr);
@@ -369,11 +338,12 @@ public:
 
     }
 
-    // Renders the scene into an active command buffer
+    // Renders the meshes in [first, last) into an active command buffer
     // In a real world application we would do some visibility culling in here
-    void render(vk::CommandBuffer cmdBuffer, bool wireframe) {
+    void render(vk::CommandBuffer cmdBuffer, bool wireframe, size_t first = 0, size_t last = SIZE_MAX) {
         vk::DeviceSize offsets[1] = { 0 };
-        for (size_t i = 0; i < meshes.size(); i++) {
+        last = std::min(last, meshes.size());
+        for (size_t i = first; i < last; i++) {
             if ((renderSingleScenePart) && (i != scenePartIndex))
                 continue;
 
@@ -451,6 +421,14 @@ public:
         scene->render(cmdBuffer, wireframe);
     }
 
+    // Each chunk renders a contiguous range of the scene meshes
+    void updateDrawCommandBufferChunk(const vk::CommandBuffer& cmdBuffer, uint32_t chunkIndex, uint32_t chunkCount) override {
+        size_t meshCount = scene->meshes.size();
+        cmdBuffer.setViewport(0, vkx::viewport(size));
+        cmdBuffer.setScissor(0, vkx::rect2D(size));
+        scene->render(cmdBuffer, wireframe, meshCount * chunkIndex / chunkCount, meshCount * (chunkIndex + 1) / chunkCount);
+    }
+
     void setupVertexDescriptions() {
         // Binding description
         vertices.bindingDescriptions.resize(1);
@@ -559,7 +537,7 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        scene->pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+        scene->pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
 
         // Alpha blended pipeline
         rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
@@ -568,14 +546,14 @@ public:
         blendAttachmentState.srcColorBlendFactor = vk::BlendFactor::eSrcColor;
         blendAttachmentState.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcColor;
 
-        scene->pipelines.blending = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+        scene->pipelines.blending = createGraphicsPipeline(pipelineCreateInfo);
 
         // Wire frame rendering pipeline
         rasterizationState.cullMode = vk::CullModeFlagBits::eBack;
         blendAttachmentState.blendEnable = VK_FALSE;
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
         rasterizationState.lineWidth = 1.0f;
-        scene->pipelines.wireframe = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+        scene->pipelines.wireframe = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void updateUniformBuffers() {
@@ -592,7 +570,7 @@ public:
 
     void loadScene() {
         withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuffer){
-            scene = new Scene(*this, textureLoader);
+            scene = new Scene(*this, &getTextureStreamer());
 #if defined(__ANDROID__)
             scene->assetManager = androidApp->activity->assetManager;
 #endif
@@ -608,6 +586,8 @@ public:
         setupVertexDescriptions();
         loadScene();
         preparePipelines();
+        // Record the draw list on all cores
+        drawChunkCount = getJobSystem().getWorkerCount();
         updateDrawCommandBuffers();
         prepared = true;
     }
@@ -651,6 +631,12 @@ public:
         case GLFW_KEY_L:
             attachLight = !attachLight;
             updateUniformBuffers();
+            break;
+        case GLFW_KEY_M:
+            // Switch between serial and parallel recording to compare the record times
+            drawChunkCount = (drawChunkCount > 1) ? 1 : getJobSystem().getWorkerCount();
+            updateDrawCommandBuffers();
+            updateTextOverlay();
             break;
 
 		case GLFW_KEY_UP:
@@ -682,6 +668,7 @@ public:
         } else {
             textOverlay->addText("Rendering whole scene (\"p\" to toggle)", 5.0f, 100.0f, vkx::TextOverlay::alignLeft);
         }
+        textOverlay->addText(std::string(drawChunkCount > 1 ? "Parallel" : "Serial") + " command buffer recording (\"m\" to toggle)", 5.0f, 115.0f, vkx::TextOverlay::alignLeft);
 #endif
     }
 };
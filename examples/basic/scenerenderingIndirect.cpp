@@ -61,8 +61,6 @@ private:
 	vk::Device device;
 	vk::Queue queue;
 
-	vk::DescriptorPool descriptorPool;
-
 	// We will be using separate descriptor sets (and bindings)
 	// for material and scene related uniforms
 	struct {
@@ -189,21 +187,7 @@ private:
 		}
 
 
-		// Generate descriptor sets for the materials
-
-		// Descriptor pool
-		std::vector<vk::DescriptorPoolSize> poolSizes;
-		poolSizes.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2)); //static_cast<uint32_t>(materials.size())
-		poolSizes.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eSampler, 1)); //static_cast<uint32_t>(materials.size())
-		poolSizes.push_back(vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, static_cast<uint32_t>(materials.size())));
-
-		vk::DescriptorPoolCreateInfo descriptorPoolInfo(vk::DescriptorPoolCreateFlags(),
-			static_cast<uint32_t>(materials.size()) + 1,
-			static_cast<uint32_t>(poolSizes.size()),
-			poolSizes.data());
-
-
-		descriptorPool = device.createDescriptorPool(descriptorPoolInfo);
+		// Generate descriptor sets for the materials, allocated from the context's descriptor allocator
 
 		// Descriptor set and pipeline layouts
 		std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings;
@@ -281,11 +265,7 @@ private:
 
 		// Material descriptor sets
 		{
-			vk::DescriptorSetAllocateInfo allocInfo(
-					descriptorPool,
-					1,
-					&descriptorSetLayouts.material);
-			descriptorSetMaterial = device.allocateDescriptorSets(allocInfo)[0];
+			descriptorSetMaterial = context.descriptorAllocator->allocate(descriptorSetLayouts.material);
 
 			std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
 
@@ -335,12 +315,7 @@ private:
 
 		// Scene descriptor set
 		{
-			vk::DescriptorSetAllocateInfo allocInfo =
-				vk::DescriptorSetAllocateInfo(
-					descriptorPool,
-					1,
-					&descriptorSetLayouts.scene);
-			descriptorSetScene = device.allocateDescriptorSets(allocInfo)[0];
+			descriptorSetScene = context.descriptorAllocator->allocate(descriptorSetLayouts.scene);
 
 			std::vector<vk::WriteDescriptorSet> writeDescriptorSets;
 			// Binding 0 : Vertex shader uniform buffer
@@ -498,7 +473,6 @@ public:
 		vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material, nullptr);
 		vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
-		vkDestroyDescriptorPool(device, descriptorPool, nullptr);
 		vkDestroyPipeline(device, pipelines.solid, nullptr);
 		vkDestroyPipeline(device, pipelines.blending, nullptr);
 		vkDestroyPipeline(device, pipelines.wireframe, nullptr);
@@ -805,7 +779,7 @@ public:
 		pipelineCreateInfo.stageCount = shaderStages.size();
 		pipelineCreateInfo.pStages = shaderStages.data();
 
-		scene->pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+		scene->pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
 
 		// Alpha blended pipeline
 		rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
@@ -814,14 +788,14 @@ public:
 		blendAttachmentState.srcColorBlendFactor = vk::BlendFactor::eSrcColor;
 		blendAttachmentState.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcColor;
 
-		scene->pipelines.blending = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+		scene->pipelines.blending = createGraphicsPipeline(pipelineCreateInfo);
 
 		// Wire frame rendering pipeline
 		rasterizationState.cullMode = vk::CullModeFlagBits::eBack;
 		blendAttachmentState.blendEnable = VK_FALSE;
 		rasterizationState.polygonMode = vk::PolygonMode::eLine;
 		rasterizationState.lineWidth = 1.0f;
-		scene->pipelines.wireframe = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+		scene->pipelines.wireframe = createGraphicsPipeline(pipelineCreateInfo);
 	}
 
 	void updateUniformBuffers() {
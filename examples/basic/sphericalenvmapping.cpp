@@ -250,7 +250,7 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.sem = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.sem = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void prepareUniformBuffers() {
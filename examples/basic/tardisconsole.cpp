@@ -224,7 +224,7 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.models = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.models = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -87,11 +87,9 @@ public:
 
         meshes.object.destroy();
 
-        device.destroyBuffer(uniformDataTC.buffer);
-        device.freeMemory(uniformDataTC.memory);
+        uniformDataTC.destroy();
 
-        device.destroyBuffer(uniformDataTE.buffer);
-        device.freeMemory(uniformDataTE.memory);
+        uniformDataTE.destroy();
 
         textures.colorMap.destroy();
     }
@@ -299,10 +297,10 @@ public:
 
         // Tessellation pipelines
         // Solid
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
         // Wireframe
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
-        pipelines.wire = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.wire = createGraphicsPipeline(pipelineCreateInfo);
 
         // Pass through pipelines
         // Load pass through tessellation shaders (Vert and frag are reused)
@@ -311,10 +309,10 @@ public:
 
         // Solid
         rasterizationState.polygonMode = vk::PolygonMode::eFill;
-        pipelines.solidPassThrough = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solidPassThrough = createGraphicsPipeline(pipelineCreateInfo);
         // Wireframe
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
-        pipelines.wirePassThrough = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.wirePassThrough = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
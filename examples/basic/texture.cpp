@@ -28,6 +28,7 @@ public:
     struct {
         vk::Buffer buffer;
         vk::DeviceMemory memory;
+        vkx::MemoryAllocation allocation;
         vk::PipelineVertexInputStateCreateInfo inputState;
         std::vector<vk::VertexInputBindingDescription> bindingDescriptions;
         std::vector<vk::VertexInputAttributeDescription> attributeDescriptions;
@@ -37,6 +38,7 @@ public:
         int count;
         vk::Buffer buffer;
         vk::DeviceMemory memory;
+        vkx::MemoryAllocation allocation;
     } indices;
 
     vkx::UniformData uniformDataVS;
@@ -76,13 +78,12 @@ public:
         device.destroyDescriptorSetLayout(descriptorSetLayout);
 
         device.destroyBuffer(vertices.buffer);
-        device.freeMemory(vertices.memory);
+        vertices.allocation.free();
 
         device.destroyBuffer(indices.buffer);
-        device.freeMemory(indices.memory);
+        indices.allocation.free();
 
-        device.destroyBuffer(uniformDataVS.buffer);
-        device.freeMemory(uniformDataVS.memory);
+        uniformDataVS.destroy();
     }
 
     // Create an image memory barrier for changing the layout of
@@ -303,6 +304,7 @@ public:
         auto result = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
         vertices.buffer = result.buffer;
         vertices.memory = result.memory;
+        vertices.allocation = result.allocation;
 
         // Setup indices
         std::vector<uint32_t> indexBuffer = { 0,1,2, 2,3,0 };
@@ -310,6 +312,7 @@ public:
         result = createBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
         indices.buffer = result.buffer;
         indices.memory = result.memory;
+        indices.allocation = result.allocation;
     }
 
     void setupVertexDescriptions() {
@@ -457,7 +460,7 @@ public:
         pipelineCreateInfo.pStages = shaderStages.data();
 
         trashPipeline(pipelines.solid);
-        pipelines.solid = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
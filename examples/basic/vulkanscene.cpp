@@ -80,10 +80,10 @@ public:
 
         for (auto& mesh : meshes) {
             device.destroyBuffer(mesh->vertexBuffer.buf);
-            device.freeMemory(mesh->vertexBuffer.mem);
+            mesh->vertexBuffer.allocation.free();
 
             device.destroyBuffer(mesh->indexBuffer.buf);
-            device.freeMemory(mesh->indexBuffer.mem);
+            mesh->indexBuffer.allocation.free();
         }
 
         textures.skybox.destroy();
@@ -172,6 +172,7 @@ public:
             auto result = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
             mesh->vertexBuffer.buf = result.buffer;
             mesh->vertexBuffer.mem = result.memory;
+            mesh->vertexBuffer.allocation = result.allocation;
             std::vector<uint32_t> indexBuffer;
             for (int m = 0; m < mesh->m_Entries.size(); m++) {
                 int indexBase = indexBuffer.size();
@@ -182,6 +183,7 @@ public:
             result = createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, indexBuffer);
             mesh->indexBuffer.buf = result.buffer;
             mesh->indexBuffer.mem = result.memory;
+            mesh->indexBuffer.allocation = result.allocation;
             mesh->indexBuffer.count = indexBuffer.size();
 
             meshes.push_back(mesh);
@@ -339,13 +341,13 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.models = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.models = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // vk::Pipeline for the logos
         shaderStages[0] = loadShader(getAssetPath() + "shaders/vulkanscene/logo.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/vulkanscene/logo.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.logos = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.logos = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // vk::Pipeline for the sky sphere (todo)
@@ -353,7 +355,7 @@ public:
         depthStencilState.depthWriteEnable = VK_FALSE; // No depth writes
         shaderStages[0] = loadShader(getAssetPath() + "shaders/vulkanscene/skybox.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/vulkanscene/skybox.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.skybox = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.skybox = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Assign pipelines
@@ -8,7 +8,6 @@
 
 #include "vulkanExampleBase.h"
 
-#include "threadPool.hpp"
 #include "frustum.hpp"
 
 
@@ -52,7 +51,7 @@ public:
 
     // Number of animated objects to be renderer
     // by using threads and secondary command buffers
-    uint32_t numObjectsPerThread;
+    uint32_t numObjects;
 
     // Multi threaded stuff
     // Max. number of concurrent threads
@@ -77,20 +76,23 @@ public:
         bool visible = true;
     };
 
+    // Per object information (position, rotation, etc.)
+    std::vector<ObjectData> objectData;
+    // One push constant block per render object
+    std::vector<ThreadPushConstantBlock> pushConstBlock;
+    // Secondary command buffer recorded for each visible object in the current frame
+    std::vector<vk::CommandBuffer> objectCommandBuffers;
+
+    // Objects are picked up by whichever worker is free, so command buffers
+    // come from a pool owned by the worker rather than by the object
     struct ThreadData {
-        vkx::MeshBuffer mesh;
         vk::CommandPool commandPool;
-        // One command buffer per render object
-        std::vector<vk::CommandBuffer> commandBuffer;
-        // One push constant block per render object
-        std::vector<ThreadPushConstantBlock> pushConstBlock;
-        // Per object information (position, rotation, etc.)
-        std::vector<ObjectData> objectData;
+        // Secondary command buffers allocated from the pool, reused every frame
+        std::vector<vk::CommandBuffer> commandBuffers;
+        uint32_t usedCommandBuffers{ 0 };
     };
     std::vector<ThreadData> threadData;
 
-    vkx::ThreadPool threadPool;
-
     // vk::Fence to wait for all command buffers to finish before
     // presenting to the swap chain
     vk::Fence renderFence;
@@ -109,8 +111,8 @@ public:
         camera.setRotation({ 0.0f, 37.5f, 0.0f });
         enableTextOverlay = true;
         title = "Vulkan Example - Multi threaded rendering";
-        // Get number of max. concurrrent threads
-        numThreads = std::thread::hardware_concurrency();
+        // One worker per hardware thread, including the main thread
+        numThreads = getJobSystem().getWorkerCount();
         assert(numThreads > 0);
 #if defined(__ANDROID__)
         LOGD("numThreads = %d", numThreads);
@@ -119,9 +121,7 @@ public:
 #endif
         srand(time(NULL));
 
-        threadPool.setThreadCount(numThreads);
-
-        numObjectsPerThread = 256 / numThreads;
+        numObjects = 256;
     }
 
     ~VulkanExample() {
@@ -139,7 +139,9 @@ public:
         meshes.skysphere.destroy();
 
         for (auto& thread : threadData) {
-            device.freeCommandBuffers(thread.commandPool, thread.commandBuffer.size(), thread.commandBuffer.data());
+            if (!thread.commandBuffers.empty()) {
+                device.freeCommandBuffers(thread.commandPool, thread.commandBuffers);
+            }
             device.destroyCommandPool(thread.commandPool);
         }
 
@@ -168,60 +170,45 @@ public:
         withPrimaryCommandBuffer([&](const vk::CommandBuffer& setupCmdBuffer) {
         });
 
-        float maxX = std::floor(std::sqrt(numThreads * numObjectsPerThread));
+        // Create one command pool for each worker, the secondary command buffers
+        // are allocated on demand while recording
+        for (auto& thread : threadData) {
+            vk::CommandPoolCreateInfo cmdPoolInfo;
+            cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
+            thread.commandPool = device.createCommandPool(cmdPoolInfo);
+        }
+
+        objectData.resize(numObjects);
+        pushConstBlock.resize(numObjects);
+        objectCommandBuffers.resize(numObjects);
+
+        float maxX = std::floor(std::sqrt(numObjects));
         uint32_t posX = 0;
         uint32_t posZ = 0;
 
-        for (uint32_t i = 0; i < numThreads; i++) {
-            ThreadData *thread = &threadData[i];
+        for (uint32_t j = 0; j < numObjects; j++) {
+            objectData[j].pos.x = (posX - maxX / 2.0f) * 3.0f + rnd(1.5f) - rnd(1.5f);
+            objectData[j].pos.z = (posZ - maxX / 2.0f) * 3.0f + rnd(1.5f) - rnd(1.5f);
 
-            // Create one command pool for each thread
-            vk::CommandPoolCreateInfo cmdPoolInfo;
-            cmdPoolInfo.queueFamilyIndex = swapChain.queueNodeIndex;
-            cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
-            thread->commandPool = device.createCommandPool(cmdPoolInfo);
-
-            // One secondary command buffer per object that is updated by this thread
-            thread->commandBuffer.resize(numObjectsPerThread);
-            // Generate secondary command buffers for each thread
-            vk::CommandBufferAllocateInfo secondaryCmdBufAllocateInfo =
-                vkx::commandBufferAllocateInfo(
-                    thread->commandPool,
-                    vk::CommandBufferLevel::eSecondary,
-                    thread->commandBuffer.size());
-            thread->commandBuffer = device.allocateCommandBuffers(secondaryCmdBufAllocateInfo);
-            thread->mesh = meshes.ufo;
-            thread->pushConstBlock.resize(numObjectsPerThread);
-            thread->objectData.resize(numObjectsPerThread);
-
-            float step = 360.0f / (float)(numThreads * numObjectsPerThread);
-            for (uint32_t j = 0; j < numObjectsPerThread; j++) {
-                float radius = 8.0f + rnd(8.0f) - rnd(4.0f);
-
-                thread->objectData[j].pos.x = (posX - maxX / 2.0f) * 3.0f + rnd(1.5f) - rnd(1.5f);
-                thread->objectData[j].pos.z = (posZ - maxX / 2.0f) * 3.0f + rnd(1.5f) - rnd(1.5f);
-
-                posX += 1.0f;
-                if (posX >= maxX) {
-                    posX = 0.0f;
-                    posZ += 1.0f;
-                }
-
-                thread->objectData[j].rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
-                thread->objectData[j].deltaT = rnd(1.0f);
-                thread->objectData[j].rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
-                thread->objectData[j].rotationSpeed = (2.0f + rnd(4.0f)) * thread->objectData[j].rotationDir;
-                thread->objectData[j].scale = 0.75f + rnd(0.5f);
-
-                thread->pushConstBlock[j].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
+            posX += 1.0f;
+            if (posX >= maxX) {
+                posX = 0.0f;
+                posZ += 1.0f;
             }
+
+            objectData[j].rotation = glm::vec3(0.0f, rnd(360.0f), 0.0f);
+            objectData[j].deltaT = rnd(1.0f);
+            objectData[j].rotationDir = (rnd(100.0f) < 50.0f) ? 1.0f : -1.0f;
+            objectData[j].rotationSpeed = (2.0f + rnd(4.0f)) * objectData[j].rotationDir;
+            objectData[j].scale = 0.75f + rnd(0.5f);
+
+            pushConstBlock[j].color = glm::vec3(rnd(1.0f), rnd(1.0f), rnd(1.0f));
         }
     }
 
-    // Builds the secondary command buffer for each thread
-    void threadRenderCode(uint32_t threadIndex, uint32_t cmdBufferIndex, vk::CommandBufferInheritanceInfo inheritanceInfo) {
-        ThreadData *thread = &threadData[threadIndex];
-        ObjectData *objectData = &thread->objectData[cmdBufferIndex];
+    // Builds the secondary command buffer for a single object
+    void threadRenderCode(uint32_t objectIndex, const vk::CommandBufferInheritanceInfo& inheritanceInfo) {
+        ObjectData *objectData = &this->objectData[objectIndex];
 
         // Check visibility against view frustum
         objectData->visible = frustum.checkSphere(objectData->pos, objectSphereDim * 0.5f);
@@ -234,7 +221,16 @@ public:
         commandBufferBeginInfo.flags = vk::CommandBufferUsageFlagBits::eRenderPassContinue;
         commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
 
-        vk::CommandBuffer cmdBuffer = thread->commandBuffer[cmdBufferIndex];
+        // A command pool must not be used by two threads at once, so take the
+        // next command buffer from the pool of the worker running this job
+        ThreadData *thread = &threadData[getJobSystem().getWorkerIndex()];
+        if (thread->usedCommandBuffers == thread->commandBuffers.size()) {
+            vk::CommandBufferAllocateInfo cmdBufAllocateInfo =
+                vkx::commandBufferAllocateInfo(thread->commandPool, vk::CommandBufferLevel::eSecondary, 1);
+            thread->commandBuffers.push_back(device.allocateCommandBuffers(cmdBufAllocateInfo)[0]);
+        }
+        vk::CommandBuffer cmdBuffer = thread->commandBuffers[thread->usedCommandBuffers++];
+        objectCommandBuffers[objectIndex] = cmdBuffer;
         cmdBuffer.begin(commandBufferBeginInfo);
 
         cmdBuffer.setViewport(0, vkx::viewport(size));
@@ -258,16 +254,16 @@ public:
         objectData->model = glm::rotate(objectData->model, glm::radians(objectData->deltaT * 360.0f), glm::vec3(0.0f, objectData->rotationDir, 0.0f));
         objectData->model = glm::scale(objectData->model, glm::vec3(objectData->scale));
 
-        thread->pushConstBlock[cmdBufferIndex].mvp = matrices.projection * matrices.view * objectData->model;
+        pushConstBlock[objectIndex].mvp = matrices.projection * matrices.view * objectData->model;
 
         // Update shader push constant block
         // Contains model view matrix
-        cmdBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(ThreadPushConstantBlock), &thread->pushConstBlock[cmdBufferIndex]);
+        cmdBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, sizeof(ThreadPushConstantBlock), &pushConstBlock[objectIndex]);
 
         vk::DeviceSize offsets = 0;
-        cmdBuffer.bindVertexBuffers(0, thread->mesh.vertices.buffer, offsets);
-        cmdBuffer.bindIndexBuffer(thread->mesh.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(thread->mesh.indexCount, 1, 0, 0, 0);
+        cmdBuffer.bindVertexBuffers(0, meshes.ufo.vertices.buffer, offsets);
+        cmdBuffer.bindIndexBuffer(meshes.ufo.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.drawIndexed(meshes.ufo.indexCount, 1, 0, 0, 0);
 
         cmdBuffer.end();
     }
@@ -294,7 +290,7 @@ public:
         secondaryCommandBuffer.end();
     }
 
-    // Updates the secondary command buffers using a thread pool 
+    // Updates the secondary command buffers using the job system
     // and puts them into the primary command buffer that's 
     // lat submitted to the queue for rendering
     void updateCommandBuffers(vk::Framebuffer framebuffer) {
@@ -331,21 +327,24 @@ public:
         updateSecondaryCommandBuffer(inheritanceInfo);
         commandBuffers.push_back(secondaryCommandBuffer);
 
-        // Add a job to the thread's queue for each object to be rendered
-        for (uint32_t t = 0; t < numThreads; t++) {
-            for (uint32_t i = 0; i < numObjectsPerThread; i++) {
-                threadPool.threads[t]->addJob([=] { threadRenderCode(t, i, inheritanceInfo); });
-            }
+        // The previous frame has completed (see draw), so the worker pools can be recycled
+        for (auto& thread : threadData) {
+            device.resetCommandPool(thread.commandPool, vk::CommandPoolResetFlags());
+            thread.usedCommandBuffers = 0;
         }
 
-        threadPool.wait();
+        // Objects are split into small chunks, idle workers steal chunks from busy ones
+        // so culled (cheap) and visible (expensive) objects even out across threads
+        getJobSystem().parallelFor(0, numObjects, 8, [&](uint32_t begin, uint32_t end) {
+            for (uint32_t i = begin; i < end; i++) {
+                threadRenderCode(i, inheritanceInfo);
+            }
+        });
 
         // Only submit if object is within the current view frustum
-        for (uint32_t t = 0; t < numThreads; t++) {
-            for (uint32_t i = 0; i < numObjectsPerThread; i++) {
-                if (threadData[t].objectData[i].visible) {
-                    commandBuffers.push_back(threadData[t].commandBuffer[i]);
-                }
+        for (uint32_t i = 0; i < numObjects; i++) {
+            if (objectData[i].visible) {
+                commandBuffers.push_back(objectCommandBuffers[i]);
             }
         }
 
@@ -469,14 +468,14 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.phong = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+        pipelines.phong = createGraphicsPipeline(pipelineCreateInfo);
 
         // Star sphere rendering pipeline
         rasterizationState.cullMode = vk::CullModeFlagBits::eFront;
         depthStencilState.depthWriteEnable = VK_FALSE;
         shaderStages[0] = loadShader(getAssetPath() + "shaders/multithreading/starsphere.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/multithreading/starsphere.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.starsphere = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.starsphere = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void updateMatrices() {
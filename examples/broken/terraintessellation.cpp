@@ -497,11 +497,11 @@ public:
         pipelineCreateInfo.pStages = shaderStages.data();
         pipelineCreateInfo.renderPass = renderPass;
 
-        pipelines.terrain = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+        pipelines.terrain = createGraphicsPipeline(pipelineCreateInfo);
 
         // Terrain wireframe pipeline
         rasterizationState.polygonMode = vk::PolygonMode::eLine;
-        pipelines.wireframe = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+        pipelines.wireframe = createGraphicsPipeline(pipelineCreateInfo);
 
         // Skysphere pipeline
         rasterizationState.polygonMode = vk::PolygonMode::eFill;
@@ -515,7 +515,7 @@ public:
         pipelineCreateInfo.layout = pipelineLayouts.skysphere;
         shaderStages[0] = loadShader(getAssetPath() + "shaders/terraintessellation/skysphere.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/terraintessellation/skysphere.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.skysphere = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo)[0];
+        pipelines.skysphere = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
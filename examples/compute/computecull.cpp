@@ -0,0 +1,485 @@
+/*
+* Vulkan Example - GPU cluster culling with compute shaders
+*
+* The mesh is split into clusters of up to 64 vertices and 124 triangles at load time (see MeshClusterizer).
+* Every frame a compute shader tests the clusters against the view frustum and their normal cones and
+* writes a compacted list of indexed indirect draws for the visible ones, which are then drawn with the
+* regular vertex pipeline.  Freezing the culling camera (F) lets you look at what was culled.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "vulkanExampleBase.h"
+#include "frustum.hpp"
+
+// Vertex layout for this example
+std::vector<vkx::VertexLayout> vertexLayout =
+{
+    vkx::VertexLayout::VERTEX_LAYOUT_POSITION,
+    vkx::VertexLayout::VERTEX_LAYOUT_NORMAL,
+    vkx::VertexLayout::VERTEX_LAYOUT_COLOR
+};
+
+class VulkanExample : public vkx::ExampleBase {
+public:
+    enum CullFlags {
+        CULL_FRUSTUM = 0x1,
+        CULL_BACKFACE = 0x2,
+    };
+
+    bool cullingEnabled{ true };
+    bool frozen{ false };
+    // Visible clusters and triangles of the last completed frame, read back for the text overlay
+    uint32_t visibleClusters{ 0 };
+    uint32_t visibleTriangles{ 0 };
+
+    struct {
+        vk::PipelineVertexInputStateCreateInfo inputState;
+        std::vector<vk::VertexInputBindingDescription> bindingDescriptions;
+        std::vector<vk::VertexInputAttributeDescription> attributeDescriptions;
+    } vertices;
+
+    struct {
+        vkx::MeshBuffer object;
+    } meshes;
+
+    struct UboVS {
+        glm::mat4 projection;
+        glm::mat4 model;
+        glm::vec4 lightPos = glm::vec4(25.0f, 5.0f, 5.0f, 1.0f);
+    } uboVS;
+
+    // Matches the uniform block of cull.comp
+    struct UboCull {
+        glm::vec4 frustumPlanes[6];
+        glm::vec4 cameraPos;
+        uint32_t clusterCount{ 0 };
+        uint32_t cullFlags{ CULL_FRUSTUM | CULL_BACKFACE };
+    } uboCull;
+
+    struct {
+        vkx::UniformData vsScene;
+        // Device local, updated through the update queue
+        vkx::UniformData cull;
+    } uniformData;
+
+    struct {
+        // MeshBuffer::clusters
+        vkx::CreateBufferResult clusters;
+        // One vk::DrawIndexedIndirectCommand per cluster, the visible ones first
+        vkx::CreateBufferResult commands;
+        // Visible cluster and triangle count
+        vkx::CreateBufferResult counters;
+        // Host visible copy of the counters, one region per frame slot
+        vkx::CreateBufferResult readback;
+    } storageBuffers;
+
+    struct {
+        vk::Pipeline solid;
+        vk::Pipeline cull;
+    } pipelines;
+
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::DescriptorSetLayout descriptorSetLayout;
+
+    vk::PipelineLayout computePipelineLayout;
+    vk::DescriptorSet computeDescriptorSet;
+    vk::DescriptorSetLayout computeDescriptorSetLayout;
+
+    VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION) {
+        camera.setZoom(-4.0f);
+        camera.setRotation({ 0.0f, -25.0f, 0.0f });
+        rotationSpeed = 0.5f;
+        title = "Vulkan Example - Compute shader cluster culling";
+    }
+
+    ~VulkanExample() {
+        device.destroyPipeline(pipelines.solid);
+        device.destroyPipelineLayout(pipelineLayout);
+        device.destroyDescriptorSetLayout(descriptorSetLayout);
+
+        device.destroyPipeline(pipelines.cull);
+        device.destroyPipelineLayout(computePipelineLayout);
+        device.destroyDescriptorSetLayout(computeDescriptorSetLayout);
+
+        storageBuffers.clusters.destroy();
+        storageBuffers.commands.destroy();
+        storageBuffers.counters.destroy();
+        storageBuffers.readback.destroy();
+        uniformData.vsScene.destroy();
+        uniformData.cull.destroy();
+        meshes.object.destroy();
+    }
+
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        // This frame slot's counters were copied when it was last used and its fence has signalled since
+        const uint32_t* counters = (const uint32_t*)storageBuffers.readback.mapped + frameSlotIndex * 2;
+        visibleClusters = counters[0];
+        visibleTriangles = counters[1];
+
+        const vk::DeviceSize countersSize = storageBuffers.counters.size;
+        std::vector<vk::BufferMemoryBarrier> barriers(2);
+        for (auto& barrier : barriers) {
+            barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+            barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        }
+        barriers[0].buffer = storageBuffers.commands.buffer;
+        barriers[0].size = storageBuffers.commands.size;
+        barriers[1].buffer = storageBuffers.counters.buffer;
+        barriers[1].size = countersSize;
+
+        // The previous frame's indirect draws and counter copy have finished reading before they are cleared
+        barriers[0].srcAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+        barriers[0].dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barriers[1].srcAccessMask = vk::AccessFlagBits::eTransferRead;
+        barriers[1].dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, barriers, nullptr);
+        // Culled clusters keep a zero command, which draws nothing
+        cmdBuffer.fillBuffer(storageBuffers.commands.buffer, 0, storageBuffers.commands.size, 0);
+        cmdBuffer.fillBuffer(storageBuffers.counters.buffer, 0, countersSize, 0);
+
+        for (auto& barrier : barriers) {
+            barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+            barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        }
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, vk::DependencyFlags(), nullptr, barriers, nullptr);
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.cull);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computePipelineLayout, 0, computeDescriptorSet, nullptr);
+        cmdBuffer.dispatch((uboCull.clusterCount + 63) / 64, 1, 1);
+
+        // Draw commands are consumed by the indirect draws, the counters by the copy below
+        barriers[0].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        barriers[0].dstAccessMask = vk::AccessFlagBits::eIndirectCommandRead;
+        barriers[1].srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        barriers[1].dstAccessMask = vk::AccessFlagBits::eTransferRead;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, barriers, nullptr);
+
+        cmdBuffer.copyBuffer(storageBuffers.counters.buffer, storageBuffers.readback.buffer, vk::BufferCopy(0, frameSlotIndex * countersSize, countersSize));
+        vk::BufferMemoryBarrier readbackBarrier;
+        readbackBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        readbackBarrier.dstAccessMask = vk::AccessFlagBits::eHostRead;
+        readbackBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        readbackBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        readbackBarrier.buffer = storageBuffers.readback.buffer;
+        readbackBarrier.offset = frameSlotIndex * countersSize;
+        readbackBarrier.size = countersSize;
+        cmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, vk::DependencyFlags(), nullptr, readbackBarrier, nullptr);
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        cmdBuffer.setViewport(0, vkx::viewport(size));
+        cmdBuffer.setScissor(0, vkx::rect2D(size));
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
+        cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.object.vertices.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
+        // The number of visible clusters is only known on the GPU, so every command is drawn and the zeroed ones
+        // after the visible clusters are skipped.  Without multiDrawIndirect each command is its own draw.
+        const uint32_t clusterCount = uboCull.clusterCount;
+        const uint32_t maxDrawCount = deviceFeatures.multiDrawIndirect ? deviceProperties.limits.maxDrawIndirectCount : 1;
+        for (uint32_t first = 0; first < clusterCount; first += maxDrawCount) {
+            cmdBuffer.drawIndexedIndirect(storageBuffers.commands.buffer, first * sizeof(vk::DrawIndexedIndirectCommand), std::min(maxDrawCount, clusterCount - first), sizeof(vk::DrawIndexedIndirectCommand));
+        }
+    }
+
+    void loadMeshes() {
+        meshes.object = loadMesh(getAssetPath() + "models/suzanne.obj", vertexLayout, 1.0f, 1, vkx::MeshLoader::OPTION_CLUSTERS);
+        if (meshes.object.clusters.empty()) {
+            throw std::runtime_error("Mesh has no clusters");
+        }
+    }
+
+    void setupVertexDescriptions() {
+        // Binding description
+        vertices.bindingDescriptions.resize(1);
+        vertices.bindingDescriptions[0] =
+            vkx::vertexInputBindingDescription(VERTEX_BUFFER_BIND_ID, vkx::vertexSize(vertexLayout), vk::VertexInputRate::eVertex);
+
+        // Attribute descriptions
+        // Describes memory layout and shader positions
+        vertices.attributeDescriptions.resize(3);
+        // Location 0 : Position
+        vertices.attributeDescriptions[0] =
+            vkx::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 0, vk::Format::eR32G32B32Sfloat, 0);
+        // Location 1 : Normal
+        vertices.attributeDescriptions[1] =
+            vkx::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 1, vk::Format::eR32G32B32Sfloat, sizeof(float) * 3);
+        // Location 2 : Color
+        vertices.attributeDescriptions[2] =
+            vkx::vertexInputAttributeDescription(VERTEX_BUFFER_BIND_ID, 2, vk::Format::eR32G32B32Sfloat, sizeof(float) * 6);
+
+        vertices.inputState = vk::PipelineVertexInputStateCreateInfo();
+        vertices.inputState.vertexBindingDescriptionCount = vertices.bindingDescriptions.size();
+        vertices.inputState.pVertexBindingDescriptions = vertices.bindingDescriptions.data();
+        vertices.inputState.vertexAttributeDescriptionCount = vertices.attributeDescriptions.size();
+        vertices.inputState.pVertexAttributeDescriptions = vertices.attributeDescriptions.data();
+    }
+
+    void prepareStorageBuffers() {
+        const auto& clusters = meshes.object.clusters;
+        uboCull.clusterCount = (uint32_t)clusters.size();
+        storageBuffers.clusters = stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, clusters);
+        // Cleared every frame before the culling dispatch
+        storageBuffers.commands = createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal, clusters.size() * sizeof(vk::DrawIndexedIndirectCommand));
+        storageBuffers.counters = createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst,
+            vk::MemoryPropertyFlagBits::eDeviceLocal, 2 * sizeof(uint32_t));
+        std::vector<uint32_t> readback(framesInFlight * 2, 0);
+        storageBuffers.readback = createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, readback);
+        storageBuffers.readback.map();
+    }
+
+    void setupDescriptorPool() {
+        std::vector<vk::DescriptorPoolSize> poolSizes =
+        {
+            vkx::descriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2),
+            vkx::descriptorPoolSize(vk::DescriptorType::eStorageBuffer, 3),
+        };
+
+        vk::DescriptorPoolCreateInfo descriptorPoolInfo =
+            vkx::descriptorPoolCreateInfo(poolSizes.size(), poolSizes.data(), 2);
+
+        descriptorPool = device.createDescriptorPool(descriptorPoolInfo);
+    }
+
+    void setupDescriptorSetLayout() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings =
+        {
+            // Binding 0 : Vertex shader uniform buffer
+            vkx::descriptorSetLayoutBinding(
+                vk::DescriptorType::eUniformBuffer,
+                vk::ShaderStageFlagBits::eVertex,
+                0),
+        };
+
+        vk::DescriptorSetLayoutCreateInfo descriptorLayout =
+            vkx::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), setLayoutBindings.size());
+
+        descriptorSetLayout = device.createDescriptorSetLayout(descriptorLayout);
+
+        vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+            vkx::pipelineLayoutCreateInfo(&descriptorSetLayout, 1);
+
+        pipelineLayout = device.createPipelineLayout(pipelineLayoutCreateInfo);
+    }
+
+    void setupDescriptorSet() {
+        vk::DescriptorSetAllocateInfo allocInfo =
+            vkx::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
+
+        descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets =
+        {
+            // Binding 0 : Vertex shader uniform buffer
+            vkx::writeDescriptorSet(
+                descriptorSet,
+                vk::DescriptorType::eUniformBuffer,
+                0,
+                &uniformData.vsScene.descriptor),
+        };
+
+        device.updateDescriptorSets(writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+    }
+
+    void preparePipelines() {
+        vk::PipelineInputAssemblyStateCreateInfo inputAssemblyState =
+            vkx::pipelineInputAssemblyStateCreateInfo(vk::PrimitiveTopology::eTriangleList, vk::PipelineInputAssemblyStateCreateFlags(), VK_FALSE);
+
+        vk::PipelineRasterizationStateCreateInfo rasterizationState =
+            vkx::pipelineRasterizationStateCreateInfo(vk::PolygonMode::eFill, vk::CullModeFlagBits::eBack, vk::FrontFace::eClockwise);
+
+        vk::PipelineColorBlendAttachmentState blendAttachmentState =
+            vkx::pipelineColorBlendAttachmentState();
+
+        vk::PipelineColorBlendStateCreateInfo colorBlendState =
+            vkx::pipelineColorBlendStateCreateInfo(1, &blendAttachmentState);
+
+        vk::PipelineDepthStencilStateCreateInfo depthStencilState =
+            vkx::pipelineDepthStencilStateCreateInfo(VK_TRUE, VK_TRUE, vk::CompareOp::eLessOrEqual);
+
+        vk::PipelineViewportStateCreateInfo viewportState =
+            vkx::pipelineViewportStateCreateInfo(1, 1);
+
+        vk::PipelineMultisampleStateCreateInfo multisampleState =
+            vkx::pipelineMultisampleStateCreateInfo(vk::SampleCountFlagBits::e1);
+
+        std::vector<vk::DynamicState> dynamicStateEnables = {
+            vk::DynamicState::eViewport,
+            vk::DynamicState::eScissor
+        };
+        vk::PipelineDynamicStateCreateInfo dynamicState =
+            vkx::pipelineDynamicStateCreateInfo(dynamicStateEnables.data(), dynamicStateEnables.size());
+
+        std::array<vk::PipelineShaderStageCreateInfo, 2> shaderStages;
+        shaderStages[0] = loadShader(getAssetPath() + "shaders/computecull/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        shaderStages[1] = loadShader(getAssetPath() + "shaders/computecull/mesh.frag.spv", vk::ShaderStageFlagBits::eFragment);
+
+        vk::GraphicsPipelineCreateInfo pipelineCreateInfo =
+            vkx::pipelineCreateInfo(pipelineLayout, renderPass);
+
+        pipelineCreateInfo.pVertexInputState = &vertices.inputState;
+        pipelineCreateInfo.pInputAssemblyState = &inputAssemblyState;
+        pipelineCreateInfo.pRasterizationState = &rasterizationState;
+        pipelineCreateInfo.pColorBlendState = &colorBlendState;
+        pipelineCreateInfo.pMultisampleState = &multisampleState;
+        pipelineCreateInfo.pViewportState = &viewportState;
+        pipelineCreateInfo.pDepthStencilState = &depthStencilState;
+        pipelineCreateInfo.pDynamicState = &dynamicState;
+        pipelineCreateInfo.stageCount = shaderStages.size();
+        pipelineCreateInfo.pStages = shaderStages.data();
+
+        pipelines.solid = createGraphicsPipeline(pipelineCreateInfo);
+    }
+
+    void prepareCompute() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+            // Binding 0 : Clusters
+            vkx::descriptorSetLayoutBinding(
+                vk::DescriptorType::eStorageBuffer,
+                vk::ShaderStageFlagBits::eCompute,
+                0),
+            // Binding 1 : Draw commands
+            vkx::descriptorSetLayoutBinding(
+                vk::DescriptorType::eStorageBuffer,
+                vk::ShaderStageFlagBits::eCompute,
+                1),
+            // Binding 2 : Counters
+            vkx::descriptorSetLayoutBinding(
+                vk::DescriptorType::eStorageBuffer,
+                vk::ShaderStageFlagBits::eCompute,
+                2),
+            // Binding 3 : Culling parameters
+            vkx::descriptorSetLayoutBinding(
+                vk::DescriptorType::eUniformBuffer,
+                vk::ShaderStageFlagBits::eCompute,
+                3),
+        };
+
+        vk::DescriptorSetLayoutCreateInfo descriptorLayout =
+            vkx::descriptorSetLayoutCreateInfo(setLayoutBindings.data(), setLayoutBindings.size());
+
+        computeDescriptorSetLayout = device.createDescriptorSetLayout(descriptorLayout);
+
+        vk::PipelineLayoutCreateInfo pipelineLayoutCreateInfo =
+            vkx::pipelineLayoutCreateInfo(&computeDescriptorSetLayout, 1);
+
+        computePipelineLayout = device.createPipelineLayout(pipelineLayoutCreateInfo);
+
+        vk::DescriptorSetAllocateInfo allocInfo =
+            vkx::descriptorSetAllocateInfo(descriptorPool, &computeDescriptorSetLayout, 1);
+
+        computeDescriptorSet = device.allocateDescriptorSets(allocInfo)[0];
+
+        std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets =
+        {
+            // Binding 0 : Clusters
+            vkx::writeDescriptorSet(
+                computeDescriptorSet,
+                vk::DescriptorType::eStorageBuffer,
+                0,
+                &storageBuffers.clusters.descriptor),
+            // Binding 1 : Draw commands
+            vkx::writeDescriptorSet(
+                computeDescriptorSet,
+                vk::DescriptorType::eStorageBuffer,
+                1,
+                &storageBuffers.commands.descriptor),
+            // Binding 2 : Counters
+            vkx::writeDescriptorSet(
+                computeDescriptorSet,
+                vk::DescriptorType::eStorageBuffer,
+                2,
+                &storageBuffers.counters.descriptor),
+            // Binding 3 : Culling parameters
+            vkx::writeDescriptorSet(
+                computeDescriptorSet,
+                vk::DescriptorType::eUniformBuffer,
+                3,
+                &uniformData.cull.descriptor),
+        };
+
+        device.updateDescriptorSets(computeWriteDescriptorSets.size(), computeWriteDescriptorSets.data(), 0, NULL);
+
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo =
+            vkx::computePipelineCreateInfo(computePipelineLayout);
+        computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/computecull/cull.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        pipelines.cull = createComputePipeline(computePipelineCreateInfo);
+    }
+
+    void prepareUniformBuffers() {
+        uniformData.vsScene = createUniformBuffer(uboVS);
+        uniformData.cull = stageToDeviceBuffer(vk::BufferUsageFlagBits::eUniformBuffer, uboCull);
+        updateUniformBuffers();
+    }
+
+    void updateUniformBuffers() {
+        uboVS.projection = getProjection();
+        uboVS.model = getView();
+        uniformData.vsScene.copy(uboVS);
+    }
+
+    // Culling happens in the mesh's object space, a frozen culling camera keeps the last planes and position
+    void updateCullUniforms() {
+        if (!frozen) {
+            vkTools::Frustum frustum;
+            frustum.update(uboVS.projection * uboVS.model);
+            std::copy(frustum.planes.begin(), frustum.planes.end(), uboCull.frustumPlanes);
+            uboCull.cameraPos = glm::inverse(uboVS.model)[3];
+        }
+        uboCull.cullFlags = cullingEnabled ? (CULL_FRUSTUM | CULL_BACKFACE) : 0;
+        updateQueue.update(uniformData.cull.buffer, 0, sizeof(uboCull), &uboCull);
+    }
+
+    void prepare() {
+        ExampleBase::prepare();
+        loadMeshes();
+        setupVertexDescriptions();
+        prepareStorageBuffers();
+        prepareUniformBuffers();
+        setupDescriptorSetLayout();
+        preparePipelines();
+        setupDescriptorPool();
+        setupDescriptorSet();
+        prepareCompute();
+        updateDrawCommandBuffers();
+        prepared = true;
+    }
+
+    virtual void render() {
+        if (!prepared) {
+            return;
+        }
+        updateCullUniforms();
+        draw();
+    }
+
+    virtual void viewChanged() {
+        updateUniformBuffers();
+    }
+
+    void keyPressed(uint32_t key) override {
+        switch (key) {
+        case GLFW_KEY_C:
+            cullingEnabled = !cullingEnabled;
+            updateTextOverlay();
+            break;
+        case GLFW_KEY_F:
+            frozen = !frozen;
+            updateTextOverlay();
+            break;
+        }
+    }
+
+    void getOverlayText(vkx::TextOverlay *textOverlay) override {
+        std::stringstream ss;
+        ss << "Culling " << (cullingEnabled ? "on" : "off") << " (C)" << (frozen ? ", frozen (F)" : "") << ": "
+            << visibleClusters << " / " << uboCull.clusterCount << " clusters, "
+            << visibleTriangles << " / " << meshes.object.indexCount / 3 << " triangles";
+        textOverlay->addText(ss.str(), 5.0f, 85.0f, vkx::TextOverlay::alignLeft);
+    }
+};
+
+RUN_EXAMPLE(VulkanExample)
@@ -85,8 +85,7 @@ public:
 
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
-        device.destroyBuffer(computeStorageBuffer.buffer);
-        device.freeMemory(computeStorageBuffer.memory);
+        computeStorageBuffer.destroy();
 
         uniformData.computeShader.ubo.destroy();
 
@@ -304,7 +303,7 @@ public:
         blendAttachmentState.srcAlphaBlendFactor = vk::BlendFactor::eSrcAlpha;
         blendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eDstAlpha;
 
-        pipelines.postCompute = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.postCompute = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void prepareCompute() {
@@ -367,7 +366,7 @@ public:
         computePipelineCreateInfo.stage = loadGlslShader(getAssetPath() + "shaders/computeparticles/particle.comp", vk::ShaderStageFlagBits::eCompute);
         vkx::shader::finalizeGlsl();
 
-        pipelines.compute = device.createComputePipelines(pipelineCache, computePipelineCreateInfo, nullptr)[0];
+        pipelines.compute = createComputePipeline(computePipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -392,23 +391,11 @@ public:
         memcpy(uniformData.computeShader.ubo.mapped, &computeUbo, sizeof(computeUbo));
     }
 
-    // Find and create a compute capable device queue
+    // The compute work is recorded from the graphics command pool and shares its buffers with rendering
+    // without ownership transfers, so it goes to the graphics queue.  See computeparticlesasync for the
+    // context's dedicated compute queue.
     void getComputeQueue() {
-        uint32_t queueIndex = 0;
-        std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
-        uint32_t queueCount = queueProps.size();
-
-
-        for (queueIndex = 0; queueIndex < queueCount; queueIndex++) {
-            if (queueProps[queueIndex].queueFlags & vk::QueueFlagBits::eCompute)
-                break;
-        }
-        assert(queueIndex < queueCount);
-
-        vk::DeviceQueueCreateInfo queueCreateInfo;
-        queueCreateInfo.queueFamilyIndex = queueIndex;
-        queueCreateInfo.queueCount = 1;
-        computeQueue = device.getQueue(queueIndex, 0);
+        computeQueue = queue;
     }
 
     void prepare() {
@@ -17,6 +17,9 @@
 #define PARTICLE_COUNT 256 * 1024
 #endif
 
+// Number of frames whose timestamps are kept, queries are read back TIMING_FRAMES - 1 frames later
+#define TIMING_FRAMES 4
+
 class VulkanExample : public vkx::ExampleBase {
 public:
     float timer = 0.0f;
@@ -41,9 +44,27 @@ public:
         vk::Pipeline compute;
     } pipelines;
 
-    vk::Queue computeQueue;
-    vk::CommandBuffer computeCmdBuffer, transferCmdBuffer;
-    vk::Fence computeResultFence;
+    // The simulation of frame N runs on the compute queue while frame N renders the result of frame N - 1.
+    // The copy of the result into the vertex buffer is the only point where the two queues meet.
+    vk::CommandPool computeCmdPool;
+    std::array<vk::CommandBuffer, TIMING_FRAMES> computeCmdBuffers;
+    vk::CommandBuffer transferCmdBuffer;
+    // Signalled when the simulation step of the last submit is done, so the uniform buffer can be rewritten
+    vk::Fence computeFence;
+    vk::Semaphore computeComplete, copyComplete;
+    uint32_t computeFrame{ 0 };
+
+    // Per frame: compute begin / end, graphics begin / end
+    vk::QueryPool timingQueryPool;
+    struct {
+        float compute{ 0.0f };
+        float graphics{ 0.0f };
+        float overlap{ 0.0f };
+        // Totals over the whole run
+        double overlapSum{ 0.0 };
+        double computeSum{ 0.0 };
+        uint32_t samples{ 0 };
+    } timings;
 
     vk::PipelineLayout computePipelineLayout;
     vk::DescriptorSet computeDescriptorSet;
@@ -74,16 +95,27 @@ public:
     vk::DescriptorSetLayout descriptorSetLayout;
 
     VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION) {
-        enableTextOverlay = false;
+        enableTextOverlay = true;
         title = "Vulkan Example - Compute shader particle system";
     }
 
     ~VulkanExample() {
         // Clean up used Vulkan resources 
         // Note : Inherited destructor cleans up resources stored in base class
-        if (computeResultFence) {
-            device.destroyFence(computeResultFence);
+        computeQueue.waitIdle();
+        queue.waitIdle();
+        if (timings.samples) {
+            std::cout << "Async compute: " << (hasDedicatedComputeQueue() ? "dedicated" : "shared") << " compute queue, "
+                << timings.computeSum / timings.samples << " ms compute per frame, "
+                << timings.overlapSum / timings.samples << " ms of it overlapping with rendering" << std::endl;
+        }
+        if (timingQueryPool) {
+            device.destroyQueryPool(timingQueryPool);
         }
+        device.destroyFence(computeFence);
+        device.destroySemaphore(computeComplete);
+        device.destroySemaphore(copyComplete);
+        device.destroyCommandPool(computeCmdPool);
 
         device.destroyPipeline(pipelines.postCompute);
 
@@ -105,39 +137,116 @@ public:
         textures.gradient = textureLoader->loadTexture(getAssetPath() + "textures/particle_gradient_rgba.ktx",  vk::Format::eR8G8B8A8Unorm);
     }
 
-    void updateComputeCommandBuffers() {
-
-        vk::CommandBufferBeginInfo beginInfo;
-        computeCmdBuffer.begin(beginInfo);
-        // Compute particle movement
-        computeCmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.compute);
-        computeCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computePipelineLayout, 0, computeDescriptorSet, nullptr);
-        // Dispatch the compute job
-        computeCmdBuffer.dispatch(PARTICLE_COUNT / 16, 1, 1);
-        computeCmdBuffer.end();
+    // Ownership of the simulation buffer moving from the compute queue to the copy on the graphics queue
+    BufferTransfer computeToGraphics() const {
+        BufferTransfer transfer;
+        transfer.buffer = computeStorageBuffer.buffer;
+        transfer.srcQueueFamily = computeQueueIndex;
+        transfer.dstQueueFamily = graphicsQueueIndex;
+        transfer.srcAccess = vk::AccessFlagBits::eShaderWrite;
+        transfer.srcStage = vk::PipelineStageFlagBits::eComputeShader;
+        transfer.dstAccess = vk::AccessFlagBits::eTransferRead;
+        transfer.dstStage = vk::PipelineStageFlagBits::eTransfer;
+        return transfer;
+    }
 
+    // And back once the copy has read it
+    BufferTransfer graphicsToCompute() const {
+        BufferTransfer transfer;
+        transfer.buffer = computeStorageBuffer.buffer;
+        transfer.srcQueueFamily = graphicsQueueIndex;
+        transfer.dstQueueFamily = computeQueueIndex;
+        transfer.srcAccess = vk::AccessFlagBits::eTransferRead;
+        transfer.srcStage = vk::PipelineStageFlagBits::eTransfer;
+        transfer.dstAccess = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite;
+        transfer.dstStage = vk::PipelineStageFlagBits::eComputeShader;
+        return transfer;
+    }
 
+    void updateComputeCommandBuffers() {
+        vk::CommandBufferBeginInfo beginInfo;
+        for (uint32_t i = 0; i < TIMING_FRAMES; ++i) {
+            const auto& computeCmdBuffer = computeCmdBuffers[i];
+            computeCmdBuffer.begin(beginInfo);
+            acquireBuffers(computeCmdBuffer, graphicsToCompute());
+            if (timingQueryPool) {
+                computeCmdBuffer.resetQueryPool(timingQueryPool, i * 4, 2);
+                computeCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timingQueryPool, i * 4);
+            }
+            // Compute particle movement
+            computeCmdBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelines.compute);
+            computeCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, computePipelineLayout, 0, computeDescriptorSet, nullptr);
+            // Dispatch the compute job
+            computeCmdBuffer.dispatch(PARTICLE_COUNT / 16, 1, 1);
+            if (timingQueryPool) {
+                computeCmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timingQueryPool, i * 4 + 1);
+            }
+            releaseBuffers(computeCmdBuffer, computeToGraphics());
+            computeCmdBuffer.end();
+        }
 
-        vk::BufferMemoryBarrier computeBarrier, drawBarrier;
-        computeBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead;
-        computeBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
-        computeBarrier.buffer = computeStorageBuffer.buffer;
-        computeBarrier.size = computeStorageBuffer.descriptor.range;
+        // The copy of frame N is still pending while the one of frame N + 1 is submitted
+        beginInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
+        transferCmdBuffer.begin(beginInfo);
+        acquireBuffers(transferCmdBuffer, computeToGraphics());
+        // The vertex buffer is overwritten once the frame submitted before has drawn it
+        vk::BufferMemoryBarrier drawBarrier;
         drawBarrier.srcAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
         drawBarrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        drawBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        drawBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
         drawBarrier.buffer = drawStorageBuffer.buffer;
-        drawBarrier.size = computeStorageBuffer.descriptor.range;
-        transferCmdBuffer.begin(beginInfo);
-        transferCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, { computeBarrier, drawBarrier }, nullptr);
+        drawBarrier.size = VK_WHOLE_SIZE;
+        transferCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eTransfer, vk::DependencyFlags(), nullptr, drawBarrier, nullptr);
         transferCmdBuffer.copyBuffer(computeStorageBuffer.buffer, drawStorageBuffer.buffer, vk::BufferCopy(0, 0, computeStorageBuffer.size));
-
-        computeBarrier.srcAccessMask = vk::AccessFlagBits::eTransferRead;
-        computeBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eShaderRead;
         drawBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
         drawBarrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead;
-        transferCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTopOfPipe, vk::DependencyFlags(), nullptr, { computeBarrier, drawBarrier }, nullptr);
+        transferCmdBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput, vk::DependencyFlags(), nullptr, drawBarrier, nullptr);
+        releaseBuffers(transferCmdBuffer, graphicsToCompute());
         transferCmdBuffer.end();
+    }
+
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        if (timingQueryPool) {
+            uint32_t query = (computeFrame % TIMING_FRAMES) * 4 + 2;
+            cmdBuffer.resetQueryPool(timingQueryPool, query, 2);
+            cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, timingQueryPool, query);
+        }
+    }
+
+    void finishPrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        if (timingQueryPool) {
+            cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, timingQueryPool, (computeFrame % TIMING_FRAMES) * 4 + 3);
+        }
+    }
 
+    // Reads the oldest timing frame without waiting, all of its work has completed by the time the
+    // frame slots and the compute fence have come around
+    void readTimings() {
+        if (!timingQueryPool || computeFrame < TIMING_FRAMES) {
+            return;
+        }
+        uint32_t timingFrame = (computeFrame + 1) % TIMING_FRAMES;
+        std::array<uint64_t, 8> results;
+        vk::ArrayProxy<uint64_t> proxy{ results };
+        device.getQueryPoolResults(timingQueryPool, timingFrame * 4, 4, proxy, 2 * sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability);
+        for (uint32_t i = 0; i < 4; ++i) {
+            if (!results[i * 2 + 1]) {
+                return;
+            }
+        }
+        // Timestamps of all queues share the device time domain
+        double period = deviceProperties.limits.timestampPeriod / 1e6;
+        uint64_t computeBegin = results[0], computeEnd = results[2];
+        uint64_t graphicsBegin = results[4], graphicsEnd = results[6];
+        uint64_t overlapBegin = std::max(computeBegin, graphicsBegin);
+        uint64_t overlapEnd = std::min(computeEnd, graphicsEnd);
+        timings.compute = (float)((computeEnd - computeBegin) * period);
+        timings.graphics = (float)((graphicsEnd - graphicsBegin) * period);
+        timings.overlap = overlapEnd > overlapBegin ? (float)((overlapEnd - overlapBegin) * period) : 0.0f;
+        timings.overlapSum += timings.overlap;
+        timings.computeSum += timings.compute;
+        ++timings.samples;
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) {
@@ -309,7 +418,7 @@ public:
         blendAttachmentState.srcAlphaBlendFactor = vk::BlendFactor::eSrcAlpha;
         blendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eDstAlpha;
 
-        pipelines.postCompute = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.postCompute = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void prepareCompute() {
@@ -372,14 +481,44 @@ public:
         computePipelineCreateInfo.stage = loadGlslShader(getAssetPath() + "shaders/computeparticles/particle.comp", vk::ShaderStageFlagBits::eCompute);
         vkx::shader::finalizeGlsl();
 
-        pipelines.compute = device.createComputePipelines(pipelineCache, computePipelineCreateInfo, nullptr)[0];
+        pipelines.compute = createComputePipeline(computePipelineCreateInfo);
+
+        // Compute command buffers have to come from a pool of the compute queue's family
+        vk::CommandPoolCreateInfo cmdPoolInfo;
+        cmdPoolInfo.queueFamilyIndex = computeQueueIndex;
+        computeCmdPool = device.createCommandPool(cmdPoolInfo);
 
         vk::CommandBufferAllocateInfo cmdBufAllocateInfo;
+        cmdBufAllocateInfo.commandPool = computeCmdPool;
+        cmdBufAllocateInfo.commandBufferCount = TIMING_FRAMES;
+        cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
+        auto cmdBuffers = device.allocateCommandBuffers(cmdBufAllocateInfo);
+        std::copy(cmdBuffers.begin(), cmdBuffers.end(), computeCmdBuffers.begin());
         cmdBufAllocateInfo.commandPool = getCommandPool();
         cmdBufAllocateInfo.commandBufferCount = 1;
-        cmdBufAllocateInfo.level = vk::CommandBufferLevel::ePrimary;
-        computeCmdBuffer = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
         transferCmdBuffer = device.allocateCommandBuffers(cmdBufAllocateInfo)[0];
+
+        // Signalled, so the first frame doesn't wait
+        computeFence = device.createFence(vk::FenceCreateInfo(vk::FenceCreateFlagBits::eSignaled));
+        computeComplete = device.createSemaphore(vk::SemaphoreCreateInfo());
+        copyComplete = device.createSemaphore(vk::SemaphoreCreateInfo());
+
+        auto queueProps = physicalDevice.getQueueFamilyProperties();
+        if (queueProps[computeQueueIndex].timestampValidBits && queueProps[graphicsQueueIndex].timestampValidBits) {
+            vk::QueryPoolCreateInfo queryPoolInfo;
+            queryPoolInfo.queryType = vk::QueryType::eTimestamp;
+            queryPoolInfo.queryCount = TIMING_FRAMES * 4;
+            timingQueryPool = device.createQueryPool(queryPoolInfo);
+        }
+
+        // The storage buffer was uploaded on the graphics queue, hand it to the compute queue.  This also
+        // signals copyComplete, which every simulation step waits on.
+        flushUploads();
+        vk::CommandBuffer releaseCmdBuffer = createCommandBuffer(vk::CommandBufferLevel::ePrimary, true);
+        releaseBuffers(releaseCmdBuffer, graphicsToCompute());
+        releaseCmdBuffer.end();
+        submit(releaseCmdBuffer, {}, copyComplete);
+        trashCommandBuffer(releaseCmdBuffer);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -404,29 +543,9 @@ public:
         memcpy(uniformData.computeShader.ubo.mapped, &computeUbo, sizeof(computeUbo));
     }
 
-    // Find and create a compute capable device queue
-    void getComputeQueue() {
-        uint32_t queueIndex = 0;
-        std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
-        uint32_t queueCount = queueProps.size();
-
-
-        for (queueIndex = 0; queueIndex < queueCount; queueIndex++) {
-            if (queueProps[queueIndex].queueFlags & vk::QueueFlagBits::eCompute)
-                break;
-        }
-        assert(queueIndex < queueCount);
-
-        vk::DeviceQueueCreateInfo queueCreateInfo;
-        queueCreateInfo.queueFamilyIndex = queueIndex;
-        queueCreateInfo.queueCount = 1;
-        computeQueue = device.getQueue(queueIndex, 0);
-    }
-
     void prepare() {
         ExampleBase::prepare();
         loadTextures();
-        getComputeQueue();
         prepareStorageBuffers();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
@@ -439,35 +558,26 @@ public:
         prepared = true;
     }
 
-    void copyComputeResults() {
-        vk::SubmitInfo submitInfo;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &transferCmdBuffer;
-        // Submit to queue
-        queue.submit(submitInfo, vk::Fence());
-    }
-
     virtual void render() {
         if (!prepared)
             return;
 
-        // Check for compute operation results
-        if (computeResultFence && vk::Result::eSuccess == device.getFenceStatus(computeResultFence)) {
-            copyComputeResults();
-            device.destroyFence(computeResultFence);
-            computeResultFence = vk::Fence();
-        }
+        // The previous simulation step has to be done with the uniform buffer and its command buffer
+        device.waitForFences(computeFence, VK_TRUE, UINT64_MAX);
+        device.resetFences(computeFence);
+        readTimings();
+        ++computeFrame;
+        updateUniformBuffers();
 
-        if (!computeResultFence) {
-            computeResultFence = device.createFence(vk::FenceCreateInfo());
-            vk::SubmitInfo computeSubmitInfo;
-            computeSubmitInfo.pCommandBuffers = &computeCmdBuffer;
-            computeSubmitInfo.commandBufferCount = 1;
-            computeQueue.submit(computeSubmitInfo, computeResultFence);
-        }
+        // Simulate on the compute queue once the previous copy has read the storage buffer...
+        submit(computeQueue, computeCmdBuffers[computeFrame % TIMING_FRAMES], { { copyComplete, vk::PipelineStageFlagBits::eComputeShader } }, computeComplete, computeFence);
 
+        // ...while the graphics queue draws the previous result
         draw();
 
+        // Then copy the new result into the vertex buffer for the next frame
+        submit(queue, transferCmdBuffer, { { computeComplete, vk::PipelineStageFlagBits::eTransfer } }, copyComplete);
+
         if (animate) {
             if (animStart > 0.0f) {
                 animStart -= frameTimer * 5.0f;
@@ -477,8 +587,15 @@ public:
                     timer = 0.f;
             }
         }
+    }
 
-        updateUniformBuffers();
+    void getOverlayText(vkx::TextOverlay *textOverlay) override {
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(2) << (hasDedicatedComputeQueue() ? "Dedicated" : "Shared") << " compute queue";
+        if (timingQueryPool) {
+            ss << ": compute " << timings.compute << "ms, graphics " << timings.graphics << "ms, overlap " << timings.overlap << "ms";
+        }
+        textOverlay->addText(ss.str(), 5.0f, 65.0f, vkx::TextOverlay::alignLeft);
     }
 
     void toggleAnimation() {
@@ -406,7 +406,7 @@ public:
         pipelineCreateInfo.pStages = shaderStages.data();
         pipelineCreateInfo.renderPass = renderPass;
 
-        pipelines.postCompute = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.postCompute = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void prepareCompute() {
@@ -484,7 +484,7 @@ public:
             std::string fileName = getAssetPath() + "shaders/computeshader/" + shaderName + ".comp.spv";
             computePipelineCreateInfo.stage = loadShader(fileName.c_str(), vk::ShaderStageFlagBits::eCompute);
             vk::Pipeline pipeline;
-            pipeline = device.createComputePipelines(pipelineCache, computePipelineCreateInfo, nullptr)[0];
+            pipeline = createComputePipeline(computePipelineCreateInfo);
 
             pipelines.compute.push_back(pipeline);
         }
@@ -505,22 +505,11 @@ public:
         uniformDataVS.copy(uboVS);
     }
 
-    // Find and create a compute capable device queue
+    // The compute work is recorded from the graphics command pool and shares its buffers with rendering
+    // without ownership transfers, so it goes to the graphics queue.  See computeparticlesasync for the
+    // context's dedicated compute queue.
     void getComputeQueue() {
-        uint32_t queueIndex = 0;
-        std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
-        uint32_t queueCount = queueProps.size();
-
-        for (queueIndex = 0; queueIndex < queueCount; queueIndex++) {
-            if (queueProps[queueIndex].queueFlags & vk::QueueFlagBits::eCompute)
-                break;
-        }
-        assert(queueIndex < queueCount);
-
-        vk::DeviceQueueCreateInfo queueCreateInfo;
-        queueCreateInfo.queueFamilyIndex = queueIndex;
-        queueCreateInfo.queueCount = 1;
-        computeQueue = device.getQueue(queueIndex, 0);
+        computeQueue = queue;
     }
 
     void compute() {
@@ -354,7 +354,7 @@ public:
         pipelineCreateInfo.pStages = shaderStages.data();
         pipelineCreateInfo.renderPass = renderPass;
 
-        pipelines.display = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.display = createGraphicsPipeline(pipelineCreateInfo);
 
     }
 
@@ -423,7 +423,7 @@ public:
             vkx::computePipelineCreateInfo(computePipelineLayout);
 
         computePipelineCreateInfo.stage = loadShader(getAssetPath() + "shaders/raytracing/raytracing.comp.spv", vk::ShaderStageFlagBits::eCompute);
-        pipelines.compute = device.createComputePipelines(pipelineCache, computePipelineCreateInfo, nullptr)[0];
+        pipelines.compute = createComputePipeline(computePipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -441,23 +441,11 @@ public:
         uniformDataCompute.copy(uboCompute);
     }
 
-    // Find and create a compute capable device queue
+    // The compute work is recorded from the graphics command pool and shares its buffers with rendering
+    // without ownership transfers, so it goes to the graphics queue.  See computeparticlesasync for the
+    // context's dedicated compute queue.
     void getComputeQueue() {
-        uint32_t queueIndex = 0;
-
-        std::vector<vk::QueueFamilyProperties> queueProps = physicalDevice.getQueueFamilyProperties();
-        uint32_t queueCount = queueProps.size();
-
-        for (queueIndex = 0; queueIndex < queueCount; queueIndex++) {
-            if (queueProps[queueIndex].queueFlags & vk::QueueFlagBits::eCompute)
-                break;
-        }
-        assert(queueIndex < queueCount);
-
-        vk::DeviceQueueCreateInfo queueCreateInfo;
-        queueCreateInfo.queueFamilyIndex = queueIndex;
-        queueCreateInfo.queueCount = 1;
-        computeQueue = device.getQueue(queueIndex, 0);
+        computeQueue = queue;
     }
 
     void prepare() {
@@ -37,12 +37,20 @@ public:
         glm::mat4 viewMatrix;
     } uboVS;
 
+    // Update queue benchmark (-updates <count>): scatters count small updates per frame over a device local
+    // buffer with twice as many slots, so roughly half of them end up adjacent to another one
+    uint32_t benchmarkUpdateCount{ 0 };
+    CreateBufferResult benchmarkTarget;
+
     // As before
     VulkanExample() : Parent(ENABLE_VALIDATION) {
         size.width = 1280;
         size.height = 720;
         camera.setZoom(-2.5f);
         title = "Vulkan Example - Basic indexed triangle";
+        benchmarkUpdateCount = (uint32_t)std::max(0, atoi(vkx::getCommandLineOption("-updates", "0").c_str()));
+        // 16 bytes per update, padding the merged ranges to 16 bytes at most doubles that
+        frameUpdateStagingSize += benchmarkUpdateCount * 2 * sizeof(glm::vec4);
     }
 
     // As before
@@ -50,6 +58,7 @@ public:
         vertices.destroy();
         indices.destroy();
         uniformDataVS.destroy();
+        benchmarkTarget.destroy();
 
         device.destroyPipeline(pipeline);
         device.destroyPipelineLayout(pipelineLayout);
@@ -67,7 +76,18 @@ public:
         uboVS.viewMatrix = glm::translate(glm::mat4(), camera.position);
         camera.yawPitch.x += frameTimer * 1.0f;
         uboVS.modelMatrix = glm::mat4_cast(camera.orientation);
-        pendingUpdates.push_back(UpdateOperation(uniformDataVS.buffer, uboVS));
+        // Copied into the uniform buffer at the start of the next frame
+        updateQueue.update(uniformDataVS.buffer, uboVS);
+
+        if (benchmarkUpdateCount) {
+            // 7919 is prime, so unless it divides the slot count every update of a frame hits a different slot
+            const uint32_t slotCount = benchmarkUpdateCount * 2;
+            for (uint32_t i = 0; i < benchmarkUpdateCount; ++i) {
+                uint32_t slot = (uint32_t)(((uint64_t)i * 7919 + (uint64_t)frameCounter * 104729) % slotCount);
+                glm::vec4 value((float)i, (float)frameCounter, (float)slot, 1.0f);
+                updateQueue.update(benchmarkTarget.buffer, value, slot * sizeof(glm::vec4));
+            }
+        }
     }
 
     ////////////////////////////////////////
@@ -76,6 +96,7 @@ public:
     //
     void prepare() {
         ExampleBase::prepare();
+        prepareBenchmarkTarget();
         prepareVertices();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
@@ -96,6 +117,12 @@ public:
         cmdBuffer.drawIndexed(indexCount, 1, 0, 0, 1);
     }
 
+    void prepareBenchmarkTarget() {
+        if (benchmarkUpdateCount) {
+            benchmarkTarget = createBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, benchmarkUpdateCount * 2 * sizeof(glm::vec4));
+        }
+    }
+
     void prepareVertices() {
         struct Vertex {
             float pos[3];
@@ -320,7 +347,7 @@ public:
         pipelineCreateInfo.pDynamicState = &dynamicState;
 
         // Create rendering pipeline
-        pipeline = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipeline = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void prepareUniformBuffers() {
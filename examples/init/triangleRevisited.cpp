@@ -324,7 +324,7 @@ public:
         pipelineCreateInfo.pDynamicState = &dynamicState;
 
         // Create rendering pipeline
-        pipeline = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipeline = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     void setupDescriptorPool() {
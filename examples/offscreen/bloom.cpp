@@ -6,15 +6,11 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
-#include "vulkanOffscreenExampleBase.hpp"
+#include "vulkanExampleBase.h"
 
 // Texture properties
 #define TEX_DIM 256
 
-// Offscreen frame buffer properties
-#define FB_DIM TEX_DIM
-#define FB_COLOR_FORMAT TEX_FORMAT
-
 // Vertex layout for this example
 vkx::MeshLayout vertexLayout =
 {
@@ -24,8 +20,8 @@ vkx::MeshLayout vertexLayout =
     vkx::VertexLayout::VERTEX_LAYOUT_NORMAL
 };
 
-class VulkanExample : public vkx::OffscreenExampleBase {
-    using Parent = OffscreenExampleBase;
+class VulkanExample : public vkx::ExampleBase {
+    using Parent = ExampleBase;
 public:
     bool bloom = true;
 
@@ -74,6 +70,8 @@ public:
 
     struct {
         vk::Pipeline blur;
+        // Vertical blur into the graph's depth-less pass
+        vk::Pipeline blurOffscreen;
         vk::Pipeline colorPass;
         vk::Pipeline phongPass;
         vk::Pipeline skyBox;
@@ -95,7 +93,16 @@ public:
     // all descriptor sets
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    VulkanExample() : vkx::OffscreenExampleBase(ENABLE_VALIDATION) {
+    // Glow geometry, its vertical blur and the depth buffer of the glow pass
+    vkx::RenderGraph graph{ *this };
+    struct {
+        vkx::RenderGraph::Resource glow;
+        vkx::RenderGraph::Resource glowDepth;
+        vkx::RenderGraph::Resource blurred;
+    } graphImages;
+    uint32_t verticalBlurPass;
+
+    VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION) {
         camera.setZoom(-10.25f);
         camera.setRotation({ 7.5f, -343.0f, 0.0f });
         timerSpeed *= 0.5f;
@@ -107,7 +114,10 @@ public:
         // Clean up used Vulkan resources 
         // Note : Inherited destructor cleans up resources stored in base class
 
+        graph.destroy();
+
         device.destroyPipeline(pipelines.blur);
+        device.destroyPipeline(pipelines.blurOffscreen);
         device.destroyPipeline(pipelines.phongPass);
         device.destroyPipeline(pipelines.colorPass);
         device.destroyPipeline(pipelines.skyBox);
@@ -133,63 +143,50 @@ public:
     }
 
 
-    // Render the 3D scene into a texture target
-    void buildOffscreenCommandBuffer() override {
-        vk::Viewport viewport = vkx::viewport(offscreen.size);
-        vk::Rect2D scissor = vkx::rect2D(offscreen.size);
-        vk::DeviceSize offset = 0;
-
-        // Horizontal blur
-        vk::ClearValue clearValues[2];
-        clearValues[0].color = vkx::clearColor({ 0.0f, 0.0f, 0.0f, 1.0f });
-        clearValues[1].depthStencil = { 1.0f, 0 };
-
-
-        offscreen.cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
-        vk::CommandBufferBeginInfo cmdBufInfo;
-        cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
-        offscreen.cmdBuffer.begin(cmdBufInfo);
-
-        // Draw the unblurred geometry to framebuffer 1
-        offscreen.cmdBuffer.setViewport(0, viewport);
-        offscreen.cmdBuffer.setScissor(0, scissor);
-
-        // Draw the bloom geometry.
-        {
-            vk::RenderPassBeginInfo renderPassBeginInfo;
-            renderPassBeginInfo.renderPass = offscreen.renderPass;
-            renderPassBeginInfo.framebuffer = offscreen.framebuffers[0].framebuffer;
-            renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-            renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
-            renderPassBeginInfo.clearValueCount = 2;
-            renderPassBeginInfo.pClearValues = clearValues;
-            offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-            offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
-            offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phongPass);
-            offscreen.cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.ufoGlow.vertices.buffer, offset);
-            offscreen.cmdBuffer.bindIndexBuffer(meshes.ufoGlow.indices.buffer, 0, vk::IndexType::eUint32);
-            offscreen.cmdBuffer.drawIndexed(meshes.ufoGlow.indexCount, 1, 0, 0, 0);
-            offscreen.cmdBuffer.endRenderPass();
+    // The glow parts of the model are rendered to a texture and blurred vertically, the horizontal
+    // blur is blended onto the scene in the main render pass
+    void prepareRenderGraph() {
+        const glm::uvec2 dim(TEX_DIM);
+        graphImages.glow = graph.createImage("Glow", dim, colorformat);
+        graphImages.glowDepth = graph.createImage("Glow depth", dim, depthFormat);
+        graphImages.blurred = graph.createImage("Vertical blur", dim, colorformat);
+
+        graph.addPass("Glow", [&](vkx::RenderGraph::PassBuilder& builder) {
+            builder.writeColor(graphImages.glow, { { 0.0f, 0.0f, 0.0f, 1.0f } });
+            builder.writeDepth(graphImages.glowDepth);
+        }, [&](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.scene, 0, descriptorSets.scene, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.phongPass);
+            cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.ufoGlow.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.ufoGlow.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(meshes.ufoGlow.indexCount, 1, 0, 0, 0);
+        });
+
+        verticalBlurPass = graph.addPass("Vertical blur", [&](vkx::RenderGraph::PassBuilder& builder) {
+            builder.readTexture(graphImages.glow);
+            builder.writeColor(graphImages.blurred, { { 0.0f, 0.0f, 0.0f, 1.0f } });
+        }, [&](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.verticalBlur, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blurOffscreen);
+            cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.quad.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 0);
+        });
+
+        // Without bloom nothing samples the blur, so both passes are culled
+        graph.setExported(graphImages.blurred, bloom);
+        graph.compile();
+        if (vkx::statsEnabled()) {
+            const auto& stats = graph.getStats();
+            std::cout << "Render graph: " << stats.passCount - stats.culledPassCount << " of " << stats.passCount << " passes, "
+                << stats.imageCount << " images, " << stats.unaliasedBytes / 1024 << " KiB unaliased, " << stats.aliasedBytes / 1024
+                << " KiB in " << stats.memoryBlockCount << " memory blocks, " << stats.barrierCount << " barriers ("
+                << stats.imageBarrierCount << " image barriers) per frame" << std::endl;
         }
+    }
 
-        {
-            vk::RenderPassBeginInfo renderPassBeginInfo;
-            renderPassBeginInfo.renderPass = offscreen.renderPass;
-            renderPassBeginInfo.framebuffer = offscreen.framebuffers[1].framebuffer;
-            renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-            renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
-            renderPassBeginInfo.clearValueCount = 2;
-            renderPassBeginInfo.pClearValues = clearValues;
-            // Draw a vertical blur pass from framebuffer 1's texture into framebuffer 2
-            offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-            offscreen.cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.verticalBlur, nullptr);
-            offscreen.cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blur);
-            offscreen.cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.quad.vertices.buffer, offset);
-            offscreen.cmdBuffer.bindIndexBuffer(meshes.quad.indices.buffer, 0, vk::IndexType::eUint32);
-            offscreen.cmdBuffer.drawIndexed(meshes.quad.indexCount, 1, 0, 0, 0);
-            offscreen.cmdBuffer.endRenderPass();
-        }
-        offscreen.cmdBuffer.end();
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        graph.execute(cmdBuffer, gpuProfiler.get());
     }
 
     void loadTextures() {
@@ -219,13 +216,6 @@ public:
 
         // Render vertical blurred scene applying a horizontal blur
         if (bloom) {
-            vkx::setImageLayout(
-                cmdBuffer,
-                offscreen.framebuffers[1].colors[0].image,
-                vk::ImageAspectFlagBits::eColor,
-                vk::ImageLayout::eColorAttachmentOptimal,
-                vk::ImageLayout::eShaderReadOnlyOptimal);
-
             cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.radialBlur, 0, descriptorSets.horizontalBlur, nullptr);
             cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.blur);
             cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.quad.vertices.buffer, offset);
@@ -349,102 +339,107 @@ public:
             vkx::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayout, 1);
 
         // Full screen blur descriptor sets
-        // Vertical blur
         descriptorSets.verticalBlur = device.allocateDescriptorSets(allocInfo)[0];
+        descriptorSets.horizontalBlur = device.allocateDescriptorSets(allocInfo)[0];
+        updateBlurDescriptorSets();
 
-        vk::DescriptorImageInfo texDescriptorVert =
-            vkx::descriptorImageInfo(offscreen.framebuffers[0].colors[0].sampler, offscreen.framebuffers[0].colors[0].view, vk::ImageLayout::eShaderReadOnlyOptimal);
+        // 3D scene
+        descriptorSets.scene = device.allocateDescriptorSets(allocInfo)[0];
 
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets =
         {
             // Binding 0 : Vertex shader uniform buffer
             vkx::writeDescriptorSet(
-                descriptorSets.verticalBlur,
+                descriptorSets.scene,
                 vk::DescriptorType::eUniformBuffer,
                 0,
-                &uniformData.vsScene.descriptor),
-            // Binding 1 : Fragment shader texture sampler
-            vkx::writeDescriptorSet(
-                descriptorSets.verticalBlur,
-                vk::DescriptorType::eCombinedImageSampler,
-                1,
-                &texDescriptorVert),
-            // Binding 2 : Fragment shader uniform buffer
-            vkx::writeDescriptorSet(
-                descriptorSets.verticalBlur,
-                vk::DescriptorType::eUniformBuffer,
-                2,
-                &uniformData.fsVertBlur.descriptor)
+                &uniformData.vsFullScreen.descriptor)
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
 
-        // Horizontal blur
-        descriptorSets.horizontalBlur = device.allocateDescriptorSets(allocInfo)[0];
+        // Skybox
+        descriptorSets.skyBox = device.allocateDescriptorSets(allocInfo)[0];
 
-        vk::DescriptorImageInfo texDescriptorHorz =
-            vkx::descriptorImageInfo(offscreen.framebuffers[1].colors[0].sampler, offscreen.framebuffers[1].colors[0].view, vk::ImageLayout::eGeneral);
+        // vk::Image descriptor for the cube map texture
+        vk::DescriptorImageInfo cubeMapDescriptor =
+            vkx::descriptorImageInfo(textures.cubemap.sampler, textures.cubemap.view, vk::ImageLayout::eGeneral);
 
         writeDescriptorSets =
         {
             // Binding 0 : Vertex shader uniform buffer
             vkx::writeDescriptorSet(
-                descriptorSets.horizontalBlur,
+                descriptorSets.skyBox,
                 vk::DescriptorType::eUniformBuffer,
                 0,
-                &uniformData.vsScene.descriptor),
+                &uniformData.vsSkyBox.descriptor),
             // Binding 1 : Fragment shader texture sampler
             vkx::writeDescriptorSet(
-                descriptorSets.horizontalBlur,
+                descriptorSets.skyBox,
                 vk::DescriptorType::eCombinedImageSampler,
                 1,
-                &texDescriptorHorz),
-            // Binding 2 : Fragment shader uniform buffer
-            vkx::writeDescriptorSet(
-                descriptorSets.horizontalBlur,
-                vk::DescriptorType::eUniformBuffer,
-                2,
-                &uniformData.fsHorzBlur.descriptor)
+                &cubeMapDescriptor),
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
 
-        // 3D scene
-        descriptorSets.scene = device.allocateDescriptorSets(allocInfo)[0];
+    // The graph images are recreated when it is compiled, so the blur sets are rewritten afterwards
+    void updateBlurDescriptorSets() {
+        if (!bloom) {
+            return;
+        }
 
-        writeDescriptorSets =
+        // Vertical blur
+        vk::DescriptorImageInfo texDescriptorVert = graph.getDescriptor(graphImages.glow);
+
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets =
         {
             // Binding 0 : Vertex shader uniform buffer
             vkx::writeDescriptorSet(
-                descriptorSets.scene,
+                descriptorSets.verticalBlur,
                 vk::DescriptorType::eUniformBuffer,
                 0,
-                &uniformData.vsFullScreen.descriptor)
+                &uniformData.vsScene.descriptor),
+            // Binding 1 : Fragment shader texture sampler
+            vkx::writeDescriptorSet(
+                descriptorSets.verticalBlur,
+                vk::DescriptorType::eCombinedImageSampler,
+                1,
+                &texDescriptorVert),
+            // Binding 2 : Fragment shader uniform buffer
+            vkx::writeDescriptorSet(
+                descriptorSets.verticalBlur,
+                vk::DescriptorType::eUniformBuffer,
+                2,
+                &uniformData.fsVertBlur.descriptor)
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
 
-        // Skybox
-        descriptorSets.skyBox = device.allocateDescriptorSets(allocInfo)[0];
-
-        // vk::Image descriptor for the cube map texture
-        vk::DescriptorImageInfo cubeMapDescriptor =
-            vkx::descriptorImageInfo(textures.cubemap.sampler, textures.cubemap.view, vk::ImageLayout::eGeneral);
+        // Horizontal blur
+        vk::DescriptorImageInfo texDescriptorHorz = graph.getDescriptor(graphImages.blurred);
 
         writeDescriptorSets =
         {
             // Binding 0 : Vertex shader uniform buffer
             vkx::writeDescriptorSet(
-                descriptorSets.skyBox,
+                descriptorSets.horizontalBlur,
                 vk::DescriptorType::eUniformBuffer,
                 0,
-                &uniformData.vsSkyBox.descriptor),
+                &uniformData.vsScene.descriptor),
             // Binding 1 : Fragment shader texture sampler
             vkx::writeDescriptorSet(
-                descriptorSets.skyBox,
+                descriptorSets.horizontalBlur,
                 vk::DescriptorType::eCombinedImageSampler,
                 1,
-                &cubeMapDescriptor),
+                &texDescriptorHorz),
+            // Binding 2 : Fragment shader uniform buffer
+            vkx::writeDescriptorSet(
+                descriptorSets.horizontalBlur,
+                vk::DescriptorType::eUniformBuffer,
+                2,
+                &uniformData.fsHorzBlur.descriptor)
         };
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
@@ -509,7 +504,16 @@ public:
         blendAttachmentState.srcAlphaBlendFactor = vk::BlendFactor::eSrcAlpha;
         blendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eDstAlpha;
 
-        pipelines.blur = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.blur = createGraphicsPipeline(pipelineCreateInfo);
+
+        // The vertical blur writes the graph's blur target, which has no depth attachment
+        pipelineCreateInfo.renderPass = graph.getRenderPass(verticalBlurPass);
+        blendAttachmentState.blendEnable = VK_FALSE;
+        depthStencilState.depthTestEnable = VK_FALSE;
+        depthStencilState.depthWriteEnable = VK_FALSE;
+        pipelines.blurOffscreen = createGraphicsPipeline(pipelineCreateInfo);
+        pipelineCreateInfo.renderPass = renderPass;
+        depthStencilState.depthTestEnable = VK_TRUE;
 
         // Phong pass (3D model)
         shaderStages[0] = loadShader(getAssetPath() + "shaders/bloom/phongpass.vert.spv", vk::ShaderStageFlagBits::eVertex);
@@ -519,19 +523,19 @@ public:
         blendAttachmentState.blendEnable = VK_FALSE;
         depthStencilState.depthWriteEnable = VK_TRUE;
 
-        pipelines.phongPass = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.phongPass = createGraphicsPipeline(pipelineCreateInfo);
 
         // Color only pass (offscreen blur base)
         shaderStages[0] = loadShader(getAssetPath() + "shaders/bloom/colorpass.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/bloom/colorpass.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
-        pipelines.colorPass = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.colorPass = createGraphicsPipeline(pipelineCreateInfo);
 
         // Skybox (cubemap
         shaderStages[0] = loadShader(getAssetPath() + "shaders/bloom/skybox.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/bloom/skybox.frag.spv", vk::ShaderStageFlagBits::eFragment);
         depthStencilState.depthWriteEnable = VK_FALSE;
-        pipelines.skyBox = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.skyBox = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -588,22 +592,7 @@ public:
         uniformData.fsHorzBlur.copy(ubos.horzBlur);
     }
 
-    void draw() override {
-        prepareFrame();
-
-        // Offscreen rendering
-        if (bloom) {
-            submit(offscreen.cmdBuffer, { { semaphores.acquireComplete, vk::PipelineStageFlagBits::eBottomOfPipe } }, offscreen.renderComplete);
-        } 
-
-        // Scene rendering
-        drawCurrentCommandBuffer(bloom ? offscreen.renderComplete : semaphores.acquireComplete);
-        submitFrame();
-    }
-
     void prepare() {
-        offscreen.framebuffers.resize(2);
-        offscreen.size = glm::uvec2(TEX_DIM);
         Parent::prepare();
         loadTextures();
         generateQuad();
@@ -611,11 +600,11 @@ public:
         setupVertexDescriptions();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
+        prepareRenderGraph();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
         updateDrawCommandBuffers();
-        buildOffscreenCommandBuffer();
         prepared = true;
     }
 
@@ -666,10 +655,12 @@ public:
 
     void toggleBloom() {
         bloom = !bloom;
+        // The blur descriptor sets are rewritten in place, so no frame slot may still be using them
+        waitForFrameSlots();
+        graph.setExported(graphImages.blurred, bloom);
+        graph.compile();
+        updateBlurDescriptorSets();
         updateDrawCommandBuffers();
-        if (bloom) {
-            buildOffscreenCommandBuffer();
-        }
     }
 };
 
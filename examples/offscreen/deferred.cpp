@@ -8,7 +8,7 @@
 
 
 
-#include "vulkanOffscreenExampleBase.hpp"
+#include "vulkanExampleBase.h"
 
 
 // Texture properties
@@ -23,8 +23,8 @@ std::vector<vkx::VertexLayout> vertexLayout =
     vkx::VertexLayout::VERTEX_LAYOUT_NORMAL
 };
 
-class VulkanExample : public vkx::OffscreenExampleBase {
-    using Parent = OffscreenExampleBase;
+class VulkanExample : public vkx::ExampleBase {
+    using Parent = ExampleBase;
 public:
     bool debugDisplay = true;
 
@@ -86,9 +86,18 @@ public:
 
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
-    vk::CommandBuffer offscreenCmdBuffer;
-    
-    VulkanExample() : vkx::OffscreenExampleBase(ENABLE_VALIDATION) {
+
+    // G-Buffer targets, sampled by the composition in the main render pass
+    vkx::RenderGraph graph{ *this };
+    struct {
+        vkx::RenderGraph::Resource position;
+        vkx::RenderGraph::Resource normal;
+        vkx::RenderGraph::Resource albedo;
+        vkx::RenderGraph::Resource depth;
+    } gBuffer;
+    uint32_t gBufferPass;
+
+    VulkanExample() : vkx::ExampleBase(ENABLE_VALIDATION) {
         
         camera.setZoom(-8.0f);
         size.width = 1024;
@@ -100,6 +109,8 @@ public:
         // Clean up used Vulkan resources 
         // Note : Inherited destructor cleans up resources stored in base class
 
+        graph.destroy();
+
         device.destroyPipeline(pipelines.deferred);
         device.destroyPipeline(pipelines.offscreen);
         device.destroyPipeline(pipelines.debug);
@@ -117,57 +128,39 @@ public:
         uniformData.vsOffscreen.destroy();
         uniformData.vsFullScreen.destroy();
         uniformData.fsLights.destroy();
-        device.freeCommandBuffers(cmdPool, offscreenCmdBuffer);
         textures.colorMap.destroy();
     }
 
 
-    // Build command buffer for rendering the scene to the offscreen frame buffer 
-    // and blitting it to the different texture targets
-    void buildOffscreenCommandBuffer() override {
-        // Create separate command buffer for offscreen 
-        // rendering
-        if (!offscreenCmdBuffer) {
-            vk::CommandBufferAllocateInfo cmd = vkx::commandBufferAllocateInfo(cmdPool, vk::CommandBufferLevel::ePrimary, 1);
-            offscreenCmdBuffer = device.allocateCommandBuffers(cmd)[0];
-        }
+    // Fill the G-Buffer in a single pass with multiple render targets
+    void prepareRenderGraph() {
+        const glm::uvec2 dim(TEX_DIM);
+        gBuffer.position = graph.createImage("Position", dim, vk::Format::eR16G16B16A16Sfloat);
+        gBuffer.normal = graph.createImage("Normal", dim, vk::Format::eR16G16B16A16Sfloat);
+        gBuffer.albedo = graph.createImage("Albedo", dim, vk::Format::eR8G8B8A8Unorm);
+        gBuffer.depth = graph.createImage("Depth", dim, depthFormat);
+
+        gBufferPass = graph.addPass("G-Buffer", [&](vkx::RenderGraph::PassBuilder& builder) {
+            builder.writeColor(gBuffer.position);
+            builder.writeColor(gBuffer.normal);
+            builder.writeColor(gBuffer.albedo);
+            builder.writeDepth(gBuffer.depth);
+        }, [&](const vk::CommandBuffer& cmdBuffer) {
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
+            cmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.example.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
+        });
+
+        graph.setExported(gBuffer.position);
+        graph.setExported(gBuffer.normal);
+        graph.setExported(gBuffer.albedo);
+        graph.compile();
+    }
 
-        vk::CommandBufferBeginInfo cmdBufInfo;
-        cmdBufInfo.flags = vk::CommandBufferUsageFlagBits::eSimultaneousUse;
-
-        // Clear values for all attachments written in the fragment sahder
-        std::array<vk::ClearValue, 4> clearValues;
-        clearValues[0].color = vkx::clearColor({ 0.0f, 0.0f, 0.0f, 0.0f });
-        clearValues[1].color = vkx::clearColor({ 0.0f, 0.0f, 0.0f, 0.0f });
-        clearValues[2].color = vkx::clearColor({ 0.0f, 0.0f, 0.0f, 0.0f });
-        clearValues[3].depthStencil = { 1.0f, 0 };
-
-        vk::RenderPassBeginInfo renderPassBeginInfo;
-        renderPassBeginInfo.renderPass = offscreen.renderPass;
-        renderPassBeginInfo.framebuffer = offscreen.framebuffers[0].framebuffer;
-        renderPassBeginInfo.renderArea.extent.width = offscreen.size.x;
-        renderPassBeginInfo.renderArea.extent.height = offscreen.size.y;
-        renderPassBeginInfo.clearValueCount = clearValues.size();
-        renderPassBeginInfo.pClearValues = clearValues.data();
-
-        offscreenCmdBuffer.begin(cmdBufInfo);
-        offscreenCmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-
-        vk::Viewport viewport = vkx::viewport(offscreen.size);
-        offscreenCmdBuffer.setViewport(0, viewport);
-
-        vk::Rect2D scissor = vkx::rect2D(offscreen.size);
-        offscreenCmdBuffer.setScissor(0, scissor);
-
-        offscreenCmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.offscreen, 0, descriptorSets.offscreen, nullptr);
-        offscreenCmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.offscreen);
-
-        vk::DeviceSize offsets = { 0 };
-        offscreenCmdBuffer.bindVertexBuffers(VERTEX_BUFFER_BIND_ID, meshes.example.vertices.buffer, { 0 });
-        offscreenCmdBuffer.bindIndexBuffer(meshes.example.indices.buffer, 0, vk::IndexType::eUint32);
-        offscreenCmdBuffer.drawIndexed(meshes.example.indexCount, 1, 0, 0, 0);
-        offscreenCmdBuffer.endRenderPass();
-        offscreenCmdBuffer.end();
+    void updatePrimaryCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        graph.execute(cmdBuffer, gpuProfiler.get());
     }
 
     void loadTextures() {
@@ -199,23 +192,6 @@ public:
         cmdBuffer.drawIndexed(6, 1, 0, 0, 1);
     }
 
-    void draw() override {
-        prepareFrame();
-        {
-            vk::SubmitInfo submitInfo;
-            submitInfo.pWaitDstStageMask = this->submitInfo.pWaitDstStageMask;
-            submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &offscreenCmdBuffer;
-            submitInfo.waitSemaphoreCount = 1;
-            submitInfo.pWaitSemaphores = &semaphores.acquireComplete;
-            submitInfo.signalSemaphoreCount = 1;
-            submitInfo.pSignalSemaphores = &offscreen.renderComplete;
-            queue.submit(submitInfo, VK_NULL_HANDLE);
-        } 
-        drawCurrentCommandBuffer(offscreen.renderComplete);
-        submitFrame();
-    }
-
     void loadMeshes() {
         meshes.example = loadMesh(getAssetPath() + "models/armor/armor.dae", vertexLayout, 1.0f);
     }
@@ -357,14 +333,9 @@ public:
         descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
 
         // vk::Image descriptor for the offscreen texture targets
-        vk::DescriptorImageInfo texDescriptorPosition =
-            vkx::descriptorImageInfo(offscreen.framebuffers[0].colors[0].sampler, offscreen.framebuffers[0].colors[0].view, vk::ImageLayout::eGeneral);
-
-        vk::DescriptorImageInfo texDescriptorNormal =
-            vkx::descriptorImageInfo(offscreen.framebuffers[0].colors[1].sampler, offscreen.framebuffers[0].colors[1].view, vk::ImageLayout::eGeneral);
-
-        vk::DescriptorImageInfo texDescriptorAlbedo =
-            vkx::descriptorImageInfo(offscreen.framebuffers[0].colors[2].sampler, offscreen.framebuffers[0].colors[2].view, vk::ImageLayout::eGeneral);
+        vk::DescriptorImageInfo texDescriptorPosition = graph.getDescriptor(gBuffer.position);
+        vk::DescriptorImageInfo texDescriptorNormal = graph.getDescriptor(gBuffer.normal);
+        vk::DescriptorImageInfo texDescriptorAlbedo = graph.getDescriptor(gBuffer.albedo);
 
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets =
         {
@@ -473,21 +444,21 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.deferred = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.deferred = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Debug display pipeline
         shaderStages[0] = loadShader(getAssetPath() + "shaders/deferred/debug.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/deferred/debug.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        pipelines.debug = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.debug = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Offscreen pipeline
         shaderStages[0] = loadShader(getAssetPath() + "shaders/deferred/mrt.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/deferred/mrt.frag.spv", vk::ShaderStageFlagBits::eFragment);
 
-        // Separate render pass
-        pipelineCreateInfo.renderPass = offscreen.renderPass;
+        // Render pass of the G-Buffer pass
+        pipelineCreateInfo.renderPass = graph.getRenderPass(gBufferPass);
 
         // Separate layout
         pipelineCreateInfo.layout = pipelineLayouts.offscreen;
@@ -504,7 +475,7 @@ public:
         colorBlendState.attachmentCount = blendAttachmentStates.size();
         colorBlendState.pAttachments = blendAttachmentStates.data();
 
-        pipelines.offscreen = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.offscreen = createGraphicsPipeline(pipelineCreateInfo);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -580,12 +551,6 @@ public:
 
 
     void prepare() override {
-        offscreen.size = glm::uvec2(TEX_DIM);
-        offscreen.colorFormats = std::vector<vk::Format>{ {
-            vk::Format::eR16G16B16A16Sfloat,
-            vk::Format::eR16G16B16A16Sfloat,
-            vk::Format::eR8G8B8A8Unorm
-        } };
         Parent::prepare();
         loadTextures();
         generateQuads();
@@ -593,11 +558,11 @@ public:
         setupVertexDescriptions();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
+        prepareRenderGraph();
         preparePipelines();
         setupDescriptorPool();
         setupDescriptorSet();
         updateDrawCommandBuffers();
-        buildOffscreenCommandBuffer();
         prepared = true;
     }
 
@@ -608,7 +573,6 @@ public:
     void toggleDebugDisplay() {
         debugDisplay = !debugDisplay;
         updateDrawCommandBuffers();
-        buildOffscreenCommandBuffer();
         updateUniformBuffersScreen();
     }
 
@@ -499,14 +499,14 @@ public:
         pipelineCreateInfo.stageCount = shaderStages.size();
         pipelineCreateInfo.pStages = shaderStages.data();
 
-        pipelines.scene = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.scene = createGraphicsPipeline(pipelineCreateInfo);
 
 
         // Cube map display pipeline
         shaderStages[0] = loadShader(getAssetPath() + "shaders/shadowmappingomniSubpasses/cubemapdisplay.vert.spv", vk::ShaderStageFlagBits::eVertex);
         shaderStages[1] = loadShader(getAssetPath() + "shaders/shadowmappingomniSubpasses/cubemapdisplay.frag.spv", vk::ShaderStageFlagBits::eFragment);
         rasterizationState.cullMode = vk::CullModeFlagBits::eFront;
-        pipelines.cubeMap = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.cubeMap = createGraphicsPipeline(pipelineCreateInfo);
 
 
 		// Offscreen pipeline
@@ -518,7 +518,7 @@ public:
 		//shaderStages[1] = loadShader(getAssetPath() + "shaders/shadowmappingomniLayered/shadow.geom.spv", vk::ShaderStageFlagBits::eGeometry);
         rasterizationState.cullMode = vk::CullModeFlagBits::eBack;
         pipelineCreateInfo.layout = pipelineLayouts.offscreen;
-        pipelines.offscreen = device.createGraphicsPipelines(pipelineCache, pipelineCreateInfo, nullptr)[0];
+        pipelines.offscreen = createGraphicsPipeline(pipelineCreateInfo);
 
     }
 
@@ -117,7 +117,8 @@ public:
 
     std::string getWindowTitle() {
         std::string device(deviceProperties.deviceName);
-        return "OpenGL Interop - " + device + " - " + std::to_string(frameCounter) + " fps";
+        return "OpenGL Interop - " + device + " - " + std::to_string(frameCounter) + " fps - LODs " + (vulkanRenderer.useLods ? "on" : "off (-nolods)")
+            + ", " + std::to_string(vulkanRenderer.visibleInstanceCount) + " instances, " + std::to_string(vulkanRenderer.triangleCount) + " triangles";
     }
 };
 
@@ -3,6 +3,10 @@
 *
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
+* Not part of the build: written against the C API VulkanExampleBase (vulkanexamplebase.h), which this
+* tree replaced with vkx::ExampleBase.  It keeps its own descriptor pool; porting it to the
+* DescriptorAllocator needs the port to the vkx base first.
+*
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
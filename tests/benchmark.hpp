@@ -0,0 +1,51 @@
+/*
+* Shared helpers of the benchmarks
+*
+* Benchmarks are built with the tests but not run by ctest, most of them need a GPU.  Models default to
+* the ones in data/models, any files passed on the command line are used instead.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "vulkanTools.h"
+
+namespace vkx { namespace benchmark {
+
+    inline std::vector<std::string> getModels(int argc, char* argv[]) {
+        std::vector<std::string> result;
+        for (int i = 1; i < argc; ++i) {
+            if (argv[i][0] != '-') {
+                result.push_back(argv[i]);
+            }
+        }
+        if (!result.empty()) {
+            return result;
+        }
+        static const char* MODELS[] = {
+            "angryteapot.3ds", "box.obj", "color_teapot_spheres.X", "cube.X", "cube.dae", "cube.obj", "cylinder.obj",
+            "fireplace.obj", "geosphere.obj", "glowsphere.X", "glowsphere.dae", "goblin.dae", "plane.obj",
+            "plane_z.3ds", "plane_z.obj", "retroufo.dae", "retroufo_glow.dae", "retroufo_red.dae",
+            "retroufo_red_lowpoly.dae", "rock01.dae", "samplescene.dae", "shadowscene_fire.dae", "shadowscene_torus.X",
+            "skysphere.dae", "sphere.3ds", "sphere.obj", "suzanne.obj", "teapot.3ds", "torus.obj", "torusknot.obj",
+            "treasure_glow.dae", "treasure_smooth.dae", "vulkanlogo.X", "vulkanscenebackground.dae",
+            "vulkanscenelogos.dae", "armor/armor.dae", "voyager/voyager.dae", "lowpoly/deer.dae",
+            "lowpoly/geosphere.obj", "lowpoly/suzanne.obj", "lowpoly/teapot.obj", "lowpoly/torus.obj",
+            "lowpoly/torusknot.obj",
+        };
+        for (auto model : MODELS) {
+            result.push_back(getAssetPath() + "models/" + model);
+        }
+        return result;
+    }
+
+    // Milliseconds since start
+    inline double elapsed(const std::chrono::high_resolution_clock::time_point& start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+} }
@@ -0,0 +1,150 @@
+/*
+* Tests of the deferred destruction queue
+*
+* Retired memory allocations go back to their allocator without any Vulkan call, so they stand in
+* for every retired object here.  The allocations are ranges of a block created by hand, pinned by
+* an extra allocation so the allocator never tries to release it.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "vulkanDeletionQueue.hpp"
+#include "testing.hpp"
+
+using namespace vkx;
+
+namespace {
+    const vk::DeviceSize RangeSize = 16;
+
+    struct TestBlock {
+        vk::PhysicalDeviceMemoryProperties memoryProperties;
+        MemoryAllocator allocator{ vk::Device(), memoryProperties, 1 };
+        MemoryBlock block;
+
+        explicit TestBlock(size_t rangeCount) {
+            block.ranges = RangeAllocator(rangeCount * RangeSize);
+            block.allocationCount = 1;
+        }
+
+        MemoryAllocation allocate() {
+            MemoryAllocation result;
+            result.allocator = &allocator;
+            result.block = &block;
+            result.size = RangeSize;
+            bool allocated = block.ranges.allocate(RangeSize, 1, result.offset);
+            CHECK(allocated);
+            ++block.allocationCount;
+            return result;
+        }
+
+        bool isEmpty() const {
+            return block.allocationCount == 1 && block.ranges.getUsed() == 0 && block.ranges.getFreeRangeCount() == 1;
+        }
+    };
+}
+
+static void testReleasedWithFrame() {
+    TestBlock test(8);
+    DeletionQueue queue{ vk::Device() };
+    queue.retire(test.allocate());
+    queue.retire(test.allocate());
+    queue.collect(0);
+    queue.retire(test.allocate());
+    queue.collect(1);
+
+    // Nothing is freed before the frame it was collected into is released
+    CHECK_EQ(test.block.ranges.getUsed(), 3 * RangeSize);
+    queue.release(1);
+    CHECK_EQ(test.block.ranges.getUsed(), 2 * RangeSize);
+    queue.release(1);
+    CHECK_EQ(test.block.ranges.getUsed(), 2 * RangeSize);
+    queue.release(0);
+    CHECK(test.isEmpty());
+
+    auto stats = queue.getStats();
+    CHECK_EQ(stats.retired, 3u);
+    CHECK_EQ(stats.destroyed, 3u);
+    CHECK_EQ(stats.peakFrameCount, 2u);
+    CHECK_EQ(stats.overflowed, 0u);
+}
+
+static void testOverflow() {
+    // More than the lock-free queue holds between two collects
+    const size_t count = 40000;
+    TestBlock test(count);
+    DeletionQueue queue{ vk::Device() };
+    for (size_t i = 0; i < count; ++i) {
+        queue.retire(test.allocate());
+    }
+    queue.collect(0);
+    queue.release(0);
+    CHECK(test.isEmpty());
+
+    auto stats = queue.getStats();
+    CHECK_EQ(stats.retired, count);
+    CHECK_EQ(stats.destroyed, count);
+    CHECK(stats.overflowed > 0);
+}
+
+// Several threads retire objects while the owner thread cycles through the frame slots, as in the examples
+static void testMultipleProducers() {
+    const uint32_t producerCount = 4;
+    const size_t perProducer = 100000;
+    const uint32_t frameCount = 3;
+    TestBlock test(producerCount * perProducer);
+    DeletionQueue queue{ vk::Device() };
+
+    // Allocating from the block isn't thread safe, only retiring is
+    std::vector<std::vector<MemoryAllocation>> allocations(producerCount);
+    for (auto& list : allocations) {
+        for (size_t i = 0; i < perProducer; ++i) {
+            list.push_back(test.allocate());
+        }
+    }
+
+    std::atomic<uint32_t> finished{ 0 };
+    auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::thread> producers;
+    for (uint32_t p = 0; p < producerCount; ++p) {
+        producers.emplace_back([&, p] {
+            for (const auto& allocation : allocations[p]) {
+                queue.retire(allocation);
+            }
+            finished.fetch_add(1);
+        });
+    }
+    uint32_t frame = 0;
+    uint64_t frames = 0;
+    while (finished.load() < producerCount) {
+        frame = (frame + 1) % frameCount;
+        queue.release(frame);
+        queue.collect(frame);
+        ++frames;
+    }
+    for (auto& producer : producers) {
+        producer.join();
+    }
+    queue.releaseAll();
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Every allocation was retired and freed exactly once: a double free would leave the block's counts off
+    CHECK(test.isEmpty());
+    auto stats = queue.getStats();
+    CHECK_EQ(stats.retired, producerCount * perProducer);
+    CHECK_EQ(stats.destroyed, producerCount * perProducer);
+    // The rate depends on the machine, it is only reported
+    const double rate = (double)stats.retired / seconds;
+    std::cout << "  " << stats.retired << " retirements in " << seconds * 1000.0 << " ms over " << frames << " frames ("
+        << (uint64_t)rate << " per second, " << stats.overflowed << " overflowed)" << std::endl;
+}
+
+int main() {
+    testing::run("released with frame", testReleasedWithFrame);
+    testing::run("overflow", testOverflow);
+    testing::run("multiple producers", testMultipleProducers);
+    return testing::result();
+}
@@ -0,0 +1,178 @@
+/*
+* Scheduling overhead of the job system against the thread pool it replaced
+*
+* Runs batches of 10k tiny jobs through the old ThreadPool (per thread std::function queues, jobs
+* assigned round robin) and through JobSystem, both with run and with parallelFor, and reports the
+* median time per batch.  The first argument is the thread count, one per hardware thread by default.
+* Runs on the CPU only.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <queue>
+
+#include "jobSystem.hpp"
+
+namespace legacy {
+    // The thread pool as it was before the job system, kept here as the baseline
+    class Thread {
+    private:
+        bool destroying = false;
+        std::thread worker;
+        std::queue<std::function<void()>> jobQueue;
+        std::mutex queueMutex;
+        std::condition_variable condition;
+
+        void queueLoop() {
+            while (true) {
+                std::function<void()> job;
+                {
+                    std::unique_lock<std::mutex> lock(queueMutex);
+                    condition.wait(lock, [this] { return !jobQueue.empty() || destroying; });
+                    if (destroying) {
+                        break;
+                    }
+                    job = jobQueue.front();
+                }
+
+                job();
+
+                {
+                    std::lock_guard<std::mutex> lock(queueMutex);
+                    jobQueue.pop();
+                    condition.notify_one();
+                }
+            }
+        }
+
+    public:
+        Thread() {
+            worker = std::thread(&Thread::queueLoop, this);
+        }
+
+        ~Thread() {
+            if (worker.joinable()) {
+                wait();
+                queueMutex.lock();
+                destroying = true;
+                condition.notify_one();
+                queueMutex.unlock();
+                worker.join();
+            }
+        }
+
+        void addJob(std::function<void()> function) {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            jobQueue.push(std::move(function));
+            condition.notify_one();
+        }
+
+        void wait() {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            condition.wait(lock, [this]() { return jobQueue.empty(); });
+        }
+    };
+
+    class ThreadPool {
+    public:
+        std::vector<std::unique_ptr<Thread>> threads;
+
+        void setThreadCount(uint32_t count) {
+            threads.clear();
+            for (uint32_t i = 0; i < count; i++) {
+                threads.push_back(std::make_unique<Thread>());
+            }
+        }
+
+        void wait() {
+            for (auto &thread : threads) {
+                thread->wait();
+            }
+        }
+    };
+}
+
+static const uint32_t JOB_COUNT = 10000;
+static const uint32_t BATCH_COUNT = 100;
+
+// A few hundred nanoseconds of work, so the scheduling cost dominates
+static void tinyJob(uint32_t index, std::atomic<uint64_t>& sum) {
+    uint32_t x = index;
+    for (int i = 0; i < 64; ++i) {
+        x = x * 1664525u + 1013904223u;
+    }
+    sum.fetch_add(x & 1, std::memory_order_relaxed);
+}
+
+// Median milliseconds per batch of JOB_COUNT jobs
+template <typename F>
+static double measure(const F& batch) {
+    std::vector<double> times;
+    for (uint32_t i = 0; i < BATCH_COUNT; ++i) {
+        auto start = std::chrono::high_resolution_clock::now();
+        batch();
+        times.push_back(std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Thread count from the first argument, one per hardware thread if it is missing or not a positive number
+static uint32_t getThreadCount(int argc, char* argv[]) {
+    if (argc > 1) {
+        char* end = nullptr;
+        long count = strtol(argv[1], &end, 10);
+        if (end != argv[1] && !*end && count > 0 && count <= 1024) {
+            return (uint32_t)count;
+        }
+        std::cerr << "Ignoring invalid thread count " << argv[1] << std::endl;
+    }
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+int main(int argc, char* argv[]) {
+    const uint32_t threadCount = getThreadCount(argc, argv);
+    std::atomic<uint64_t> sum{ 0 };
+
+    double poolMs;
+    {
+        legacy::ThreadPool pool;
+        pool.setThreadCount(threadCount);
+        poolMs = measure([&] {
+            for (uint32_t i = 0; i < JOB_COUNT; ++i) {
+                pool.threads[i % threadCount]->addJob([i, &sum] { tinyJob(i, sum); });
+            }
+            pool.wait();
+        });
+    }
+
+    double runMs, parallelForMs;
+    {
+        vkx::JobSystem jobs(threadCount);
+        runMs = measure([&] {
+            vkx::JobCounter counter;
+            for (uint32_t i = 0; i < JOB_COUNT; ++i) {
+                jobs.run([i, &sum] { tinyJob(i, sum); }, counter);
+            }
+            jobs.wait(counter);
+        });
+        parallelForMs = measure([&] {
+            jobs.parallelFor(0, JOB_COUNT, 1, [&](uint32_t begin, uint32_t end) {
+                for (uint32_t i = begin; i < end; ++i) {
+                    tinyJob(i, sum);
+                }
+            });
+        });
+    }
+
+    std::cout << JOB_COUNT << " jobs on " << threadCount << " threads, median of " << BATCH_COUNT << " batches" << std::endl;
+    std::cout << "ThreadPool:            " << poolMs << " ms" << std::endl;
+    std::cout << "JobSystem::run:        " << runMs << " ms" << std::endl;
+    std::cout << "JobSystem::parallelFor " << parallelForMs << " ms" << std::endl;
+    return sum.load() ? 0 : 1;
+}
@@ -0,0 +1,69 @@
+/*
+* Cold and warm mesh loads through the mesh cache
+*
+* Loads every model once with its cache entry removed (Assimp import, post processing and cache store)
+* and once more from the cache entry just written, and reports the load times per model and in total.
+* Meshes are loaded with the options the examples use by default.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdio.h>
+#include <iomanip>
+
+#include "vulkanContext.hpp"
+#include "vulkanMeshLoader.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx;
+
+int main(int argc, char* argv[]) {
+    if (getCachePath().empty()) {
+        std::cerr << "The mesh cache isn't available on this platform" << std::endl;
+        return 1;
+    }
+    const MeshLayout layout{ VERTEX_LAYOUT_POSITION, VERTEX_LAYOUT_NORMAL, VERTEX_LAYOUT_UV };
+    MeshCache cache(getCachePath());
+
+    Context context;
+    context.headless = true;
+    context.createContext(false);
+
+    double coldTotal = 0.0, warmTotal = 0.0;
+    uint32_t modelCount = 0;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto& filename : benchmark::getModels(argc, argv)) {
+        double times[2];
+        bool fromCache[2];
+        try {
+            for (int pass = 0; pass < 2; ++pass) {
+                MeshLoader loader;
+                loader.options = MeshLoader::OPTION_OPTIMIZE;
+                if (!pass) {
+                    remove(cache.getEntryPath(loader.getCacheKey(filename, layout, 1.0f)).c_str());
+                }
+                auto start = std::chrono::high_resolution_clock::now();
+                MeshBuffer mesh = loader.loadBuffers(context, filename, layout, 1.0f);
+                times[pass] = benchmark::elapsed(start);
+                fromCache[pass] = loader.loadedFromCache;
+                // The upload may still be executing
+                context.device.waitIdle();
+                mesh.destroy();
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Skipping " << filename << ": " << e.what() << std::endl;
+            continue;
+        }
+        if (fromCache[0] || !fromCache[1]) {
+            std::cerr << filename << ": expected a cache miss followed by a hit" << std::endl;
+            return 1;
+        }
+        std::cout << filename << ": cold " << times[0] << " ms, warm " << times[1] << " ms" << std::endl;
+        coldTotal += times[0];
+        warmTotal += times[1];
+        ++modelCount;
+    }
+    std::cout << modelCount << " models: cold " << coldTotal << " ms, warm " << warmTotal << " ms" << std::endl;
+    context.destroyContext();
+    return 0;
+}
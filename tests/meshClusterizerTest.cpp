@@ -0,0 +1,134 @@
+/*
+* Tests of the cluster (meshlet) decomposition
+*
+* The clusters are checked for what the culling in instancing relies on: the vertex and triangle limits
+* hold, the clusters are contiguous ranges that together hold every input triangle exactly once, and
+* the bounding spheres and normal cones contain the vertices and normals of their triangles.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <iostream>
+
+#include "vulkanMeshClusterizer.hpp"
+#include "testing.hpp"
+#include "testMeshes.hpp"
+
+using namespace vkx;
+using namespace vkx::testing;
+
+namespace {
+    glm::vec3 position(const TestMesh& mesh, uint32_t vertex) {
+        const float* p = mesh.position(vertex);
+        return glm::vec3(p[0], p[1], p[2]);
+    }
+
+    // The triangles as index triples, each rotated to start at its smallest index so the winding is kept
+    std::vector<std::vector<uint32_t>> triangleSet(const std::vector<uint32_t>& indices) {
+        std::vector<std::vector<uint32_t>> result;
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            uint32_t first = 0;
+            for (uint32_t c = 1; c < 3; ++c) {
+                if (indices[i + c] < indices[i + first]) {
+                    first = c;
+                }
+            }
+            result.push_back({ indices[i + first], indices[i + (first + 1) % 3], indices[i + (first + 2) % 3] });
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    void checkClusters(const char* name, const TestMesh& mesh, uint32_t maxVertices, uint32_t maxTriangles) {
+        std::vector<uint32_t> indices = mesh.indices;
+        auto clusters = MeshClusterizer::build(indices, mesh.vertices.data(), TestMesh::VERTEX_STRIDE, mesh.vertexCount(), maxVertices, maxTriangles);
+
+        // Every input triangle exactly once, with its winding
+        CHECK(triangleSet(indices) == triangleSet(mesh.indices));
+
+        // Contiguous ranges covering the index buffer in order
+        uint32_t next = 0;
+        bool contiguous = true;
+        for (const auto& cluster : clusters) {
+            contiguous &= cluster.firstIndex == next && cluster.indexCount > 0 && cluster.indexCount % 3 == 0;
+            next = cluster.firstIndex + cluster.indexCount;
+        }
+        CHECK(contiguous);
+        CHECK_EQ(next, (uint32_t)indices.size());
+        if (!contiguous || next != indices.size()) {
+            return;
+        }
+
+        bool withinLimits = true;
+        bool spheresContain = true;
+        bool conesContain = true;
+        uint32_t largestVertexCount = 0;
+        for (const auto& cluster : clusters) {
+            std::vector<uint32_t> vertices(indices.begin() + cluster.firstIndex, indices.begin() + cluster.firstIndex + cluster.indexCount);
+            std::sort(vertices.begin(), vertices.end());
+            vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+            withinLimits &= vertices.size() <= maxVertices && cluster.indexCount / 3 <= maxTriangles;
+            largestVertexCount = std::max(largestVertexCount, (uint32_t)vertices.size());
+
+            const glm::vec3 center(cluster.sphere.x, cluster.sphere.y, cluster.sphere.z);
+            const float tolerance = 1e-5f * (1.0f + cluster.sphere.w);
+            for (auto vertex : vertices) {
+                spheresContain &= glm::length(position(mesh, vertex) - center) <= cluster.sphere.w + tolerance;
+            }
+
+            // A cutoff below 1 promises every triangle normal lies within the cone
+            if (cluster.cone.w < 1.0f) {
+                const glm::vec3 axis(cluster.cone.x, cluster.cone.y, cluster.cone.z);
+                const float minimumDot = sqrtf(1.0f - cluster.cone.w * cluster.cone.w);
+                for (uint32_t i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i += 3) {
+                    glm::vec3 p0 = position(mesh, indices[i]);
+                    glm::vec3 normal = glm::cross(position(mesh, indices[i + 1]) - p0, position(mesh, indices[i + 2]) - p0);
+                    conesContain &= glm::dot(normal / glm::length(normal), axis) >= minimumDot - 1e-4f;
+                }
+            }
+        }
+        CHECK(withinLimits);
+        CHECK(spheresContain);
+        CHECK(conesContain);
+
+        std::cout << "  " << name << " (" << maxVertices << " vertices, " << maxTriangles << " triangles): " << mesh.triangleCount() << " triangles in "
+            << clusters.size() << " clusters, " << (float)mesh.triangleCount() / clusters.size() << " triangles and at most " << largestVertexCount
+            << " vertices per cluster" << std::endl;
+    }
+}
+
+static void testDefaultLimits() {
+    checkClusters("torus", makeTorus(96, 48), MeshClusterizer::MAX_VERTICES, MeshClusterizer::MAX_TRIANGLES);
+    checkClusters("grid", makeGrid(64), MeshClusterizer::MAX_VERTICES, MeshClusterizer::MAX_TRIANGLES);
+}
+
+static void testSmallLimits() {
+    const TestMesh torus = makeTorus(48, 24);
+    checkClusters("torus", torus, 32, 32);
+    checkClusters("torus", torus, 16, 64);
+    checkClusters("torus", torus, 3, 1);
+}
+
+static void testScattered() {
+    // Shuffled triangles make every cluster start from the seed search rather than the input order
+    TestMesh shuffled = makeTorus(48, 24);
+    shuffled.shuffleTriangles(7);
+    checkClusters("shuffled torus", shuffled, MeshClusterizer::MAX_VERTICES, MeshClusterizer::MAX_TRIANGLES);
+    // Without shared vertices the clusters can only grow through the seed search
+    checkClusters("triangle soup", makeTorus(16, 8).toSoup(), MeshClusterizer::MAX_VERTICES, MeshClusterizer::MAX_TRIANGLES);
+}
+
+static void testEmpty() {
+    std::vector<uint32_t> indices;
+    float position[3] = { 0.0f, 0.0f, 0.0f };
+    CHECK(MeshClusterizer::build(indices, position, sizeof(position), 1).empty());
+    CHECK(indices.empty());
+}
+
+int main() {
+    testing::run("default limits", testDefaultLimits);
+    testing::run("small limits", testSmallLimits);
+    testing::run("scattered", testScattered);
+    testing::run("empty", testEmpty);
+    return testing::result();
+}
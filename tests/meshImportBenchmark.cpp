@@ -0,0 +1,62 @@
+/*
+* Peak memory and time of a mesh import
+*
+* Imports a model through MeshLoader::importBuffers on the job system, as loadBuffers does, or with
+* -legacy through load and interleave, as loadBuffers did before: the Assimp scene, m_Entries and the
+* interleaved buffers are then all alive at once.  The peak resident memory of a process only grows,
+* so run each mode in its own process on one model.  Needs no Vulkan device.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <string.h>
+#include <iomanip>
+#include <iostream>
+
+#include "vulkanMeshLoader.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx;
+
+int main(int argc, char* argv[]) {
+    bool legacy = false;
+    for (int i = 1; i < argc; ++i) {
+        legacy |= strcmp(argv[i], "-legacy") == 0;
+    }
+    // The largest model in data/models unless one is passed
+    std::string filename = getAssetPath() + "models/voyager/voyager.dae";
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-') {
+            filename = argv[i];
+        }
+    }
+
+    const MeshLayout layout{ VERTEX_LAYOUT_POSITION, VERTEX_LAYOUT_NORMAL, VERTEX_LAYOUT_UV };
+    JobSystem jobs;
+    const double before = getPeakMemoryMB();
+    std::vector<float> vertexBuffer;
+    std::vector<uint32_t> indexBuffer;
+    MeshDequantization dequantization;
+    MeshLoader loader;
+    auto start = std::chrono::high_resolution_clock::now();
+    try {
+        if (legacy) {
+            loader.load(filename, MeshLoader::DEFAULT_FLAGS);
+            loader.interleave(layout, 1.0f, vertexBuffer, indexBuffer, dequantization);
+        } else {
+            loader.jobSystem = &jobs;
+            loader.importBuffers(filename, MeshLoader::DEFAULT_FLAGS, layout, 1.0f, vertexBuffer, indexBuffer, dequantization);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Import of " << filename << " failed: " << e.what() << std::endl;
+        return 1;
+    }
+    double time = benchmark::elapsed(start);
+
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << filename << (legacy ? " (load + interleave)" : " (importBuffers)") << ": " << loader.numVertices << " vertices, "
+        << indexBuffer.size() / 3 << " triangles in " << time << " ms, peak memory " << getPeakMemoryMB() << " MB ("
+        << before << " MB before the import, " << (vertexBuffer.size() * sizeof(float) + indexBuffer.size() * sizeof(uint32_t)) / (1024.0 * 1024.0)
+        << " MB of output)" << std::endl;
+    return 0;
+}
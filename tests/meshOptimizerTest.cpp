@@ -0,0 +1,171 @@
+/*
+* Tests of the vertex cache, overdraw and vertex fetch optimizer
+*
+* The baseline for the cache and fetch statistics is the input with identical vertices welded in order
+* of first appearance, which is what Assimp's JoinIdenticalVertices produces.  The vertex cache pass
+* may fetch somewhat more bytes than that baseline: fanning around vertices revisits neighbours whose
+* cache lines have been evicted.  The overdraw pass must not add more than its threshold on top.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <string.h>
+#include <iostream>
+
+#include "vulkanMeshOptimizer.hpp"
+#include "testing.hpp"
+#include "testMeshes.hpp"
+
+using namespace vkx;
+using namespace vkx::testing;
+
+namespace {
+    const float OverdrawThreshold = 1.05f;
+    // Vertex fetch the vertex cache pass may cost over the welded input, see above
+    const float MaxOverfetchGrowth = 1.3f;
+
+    // The triangles of a mesh by value, each rotated to start at its smallest vertex so the winding is kept
+    std::vector<std::vector<float>> triangleSet(const std::vector<float>& vertices, const std::vector<uint32_t>& indices) {
+        const uint32_t floats = TestMesh::FLOATS_PER_VERTEX;
+        std::vector<std::vector<float>> result;
+        for (size_t t = 0; t < indices.size(); t += 3) {
+            std::vector<float> corners[3];
+            for (uint32_t c = 0; c < 3; ++c) {
+                const float* vertex = vertices.data() + (size_t)indices[t + c] * floats;
+                corners[c].assign(vertex, vertex + floats);
+            }
+            uint32_t first = 0;
+            for (uint32_t c = 1; c < 3; ++c) {
+                if (corners[c] < corners[first]) {
+                    first = c;
+                }
+            }
+            std::vector<float> triangle;
+            for (uint32_t c = 0; c < 3; ++c) {
+                const auto& corner = corners[(first + c) % 3];
+                triangle.insert(triangle.end(), corner.begin(), corner.end());
+            }
+            result.push_back(triangle);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    struct Baseline {
+        MeshOptimizer::VertexCacheStats welded;
+        MeshOptimizer::VertexFetchStats weldedFetch;
+        // After the vertex cache and vertex fetch passes only, without the overdraw pass
+        MeshOptimizer::VertexFetchStats cacheOrderFetch;
+    };
+
+    Baseline analyze(const TestMesh& mesh) {
+        const uint32_t stride = TestMesh::VERTEX_STRIDE;
+        Baseline baseline;
+        std::vector<uint32_t> remap;
+        uint32_t uniqueCount = MeshOptimizer::weldVertices(mesh.vertices.data(), mesh.vertexCount(), stride, remap);
+        std::vector<uint32_t> indices = mesh.indices;
+        for (auto& index : indices) {
+            index = remap[index];
+        }
+        std::vector<float> vertices(uniqueCount * TestMesh::FLOATS_PER_VERTEX);
+        MeshOptimizer::remapVertices(vertices.data(), mesh.vertices.data(), mesh.vertexCount(), stride, remap);
+        baseline.welded = MeshOptimizer::analyzeVertexCache(indices, uniqueCount);
+        baseline.weldedFetch = MeshOptimizer::analyzeVertexFetch(indices, uniqueCount, stride);
+
+        MeshOptimizer::optimizeVertexCache(indices, uniqueCount);
+        uint32_t vertexCount = MeshOptimizer::optimizeVertexFetch(vertices, stride, indices);
+        baseline.cacheOrderFetch = MeshOptimizer::analyzeVertexFetch(indices, vertexCount, stride);
+        return baseline;
+    }
+
+    void checkOptimize(const char* name, const TestMesh& mesh) {
+        const Baseline baseline = analyze(mesh);
+        const auto trianglesBefore = triangleSet(mesh.vertices, mesh.indices);
+
+        std::vector<float> vertices = mesh.vertices;
+        std::vector<uint32_t> indices = mesh.indices;
+        auto stats = MeshOptimizer::optimize(vertices, TestMesh::VERTEX_STRIDE, 0, indices, OverdrawThreshold);
+
+        // Still a valid index buffer over the welded vertices, describing the same triangles
+        CHECK_EQ(stats.verticesAfter, (uint32_t)(vertices.size() / TestMesh::FLOATS_PER_VERTEX));
+        CHECK_EQ(stats.verticesAfter, baseline.welded.vertices);
+        CHECK_EQ(indices.size(), mesh.indices.size());
+        bool inRange = true;
+        for (auto index : indices) {
+            inRange &= index < stats.verticesAfter;
+        }
+        if (CHECK(inRange)) {
+            CHECK(triangleSet(vertices, indices) == trianglesBefore);
+        }
+
+        // The vertex cache never does worse than the welded input
+        CHECK(stats.cacheAfter.acmr <= baseline.welded.acmr);
+        CHECK(stats.cacheAfter.acmr <= stats.cacheBefore.acmr);
+
+        // Vertex fetch: the overdraw pass stays within its threshold, the whole optimization within the documented growth
+        CHECK(stats.fetchAfter.bytesFetched <= baseline.cacheOrderFetch.bytesFetched * OverdrawThreshold);
+        CHECK(stats.fetchAfter.overfetch <= baseline.weldedFetch.overfetch * MaxOverfetchGrowth);
+
+        std::cout << "  " << name << ": " << stats.cacheBefore.triangles << " triangles, " << stats.verticesBefore << " -> " << stats.verticesAfter
+            << " vertices, ACMR " << baseline.welded.acmr << " -> " << stats.cacheAfter.acmr << ", overfetch " << baseline.weldedFetch.overfetch
+            << " -> " << stats.fetchAfter.overfetch << std::endl;
+    }
+}
+
+static void testGrid() {
+    checkOptimize("grid", makeGrid(64).toSoup());
+}
+
+static void testTorus() {
+    checkOptimize("torus", makeTorus(96, 48).toSoup());
+}
+
+static void testShuffled() {
+    // Random triangle order leaves the welded baseline with an ACMR close to 3
+    TestMesh mesh = makeTorus(96, 48);
+    mesh.shuffleTriangles(1);
+    checkOptimize("shuffled torus", mesh.toSoup());
+}
+
+static void testTiny() {
+    // A single triangle and a single quad have nothing to reorder, but must pass through intact
+    TestMesh triangle;
+    triangle.addVertex(0, 0, 0, 0, 1, 0, 0, 0);
+    triangle.addVertex(0, 0, 1, 0, 1, 0, 0, 1);
+    triangle.addVertex(1, 0, 0, 0, 1, 0, 1, 0);
+    triangle.indices = { 0, 1, 2 };
+    checkOptimize("triangle", triangle);
+    checkOptimize("quad", makeGrid(1).toSoup());
+}
+
+static void testWeld() {
+    // Only bitwise identical vertices are joined, vertices differing in any attribute are kept apart
+    TestMesh mesh = makeTorus(8, 4);
+    std::vector<uint32_t> remap;
+    uint32_t uniqueCount = MeshOptimizer::weldVertices(mesh.vertices.data(), mesh.vertexCount(), TestMesh::VERTEX_STRIDE, remap);
+    CHECK_EQ(uniqueCount, mesh.vertexCount());
+
+    TestMesh soup = mesh.toSoup();
+    uniqueCount = MeshOptimizer::weldVertices(soup.vertices.data(), soup.vertexCount(), TestMesh::VERTEX_STRIDE, remap);
+    CHECK_EQ(uniqueCount, mesh.vertexCount());
+    // Numbered in order of first appearance, every copy maps to a vertex with the same bytes
+    std::vector<uint32_t> firstCopy;
+    bool identical = true;
+    for (uint32_t i = 0; i < soup.vertexCount(); ++i) {
+        if (remap[i] == firstCopy.size()) {
+            firstCopy.push_back(i);
+        }
+        CHECK(remap[i] < firstCopy.size());
+        identical &= !memcmp(soup.position(i), soup.position(firstCopy[remap[i]]), TestMesh::VERTEX_STRIDE);
+    }
+    CHECK(identical);
+}
+
+int main() {
+    testing::run("grid", testGrid);
+    testing::run("torus", testTorus);
+    testing::run("shuffled", testShuffled);
+    testing::run("tiny", testTiny);
+    testing::run("weld", testWeld);
+    return testing::result();
+}
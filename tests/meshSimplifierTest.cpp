@@ -0,0 +1,238 @@
+/*
+* Tests of the quadric error mesh simplifier and the level of detail selection
+*
+* The simplified meshes are checked against what generateLods relies on: the index count target is
+* met, open borders keep their outline, closed meshes stay closed and the reported error bounds the
+* distance of the original vertices from the simplified surface.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <iostream>
+#include <map>
+
+#include "vulkanMeshLoader.hpp"
+#include "vulkanMeshSimplifier.hpp"
+#include "testing.hpp"
+#include "testMeshes.hpp"
+
+using namespace vkx;
+using namespace vkx::testing;
+
+namespace {
+    std::vector<uint32_t> simplify(const TestMesh& mesh, size_t targetIndexCount, float targetError = FLT_MAX, float* resultError = nullptr) {
+        return MeshSimplifier::simplify(mesh.indices, mesh.vertices.data(), TestMesh::VERTEX_STRIDE, mesh.vertexCount(), targetIndexCount, targetError, resultError);
+    }
+
+    glm::vec3 position(const TestMesh& mesh, uint32_t vertex) {
+        const float* p = mesh.position(vertex);
+        return glm::vec3(p[0], p[1], p[2]);
+    }
+
+    using PositionKey = std::vector<float>;
+    using Edge = std::pair<PositionKey, PositionKey>;
+
+    // Edges of the triangles by position, so vertices split along attribute seams count as one
+    std::map<Edge, uint32_t> countEdges(const TestMesh& mesh, const std::vector<uint32_t>& indices) {
+        std::map<Edge, uint32_t> edges;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            const float* a = mesh.position(indices[i]);
+            const float* b = mesh.position(indices[i - i % 3 + (i + 1) % 3]);
+            PositionKey keyA(a, a + 3);
+            PositionKey keyB(b, b + 3);
+            ++edges[keyA < keyB ? Edge(keyA, keyB) : Edge(keyB, keyA)];
+        }
+        return edges;
+    }
+
+    // Valid indices into the original vertices without degenerate triangles
+    bool isValid(const TestMesh& mesh, const std::vector<uint32_t>& indices) {
+        if (indices.size() % 3) {
+            return false;
+        }
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            if (indices[i] >= mesh.vertexCount() || indices[i + 1] >= mesh.vertexCount() || indices[i + 2] >= mesh.vertexCount()) {
+                return false;
+            }
+            glm::vec3 a = position(mesh, indices[i]);
+            glm::vec3 b = position(mesh, indices[i + 1]);
+            glm::vec3 c = position(mesh, indices[i + 2]);
+            if (a == b || b == c || a == c) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    float distanceToTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+        glm::vec3 normal = glm::cross(b - a, c - a);
+        float area = glm::length(normal);
+        normal = normal / area;
+        // Inside the prism of the triangle the distance is the one to its plane
+        glm::vec3 projected = p - normal * glm::dot(p - a, normal);
+        glm::vec3 corners[3] = { a, b, c };
+        bool inside = true;
+        for (uint32_t k = 0; k < 3; ++k) {
+            inside = inside && glm::dot(glm::cross(corners[(k + 1) % 3] - corners[k], projected - corners[k]), normal) >= 0.0f;
+        }
+        if (inside) {
+            return fabsf(glm::dot(p - a, normal));
+        }
+        float result = FLT_MAX;
+        for (uint32_t k = 0; k < 3; ++k) {
+            glm::vec3 edge = corners[(k + 1) % 3] - corners[k];
+            float t = std::min(std::max(glm::dot(p - corners[k], edge) / glm::dot(edge, edge), 0.0f), 1.0f);
+            result = std::min(result, glm::length(p - (corners[k] + edge * t)));
+        }
+        return result;
+    }
+
+    // Largest distance of an original vertex from the simplified surface
+    float maxDeviation(const TestMesh& mesh, const std::vector<uint32_t>& indices) {
+        float result = 0.0f;
+        for (uint32_t vertex = 0; vertex < mesh.vertexCount(); ++vertex) {
+            glm::vec3 p = position(mesh, vertex);
+            float distance = FLT_MAX;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                distance = std::min(distance, distanceToTriangle(p, position(mesh, indices[i]), position(mesh, indices[i + 1]), position(mesh, indices[i + 2])));
+            }
+            result = std::max(result, distance);
+        }
+        return result;
+    }
+}
+
+static void testTargetCount() {
+    const TestMesh torus = makeTorus(48, 24);
+    for (uint32_t divisor = 2; divisor <= 16; divisor *= 2) {
+        const size_t target = torus.indices.size() / divisor / 3 * 3;
+        auto result = simplify(torus, target);
+        CHECK(result.size() <= target);
+        // Stops close to the target rather than simplifying past it
+        CHECK(result.size() >= target * 3 / 4);
+        CHECK(isValid(torus, result));
+        std::cout << "  torus: target " << target / 3 << " triangles, " << result.size() / 3 << " left" << std::endl;
+    }
+    // A target the mesh already meets leaves it untouched
+    CHECK(simplify(torus, torus.indices.size()) == torus.indices);
+}
+
+static void testBorder() {
+    const uint32_t size = 16;
+    const TestMesh grid = makeGrid(size);
+    float error = -1.0f;
+    auto result = simplify(grid, grid.indices.size() / 8, FLT_MAX, &error);
+    CHECK(result.size() <= grid.indices.size() / 8);
+    CHECK(isValid(grid, result));
+
+    // Every open edge runs along one side of the original square
+    auto onSide = [&](const PositionKey& a, const PositionKey& b) {
+        const float side = (float)size;
+        return (a[0] == 0.0f && b[0] == 0.0f) || (a[0] == side && b[0] == side) || (a[2] == 0.0f && b[2] == 0.0f) || (a[2] == side && b[2] == side);
+    };
+    bool outline = true;
+    for (const auto& edge : countEdges(grid, result)) {
+        CHECK(edge.second <= 2);
+        if (edge.second == 1) {
+            outline &= onSide(edge.first.first, edge.first.second);
+        }
+    }
+    CHECK(outline);
+
+    // The corners can't move along a side, so the square is covered exactly as before and nothing flipped
+    float area = 0.0f;
+    bool facingUp = true;
+    for (size_t i = 0; i < result.size(); i += 3) {
+        glm::vec3 normal = glm::cross(position(grid, result[i + 1]) - position(grid, result[i]), position(grid, result[i + 2]) - position(grid, result[i]));
+        facingUp &= normal.y > 0.0f;
+        area += glm::length(normal) * 0.5f;
+    }
+    CHECK(facingUp);
+    CHECK(fabsf(area - (float)(size * size)) < 1e-3f);
+    // Flat, so simplifying costs nothing
+    CHECK(error >= 0.0f && error < 1e-3f);
+}
+
+static void testClosed() {
+    // Collapses along the uv seam of the torus must not tear it open
+    const TestMesh torus = makeTorus(48, 24);
+    auto result = simplify(torus, torus.indices.size() / 8);
+    bool closed = true;
+    for (const auto& edge : countEdges(torus, result)) {
+        closed &= edge.second == 2;
+    }
+    CHECK(closed);
+}
+
+static void testErrorBound() {
+    const TestMesh torus = makeTorus(48, 24);
+    size_t previousSize = torus.indices.size();
+    for (float targetError : { 0.001f, 0.005f, 0.02f }) {
+        float error = -1.0f;
+        auto result = simplify(torus, 0, targetError, &error);
+        CHECK(!result.empty());
+        CHECK(isValid(torus, result));
+        CHECK(error >= 0.0f && error <= targetError);
+        // A larger error budget never simplifies less
+        CHECK(result.size() <= previousSize);
+        previousSize = result.size();
+        // The error is a weighted mean of squared plane distances rather than a maximum, hence the margin
+        float deviation = maxDeviation(torus, result);
+        CHECK(deviation <= targetError * 2.0f);
+        std::cout << "  torus: target error " << targetError << ", reported " << error << ", measured " << deviation << ", "
+            << result.size() / 3 << " triangles" << std::endl;
+    }
+    CHECK(previousSize < torus.indices.size());
+}
+
+static void testLodSelector() {
+    // Unit cube sized mesh with three coarser levels
+    MeshBuffer mesh;
+    mesh.dim = glm::vec3(2.0f);
+    const float errors[] = { 0.0f, 0.001f, 0.01f, 0.1f };
+    for (float error : errors) {
+        MeshLod lod;
+        lod.error = error;
+        mesh.lods.push_back(lod);
+    }
+    const float radius = glm::length(mesh.dim) * 0.5f;
+    const float viewportHeight = 1000.0f;
+    const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 1.0f, 0.1f, 1000.0f);
+    const float pixelsAtUnitDistance = projection[1][1] * viewportHeight * 0.5f;
+
+    // Level i is allowed once its error projects to at most a pixel, which happens beyond this camera distance
+    auto thresholdDistance = [&](uint32_t level, float pixels, float scale) {
+        return errors[level] * pixelsAtUnitDistance * scale / pixels + radius * scale;
+    };
+    auto select = [&](float distance, float pixels, float scale) {
+        glm::mat4 view = glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -distance));
+        return LodSelector(projection, view, viewportHeight, pixels).select(mesh, glm::vec3(0.0f), scale);
+    };
+
+    for (float pixels : { 1.0f, 4.0f }) {
+        for (float scale : { 1.0f, 3.0f }) {
+            for (uint32_t level = 1; level < mesh.lods.size(); ++level) {
+                float distance = thresholdDistance(level, pixels, scale);
+                CHECK_EQ(select(distance * 0.99f, pixels, scale), level - 1);
+                CHECK_EQ(select(distance * 1.01f, pixels, scale), level);
+            }
+        }
+    }
+    // Inside the bounding sphere only full detail will do, far away the coarsest level
+    CHECK_EQ(select(0.5f * radius, 1.0f, 1.0f), 0u);
+    CHECK_EQ(select(1e6f, 1.0f, 1.0f), (uint32_t)mesh.lods.size() - 1);
+
+    // Without levels of detail there is nothing to choose
+    MeshBuffer single;
+    single.dim = mesh.dim;
+    CHECK_EQ(LodSelector(projection, glm::mat4(), viewportHeight).select(single, glm::vec3(0.0f, 0.0f, -100.0f)), 0u);
+}
+
+int main() {
+    testing::run("target count", testTargetCount);
+    testing::run("border", testBorder);
+    testing::run("closed", testClosed);
+    testing::run("error bound", testErrorBound);
+    testing::run("lod selector", testLodSelector);
+    return testing::result();
+}
@@ -0,0 +1,199 @@
+/*
+* Tests of the free list used by the device memory allocator
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <random>
+
+#include "vulkanAllocator.hpp"
+#include "testing.hpp"
+
+using namespace vkx;
+
+// Free list state of a range allocator as seen through MemoryAllocator::getStats
+static MemoryStats getStats(const RangeAllocator& ranges) {
+    MemoryStats result;
+    result.blockCount = 1;
+    result.freeRangeCount = (uint32_t)ranges.getFreeRangeCount();
+    result.bytesReserved = ranges.getSize();
+    result.bytesUsed = ranges.getUsed();
+    result.bytesLargestFree = ranges.getLargestFreeRange();
+    return result;
+}
+
+static void testSplit() {
+    RangeAllocator ranges(1024);
+    vk::DeviceSize a, b;
+    CHECK(ranges.allocate(100, 1, a));
+    CHECK_EQ(a, 0u);
+    CHECK_EQ(ranges.getFreeRangeCount(), 1u);
+    CHECK_EQ(ranges.getLargestFreeRange(), 924u);
+    CHECK(ranges.allocate(200, 1, b));
+    CHECK_EQ(b, 100u);
+    CHECK_EQ(ranges.getUsed(), 300u);
+    CHECK_EQ(ranges.getFree(), 724u);
+
+    // An exact fit consumes the range without leaving an empty one behind
+    vk::DeviceSize c;
+    CHECK(ranges.allocate(724, 1, c));
+    CHECK_EQ(c, 300u);
+    CHECK_EQ(ranges.getFreeRangeCount(), 0u);
+    CHECK(!ranges.allocate(1, 1, c));
+    CHECK(!ranges.allocate(0, 1, c));
+}
+
+static void testBestFit() {
+    RangeAllocator ranges(1000);
+    vk::DeviceSize offsets[5];
+    const vk::DeviceSize sizes[5] = { 300, 100, 200, 100, 300 };
+    for (int i = 0; i < 5; ++i) {
+        CHECK(ranges.allocate(sizes[i], 1, offsets[i]));
+    }
+    // Holes of 300 at 0 and 200 at 400
+    ranges.free(offsets[0], sizes[0]);
+    ranges.free(offsets[2], sizes[2]);
+    vk::DeviceSize offset;
+    CHECK(ranges.allocate(150, 1, offset));
+    CHECK_EQ(offset, 400u);
+    CHECK(ranges.allocate(250, 1, offset));
+    CHECK_EQ(offset, 0u);
+    CHECK(!ranges.allocate(100, 1, offset));
+}
+
+static void testCoalesce() {
+    RangeAllocator ranges(1024);
+    vk::DeviceSize a, b, c;
+    CHECK(ranges.allocate(100, 1, a));
+    CHECK(ranges.allocate(100, 1, b));
+    CHECK(ranges.allocate(100, 1, c));
+
+    // Freeing the middle range leaves a hole next to used ranges on both sides
+    ranges.free(b, 100);
+    CHECK_EQ(ranges.getFreeRangeCount(), 2u);
+    // Merges with the hole following it
+    ranges.free(a, 100);
+    CHECK_EQ(ranges.getFreeRangeCount(), 2u);
+    CHECK_EQ(ranges.getLargestFreeRange(), 724u);
+    vk::DeviceSize ab;
+    CHECK(ranges.allocate(200, 1, ab));
+    CHECK_EQ(ab, 0u);
+    ranges.free(ab, 200);
+    // Merges with the ranges on both sides
+    ranges.free(c, 100);
+    CHECK_EQ(ranges.getFreeRangeCount(), 1u);
+    CHECK_EQ(ranges.getLargestFreeRange(), 1024u);
+    CHECK(ranges.empty());
+}
+
+static void testAlignment() {
+    RangeAllocator ranges(1024);
+    vk::DeviceSize a, b, c;
+    CHECK(ranges.allocate(3, 1, a));
+    CHECK(ranges.allocate(16, 256, b));
+    CHECK_EQ(b, 256u);
+    // The padding in front of the aligned range stays available
+    CHECK_EQ(ranges.getFreeRangeCount(), 2u);
+    CHECK_EQ(ranges.getUsed(), 19u);
+    CHECK(ranges.allocate(200, 4, c));
+    CHECK_EQ(c, 4u);
+    // Nothing aligned to 512 fits in the remaining ranges [204, 256) and [272, 1024) except 512 itself
+    vk::DeviceSize d;
+    CHECK(ranges.allocate(512, 512, d));
+    CHECK_EQ(d, 512u);
+    CHECK(!ranges.allocate(8, 1024, d));
+
+    ranges.free(a, 3);
+    ranges.free(b, 16);
+    ranges.free(c, 200);
+    ranges.free(512, 512);
+    CHECK_EQ(ranges.getFreeRangeCount(), 1u);
+    CHECK(ranges.empty());
+}
+
+static void testFragmentation() {
+    RangeAllocator ranges(1024);
+    vk::DeviceSize offsets[16];
+    for (auto& offset : offsets) {
+        CHECK(ranges.allocate(64, 64, offset));
+    }
+    CHECK_EQ(getStats(ranges).fragmentation(), 0.0f);
+
+    // Every other range freed, the free memory is scattered in eight holes of 64 bytes
+    for (int i = 0; i < 16; i += 2) {
+        ranges.free(offsets[i], 64);
+    }
+    auto stats = getStats(ranges);
+    CHECK_EQ(stats.freeRangeCount, 8u);
+    CHECK_EQ(stats.bytesFree(), 512u);
+    CHECK_EQ(stats.bytesLargestFree, 64u);
+    CHECK_EQ(stats.fragmentation(), 0.875f);
+    vk::DeviceSize offset;
+    CHECK(!ranges.allocate(65, 1, offset));
+
+    for (int i = 1; i < 16; i += 2) {
+        ranges.free(offsets[i], 64);
+    }
+    stats = getStats(ranges);
+    CHECK_EQ(stats.freeRangeCount, 1u);
+    CHECK_EQ(stats.fragmentation(), 0.0f);
+}
+
+// Random allocations and frees, checked against a byte map of the block
+static void testRandom() {
+    const vk::DeviceSize size = 1 << 16;
+    RangeAllocator ranges(size);
+    std::vector<uint8_t> owner(size, 0);
+    struct Allocation { vk::DeviceSize offset, size; };
+    std::vector<Allocation> live;
+    std::mt19937 random(1234);
+    vk::DeviceSize used = 0;
+
+    for (int i = 0; i < 20000; ++i) {
+        if (live.empty() || random() % 3 != 0) {
+            Allocation allocation;
+            allocation.size = 1 + random() % 1024;
+            const vk::DeviceSize alignment = (vk::DeviceSize)1 << (random() % 9);
+            if (!ranges.allocate(allocation.size, alignment, allocation.offset)) {
+                CHECK(ranges.getLargestFreeRange() < allocation.size + alignment - 1);
+                continue;
+            }
+            CHECK_EQ(allocation.offset % alignment, 0u);
+            CHECK(allocation.offset + allocation.size <= size);
+            bool overlap = false;
+            for (vk::DeviceSize b = allocation.offset; b < allocation.offset + allocation.size; ++b) {
+                overlap |= owner[b] != 0;
+                owner[b] = 1;
+            }
+            CHECK(!overlap);
+            used += allocation.size;
+            live.push_back(allocation);
+        } else {
+            size_t index = random() % live.size();
+            Allocation allocation = live[index];
+            live[index] = live.back();
+            live.pop_back();
+            std::fill(owner.begin() + allocation.offset, owner.begin() + allocation.offset + allocation.size, 0);
+            ranges.free(allocation.offset, allocation.size);
+            used -= allocation.size;
+        }
+        CHECK_EQ(ranges.getUsed(), used);
+    }
+
+    for (const auto& allocation : live) {
+        ranges.free(allocation.offset, allocation.size);
+    }
+    CHECK(ranges.empty());
+    CHECK_EQ(ranges.getFreeRangeCount(), 1u);
+    CHECK_EQ(ranges.getLargestFreeRange(), size);
+}
+
+int main() {
+    testing::run("split", testSplit);
+    testing::run("best fit", testBestFit);
+    testing::run("coalesce", testCoalesce);
+    testing::run("alignment", testAlignment);
+    testing::run("fragmentation", testFragmentation);
+    testing::run("random", testRandom);
+    return testing::result();
+}
@@ -0,0 +1,155 @@
+/*
+* Cold and warm GLSL compiles through the SPIR-V cache
+*
+* Compiles every shader in data/shaders three times with the same batched compile the examples use:
+* cold (cache files removed, glslang runs for everything), warm from the cache directory and warm from
+* memory.  Needs no Vulkan device.  Shader files passed on the command line are used instead of data/shaders.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <stdio.h>
+#include <iostream>
+#include <iomanip>
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <dirent.h>
+#endif
+
+#include "vulkanShaders.h"
+#include "jobSystem.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx;
+
+static bool getStage(const std::string& filename, vk::ShaderStageFlagBits& stage) {
+    static const std::pair<const char*, vk::ShaderStageFlagBits> EXTENSIONS[] = {
+        { ".vert", vk::ShaderStageFlagBits::eVertex },
+        { ".frag", vk::ShaderStageFlagBits::eFragment },
+        { ".comp", vk::ShaderStageFlagBits::eCompute },
+        { ".geom", vk::ShaderStageFlagBits::eGeometry },
+        { ".tesc", vk::ShaderStageFlagBits::eTessellationControl },
+        { ".tese", vk::ShaderStageFlagBits::eTessellationEvaluation },
+    };
+    size_t dot = filename.rfind('.');
+    if (dot == std::string::npos) {
+        return false;
+    }
+    for (const auto& extension : EXTENSIONS) {
+        if (filename.compare(dot, std::string::npos, extension.first) == 0) {
+            stage = extension.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Files directly inside path, the shaders are one directory per example
+static std::vector<std::string> listDirectory(const std::string& path, bool directories) {
+    std::vector<std::string> result;
+#if defined(_WIN32)
+    _finddata_t data;
+    intptr_t handle = _findfirst((path + "*").c_str(), &data);
+    if (handle == -1) {
+        return result;
+    }
+    do {
+        if (data.name[0] != '.' && ((data.attrib & _A_SUBDIR) != 0) == directories) {
+            result.push_back(data.name);
+        }
+    } while (_findnext(handle, &data) == 0);
+    _findclose(handle);
+#else
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return result;
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.' && (entry->d_type == DT_DIR) == directories) {
+            result.push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+#endif
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+static std::vector<std::string> getShaders(int argc, char* argv[]) {
+    std::vector<std::string> result;
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-') {
+            result.push_back(argv[i]);
+        }
+    }
+    if (!result.empty()) {
+        return result;
+    }
+    const std::string root = getAssetPath() + "shaders/";
+    for (const auto& dir : listDirectory(root, true)) {
+        for (const auto& file : listDirectory(root + dir + "/", false)) {
+            result.push_back(root + dir + "/" + file);
+        }
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    if (getCachePath().empty()) {
+        std::cerr << "The shader cache isn't available on this platform" << std::endl;
+        return 1;
+    }
+
+    std::vector<shader::GlslSource> sources;
+    for (const auto& filename : getShaders(argc, argv)) {
+        shader::GlslSource source;
+        if (getStage(filename, source.stage)) {
+            source.source = readTextFile(filename);
+            sources.push_back(source);
+        }
+    }
+    if (sources.empty()) {
+        std::cerr << "No shaders found in " << getAssetPath() << "shaders/" << std::endl;
+        return 1;
+    }
+
+    static const char* PASSES[] = { "cold", "warm (disk)", "warm (memory)" };
+    JobSystem jobs;
+    shader::initGlsl();
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << sources.size() << " shaders" << std::endl;
+    for (int pass = 0; pass < 3; ++pass) {
+        if (pass == 0) {
+            for (const auto& source : sources) {
+                remove(shader::getSpvCachePath(source.stage, source.source).c_str());
+            }
+        }
+        if (pass < 2) {
+            shader::clearMemoryCache();
+        }
+        shader::CompileStats before = shader::getCompileStats();
+        auto start = std::chrono::high_resolution_clock::now();
+        try {
+            shader::glslToSpv(sources, &jobs);
+        } catch (const std::exception& e) {
+            std::cerr << "Compile failed: " << e.what() << std::endl;
+            shader::finalizeGlsl();
+            return 1;
+        }
+        double time = benchmark::elapsed(start);
+        shader::CompileStats after = shader::getCompileStats();
+        std::cout << std::setw(14) << std::left << PASSES[pass] << std::right << std::setw(10) << time << " ms"
+            << "  compiled " << after.compiled - before.compiled
+            << ", disk hits " << after.diskHits - before.diskHits
+            << ", memory hits " << after.memoryHits - before.memoryHits
+            << ", glslang " << after.compileMilliseconds - before.compileMilliseconds << " ms" << std::endl;
+        if (pass && after.compiled != before.compiled) {
+            std::cerr << "Expected every shader to come from the cache" << std::endl;
+            shader::finalizeGlsl();
+            return 1;
+        }
+    }
+    shader::finalizeGlsl();
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+* Mesh upload benchmark for the staging ring
+*
+* Uploads the vertex and index buffers of every model twice: once the way the context did before the
+* staging ring (a staging buffer, command buffer, submit and queue wait per buffer) and once through the
+* ring, one batch per mesh.  Reports wall time and submit count of both.  The Assimp import is done up
+* front and not part of the timings.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "vulkanContext.hpp"
+#include "vulkanMeshLoader.hpp"
+#include "benchmark.hpp"
+
+using namespace vkx;
+
+struct ImportedMesh {
+    std::string filename;
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Upload through a staging buffer of its own, one submit and queue wait per buffer
+static CreateBufferResult uploadUnbatched(const Context& context, const vk::BufferUsageFlags& usage, vk::DeviceSize size, const void* data) {
+    CreateBufferResult staging = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, size, data);
+    CreateBufferResult result = context.createBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eDeviceLocal, size);
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
+        copyCmd.copyBuffer(staging.buffer, result.buffer, vk::BufferCopy(0, 0, size));
+    });
+    staging.destroy();
+    return result;
+}
+
+int main(int argc, char* argv[]) {
+    const MeshLayout layout{ VERTEX_LAYOUT_POSITION, VERTEX_LAYOUT_NORMAL, VERTEX_LAYOUT_UV };
+    std::vector<ImportedMesh> meshes;
+    uint64_t totalBytes = 0;
+    for (const auto& filename : benchmark::getModels(argc, argv)) {
+        ImportedMesh mesh;
+        mesh.filename = filename;
+        MeshLoader loader;
+        MeshDequantization dequantization;
+        try {
+            loader.importBuffers(filename, MeshLoader::DEFAULT_FLAGS, layout, 1.0f, mesh.vertices, mesh.indices, dequantization);
+        } catch (const std::exception& e) {
+            std::cerr << "Skipping " << filename << ": " << e.what() << std::endl;
+            continue;
+        }
+        if (mesh.indices.empty()) {
+            continue;
+        }
+        totalBytes += mesh.vertices.size() * sizeof(float) + mesh.indices.size() * sizeof(uint32_t);
+        meshes.push_back(std::move(mesh));
+    }
+
+    Context context;
+    context.headless = true;
+    context.createContext(false);
+    std::vector<CreateBufferResult> buffers;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (const auto& mesh : meshes) {
+        buffers.push_back(uploadUnbatched(context, vk::BufferUsageFlagBits::eVertexBuffer, mesh.vertices.size() * sizeof(float), mesh.vertices.data()));
+        buffers.push_back(uploadUnbatched(context, vk::BufferUsageFlagBits::eIndexBuffer, mesh.indices.size() * sizeof(uint32_t), mesh.indices.data()));
+    }
+    const double unbatchedMs = benchmark::elapsed(start);
+    const uint64_t unbatchedSubmits = buffers.size();
+    for (auto& buffer : buffers) {
+        buffer.destroy();
+    }
+    buffers.clear();
+
+    const uint64_t submitsBefore = context.staging->getStats().submitCount;
+    start = std::chrono::high_resolution_clock::now();
+    UploadToken token = 0;
+    for (const auto& mesh : meshes) {
+        context.beginUploadBatch();
+        buffers.push_back(context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, mesh.vertices));
+        buffers.push_back(context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, mesh.indices));
+        token = context.endUploadBatch();
+    }
+    context.waitForUpload(token);
+    const double ringMs = benchmark::elapsed(start);
+    const uint64_t ringSubmits = context.staging->getStats().submitCount - submitsBefore;
+    for (auto& buffer : buffers) {
+        buffer.destroy();
+    }
+
+    std::cout << meshes.size() << " meshes, " << totalBytes / (1024.0 * 1024.0) << " MB" << std::endl;
+    std::cout << "Staging buffer per upload: " << unbatchedMs << " ms, " << unbatchedSubmits << " submits" << std::endl;
+    std::cout << "Staging ring:              " << ringMs << " ms, " << ringSubmits << " submits" << std::endl;
+    context.destroyContext();
+    return 0;
+}
@@ -0,0 +1,291 @@
+/*
+* Tests of the resource state tracker
+*
+* flush records into a mock command buffer that keeps the pipelineBarrier calls, so the merged
+* barriers can be checked without a device.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <random>
+
+#include "vulkanStateTracker.hpp"
+#include "testing.hpp"
+
+using namespace vkx;
+
+namespace {
+    using Usage = ResourceStateTracker::Usage;
+
+    struct MockCommandBuffer {
+        struct Call {
+            vk::PipelineStageFlags srcStages;
+            vk::PipelineStageFlags dstStages;
+            std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+            std::vector<vk::ImageMemoryBarrier> imageBarriers;
+        };
+        mutable std::vector<Call> calls;
+
+        void pipelineBarrier(vk::PipelineStageFlags srcStages, vk::PipelineStageFlags dstStages, vk::DependencyFlags, std::nullptr_t,
+            const std::vector<vk::BufferMemoryBarrier>& bufferBarriers, const std::vector<vk::ImageMemoryBarrier>& imageBarriers) const {
+            Call call;
+            call.srcStages = srcStages;
+            call.dstStages = dstStages;
+            call.bufferBarriers = bufferBarriers;
+            call.imageBarriers = imageBarriers;
+            calls.push_back(call);
+        }
+    };
+
+    const vk::Image image1((VkImage)(uintptr_t)0x10);
+    const vk::Image image2((VkImage)(uintptr_t)0x20);
+    const vk::Buffer buffer1((VkBuffer)(uintptr_t)0x30);
+
+    vk::PipelineStageFlags stages(vk::PipelineStageFlagBits stage) {
+        return vk::PipelineStageFlags(stage);
+    }
+
+    vk::ImageSubresourceRange colorRange(uint32_t baseLevel, uint32_t levelCount, uint32_t baseLayer = 0, uint32_t layerCount = 1) {
+        return vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, baseLevel, levelCount, baseLayer, layerCount);
+    }
+}
+
+// Uploading all faces and levels of a cube map takes one barrier each way
+static void testCube() {
+    ResourceStateTracker tracker;
+    MockCommandBuffer cmdBuffer;
+    const auto range = colorRange(0, 10, 0, 6);
+    tracker.requireImage(image1, range, Usage::transferDst());
+    tracker.flush(cmdBuffer);
+    CHECK_EQ(cmdBuffer.calls.size(), 1u);
+    CHECK_EQ(cmdBuffer.calls[0].imageBarriers.size(), 1u);
+    const auto& upload = cmdBuffer.calls[0].imageBarriers[0];
+    CHECK_EQ(upload.subresourceRange.levelCount, 10u);
+    CHECK_EQ(upload.subresourceRange.layerCount, 6u);
+    CHECK(upload.oldLayout == vk::ImageLayout::eUndefined);
+    CHECK(upload.newLayout == vk::ImageLayout::eTransferDstOptimal);
+    CHECK(!upload.srcAccessMask);
+    CHECK(cmdBuffer.calls[0].srcStages == stages(vk::PipelineStageFlagBits::eTopOfPipe));
+    CHECK(cmdBuffer.calls[0].dstStages == stages(vk::PipelineStageFlagBits::eTransfer));
+
+    tracker.requireImage(image1, range, Usage::sampled());
+    tracker.flush(cmdBuffer);
+    CHECK_EQ(cmdBuffer.calls.size(), 2u);
+    CHECK_EQ(cmdBuffer.calls[1].imageBarriers.size(), 1u);
+    CHECK(cmdBuffer.calls[1].srcStages == stages(vk::PipelineStageFlagBits::eTransfer));
+    CHECK(cmdBuffer.calls[1].imageBarriers[0].srcAccessMask == vk::AccessFlags(vk::AccessFlagBits::eTransferWrite));
+    CHECK(cmdBuffer.calls[1].imageBarriers[0].oldLayout == vk::ImageLayout::eTransferDstOptimal);
+    CHECK_EQ(tracker.getStats().imageBarriers, 2u);
+}
+
+// Generating mips blits each level from the previous one, then samples the whole chain
+static void testMipChain() {
+    ResourceStateTracker tracker;
+    MockCommandBuffer cmdBuffer;
+    const uint32_t levels = 8;
+    tracker.requireImage(image1, colorRange(0, levels), Usage::transferDst());
+    tracker.flush(cmdBuffer);
+    for (uint32_t level = 1; level < levels; ++level) {
+        tracker.requireImage(image1, colorRange(level - 1, 1), Usage::transferSrc());
+        tracker.flush(cmdBuffer);
+    }
+    CHECK_EQ(cmdBuffer.calls.size(), levels);
+    for (size_t i = 1; i < cmdBuffer.calls.size(); ++i) {
+        CHECK_EQ(cmdBuffer.calls[i].imageBarriers.size(), 1u);
+        CHECK_EQ(cmdBuffer.calls[i].imageBarriers[0].subresourceRange.baseMipLevel, (uint32_t)i - 1);
+        CHECK(cmdBuffer.calls[i].imageBarriers[0].srcAccessMask == vk::AccessFlags(vk::AccessFlagBits::eTransferWrite));
+    }
+
+    // Levels 0 to 6 come from eTransferSrcOptimal, level 7 from eTransferDstOptimal
+    tracker.requireImage(image1, colorRange(0, levels), Usage::sampled());
+    tracker.flush(cmdBuffer);
+    const auto& barriers = cmdBuffer.calls.back().imageBarriers;
+    CHECK_EQ(barriers.size(), 2u);
+    for (const auto& barrier : barriers) {
+        if (barrier.oldLayout == vk::ImageLayout::eTransferSrcOptimal) {
+            CHECK_EQ(barrier.subresourceRange.baseMipLevel, 0u);
+            CHECK_EQ(barrier.subresourceRange.levelCount, levels - 1);
+        } else {
+            CHECK(barrier.oldLayout == vk::ImageLayout::eTransferDstOptimal);
+            CHECK_EQ(barrier.subresourceRange.baseMipLevel, levels - 1);
+            CHECK_EQ(barrier.subresourceRange.levelCount, 1u);
+        }
+    }
+    CHECK(cmdBuffer.calls.back().srcStages == stages(vk::PipelineStageFlagBits::eTransfer));
+
+    // Uploading the levels one by one still merges into a single barrier
+    ResourceStateTracker perLevel;
+    MockCommandBuffer perLevelCmdBuffer;
+    for (uint32_t level = 0; level < 12; ++level) {
+        perLevel.requireImage(image2, colorRange(level, 1), Usage::transferDst());
+    }
+    perLevel.flush(perLevelCmdBuffer);
+    CHECK_EQ(perLevelCmdBuffer.calls.size(), 1u);
+    CHECK_EQ(perLevelCmdBuffer.calls[0].imageBarriers.size(), 1u);
+    CHECK_EQ(perLevelCmdBuffer.calls[0].imageBarriers[0].subresourceRange.levelCount, 12u);
+}
+
+// The aspects of a depth stencil image share a barrier, different images don't
+static void testAspectMerge() {
+    ResourceStateTracker tracker;
+    MockCommandBuffer cmdBuffer;
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil, Usage::depthAttachment());
+    tracker.requireImage(image2, vk::ImageAspectFlagBits::eColor, Usage::colorAttachment());
+    tracker.flush(cmdBuffer);
+    CHECK_EQ(cmdBuffer.calls.size(), 1u);
+    CHECK_EQ(cmdBuffer.calls[0].imageBarriers.size(), 2u);
+    for (const auto& barrier : cmdBuffer.calls[0].imageBarriers) {
+        if ((VkImage)barrier.image == (VkImage)image1) {
+            CHECK(barrier.subresourceRange.aspectMask == (vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil));
+        } else {
+            CHECK(barrier.subresourceRange.aspectMask == vk::ImageAspectFlags(vk::ImageAspectFlagBits::eColor));
+        }
+    }
+}
+
+// Reads of visible data need nothing, reads in a second stage of the same batch share the barrier
+static void testReadAfterRead() {
+    ResourceStateTracker tracker;
+    MockCommandBuffer cmdBuffer;
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::colorAttachment());
+    tracker.flush(cmdBuffer);
+
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::sampled(vk::PipelineStageFlagBits::eFragmentShader));
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::sampled(vk::PipelineStageFlagBits::eComputeShader));
+    tracker.flush(cmdBuffer);
+    CHECK_EQ(cmdBuffer.calls.size(), 2u);
+    CHECK_EQ(cmdBuffer.calls[1].imageBarriers.size(), 1u);
+    CHECK(cmdBuffer.calls[1].dstStages == (vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader));
+
+    const uint64_t elided = tracker.getStats().elided;
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::sampled(vk::PipelineStageFlagBits::eComputeShader));
+    tracker.flush(cmdBuffer);
+    CHECK_EQ(cmdBuffer.calls.size(), 2u);
+    CHECK_EQ(tracker.getStats().elided, elided + 1);
+
+    // A read in a new stage after a layout transition only needs an execution dependency
+    ResourceStateTracker upload;
+    MockCommandBuffer uploadCmdBuffer;
+    upload.requireImage(image2, colorRange(0, 1), Usage::transferDst());
+    upload.flush(uploadCmdBuffer);
+    upload.requireImage(image2, colorRange(0, 1), Usage::sampled(vk::PipelineStageFlagBits::eFragmentShader));
+    upload.flush(uploadCmdBuffer);
+    upload.requireImage(image2, colorRange(0, 1), Usage::sampled(vk::PipelineStageFlagBits::eComputeShader));
+    upload.flush(uploadCmdBuffer);
+    CHECK_EQ(uploadCmdBuffer.calls.size(), 3u);
+    CHECK(uploadCmdBuffer.calls[2].imageBarriers.empty());
+    CHECK(uploadCmdBuffer.calls[2].srcStages == stages(vk::PipelineStageFlagBits::eFragmentShader));
+}
+
+// Writes after reads wait for the readers without a memory dependency, writes after writes need one
+static void testWriteAfterReadAndWrite() {
+    ResourceStateTracker tracker;
+    MockCommandBuffer cmdBuffer;
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::colorAttachment());
+    tracker.flush(cmdBuffer);
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::sampled(vk::PipelineStageFlagBits::eFragmentShader));
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::sampled(vk::PipelineStageFlagBits::eComputeShader));
+    tracker.flush(cmdBuffer);
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::colorAttachment());
+    tracker.flush(cmdBuffer);
+    CHECK_EQ(cmdBuffer.calls.size(), 3u);
+    CHECK(cmdBuffer.calls[2].srcStages == (vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader));
+    CHECK(!cmdBuffer.calls[2].imageBarriers[0].srcAccessMask);
+
+    // Conflicting requirements in one batch can't be expressed by a single barrier
+    tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::sampled());
+    CHECK_THROWS(tracker.requireImage(image1, vk::ImageAspectFlagBits::eColor, Usage::transferSrc()));
+
+    // Buffers: nothing before the first write, adjacent ranges merge, WAR is an execution dependency only
+    ResourceStateTracker buffers;
+    MockCommandBuffer bufferCmdBuffer;
+    buffers.requireBuffer(buffer1, 0, 100, Usage::transferDst());
+    buffers.requireBuffer(buffer1, 100, 100, Usage::transferDst());
+    buffers.flush(bufferCmdBuffer);
+    CHECK(bufferCmdBuffer.calls.empty());
+    buffers.requireBuffer(buffer1, 0, 200, Usage::vertexBuffer());
+    buffers.flush(bufferCmdBuffer);
+    CHECK_EQ(bufferCmdBuffer.calls.size(), 1u);
+    CHECK_EQ(bufferCmdBuffer.calls[0].bufferBarriers.size(), 1u);
+    CHECK_EQ(bufferCmdBuffer.calls[0].bufferBarriers[0].offset, 0u);
+    CHECK_EQ(bufferCmdBuffer.calls[0].bufferBarriers[0].size, 200u);
+    buffers.requireBuffer(buffer1, 50, 100, Usage::transferDst());
+    buffers.flush(bufferCmdBuffer);
+    CHECK_EQ(bufferCmdBuffer.calls.size(), 2u);
+    CHECK(bufferCmdBuffer.calls[1].bufferBarriers.empty());
+    CHECK(bufferCmdBuffer.calls[1].srcStages == stages(vk::PipelineStageFlagBits::eVertexInput));
+
+    // A partial rewrite splits the range, the barriers still cover all of it
+    buffers.requireBuffer(buffer1, 0, 200, Usage::indexBuffer());
+    buffers.flush(bufferCmdBuffer);
+    CHECK_EQ(bufferCmdBuffer.calls.size(), 3u);
+    vk::DeviceSize covered = 0;
+    for (const auto& barrier : bufferCmdBuffer.calls[2].bufferBarriers) {
+        covered += barrier.size;
+    }
+    CHECK_EQ(covered, 200u);
+
+    // WAW without reads in between
+    buffers.requireBuffer(buffer1, 300, 16, Usage::storageBuffer());
+    buffers.flush(bufferCmdBuffer);
+    buffers.requireBuffer(buffer1, 300, 16, Usage::transferDst());
+    buffers.flush(bufferCmdBuffer);
+    CHECK_EQ(bufferCmdBuffer.calls.back().bufferBarriers.size(), 1u);
+    CHECK(bufferCmdBuffer.calls.back().bufferBarriers[0].srcAccessMask == vk::AccessFlags(vk::AccessFlagBits::eShaderWrite));
+}
+
+// Random ranges and usages, every barrier must transition from the previous layout to the required one
+static void testRandomLayouts() {
+    const uint32_t levels = 4, layers = 3;
+    ResourceStateTracker tracker;
+    MockCommandBuffer cmdBuffer;
+    vk::ImageLayout expected[levels][layers];
+    for (auto& level : expected) {
+        for (auto& layout : level) {
+            layout = vk::ImageLayout::eUndefined;
+        }
+    }
+    const Usage usages[] = { Usage::transferDst(), Usage::transferSrc(), Usage::sampled(), Usage::colorAttachment(), Usage::storage() };
+    std::mt19937 rng(1);
+    for (int i = 0; i < 20000; ++i) {
+        uint32_t baseLevel = rng() % levels, levelCount = 1 + rng() % (levels - baseLevel);
+        uint32_t baseLayer = rng() % layers, layerCount = 1 + rng() % (layers - baseLayer);
+        const Usage& usage = usages[rng() % 5];
+        tracker.requireImage(image1, colorRange(baseLevel, levelCount, baseLayer, layerCount), usage);
+        tracker.flush(cmdBuffer);
+        for (const auto& call : cmdBuffer.calls) {
+            for (const auto& barrier : call.imageBarriers) {
+                const auto& range = barrier.subresourceRange;
+                for (uint32_t level = range.baseMipLevel; level < range.baseMipLevel + range.levelCount; ++level) {
+                    for (uint32_t layer = range.baseArrayLayer; layer < range.baseArrayLayer + range.layerCount; ++layer) {
+                        CHECK(barrier.oldLayout == expected[level][layer] || barrier.oldLayout == barrier.newLayout);
+                        CHECK(barrier.newLayout == usage.layout);
+                    }
+                }
+            }
+        }
+        cmdBuffer.calls.clear();
+        for (uint32_t level = baseLevel; level < baseLevel + levelCount; ++level) {
+            for (uint32_t layer = baseLayer; layer < baseLayer + layerCount; ++layer) {
+                expected[level][layer] = usage.layout;
+            }
+        }
+        for (uint32_t level = 0; level < levels; ++level) {
+            for (uint32_t layer = 0; layer < layers; ++layer) {
+                if (!CHECK(tracker.getImageLayout(image1, vk::ImageAspectFlagBits::eColor, level, layer) == expected[level][layer])) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+int main() {
+    testing::run("cube", testCube);
+    testing::run("mip chain", testMipChain);
+    testing::run("aspect merge", testAspectMerge);
+    testing::run("read after read", testReadAfterRead);
+    testing::run("write after read and write", testWriteAfterReadAndWrite);
+    testing::run("random layouts", testRandomLayouts);
+    return testing::result();
+}
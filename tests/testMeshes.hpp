@@ -0,0 +1,113 @@
+/*
+* Procedural meshes for the CPU side mesh processing tests
+*
+* Vertices are interleaved as position, normal and uv (32 bytes), the layout the mesh loader
+* produces for most examples.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace vkx { namespace testing {
+
+    struct TestMesh {
+        static const uint32_t FLOATS_PER_VERTEX = 8;
+        static const uint32_t VERTEX_STRIDE = FLOATS_PER_VERTEX * sizeof(float);
+
+        std::vector<float> vertices;
+        std::vector<uint32_t> indices;
+
+        uint32_t vertexCount() const {
+            return (uint32_t)(vertices.size() / FLOATS_PER_VERTEX);
+        }
+
+        uint32_t triangleCount() const {
+            return (uint32_t)(indices.size() / 3);
+        }
+
+        const float* position(uint32_t vertex) const {
+            return vertices.data() + (size_t)vertex * FLOATS_PER_VERTEX;
+        }
+
+        void addVertex(float x, float y, float z, float nx, float ny, float nz, float u, float v) {
+            const float vertex[FLOATS_PER_VERTEX] = { x, y, z, nx, ny, nz, u, v };
+            vertices.insert(vertices.end(), vertex, vertex + FLOATS_PER_VERTEX);
+        }
+
+        // Every corner gets its own copy of the vertex, as Assimp produces without JoinIdenticalVertices
+        TestMesh toSoup() const {
+            TestMesh result;
+            for (auto index : indices) {
+                result.indices.push_back((uint32_t)result.indices.size());
+                result.vertices.insert(result.vertices.end(), position(index), position(index) + FLOATS_PER_VERTEX);
+            }
+            return result;
+        }
+
+        // Triangles in random order, the worst case for the vertex cache
+        void shuffleTriangles(uint32_t seed) {
+            std::vector<uint32_t> order(triangleCount());
+            for (uint32_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+            std::shuffle(order.begin(), order.end(), std::mt19937(seed));
+            std::vector<uint32_t> shuffled;
+            shuffled.reserve(indices.size());
+            for (auto triangle : order) {
+                shuffled.insert(shuffled.end(), indices.begin() + triangle * 3, indices.begin() + triangle * 3 + 3);
+            }
+            indices.swap(shuffled);
+        }
+    };
+
+    // Flat square of size x size quads in the xz plane spanning [0, size], open on all four sides
+    inline TestMesh makeGrid(uint32_t size) {
+        TestMesh mesh;
+        for (uint32_t z = 0; z <= size; ++z) {
+            for (uint32_t x = 0; x <= size; ++x) {
+                mesh.addVertex((float)x, 0.0f, (float)z, 0.0f, 1.0f, 0.0f, (float)x / size, (float)z / size);
+            }
+        }
+        for (uint32_t z = 0; z < size; ++z) {
+            for (uint32_t x = 0; x < size; ++x) {
+                uint32_t i = z * (size + 1) + x;
+                uint32_t quad[6] = { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 };
+                mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+            }
+        }
+        return mesh;
+    }
+
+    // Closed torus around the y axis, the seam vertices are duplicated for the uvs as a modeller would
+    inline TestMesh makeTorus(uint32_t rings, uint32_t sides, float radius = 1.0f, float tubeRadius = 0.25f) {
+        const float pi = 3.14159265358979f;
+        TestMesh mesh;
+        for (uint32_t r = 0; r <= rings; ++r) {
+            // The angles wrap around so both copies of a seam vertex get bitwise identical positions
+            float ringAngle = (float)(r % rings) / rings * 2.0f * pi;
+            for (uint32_t s = 0; s <= sides; ++s) {
+                float sideAngle = (float)(s % sides) / sides * 2.0f * pi;
+                float nx = cosf(sideAngle) * cosf(ringAngle);
+                float ny = sinf(sideAngle);
+                float nz = cosf(sideAngle) * sinf(ringAngle);
+                float distance = radius + tubeRadius * cosf(sideAngle);
+                mesh.addVertex(distance * cosf(ringAngle), tubeRadius * ny, distance * sinf(ringAngle), nx, ny, nz, (float)r / rings, (float)s / sides);
+            }
+        }
+        for (uint32_t r = 0; r < rings; ++r) {
+            for (uint32_t s = 0; s < sides; ++s) {
+                uint32_t i = r * (sides + 1) + s;
+                uint32_t quad[6] = { i, i + 1, i + sides + 1, i + 1, i + sides + 2, i + sides + 1 };
+                mesh.indices.insert(mesh.indices.end(), quad, quad + 6);
+            }
+        }
+        return mesh;
+    }
+} }
@@ -0,0 +1,56 @@
+/*
+* Minimal checks for the CPU side tests
+*
+* A failed check prints the expression and location and makes the test return a non zero exit code,
+* the remaining checks still run.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <stdio.h>
+#include <exception>
+
+namespace vkx { namespace testing {
+
+    inline int& failureCount() {
+        static int count = 0;
+        return count;
+    }
+
+    inline bool check(bool condition, const char* expression, const char* file, int line) {
+        if (!condition) {
+            fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+            ++failureCount();
+        }
+        return condition;
+    }
+
+    // Runs a test case, reporting any exception escaping it as a failure
+    template <typename Fn>
+    void run(const char* name, const Fn& test) {
+        const int failuresBefore = failureCount();
+        try {
+            test();
+        } catch (const std::exception& e) {
+            fprintf(stderr, "%s: unexpected exception: %s\n", name, e.what());
+            ++failureCount();
+        }
+        printf("%s %s\n", failureCount() == failuresBefore ? "passed" : "FAILED", name);
+    }
+
+    // Exit code of the test executable
+    inline int result() {
+        return failureCount() ? 1 : 0;
+    }
+} }
+
+#define CHECK(condition) vkx::testing::check(!!(condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQ(a, b) vkx::testing::check((a) == (b), #a " == " #b, __FILE__, __LINE__)
+#define CHECK_THROWS(expression) \
+    do { \
+        bool thrown = false; \
+        try { expression; } catch (const std::exception&) { thrown = true; } \
+        vkx::testing::check(thrown, #expression " throws", __FILE__, __LINE__); \
+    } while (0)
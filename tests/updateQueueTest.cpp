@@ -0,0 +1,236 @@
+/*
+* Tests of the batched buffer update queue
+*
+* The queue records into a mock command buffer that executes the copies against byte arrays, so the
+* merged and packed ranges are checked against the updates applied one by one.  The last case is the
+* pattern of triangleAnimated -updates 10000 and reports the CPU time per frame.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+
+#include "vulkanUpdateQueue.hpp"
+#include "testing.hpp"
+
+using namespace vkx;
+
+namespace {
+    using Memory = std::map<VkBuffer, std::vector<uint8_t>>;
+
+    struct MockCommandBuffer {
+        const std::vector<uint8_t>& staging;
+        Memory& memory;
+        mutable uint32_t copyCommands{ 0 };
+        mutable uint32_t copyRegions{ 0 };
+        mutable uint32_t barriers{ 0 };
+
+        MockCommandBuffer(const std::vector<uint8_t>& staging, Memory& memory) : staging(staging), memory(memory) {}
+
+        template <typename... Args>
+        void pipelineBarrier(const Args&...) const {
+            ++barriers;
+        }
+
+        void copyBuffer(const vk::Buffer& src, const vk::Buffer& dst, const std::vector<vk::BufferCopy>& regions) const {
+            CHECK(src == stagingBuffer());
+            auto& target = memory[(VkBuffer)dst];
+            for (size_t i = 0; i < regions.size(); ++i) {
+                const auto& region = regions[i];
+                CHECK(region.srcOffset + region.size <= staging.size());
+                CHECK(region.dstOffset + region.size <= target.size());
+                // The destination ranges of one copy must not overlap
+                for (size_t j = 0; j < i; ++j) {
+                    CHECK(region.dstOffset >= regions[j].dstOffset + regions[j].size || regions[j].dstOffset >= region.dstOffset + region.size);
+                }
+                memcpy(target.data() + region.dstOffset, staging.data() + region.srcOffset, (size_t)region.size);
+            }
+            ++copyCommands;
+            copyRegions += (uint32_t)regions.size();
+        }
+
+        static vk::Buffer stagingBuffer() {
+            return vk::Buffer((VkBuffer)(uintptr_t)0x1000);
+        }
+    };
+
+    vk::Buffer makeBuffer(uintptr_t id) {
+        return vk::Buffer((VkBuffer)id);
+    }
+
+    struct Fixture {
+        std::vector<uint8_t> staging;
+        Memory memory;
+        Memory expected;
+        UpdateQueue queue;
+        MockCommandBuffer cmdBuffer{ staging, memory };
+
+        Fixture(uint32_t frameCount, vk::DeviceSize frameSize) {
+            staging.resize((size_t)(frameSize * frameCount));
+            queue.create(MockCommandBuffer::stagingBuffer(), staging.data(), frameSize);
+        }
+
+        void addBuffer(const vk::Buffer& buffer, size_t size) {
+            memory[(VkBuffer)buffer].assign(size, 0);
+            expected[(VkBuffer)buffer].assign(size, 0);
+        }
+
+        void update(const vk::Buffer& buffer, vk::DeviceSize offset, vk::DeviceSize size, const void* data) {
+            queue.update(buffer, offset, size, data);
+            memcpy(expected[(VkBuffer)buffer].data() + offset, data, (size_t)size);
+        }
+
+        bool matches() const {
+            return memory == expected;
+        }
+    };
+}
+
+static void testMerge() {
+    Fixture test(2, 4096);
+    const vk::Buffer a = makeBuffer(0x10), b = makeBuffer(0x20);
+    test.addBuffer(a, 256);
+    test.addBuffer(b, 256);
+    const uint8_t ones[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+    const uint8_t twos[16] = { 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 };
+
+    test.queue.beginFrame(0);
+    // Adjacent, overlapping (the later update wins) and separate ranges, queued out of order
+    test.update(a, 32, 16, ones);
+    test.update(a, 16, 16, ones);
+    test.update(a, 24, 16, twos);
+    test.update(a, 128, 8, twos);
+    test.update(b, 0, 16, twos);
+    test.queue.record(test.cmdBuffer);
+
+    CHECK(test.matches());
+    CHECK_EQ(test.cmdBuffer.copyCommands, 2u);
+    CHECK_EQ(test.cmdBuffer.copyRegions, 3u);
+    CHECK_EQ(test.cmdBuffer.barriers, 2u);
+    CHECK(test.queue.empty());
+
+    // Nothing queued, nothing recorded
+    test.queue.beginFrame(1);
+    test.queue.record(test.cmdBuffer);
+    CHECK_EQ(test.cmdBuffer.barriers, 2u);
+
+    auto stats = test.queue.getStats();
+    CHECK_EQ(stats.updates, 5u);
+    CHECK_EQ(stats.copyRegions, 3u);
+    CHECK_EQ(stats.bytesCopied, 32u + 8u + 16u);
+}
+
+static void testExhausted() {
+    Fixture test(1, 64);
+    const vk::Buffer a = makeBuffer(0x10);
+    test.addBuffer(a, 256);
+    std::vector<uint8_t> data(128, 1);
+    test.queue.beginFrame(0);
+    test.queue.update(a, 0, data.size(), data.data());
+    CHECK_THROWS(test.queue.record(test.cmdBuffer));
+}
+
+static void testEmpty() {
+    Fixture test(1, 4096);
+    const vk::Buffer a = makeBuffer(0x10);
+    test.addBuffer(a, 256);
+    const uint8_t ones[16] = { 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 };
+
+    // Empty updates are dropped, so nothing is recorded for them
+    test.queue.beginFrame(0);
+    test.queue.update(a, 0, 0, ones);
+    test.queue.update(a, 256, 0, nullptr);
+    CHECK(test.queue.empty());
+    test.queue.record(test.cmdBuffer);
+    CHECK_EQ(test.cmdBuffer.barriers, 0u);
+    CHECK_EQ(test.cmdBuffer.copyCommands, 0u);
+
+    // Nor do they add regions between or next to real ones
+    test.update(a, 0, 16, ones);
+    test.queue.update(a, 16, 0, ones);
+    test.queue.update(a, 64, 0, ones);
+    test.update(a, 128, 16, ones);
+    test.queue.record(test.cmdBuffer);
+    CHECK(test.matches());
+    CHECK_EQ(test.cmdBuffer.copyCommands, 1u);
+    CHECK_EQ(test.cmdBuffer.copyRegions, 2u);
+    CHECK_EQ(test.queue.getStats().updates, 2u);
+}
+
+static void testRandom() {
+    Fixture test(2, 64 * 1024);
+    const vk::Buffer buffers[3] = { makeBuffer(0x10), makeBuffer(0x20), makeBuffer(0x30) };
+    for (const auto& buffer : buffers) {
+        test.addBuffer(buffer, 4096);
+    }
+    std::mt19937 rng(1);
+    std::vector<uint8_t> data;
+    for (uint32_t frame = 0; frame < 200; ++frame) {
+        test.queue.beginFrame(frame % 2);
+        uint32_t count = rng() % 300;
+        for (uint32_t i = 0; i < count; ++i) {
+            const vk::Buffer& buffer = buffers[rng() % 3];
+            uint32_t offset = rng() % 4000;
+            uint32_t size = std::min<uint32_t>(1 + rng() % 96, 4096 - offset);
+            data.resize(size);
+            for (auto& byte : data) {
+                byte = (uint8_t)rng();
+            }
+            test.update(buffer, offset, size, data.data());
+        }
+        test.queue.record(test.cmdBuffer);
+        if (!CHECK(test.matches())) {
+            return;
+        }
+    }
+}
+
+// triangleAnimated -updates 10000: 16 byte updates scattered over twice as many slots
+static void testScatter() {
+    const uint32_t updateCount = 10000;
+    const uint32_t slotCount = updateCount * 2;
+    const uint32_t frameCount = 300;
+    Fixture test(2, 1024 * 1024 + updateCount * 2 * 16);
+    const vk::Buffer target = makeBuffer(0x40);
+    test.addBuffer(target, slotCount * 16);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        test.queue.beginFrame(frame % 2);
+        for (uint32_t i = 0; i < updateCount; ++i) {
+            uint32_t slot = (uint32_t)(((uint64_t)i * 7919 + (uint64_t)frame * 104729) % slotCount);
+            float value[4] = { (float)i, (float)frame, (float)slot, 1.0f };
+            test.queue.update(target, slot * sizeof(value), sizeof(value), value);
+        }
+        test.queue.record(test.cmdBuffer);
+    }
+    double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    // Every slot holds the last value written to it
+    const float* slots = (const float*)test.memory[(VkBuffer)target].data();
+    for (uint32_t frame = 0; frame < frameCount; ++frame) {
+        for (uint32_t i = 0; i < updateCount; ++i) {
+            uint32_t slot = (uint32_t)(((uint64_t)i * 7919 + (uint64_t)frame * 104729) % slotCount);
+            if (slots[slot * 4 + 1] == (float)frame && !CHECK(slots[slot * 4] == (float)i && slots[slot * 4 + 2] == (float)slot)) {
+                return;
+            }
+        }
+    }
+    CHECK_EQ(test.cmdBuffer.copyCommands, frameCount);
+
+    auto stats = test.queue.getStats();
+    std::cout << "  " << stats.updates / frameCount << " updates per frame merged into " << stats.copyRegions / frameCount
+        << " regions, " << milliseconds / frameCount << " ms per frame to queue and record" << std::endl;
+}
+
+int main() {
+    testing::run("merge", testMerge);
+    testing::run("exhausted", testExhausted);
+    testing::run("empty", testEmpty);
+    testing::run("random", testRandom);
+    testing::run("scatter", testScatter);
+    return testing::result();
+}